@@ -0,0 +1,33 @@
+#pragma once
+#include <Adafruit_APDS9960.h>
+
+#include "freertos/FreeRTOS.h"
+
+namespace ambient_light {
+
+using IntensitySetter = void (*)(uint8_t level);
+
+/**
+ * @brief Enables the APDS-9960 ALS engine and starts the brightness task.
+ *
+ * The task sleeps until the sensor raises an ALS threshold interrupt (or a long
+ * idle timeout elapses), then samples the clear channel and passes the smoothed
+ * intensity to @p set_intensity whenever it changes.
+ *
+ * @return true if the task was started.
+ */
+bool start(Adafruit_APDS9960& sensor, IntensitySetter set_intensity);
+
+/**
+ * @brief Forwards the shared APDS-9960 interrupt to the brightness task.
+ *
+ * Safe to call from the GPIO ISR; does nothing if the task is not running.
+ */
+void notify_from_isr(BaseType_t* higher_priority_task_woken);
+
+/**
+ * @brief Task context counterpart of notify_from_isr(). Never blocks.
+ */
+void notify();
+
+} // namespace ambient_light
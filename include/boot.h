@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "boot_profile.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/**
+ * @file boot.h
+ * @brief Boot stages, their dependencies and timestamps.
+ *
+ * setup() only does what everything else needs (serial, timezone, mutexes,
+ * I2C bus) and then lets independent stages run in parallel: each stage is
+ * either spawned here with the stages it depends on, or marked by the task
+ * that naturally completes it. The first time each stage is reached is
+ * recorded, so boot-to-first-frame and boot-to-online can be compared
+ * between builds.
+ *
+ * Stage times count from the start of the application image (esp_timer).
+ * The time spent before it, in the ROM and the second stage bootloader, is
+ * measured with the RTC timer where that is possible: after a power-on,
+ * when the RTC timer starts with the chip, and after esp_restart(), which
+ * stamps the RTC time just before the reset.
+ *
+ * The stage order and the time to the first frame are checked when the
+ * stages are reached (see boot_profile.h); a violation is logged as an error.
+ */
+
+namespace boot {
+
+constexpr EventBits_t bit(const Stage stage) {
+    return static_cast<EventBits_t>(1) << static_cast<uint8_t>(stage);
+}
+
+using StageFn = void (*)();
+
+/**
+ * @brief Called whenever a stage is reached for the first time, from the marking task.
+ */
+using Listener = void (*)(Stage stage);
+
+/**
+ * @brief Records the start of the application and marks Setup. Call first in setup().
+ */
+void begin();
+
+/**
+ * @brief Records that @p stage was reached. Only the first call per stage counts.
+ */
+void mark(Stage stage);
+
+bool reached(Stage stage);
+
+/**
+ * @brief Blocks the calling task until all stages in @p stages are reached.
+ * @return true if they were reached before the timeout.
+ */
+bool wait(EventBits_t stages, TickType_t timeout);
+
+/**
+ * @brief Runs @p fn in its own task once all stages in @p deps are reached,
+ * then marks @p stage.
+ * @return false if the task could not be created.
+ */
+bool spawn(Stage stage, StageFn fn, EventBits_t deps, uint32_t stack_size, UBaseType_t priority);
+
+/**
+ * @brief Time of @p stage in microseconds since start-up, or -1 if not reached yet.
+ */
+int64_t at_us(Stage stage);
+
+const char* stage_name(Stage stage);
+
+/**
+ * @brief Time from the reset to the start of the application in microseconds,
+ * or -1 if it cannot be told for this reset reason.
+ */
+int64_t bootloader_us();
+
+void set_listener(Listener listener);
+
+/**
+ * @brief Writes the reset reason, the bootloader time and the reached stages as JSON,
+ * e.g. {"reset":3,"Bootloader":297,"AppStart":0,"Setup":312,...} in ms.
+ * @return The length written, or -1 if the buffer is too small.
+ */
+int format_profile(char* buf, size_t size);
+
+/**
+ * @brief Logs the timestamps of all stages reached so far.
+ */
+void log_profile();
+
+} // namespace boot
@@ -0,0 +1,168 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @file boot_profile.h
+ * @brief Boot stage timestamps, their JSON form and the checks run on them.
+ *
+ * Every stage may only be reached after the stages the boot graph in
+ * setup() starts it after, so a profile in another order means the graph
+ * was changed by mistake. The first frame must also come within a bound,
+ * however slow the network is.
+ *
+ * boot.cpp keeps the one Profile behind a spinlock and copies it out for the
+ * checks. test_boot_profile covers the order checks and the JSON.
+ */
+
+namespace boot {
+
+enum class Stage : uint8_t {
+    AppStart,   // application image started, static constructors running
+    Setup,      // setup() entered
+    Display,    // matrix initialized
+    FirstFrame, // first clock frame decided and drawn
+    Relays,     // relay states restored from NVS
+    Sensors,    // APDS-9960 configured, or found missing
+    LinkUp,     // first WiFi link with an IP address
+    TimeValid,  // system clock valid, from the RTC or SNTP
+    Services,   // SNTP, OTA, MQTT and mDNS started
+    Forecast,   // first forecast available
+    Online,     // LinkUp, TimeValid, Services and Forecast all reached
+    Count,
+};
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::Count);
+
+using StageMask = uint32_t;
+
+constexpr StageMask mask(const Stage stage) {
+    return StageMask{1} << static_cast<uint8_t>(stage);
+}
+
+constexpr const char* STAGE_NAMES[] = {"AppStart", "Setup",   "Display",   "FirstFrame",
+                                       "Relays",   "Sensors", "LinkUp",    "TimeValid",
+                                       "Services", "Forecast", "Online"};
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == STAGE_COUNT);
+
+/**
+ * @brief Stages that must be reached before each stage, as setup() orders them.
+ */
+constexpr StageMask STAGE_PREREQUISITES[] = {
+    0,                                   // AppStart
+    mask(Stage::AppStart),               // Setup
+    mask(Stage::Setup),                  // Display
+    mask(Stage::Display),                // FirstFrame: the minute task starts after it
+    mask(Stage::Display),                // Relays: spawned after the display is up
+    mask(Stage::Display),                // Sensors
+    mask(Stage::Display),                // LinkUp: WiFi starts after the spawns
+    mask(Stage::Display),                // TimeValid: from the RTC right after, or SNTP
+    mask(Stage::LinkUp),                 // Services
+    mask(Stage::Display),                // Forecast: restored or fetched
+    mask(Stage::LinkUp) | mask(Stage::TimeValid) | mask(Stage::Services) |
+        mask(Stage::Forecast),           // Online
+};
+static_assert(sizeof(STAGE_PREREQUISITES) / sizeof(STAGE_PREREQUISITES[0]) == STAGE_COUNT);
+
+class Profile {
+  public:
+    Profile() {
+        for (int64_t& at : at_us_)
+            at = -1;
+    }
+
+    /**
+     * @brief Records @p stage at @p at_us. Only the first call per stage counts.
+     * @return true if this was the first call.
+     */
+    bool record(const Stage stage, const int64_t at_us) {
+        const auto idx = static_cast<size_t>(stage);
+        if (idx >= STAGE_COUNT || at_us_[idx] >= 0)
+            return false;
+        at_us_[idx] = at_us;
+        return true;
+    }
+
+    /**
+     * @brief Time of @p stage in microseconds, or -1 if not reached.
+     */
+    int64_t at_us(const Stage stage) const {
+        const auto idx = static_cast<size_t>(stage);
+        return idx < STAGE_COUNT ? at_us_[idx] : -1;
+    }
+
+    bool reached(const Stage stage) const { return at_us(stage) >= 0; }
+
+    /**
+     * @brief Writes the profile as JSON, times in ms, e.g.
+     * {"reset":3,"Bootloader":297,"AppStart":0,"Setup":312,...}.
+     * @param bootloader_us Reset to application start, left out if negative.
+     * @return The length written, or -1 if the buffer is too small.
+     */
+    int format(char* buf, const size_t size, const int reset_reason,
+               const int64_t bootloader_us) const {
+        size_t len = 0;
+        const auto put = [&](const int n) {
+            if (n < 0 || len + static_cast<size_t>(n) >= size)
+                return false;
+            len += static_cast<size_t>(n);
+            return true;
+        };
+        if (size == 0 || !put(std::snprintf(buf, size, "{\"reset\":%d", reset_reason)))
+            return -1;
+        if (bootloader_us >= 0 &&
+            !put(std::snprintf(buf + len, size - len, ",\"Bootloader\":%lld",
+                               static_cast<long long>(bootloader_us / 1000))))
+            return -1;
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            if (at_us_[i] >= 0 &&
+                !put(std::snprintf(buf + len, size - len, ",\"%s\":%lld", STAGE_NAMES[i],
+                                   static_cast<long long>(at_us_[i] / 1000))))
+                return -1;
+        }
+        if (!put(std::snprintf(buf + len, size - len, "}")))
+            return -1;
+        return static_cast<int>(len);
+    }
+
+  private:
+    int64_t at_us_[STAGE_COUNT];
+};
+
+/**
+ * @brief Whether all prerequisites of a reached @p stage were reached no later than it.
+ */
+inline bool in_order(const Profile& profile, const Stage stage) {
+    const int64_t at = profile.at_us(stage);
+    for (size_t j = 0; j < STAGE_COUNT; ++j) {
+        const auto before = static_cast<Stage>(j);
+        if ((STAGE_PREREQUISITES[static_cast<size_t>(stage)] & mask(before)) &&
+            (!profile.reached(before) || profile.at_us(before) > at))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds a stage reached before one of its prerequisites.
+ * @return The first such stage, or Stage::Count if the order holds.
+ */
+inline Stage first_out_of_order(const Profile& profile) {
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const auto stage = static_cast<Stage>(i);
+        if (profile.reached(stage) && !in_order(profile, stage))
+            return stage;
+    }
+    return Stage::Count;
+}
+
+/**
+ * @brief Whether the first frame was drawn within @p bound_us of the application start.
+ */
+inline bool first_frame_within(const Profile& profile, const int64_t bound_us) {
+    return profile.reached(Stage::FirstFrame) &&
+           profile.at_us(Stage::FirstFrame) - profile.at_us(Stage::AppStart) <= bound_us;
+}
+
+} // namespace boot
@@ -0,0 +1,131 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @file brightness_curve.h
+ * @brief Mapping of ambient light readings to MAX7219 intensity levels.
+ *
+ * ambient_light.cpp owns the only Controller. test_brightness_curve covers
+ * the curve, the filter and the hysteresis.
+ */
+
+namespace brightness {
+
+// MAX7219 intensity register accepts 0..15.
+constexpr uint8_t MAX_INTENSITY = 15;
+
+struct CurveConfig {
+    uint16_t dark_count;     // clear channel count at or below which min_level is used
+    uint16_t bright_count;   // clear channel count at or above which max_level is used
+    uint8_t min_level;       // intensity used in the dark
+    uint8_t max_level;       // intensity used in bright light (<= MAX_INTENSITY)
+    float hysteresis;        // extra margin (in levels) required before changing the level
+    uint8_t smoothing_shift; // EMA weight of a new sample is 1 / 2^smoothing_shift
+};
+
+struct ThresholdWindow {
+    uint16_t low;
+    uint16_t high;
+};
+
+/**
+ * @brief Maps a clear channel count to a fractional intensity level.
+ *
+ * The curve is logarithmic between dark_count and bright_count, which follows
+ * the perceived brightness of the LEDs much better than a linear mapping.
+ */
+inline float level_for_count(const CurveConfig& cfg, const uint16_t count) {
+    if (count <= cfg.dark_count || cfg.bright_count <= cfg.dark_count)
+        return cfg.min_level;
+    if (count >= cfg.bright_count)
+        return cfg.max_level;
+    const float dark = cfg.dark_count > 0 ? cfg.dark_count : 1.f;
+    const float pos = std::log2(count / dark) / std::log2(cfg.bright_count / dark);
+    return cfg.min_level + pos * (cfg.max_level - cfg.min_level);
+}
+
+/**
+ * @brief Computes the ALS interrupt thresholds around a reading.
+ *
+ * The sensor raises an interrupt only when the clear channel leaves the
+ * window, so small fluctuations never wake the MCU.
+ */
+inline ThresholdWindow interrupt_window(const uint16_t count, const uint8_t percent) {
+    const uint32_t margin = (static_cast<uint32_t>(count) * percent) / 100u + 1u;
+    const uint32_t low = count > margin ? count - margin : 0u;
+    const uint32_t high = count + margin > 0xFFFFu ? 0xFFFFu : count + margin;
+    return {static_cast<uint16_t>(low), static_cast<uint16_t>(high)};
+}
+
+/**
+ * @brief Smoothed, hysteretic brightness controller.
+ *
+ * Samples are filtered with an exponential moving average (fixed point), then
+ * mapped with level_for_count(). The output level changes only when the mapped
+ * value moves further than half a level plus the configured hysteresis, so the
+ * display is not rewritten on every small change of the ambient light.
+ */
+class Controller {
+  public:
+    explicit Controller(const CurveConfig& cfg) : cfg_(cfg), level_(cfg.min_level) {}
+
+    /**
+     * @brief Feeds a raw clear channel sample.
+     * @return true if the output level changed.
+     */
+    bool update(const uint16_t clear_count) {
+        const int32_t sample = static_cast<int32_t>(clear_count) << FRACTION_BITS;
+        if (!primed_) {
+            ema_ = sample;
+            primed_ = true;
+        } else {
+            ema_ += (sample - ema_) >> cfg_.smoothing_shift;
+        }
+
+        const float target = level_for_count(cfg_, smoothed());
+        if (std::fabs(target - level_) < 0.5f + cfg_.hysteresis)
+            return false;
+
+        long next = std::lround(target);
+        if (next < cfg_.min_level)
+            next = cfg_.min_level;
+        if (next > cfg_.max_level)
+            next = cfg_.max_level;
+        if (next == level_)
+            return false;
+        level_ = static_cast<uint8_t>(next);
+        return true;
+    }
+
+    /**
+     * @brief Tells whether the filter has caught up with the given raw sample.
+     *
+     * Used to decide whether more samples are needed after a large step in
+     * ambient light, before going back to interrupt-driven operation.
+     */
+    bool settled(const uint16_t clear_count, const uint8_t window_percent) const {
+        const ThresholdWindow w = interrupt_window(clear_count, window_percent);
+        const uint16_t s = smoothed();
+        return s >= w.low && s <= w.high;
+    }
+
+    uint8_t level() const { return level_; }
+    /**
+     * @brief The filtered clear channel count, rounded: the filter stops a fraction of a
+     * count short of a rising input, which truncating would show as one count too low.
+     */
+    uint16_t smoothed() const {
+        return static_cast<uint16_t>((ema_ + (1 << (FRACTION_BITS - 1))) >> FRACTION_BITS);
+    }
+
+  private:
+    static constexpr int FRACTION_BITS = 8;
+
+    CurveConfig cfg_;
+    int32_t ema_ = 0;
+    bool primed_ = false;
+    uint8_t level_;
+};
+
+} // namespace brightness
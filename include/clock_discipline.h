@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "drift_estimator.h"
+
+/**
+ * @file clock_discipline.h
+ * @brief How the system clock follows the NTP offsets: step or slew, the
+ * drift correction between syncs and the next sync interval.
+ *
+ * time_sync.cpp owns the only instance and takes its mutex around every
+ * call, since the SNTP callback and the correction timer run in different
+ * tasks. test_time_sync drives apply() against a local NTP stand-in.
+ */
+
+struct ClockDisciplineConfig {
+    int64_t step_threshold_us; // larger offsets are stepped, smaller ones slewed
+    int64_t accuracy_bound_us; // the interval widens while offsets stay below
+    uint32_t min_interval_ms;
+    uint32_t max_interval_ms;
+};
+
+/**
+ * @brief What ClockDiscipline::apply() did with a server time.
+ */
+struct ClockSync {
+    int64_t offset_us; // server time minus local time
+    bool stepped;      // set with settimeofday() instead of slewed
+};
+
+/**
+ * @tparam N Samples kept by the drift estimator.
+ */
+template <size_t N> class ClockDiscipline {
+  public:
+    explicit ClockDiscipline(const ClockDisciplineConfig& config)
+        : config_(config), interval_ms_(config.min_interval_ms) {}
+
+    /**
+     * @brief Starts correcting a drift known from before, e.g. stored in NVS.
+     */
+    void restore(const int32_t drift_ppb, const int64_t now_us) {
+        drift_ppb_ = drift_ppb;
+        last_correction_us_ = now_us;
+        residue_ns_ = 0;
+    }
+
+    /**
+     * @brief Whether an offset must be stepped rather than slewed.
+     */
+    bool should_step(const int64_t offset_us, const bool first_sync) const {
+        return first_sync || std::llabs(offset_us) > config_.step_threshold_us;
+    }
+
+    /**
+     * @brief Accounts for a correction that was still outstanding and got
+     * replaced by a new one, so it was never applied.
+     */
+    void drop_pending(const int64_t dropped_us) { total_correction_us_ -= dropped_us; }
+
+    /**
+     * @brief Feeds a server response that was just applied, by a step or a slew.
+     *
+     * The interval is doubled while the residual offset stays well within the
+     * accuracy bound and halved when it exceeds it.
+     * @param offset_us Server time minus local time.
+     * @param first_sync The clock had never been set, so the offset says
+     * nothing about the drift.
+     */
+    void on_sync(const int64_t now_us, const int64_t offset_us, const bool stepped,
+                 const bool first_sync) {
+        if (first_sync)
+            estimator_.reset();
+        const int64_t applied_us = first_sync ? 0 : offset_us;
+        estimator_.add(now_us, -applied_us - total_correction_us_);
+        total_correction_us_ += applied_us;
+
+        const bool fitted = estimator_.valid();
+        if (!stepped && fitted) {
+            const int64_t residual_us = std::llabs(offset_us);
+            if (residual_us > config_.accuracy_bound_us)
+                interval_ms_ = std::max(interval_ms_ / 2, config_.min_interval_ms);
+            else if (residual_us < config_.accuracy_bound_us / 2)
+                interval_ms_ = std::min(interval_ms_ * 2, config_.max_interval_ms);
+        }
+        if (fitted)
+            drift_ppb_ = estimator_.ppb();
+        last_correction_us_ = now_us;
+        residue_ns_ = 0;
+    }
+
+    /**
+     * @brief Applies a server time to the clock and feeds the result to the model.
+     *
+     * Steps the clock on the first sync, when the offset is too large or when
+     * it cannot be slewed, and slews it otherwise.
+     * @param clock The system clock, providing now_us(), monotonic_us(),
+     * pending_us() (the correction adjtime() still has to apply), slew(delta_us)
+     * returning false if adjtime() refused and step(server_us).
+     * @param first_sync The clock had never been set.
+     */
+    template <typename Clock>
+    ClockSync apply(Clock& clock, const int64_t server_us, const bool first_sync) {
+        const int64_t offset_us = server_us - clock.now_us();
+        // Whatever is still outstanding from earlier corrections is superseded by this one.
+        drop_pending(clock.pending_us());
+        const bool stepped = should_step(offset_us, first_sync) || !clock.slew(offset_us);
+        if (stepped)
+            clock.step(server_us);
+        on_sync(clock.monotonic_us(), offset_us, stepped, first_sync);
+        return {offset_us, stepped};
+    }
+
+    /**
+     * @brief Correction for the drift since the previous call, to be slewed now.
+     *
+     * A clock running fast (positive ppb) is slowed down.
+     */
+    int64_t drift_correction(const int64_t now_us) {
+        // ppb times microseconds is 10^-15 s, so / 10^6 gives nanoseconds.
+        const int64_t elapsed_us = now_us - last_correction_us_;
+        residue_ns_ -= static_cast<int64_t>(drift_ppb_) * elapsed_us / 1000000;
+        last_correction_us_ = now_us;
+        const int64_t correction_us = residue_ns_ / 1000;
+        residue_ns_ -= correction_us * 1000;
+        total_correction_us_ += correction_us;
+        return correction_us;
+    }
+
+    /**
+     * @brief Drift correction applied between syncs, in parts per billion.
+     */
+    int32_t drift_ppb() const { return drift_ppb_; }
+
+    uint32_t interval_ms() const { return interval_ms_; }
+
+    size_t samples() const { return estimator_.count(); }
+
+  private:
+    ClockDisciplineConfig config_;
+    DriftEstimator<N> estimator_;
+    int64_t total_correction_us_ = 0; // every step, slew and drift correction since boot
+    int32_t drift_ppb_ = 0;
+    int64_t residue_ns_ = 0;
+    int64_t last_correction_us_ = 0;
+    uint32_t interval_ms_;
+};
@@ -10,6 +10,32 @@ constexpr int CONFIG_BLINK_GPIO = 2;
 // NTP and timezone configuration
 constexpr char NTP_SERVER[] = "pool.ntp.org";
 constexpr int NTP_UPDATE_INTERVAL_MS = 60 * 60 * 1000; // 1 hour
+constexpr int NTP_STEP_THRESHOLD_MS = 2000; // larger offsets are stepped, smaller ones slewed
+constexpr uint32_t NTP_MAX_UPDATE_INTERVAL_MS = 24 * 60 * 60 * 1000; // once the drift is known
+constexpr uint32_t TIME_ACCURACY_BOUND_MS = 100; // widen the NTP interval while offsets stay below
+constexpr uint32_t DRIFT_CORRECTION_PERIOD_S = 60;
+constexpr size_t DRIFT_ESTIMATOR_SAMPLES = 8;
+
+// WiFi reconnect backoff: doubles after every failed attempt, with up to 25% random jitter
+constexpr uint32_t WIFI_RETRY_MIN_MS = 500;
+constexpr uint32_t WIFI_RETRY_MAX_MS = 60 * 1000;
+
+// Power management: DFS between the two frequencies, automatic light sleep when idle
+#define ENABLE_LIGHT_SLEEP // comment out to only scale the CPU frequency
+constexpr int CPU_FREQ_MAX_MHZ = 160;
+constexpr int CPU_FREQ_MIN_MHZ = 40;
+constexpr uint8_t WIFI_LISTEN_INTERVAL = 3; // beacon intervals slept through in modem sleep
+constexpr int64_t SECOND_TICK_JITTER_BOUND_US = 5000; // warn when the second tick is later
+constexpr int64_t BOOT_FIRST_FRAME_BOUND_US = 2000 * 1000; // app start to first frame, at most
+
+// Night mode (local time): dark display, no seconds indicator, slower background work
+#define ENABLE_NIGHT_MODE // comment out to run the display around the clock
+constexpr uint16_t NIGHT_START_MINUTE = 23 * 60;    // minutes since local midnight
+constexpr uint16_t NIGHT_END_MINUTE = 6 * 60 + 30;
+constexpr bool NIGHT_DISPLAY_OFF = true; // shut the MAX7219s down; false: DISPLAY_BRIGHTNESS
+constexpr uint32_t NIGHT_PEEK_MS = 10 * 1000; // display lit after a proximity event
+constexpr uint32_t NIGHT_FORECAST_INTERVAL_S = 4 * 60 * 60;
+constexpr uint32_t NIGHT_TELEMETRY_INTERVAL_S = 15 * 60;
 
 // TZ string in POSIX form
 constexpr char TIMEZONE[] = "CET-1CEST,M3.5.0/2,M10.5.0/3";
@@ -19,10 +45,21 @@ constexpr uint8_t STATUS_UPDATE_INTERVAL_SECONDS{5};
 constexpr uint8_t FORECAST_MINIMAL_DISPLAY_TIME_SECONDS{3};
 constexpr uint8_t FORECAST_PAGE_SWITCH_PROXIMITY{12}; // proximity threshold to switch forecast pages
 constexpr uint8_t PRECIPITATION_PAGE_SWITCH_PROXIMITY{100}; // proximity threshold for precipitation chart
+// Location of the clock, for the forecast and sunrise/sunset; set it here only
+#define CLOCK_LATITUDE 53.428543
+#define CLOCK_LONGITUDE 14.552812
+#define CONFIG_STRINGIFY_(x) #x
+#define CONFIG_STRINGIFY(x) CONFIG_STRINGIFY_(x)
+constexpr double LOCATION_LATITUDE = CLOCK_LATITUDE;
+constexpr double LOCATION_LONGITUDE = CLOCK_LONGITUDE;
 constexpr char FORECAST_API_URL[] =
     "https://api.open-meteo.com/v1/forecast?"
-    "latitude=53.428543&longitude=14.552812&hourly=temperature_2m,precipitation_probability&forecast_days=2";
+    "latitude=" CONFIG_STRINGIFY(CLOCK_LATITUDE) "&longitude=" CONFIG_STRINGIFY(CLOCK_LONGITUDE)
+    "&hourly=temperature_2m,precipitation_probability&forecast_days=2";
 constexpr uint8_t FORECAST_HOURS = 16;
+// A forecast pushed to MQTT_TOPIC_BASE/forecast (see forecast_packet.h) replaces the HTTP fetch
+#define ENABLE_FORECAST_PUSH // comment out to ignore pushed forecasts
+constexpr uint32_t FORECAST_PUSH_MAX_AGE_S = 2 * 60 * 60; // fetch over HTTP when the push is older
 
 // Display hardware/type (enum-like). Replace with the actual enum type.    
 constexpr MD_MAX72XX::moduleType_t DISPLAY_HARDWARE_TYPE = MD_MAX72XX::FC16_HW;
@@ -31,7 +68,8 @@ constexpr MD_MAX72XX::moduleType_t DISPLAY_HARDWARE_TYPE = MD_MAX72XX::FC16_HW;
 constexpr uint8_t DISPLAY_CLK_PIN = 13;
 constexpr uint8_t DISPLAY_DATA_PIN = 14;
 constexpr uint8_t DISPLAY_CS_PIN = 12;
-constexpr uint8_t DISPLAY_BRIGHTNESS = 0u;
+constexpr uint8_t DISPLAY_BRIGHTNESS = 0u;     // startup intensity and the darkest adaptive level
+constexpr uint8_t DISPLAY_BRIGHTNESS_MAX = 15u; // brightest adaptive level (MAX7219 maximum is 15)
 // changing values below is risky without changing the code
 constexpr u_int8_t DISPLAY_MAX_DEVICES = 4;
 constexpr size_t MATRIX_WIDTH = DISPLAY_MAX_DEVICES * 8;
@@ -44,6 +82,17 @@ constexpr gpio_num_t I2C_SCL = GPIO_NUM_22;
 constexpr uint32_t I2C_FREQ_HZ = 100000; // 100 kHz
 constexpr gpio_num_t APDS_INT_PIN = GPIO_NUM_4;
 
+// Adaptive brightness from the APDS-9960 ambient light sensor (clear channel counts)
+#define ENABLE_AMBIENT_BRIGHTNESS // comment out to keep the fixed DISPLAY_BRIGHTNESS
+constexpr uint16_t ALS_INTEGRATION_MS = 50;
+constexpr uint16_t ALS_DARK_COUNT = 4;     // at or below: DISPLAY_BRIGHTNESS
+constexpr uint16_t ALS_BRIGHT_COUNT = 4000; // at or above: DISPLAY_BRIGHTNESS_MAX
+constexpr float ALS_HYSTERESIS_LEVELS = 0.3f;
+constexpr uint8_t ALS_SMOOTHING_SHIFT = 2; // EMA weight of a new sample: 1/4
+constexpr uint8_t ALS_THRESHOLD_WINDOW_PERCENT = 20; // interrupt when light changes by more
+constexpr uint32_t ALS_SETTLE_INTERVAL_MS = 500;
+constexpr uint32_t ALS_IDLE_RESAMPLE_MS = 10 * 60 * 1000;
+
 // --- Relay / MQTT config ---
 constexpr char MQTT_BROKER_IP[] = "BROKER_IP_PLACEHOLDER"; // replace with e.g. "192.168.1.10"
 constexpr uint16_t MQTT_BROKER_PORT = 1883;
@@ -55,6 +104,54 @@ constexpr char MQTT_PASSWORD[] = "pass"; // set to your MQTT password
 constexpr char DEVICE_NAME[] = "sew-matrix-clock";
 constexpr char MQTT_TOPIC_BASE[] = "clock"; // final topics will be "home/light1/command", etc.
 
+// Outbound publishing: messages per batch, pause between batches and outbox high-water mark
+constexpr size_t MQTT_PUBLISH_BATCH_SIZE = 4;
+constexpr uint32_t MQTT_PUBLISH_BATCH_PAUSE_MS = 20;
+constexpr uint32_t MQTT_PUBLISH_RETRY_MS = 1000;
+constexpr int MQTT_OUTBOX_LIMIT_BYTES = 4096;
+
+// Notifications pushed to MQTT_TOPIC_BASE/notify, payload "[priority|ttl_s|]text"
+#define ENABLE_NOTIFICATIONS // comment out to ignore pushed notifications
+constexpr size_t NOTIFY_QUEUE_CAPACITY = 8;
+constexpr uint8_t NOTIFY_DEFAULT_PRIORITY = 5;
+constexpr uint32_t NOTIFY_DEFAULT_TTL_S = 5 * 60;
+constexpr uint32_t NOTIFY_MAX_TTL_S = 24 * 60 * 60;
+constexpr uint32_t NOTIFY_SHOW_MS = 5000;     // how long a message that fits is shown
+constexpr uint16_t NOTIFY_SCROLL_SPEED_MS = 40; // per column, for messages wider than the matrix
+constexpr uint32_t NOTIFY_RESUME_DELAY_MS = 3000; // clock shown before a message resumes
+
+// Telemetry on MQTT_TOPIC_BASE/telemetry: changed values only, plus periodic full reports
+#define ENABLE_TELEMETRY // comment out to disable the telemetry publisher
+constexpr uint32_t TELEMETRY_INTERVAL_S = 60;
+constexpr uint32_t TELEMETRY_KEYFRAME_EVERY = 15; // full report every N intervals
+constexpr uint32_t TELEMETRY_HEAP_DELTA_BYTES = 1024; // smaller heap changes are not reported
+constexpr uint8_t TELEMETRY_CPU_DELTA_PERCENT = 2;
+
+// Per-task CPU, switch, wake latency and stack statistics on GET /tasks (see task_profiler.h)
+#define ENABLE_TASK_PROFILER // comment out to disable the sampler and its tick hook
+constexpr uint32_t TASK_PROFILER_PERIOD_MS = 1000;
+constexpr uint32_t TASK_PROFILER_STREAM_MAX = 60; // samples per /tasks?stream=N request
+
+// Event tracer: spans in a ring per core, dumped as Chrome trace JSON on GET /trace (see trace.h)
+#define ENABLE_TRACE // comment out to compile the trace points away
+constexpr uint32_t TRACE_EVENTS_PER_CORE = 256; // a power of two, 24 bytes each
+
+// OTA: ranged HTTP requests, written in chunks with a pause in between, resumable after failures
+constexpr int OTA_HTTP_BUFFER_SIZE = 2048;       // bytes per chunk
+constexpr int OTA_HTTP_REQUEST_SIZE = 32 * 1024; // bytes per Range request
+constexpr uint32_t OTA_CHUNK_PAUSE_MS = 2;
+constexpr size_t OTA_SAVE_EVERY_BYTES = 64 * 1024; // download offset saved to NVS this often
+constexpr uint8_t OTA_MAX_ATTEMPTS = 5;
+constexpr uint32_t OTA_RETRY_DELAY_MS = 5000; // multiplied by the attempt number
+constexpr uint8_t OTA_MAX_RESUME_BOOTS = 3; // restarts continuing a download without progress
+constexpr size_t OTA_MIN_FREE_HEAP = 40 * 1024;
+// Packages made by tools/ota_pack.py are inflated on the fly. Unsigned packages and plain images
+// are accepted unless signatures are required; that needs the real key below, or the build fails
+// #define ENABLE_OTA_SIGNATURE // also refuses plain images
+constexpr char OTA_SIGNING_PUBLIC_KEY_PEM[] = "-----BEGIN PUBLIC KEY-----\n"
+                                              "REPLACE_WITH_THE_OUTPUT_OF_ota_pack.py_--pubkey\n"
+                                              "-----END PUBLIC KEY-----\n";
+
 #define ENABLE_MDNS // comment out to disable broadcasting the name via mDNS
 #define ENABLE_MQTT // comment out to disable MQTT activation
 
@@ -69,7 +166,12 @@ constexpr bool RELAY_ACTIVE_HIGH = false;
 
 // NVS namespace & keys
 constexpr char NVS_NAMESPACE[] = "relays";
-constexpr char NVS_KEY_FMT[] = "r%u"; // use r1, r2... (sprintf style)
+constexpr char NVS_KEY_FMT[] = "r%u"; // legacy per-relay keys, migrated into NVS_KEY_STATE
+constexpr char NVS_KEY_STATE[] = "state"; // all relay states in one blob
+constexpr uint32_t RELAY_SAVE_DEBOUNCE_MS = 2000; // changes within the window share one commit
+
+// On-device relay schedule, edited via MQTT_TOPIC_BASE/schedule/set (see relay_schedule.h)
+#define ENABLE_RELAY_SCHEDULE // comment out to disable the local relay scheduler
 
 static_assert(FORECAST_HOURS <= MATRIX_WIDTH,
               "FORECAST_HOURS must be less than or equal to MATRIX_WIDTH");
\ No newline at end of file
@@ -4,6 +4,8 @@
 enum class DisplayPage : uint8_t {
     Time = 0,
     Forecast = 1,
+    Notification = 2,
+    Update = 3, // OTA progress
 };
 
 enum class ForecastPage : uint8_t {
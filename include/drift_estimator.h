@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file drift_estimator.h
+ * @brief Least-squares estimate of the local oscillator drift.
+ *
+ * Used through ClockDiscipline only, so test_time_sync exercises it with
+ * simulated days of drift.
+ */
+
+/**
+ * @brief Keeps the last N (time, error) samples of the free-running clock and
+ * fits a line through them.
+ *
+ * The error must be measured against the uncorrected clock, i.e. with all
+ * corrections applied so far added back, otherwise the fit would see the
+ * corrections instead of the oscillator.
+ *
+ * @tparam N Number of samples kept; older samples are dropped.
+ */
+template <size_t N> class DriftEstimator {
+    static_assert(N >= 2, "at least two samples are needed to fit a slope");
+
+  public:
+    static constexpr size_t MIN_SAMPLES = 3;
+
+    /**
+     * @brief Adds a sample.
+     * @param time_us Monotonic time of the measurement.
+     * @param free_error_us Local free-running clock minus reference time.
+     */
+    void add(const int64_t time_us, const int64_t free_error_us) {
+        samples_[head_] = {time_us, free_error_us};
+        head_ = (head_ + 1) % N;
+        if (count_ < N)
+            ++count_;
+    }
+
+    void reset() {
+        head_ = 0;
+        count_ = 0;
+    }
+
+    size_t count() const { return count_; }
+
+    bool valid() const { return count_ >= MIN_SAMPLES && span_us() > 0; }
+
+    /**
+     * @brief Returns the fitted drift in parts per billion (positive = clock runs fast).
+     */
+    int32_t ppb() const {
+        if (!valid())
+            return 0;
+        // Work relative to the oldest sample to keep doubles well conditioned.
+        const Sample& ref = oldest();
+        double mean_t = 0, mean_e = 0;
+        for (size_t i = 0; i < count_; ++i) {
+            mean_t += static_cast<double>(samples_[i].time_us - ref.time_us);
+            mean_e += static_cast<double>(samples_[i].error_us - ref.error_us);
+        }
+        mean_t /= count_;
+        mean_e /= count_;
+
+        double cov = 0, var = 0;
+        for (size_t i = 0; i < count_; ++i) {
+            const double dt = static_cast<double>(samples_[i].time_us - ref.time_us) - mean_t;
+            const double de = static_cast<double>(samples_[i].error_us - ref.error_us) - mean_e;
+            cov += dt * de;
+            var += dt * dt;
+        }
+        if (var <= 0)
+            return 0;
+        return static_cast<int32_t>(cov / var * 1e9);
+    }
+
+  private:
+    struct Sample {
+        int64_t time_us;
+        int64_t error_us;
+    };
+
+    const Sample& oldest() const { return samples_[count_ < N ? 0 : head_]; }
+
+    int64_t span_us() const {
+        const Sample& newest = samples_[(head_ + N - 1) % N];
+        return newest.time_us - oldest().time_us;
+    }
+
+    Sample samples_[N]{};
+    size_t head_ = 0;
+    size_t count_ = 0;
+};
@@ -1,7 +1,9 @@
 #pragma once
 #include "config.h"
+#include "forecast_packet.h"
 #include "result.h"
 #include <WString.h>
+#include <ctime>
 
 template <uint8_t STORED_HOURS>
 struct ForecastData {
@@ -29,6 +31,17 @@ std::array<uint8_t, STORED_HOURS> forecast_to_columns_precip(const ForecastData<
 template <uint8_t STORED_HOURS>
 typename ForecastData<STORED_HOURS>::result_t get_forecast(int start_hour);
 
+/**
+ * @brief Fills @p out from a decoded forecast packet.
+ *
+ * The stored window starts at the UTC hour containing @p now; leading hours
+ * of the packet that are already over are dropped.
+ * @return false if the packet does not cover STORED_HOURS from now.
+ */
+template <uint8_t STORED_HOURS>
+bool forecast_from_packet(const ForecastPacket& packet, time_t now,
+                          ForecastData<STORED_HOURS>& out);
+
 void format_temp_range(char *buf, size_t bufsize, float min, float max);
 
 unsigned char reverse_bits_compact(unsigned char b);
@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file forecast_packet.h
+ * @brief Compact binary forecast pushed over MQTT.
+ *
+ * Layout (all integers little endian):
+ *
+ *   offset size  field
+ *   0      2     magic "FC"
+ *   2      1     version (FORECAST_PACKET_VERSION)
+ *   3      1     hours (n), 1..FORECAST_PACKET_MAX_HOURS
+ *   4      4     start, UTC epoch seconds of the first hour (multiple of 3600)
+ *   8      2n    temperature per hour, int16, 1/100 degC
+ *   8+2n   n     precipitation probability per hour, uint8, percent
+ *   8+3n   4     CRC-32 (IEEE, as zlib.crc32) of all preceding bytes
+ *
+ * tools/publish_forecast.py produces this format.
+ *
+ * Header-only. test_forecast_packet packs forecasts the way the script does
+ * and checks what the decoder rejects.
+ */
+
+constexpr uint8_t FORECAST_PACKET_VERSION = 1;
+constexpr size_t FORECAST_PACKET_MAX_HOURS = 48;
+constexpr size_t FORECAST_PACKET_HEADER_SIZE = 8;
+constexpr size_t FORECAST_PACKET_CRC_SIZE = 4;
+constexpr int16_t FORECAST_PACKET_MIN_TEMP_C100 = -6000;
+constexpr int16_t FORECAST_PACKET_MAX_TEMP_C100 = 6000;
+
+enum class ForecastPacketError : uint8_t {
+    None,
+    TooShort,
+    BadMagic,
+    BadVersion,
+    BadLength,
+    BadChecksum,
+    BadStart,
+    ValueOutOfRange,
+};
+
+struct ForecastPacket {
+    uint32_t start_epoch;
+    uint8_t hours;
+    int16_t temps_c100[FORECAST_PACKET_MAX_HOURS];
+    uint8_t precip_percent[FORECAST_PACKET_MAX_HOURS];
+};
+
+namespace forecast_packet_detail {
+
+inline uint16_t read_u16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+
+inline uint32_t read_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+// Bitwise CRC-32; the packet is well under a hundred bytes, so no table is needed.
+inline uint32_t crc32(const uint8_t* data, const size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+} // namespace forecast_packet_detail
+
+/**
+ * @brief Validates and decodes a packet.
+ *
+ * @p out is only written when the whole packet is valid.
+ */
+inline ForecastPacketError decode_forecast_packet(const uint8_t* data, const size_t len,
+                                                  ForecastPacket& out) {
+    using namespace forecast_packet_detail;
+    if (!data || len < FORECAST_PACKET_HEADER_SIZE + FORECAST_PACKET_CRC_SIZE)
+        return ForecastPacketError::TooShort;
+    if (data[0] != 'F' || data[1] != 'C')
+        return ForecastPacketError::BadMagic;
+    if (data[2] != FORECAST_PACKET_VERSION)
+        return ForecastPacketError::BadVersion;
+    const size_t hours = data[3];
+    if (hours == 0 || hours > FORECAST_PACKET_MAX_HOURS ||
+        len != FORECAST_PACKET_HEADER_SIZE + 3 * hours + FORECAST_PACKET_CRC_SIZE)
+        return ForecastPacketError::BadLength;
+    const size_t body = len - FORECAST_PACKET_CRC_SIZE;
+    if (read_u32(data + body) != crc32(data, body))
+        return ForecastPacketError::BadChecksum;
+    const uint32_t start = read_u32(data + 4);
+    if (start % 3600 != 0)
+        return ForecastPacketError::BadStart;
+
+    const uint8_t* temps = data + FORECAST_PACKET_HEADER_SIZE;
+    const uint8_t* precip = temps + 2 * hours;
+    for (size_t i = 0; i < hours; ++i) {
+        const auto t = static_cast<int16_t>(read_u16(temps + 2 * i));
+        if (t < FORECAST_PACKET_MIN_TEMP_C100 || t > FORECAST_PACKET_MAX_TEMP_C100 ||
+            precip[i] > 100)
+            return ForecastPacketError::ValueOutOfRange;
+    }
+
+    out.start_epoch = start;
+    out.hours = static_cast<uint8_t>(hours);
+    for (size_t i = 0; i < hours; ++i) {
+        out.temps_c100[i] = static_cast<int16_t>(read_u16(temps + 2 * i));
+        out.precip_percent[i] = precip[i];
+    }
+    return ForecastPacketError::None;
+}
+
+inline const char* forecast_packet_error_name(const ForecastPacketError err) {
+    switch (err) {
+    case ForecastPacketError::None:
+        return "none";
+    case ForecastPacketError::TooShort:
+        return "too short";
+    case ForecastPacketError::BadMagic:
+        return "bad magic";
+    case ForecastPacketError::BadVersion:
+        return "unsupported version";
+    case ForecastPacketError::BadLength:
+        return "bad length";
+    case ForecastPacketError::BadChecksum:
+        return "bad checksum";
+    case ForecastPacketError::BadStart:
+        return "start not on an hour";
+    case ForecastPacketError::ValueOutOfRange:
+        return "value out of range";
+    }
+    return "unknown";
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+/**
+ * @file local_clock.h
+ * @brief Incremental UTC to local time conversion for a POSIX TZ rule.
+ *
+ * localtime_r() re-evaluates the TZ rule on every call. LocalClock parses the
+ * rule once, caches the current UTC offset together with the instants of the
+ * surrounding DST transitions, and advances the cached broken-down time by
+ * the elapsed seconds. A full derivation only happens when a transition is
+ * crossed, the clock steps backwards or jumps by more than a day.
+ *
+ * Needs only the C library. The native environment builds local_clock.cpp,
+ * and test_local_clock compares it with localtime_r() and times both. Not
+ * thread-safe; time_utils.cpp holds a spinlock around its instance.
+ */
+
+struct TzTransitionRule {
+    enum class Kind : uint8_t {
+        MonthWeekDay, // Mm.w.d: day d (0 = Sunday) of week w (5 = last) of month m
+        Julian1,      // Jn: day n (1..365), February 29th is never counted
+        Julian0,      // n: zero-based day n (0..365), leap days counted
+    };
+    Kind kind = Kind::MonthWeekDay;
+    uint8_t month = 0;
+    uint8_t week = 0;
+    uint8_t weekday = 0;
+    uint16_t day = 0;
+    int32_t time_s = 2 * 3600; // local wall time of the transition, default 02:00
+};
+
+struct TzInfo {
+    int32_t std_offset_s = 0; // seconds east of UTC
+    int32_t dst_offset_s = 0;
+    bool has_dst = false;
+    TzTransitionRule dst_start;
+    TzTransitionRule dst_end;
+};
+
+class LocalClock {
+  public:
+    /**
+     * @brief Parses a POSIX TZ string, e.g. "CET-1CEST,M3.5.0/2,M10.5.0/3".
+     * @return false if the string could not be parsed; the clock then uses UTC.
+     */
+    bool set_timezone(const char* posix_tz);
+
+    /**
+     * @brief Converts a UTC instant to broken-down local time.
+     *
+     * Calls with monotonically increasing instants are served from the cache.
+     */
+    tm to_local(time_t utc);
+
+    /**
+     * @brief Returns the UTC offset in effect at @p utc, in seconds east of UTC.
+     *
+     * Does not touch the cache.
+     */
+    int32_t utc_offset_at(time_t utc) const;
+
+    /**
+     * @brief Returns the first DST transition after @p utc, or 0 without DST.
+     */
+    time_t next_transition_after(time_t utc) const;
+
+    /**
+     * @brief Number of full derivations done so far (for diagnostics).
+     */
+    uint32_t derivations() const { return derivations_; }
+
+    const TzInfo& timezone() const { return tz_; }
+
+    /**
+     * @brief Days since 1970-01-01 of a proleptic Gregorian date.
+     */
+    static int64_t days_from_civil(int64_t y, unsigned m, unsigned d);
+
+  private:
+    struct Period {
+        time_t from;  // first instant of the period, or INT64_MIN-ish when unbounded
+        time_t until; // first instant after the period
+        int32_t offset_s;
+        bool dst;
+    };
+
+    Period period_at(time_t utc) const;
+    time_t transition_utc(int64_t year, const TzTransitionRule& rule, int32_t wall_offset_s) const;
+    void derive(time_t utc);
+    static void fill_tm(int64_t local_s, tm& out);
+    static void advance(tm& t, int64_t seconds);
+
+    TzInfo tz_;
+    bool valid_ = false;
+    time_t cached_utc_ = 0;
+    tm cached_tm_{};
+    Period period_{};
+    uint32_t derivations_ = 0;
+};
@@ -1,3 +1,34 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 
 void mqtt_app_start();
+
+/**
+ * @brief Stops the client while the network link is down and restarts it when it is back.
+ *
+ * Must not be called from the MQTT task. No-op before mqtt_app_start().
+ */
+void mqtt_app_link_changed(bool up);
+
+/**
+ * @brief Reports a relay state change made outside of MQTT.
+ *
+ * The change is journaled and published when the broker is reachable.
+ */
+void mqtt_relay_state_changed(size_t idx);
+
+/**
+ * @brief Publishes the current OTA progress on MQTT_TOPIC_BASE/ota. Never blocks.
+ */
+void mqtt_ota_progress_changed();
+
+using ForecastPacketHandler = void (*)(const uint8_t* data, size_t len);
+
+/**
+ * @brief Sets the receiver of binary forecasts pushed to MQTT_TOPIC_BASE/forecast.
+ *
+ * Called from the MQTT task; the topic is only subscribed if a handler is set
+ * before mqtt_app_start().
+ */
+void mqtt_set_forecast_handler(ForecastPacketHandler handler);
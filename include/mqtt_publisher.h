@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "mqtt_client.h"
+
+/**
+ * @file mqtt_publisher.h
+ * @brief Coalescing outbound MQTT publish queue.
+ *
+ * Every outbound topic is a slot. Producers only mark a slot dirty; the
+ * publisher task renders topic and payload when it actually sends, so a
+ * burst of updates to one topic results in a single message carrying the
+ * latest value. Memory use is fixed by the number of slots, whatever the
+ * rate of updates. Messages of every QoS are enqueued into the client's
+ * outbox and sent by the MQTT task, so the outbox holds everything not yet
+ * written to the socket. The publisher enqueues in small batches and waits
+ * while the outbox is above MQTT_OUTBOX_LIMIT_BYTES, which bounds its memory
+ * and keeps a slow broker from stalling the task that handles incoming
+ * commands. tools/mqtt_burst_test.py floods a clock with commands through a
+ * broker to check this.
+ *
+ * Dirty slots are kept in a journal ordered by their first change. While the
+ * broker is unreachable the journal keeps collecting changes, and after a
+ * reconnect it is replayed in that order, one message per topic.
+ */
+
+namespace mqtt_publisher {
+
+using SlotId = int;
+
+struct PublisherStats {
+    uint32_t queued;    // changes that added a slot to the journal
+    uint32_t coalesced; // changes merged into an already pending slot
+    uint32_t published;
+    uint32_t failed;
+};
+
+constexpr SlotId INVALID_SLOT = -1;
+constexpr size_t MAX_SLOTS = 24;
+constexpr size_t TOPIC_MAX = 128;
+constexpr size_t PAYLOAD_MAX = 1024; // fits the full relay schedule
+
+/**
+ * @brief Renders a message into the publisher's buffers at send time.
+ * @param arg The argument given to add_slot(), e.g. a relay index.
+ * @return Payload length, or a negative value to skip this message.
+ */
+using RenderFn = int (*)(size_t arg, char* topic, size_t topic_size, char* payload,
+                         size_t payload_size);
+
+/**
+ * @brief Registers an outbound topic. Call before start().
+ */
+SlotId add_slot(RenderFn render, size_t arg, int qos, bool retain);
+
+/**
+ * @brief Requests a publish of the slot's current value. Never blocks.
+ */
+void mark_dirty(SlotId slot);
+
+/**
+ * @brief Starts the publisher task for @p client.
+ */
+void start(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief Tells the publisher whether the broker connection is up.
+ *
+ * Dirty slots are kept while disconnected and sent after reconnecting.
+ */
+void set_connected(bool connected);
+
+/**
+ * @brief Number of slots waiting to be published.
+ */
+size_t pending();
+
+PublisherStats get_stats();
+
+} // namespace mqtt_publisher
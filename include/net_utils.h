@@ -1,9 +1,50 @@
 #pragma once
-#include <NTPClient.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/**
+ * @file net_utils.h
+ * @brief Event-driven WiFi station manager.
+ *
+ * start() returns at once; connecting, reconnecting and backing off happen in
+ * a background task driven by WiFi events. The BSSID and channel of the last
+ * good access point are cached in NVS, so a reconnect skips the full scan, and
+ * lwIP restores the last DHCP lease (CONFIG_LWIP_DHCP_RESTORE_LAST_IP).
+ *
+ * Services follow the link through the event group returned by events():
+ * exactly one of LINK_UP_BIT and LINK_DOWN_BIT is set at any time.
+ */
 
 namespace net_utils {
 
-bool setup_wifi();
-void setup_NTP(NTPClient& timeClient);
+constexpr EventBits_t LINK_UP_BIT = BIT0;   // associated and holding an IP address
+constexpr EventBits_t LINK_DOWN_BIT = BIT1; // no usable link
+
+/**
+ * @brief Starts the connection manager. Does not block.
+ */
+void start();
+
+/**
+ * @brief Returns the event group carrying LINK_UP_BIT and LINK_DOWN_BIT.
+ */
+EventGroupHandle_t events();
+
+/**
+ * @brief Tells whether the station currently has an IP address.
+ */
+bool is_connected();
+
+/**
+ * @brief Blocks the calling task until the link is up or the timeout expires.
+ * @return true if the link is up.
+ */
+bool wait_connected(TickType_t timeout);
+
+/**
+ * @brief Blocks the calling task until the link is down or the timeout expires.
+ * @return true if the link is down.
+ */
+bool wait_disconnected(TickType_t timeout);
 
-} // namespace net_utils
\ No newline at end of file
+} // namespace net_utils
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @file night_mode.h
+ * @brief Night window with a dark display and reduced background activity.
+ *
+ * Inside the window [NIGHT_START_MINUTE, NIGHT_END_MINUTE) of local time the
+ * display goes dark, the seconds indicator stops and periodic work slows
+ * down. A proximity event lights the display for NIGHT_PEEK_MS.
+ *
+ * The window is evaluated by update(), which the minute task calls with the
+ * local time from time_utils, so transitions follow the TIMEZONE rule
+ * including DST changes.
+ */
+
+namespace night_mode {
+
+enum class State : uint8_t {
+    Day,   // outside the window
+    Night, // inside the window, display dark
+    Peek,  // inside the window, display lit for a moment
+};
+
+/**
+ * @brief Called on every state change, in order, from the task that caused it
+ * or the esp_timer task. May take the display mutex; must not call update() or peek().
+ */
+using Listener = void (*)(State state);
+
+/**
+ * @brief Tells whether @p minute (minutes since local midnight) lies in the
+ * window [start, end), which may wrap past midnight. An empty window (start == end)
+ * never matches.
+ */
+constexpr bool in_window(const uint16_t minute, const uint16_t start, const uint16_t end) {
+    return start <= end ? minute >= start && minute < end : minute >= start || minute < end;
+}
+
+void start(Listener listener);
+
+/**
+ * @brief Re-evaluates the window for the given local time.
+ */
+void update(int minute_of_day);
+
+/**
+ * @brief Lights the display for NIGHT_PEEK_MS if it is dark. Restarts a running peek.
+ */
+void peek();
+
+State state();
+
+/**
+ * @brief Tells whether the night window is in effect (also during a peek).
+ */
+bool is_night();
+
+/**
+ * @brief Blocks the calling task while the display is dark.
+ * @return true if the display is lit.
+ */
+bool wait_until_lit(TickType_t timeout);
+
+} // namespace night_mode
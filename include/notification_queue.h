@@ -0,0 +1,137 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/**
+ * @file notification_queue.h
+ * @brief Bounded, preallocated priority queue of short display messages.
+ *
+ * Entries live in inline storage; nothing is allocated after construction.
+ * The highest priority is served first, FIFO within a priority. When the
+ * queue is full a new message replaces the oldest one of the lowest priority,
+ * provided that priority is not higher than its own. Otherwise it is rejected.
+ * Expired entries are dropped lazily.
+ *
+ * Not thread-safe; notifications.cpp holds a spinlock around every call.
+ * test_notification_queue covers the order, the eviction rule and expiry.
+ */
+
+template <size_t CAPACITY, size_t TEXT_MAX> class NotificationQueue {
+    static_assert(TEXT_MAX <= 256, "text length is stored in a byte");
+
+  public:
+    struct Entry {
+        char text[TEXT_MAX]; // NUL-terminated
+        uint8_t len;
+        uint8_t priority; // higher is more important
+        int64_t expires_us;
+        uint32_t seq; // arrival order
+
+        std::string_view view() const { return {text, len}; }
+    };
+
+    /**
+     * @brief Queues a message; text longer than TEXT_MAX - 1 is truncated.
+     * @return false if the queue is full of messages with higher priority.
+     */
+    bool push(const std::string_view text, const uint8_t priority, const int64_t expires_us,
+              const int64_t now_us) {
+        drop_expired(now_us);
+        Entry* slot = nullptr;
+        if (size_ < CAPACITY) {
+            slot = &entries_[size_++];
+        } else {
+            slot = &entries_[lowest()];
+            if (slot->priority > priority)
+                return false;
+            ++evicted_;
+        }
+        const size_t len = text.size() < TEXT_MAX - 1 ? text.size() : TEXT_MAX - 1;
+        std::memcpy(slot->text, text.data(), len);
+        slot->text[len] = '\0';
+        slot->len = static_cast<uint8_t>(len);
+        slot->priority = priority;
+        slot->expires_us = expires_us;
+        slot->seq = next_seq_++;
+        return true;
+    }
+
+    /**
+     * @brief Puts back an entry taken with pop(), keeping its place in the order.
+     */
+    bool requeue(const Entry& entry, const int64_t now_us) {
+        drop_expired(now_us);
+        if (size_ >= CAPACITY || entry.expires_us <= now_us)
+            return false;
+        entries_[size_++] = entry;
+        return true;
+    }
+
+    /**
+     * @brief Removes the most important live entry.
+     * @return false if nothing is queued.
+     */
+    bool pop(Entry& out, const int64_t now_us) {
+        drop_expired(now_us);
+        if (size_ == 0)
+            return false;
+        const size_t best = highest();
+        out = entries_[best];
+        entries_[best] = entries_[--size_];
+        return true;
+    }
+
+    /**
+     * @brief Priority of the entry pop() would return, or -1 if empty.
+     */
+    int top_priority(const int64_t now_us) {
+        drop_expired(now_us);
+        return size_ ? entries_[highest()].priority : -1;
+    }
+
+    size_t size() const { return size_; }
+    uint32_t evicted() const { return evicted_; }
+
+  private:
+    static bool before(const Entry& a, const Entry& b) {
+        return a.priority != b.priority ? a.priority > b.priority
+                                        : static_cast<int32_t>(a.seq - b.seq) < 0;
+    }
+
+    size_t highest() const {
+        size_t best = 0;
+        for (size_t i = 1; i < size_; ++i)
+            if (before(entries_[i], entries_[best]))
+                best = i;
+        return best;
+    }
+
+    // Lowest priority, oldest first: under a flood the newest messages survive.
+    size_t lowest() const {
+        size_t worst = 0;
+        for (size_t i = 1; i < size_; ++i) {
+            const Entry& e = entries_[i];
+            const Entry& w = entries_[worst];
+            if (e.priority < w.priority ||
+                (e.priority == w.priority && static_cast<int32_t>(e.seq - w.seq) < 0))
+                worst = i;
+        }
+        return worst;
+    }
+
+    void drop_expired(const int64_t now_us) {
+        for (size_t i = 0; i < size_;) {
+            if (entries_[i].expires_us <= now_us)
+                entries_[i] = entries_[--size_];
+            else
+                ++i;
+        }
+    }
+
+    Entry entries_[CAPACITY]{};
+    size_t size_ = 0;
+    uint32_t next_seq_ = 0;
+    uint32_t evicted_ = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "notification_queue.h"
+
+/**
+ * @file notifications.h
+ * @brief Text notifications pushed to the display.
+ *
+ * Messages are kept in a bounded, preallocated priority queue
+ * (NOTIFY_QUEUE_CAPACITY entries), so a flood of posts costs a fixed amount
+ * of memory and never blocks the poster. The display task takes them one by
+ * one between clock updates.
+ */
+
+namespace notifications {
+
+constexpr size_t TEXT_MAX = 96;
+using Entry = NotificationQueue<NOTIFY_QUEUE_CAPACITY, TEXT_MAX>::Entry;
+
+/**
+ * @brief Sets the task that is notified whenever a message is queued.
+ */
+void set_listener(TaskHandle_t task);
+
+/**
+ * @brief Queues a message. Never blocks.
+ * @return false if the queue is full of more important messages.
+ */
+bool post(std::string_view text, uint8_t priority, uint32_t ttl_s);
+
+/**
+ * @brief Queues a message received over MQTT.
+ *
+ * The payload is "text" or "priority|ttl_s|text". The tokens :rain:, :sun:
+ * and :deg: are replaced by the matching display icons.
+ */
+bool post_payload(std::string_view payload);
+
+/**
+ * @brief Takes the most important live message.
+ */
+bool take(Entry& out);
+
+/**
+ * @brief Returns a message that was interrupted before it was fully shown.
+ */
+void put_back(const Entry& entry);
+
+/**
+ * @brief Priority of the next message, or -1 if none is queued.
+ */
+int top_priority();
+
+} // namespace notifications
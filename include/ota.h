@@ -1,14 +1,55 @@
 #pragma once
+#include <cstdint>
+
 #include "freertos/queue.h"
 
 // The handle for the queue that passes firmware URLs from triggers to the update task.
 extern QueueHandle_t otaUrlQueue;
 
+enum class OtaState : uint8_t {
+    Idle,
+    Downloading,
+    Verifying, // image complete, checked before switching the boot partition
+    Done,      // about to restart into the new image
+    Failed,
+};
+
+struct OtaProgress {
+    OtaState state;
+    uint32_t received; // image bytes in the partition, including a resumed part
+    int32_t total;     // image size, -1 if the server did not tell
+    uint8_t attempt;
+};
+
+/**
+ * @brief Called from the OTA task on every state change and percent of progress.
+ */
+using OtaProgressListener = void (*)(const OtaProgress& progress);
+
 /**
  * @brief Initializes the OTA module.
  *
  * Creates the necessary FreeRTOS queue and task for handling OTA updates.
  * The task listens for firmware URLs on the queue and performs the update.
  * The triggering of OTA updates (e.g., via MQTT or HTTP) is implemented elsewhere.
+ *
+ * The image is downloaded in ranged requests of OTA_HTTP_REQUEST_SIZE and
+ * written chunk by chunk, pausing between chunks so the clock keeps running.
+ * The download offset is saved in NVS; an interrupted update continues where
+ * it stopped, also after a restart.
+ *
+ * A compressed package (see ota_package.h) is recognized by its header and
+ * inflated into the update partition as it arrives; it is not resumed. A delta
+ * package is applied to the running image, which is checked against the base
+ * hash in the package first.
  */
 void ota_app_start();
+
+/**
+ * @brief Sets the receiver of progress reports. Call before ota_app_start().
+ */
+void ota_set_progress_listener(OtaProgressListener listener);
+
+OtaProgress ota_get_progress();
+
+const char* ota_state_name(OtaState state);
@@ -0,0 +1,289 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file ota_package.h
+ * @brief Compressed OTA image ("package") header and delta patch decoder.
+ *
+ * A package is this header followed by the firmware image compressed as a
+ * raw deflate stream. The device inflates it while downloading, straight into
+ * the inactive app partition, through a window of 2^window_bits bytes.
+ *
+ * A delta package carries a patch against the running image instead. The
+ * header is followed by the base descriptor (base image size, 4 bytes, and
+ * its SHA-256, 32 bytes) in the clear, then the deflated patch. The patch is
+ * a sequence of ops, integers little endian:
+ *
+ *   0x00 offset:u32 len:u32            copy len bytes of the base at offset
+ *   0x01 offset:u32 len:u32 bytes[len] add bytes to the base at offset, mod 256
+ *   0x02 len:u32 bytes[len]            insert bytes
+ *
+ * Image size, hash and signature always describe the resulting image.
+ *
+ * Layout (all integers little endian):
+ *
+ *   offset size  field
+ *   0      4     magic "CLKP"
+ *   4      1     version (OTA_PACKAGE_VERSION)
+ *   5      1     kind (OtaPackageKind)
+ *   6      1     window bits of the deflate stream, 9..OTA_PACKAGE_MAX_WINDOW_BITS
+ *   7      1     reserved, 0
+ *   8      4     image size, bytes after decompression
+ *   12     4     payload size, bytes of deflate data after the header
+ *   16     32    SHA-256 of the decompressed image
+ *   48     1     signature length, 0 if unsigned
+ *   49     72    ECDSA P-256 signature (DER) over bytes 0..47, zero padded
+ *   121    7     reserved, 0
+ *   128          payload, after the base descriptor in a delta package
+ *
+ * The signature covers the image hash, so a verified header vouches for the
+ * whole image. tools/ota_pack.py produces this format.
+ *
+ * Header-only parsing and patching. ota.cpp hashes, verifies and writes the
+ * result; test_ota_package covers the header checks and the delta decoder.
+ */
+
+constexpr uint8_t OTA_PACKAGE_VERSION = 1;
+constexpr size_t OTA_PACKAGE_HEADER_SIZE = 128;
+constexpr size_t OTA_PACKAGE_SIGNED_SIZE = 48;
+constexpr size_t OTA_PACKAGE_MAX_SIGNATURE = 72;
+constexpr uint8_t OTA_PACKAGE_MIN_WINDOW_BITS = 9;
+constexpr uint8_t OTA_PACKAGE_MAX_WINDOW_BITS = 15;
+constexpr size_t OTA_DELTA_BASE_SIZE = 36;
+
+enum class OtaPackageKind : uint8_t {
+    Full = 0,  // the whole image
+    Delta = 1, // a patch against the running image
+};
+
+enum class OtaPackageError : uint8_t {
+    None,
+    TooShort,
+    BadMagic,
+    BadVersion,
+    BadKind,
+    BadWindow,
+    BadSignatureLength,
+    BadDelta,
+};
+
+struct OtaPackageHeader {
+    OtaPackageKind kind;
+    uint8_t window_bits;
+    uint32_t image_size;
+    uint32_t payload_size;
+    uint8_t image_sha256[32];
+    uint8_t signature_len;
+    uint8_t signature[OTA_PACKAGE_MAX_SIGNATURE];
+};
+
+struct OtaDeltaBase {
+    uint32_t size;
+    uint8_t sha256[32];
+};
+
+namespace ota_package_detail {
+inline uint32_t read_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+} // namespace ota_package_detail
+
+/**
+ * @brief Tells whether @p data starts like a package; needs at least 4 bytes.
+ */
+inline bool is_ota_package(const uint8_t* data, const size_t len) {
+    return data && len >= 4 && data[0] == 'C' && data[1] == 'L' && data[2] == 'K' &&
+           data[3] == 'P';
+}
+
+/**
+ * @brief Validates and decodes a package header (the first OTA_PACKAGE_HEADER_SIZE bytes).
+ *
+ * @p out is only written when the header is valid. The signature is not checked here.
+ */
+inline OtaPackageError decode_ota_package_header(const uint8_t* data, const size_t len,
+                                                 OtaPackageHeader& out) {
+    if (!data || len < OTA_PACKAGE_HEADER_SIZE)
+        return OtaPackageError::TooShort;
+    if (!is_ota_package(data, len))
+        return OtaPackageError::BadMagic;
+    if (data[4] != OTA_PACKAGE_VERSION)
+        return OtaPackageError::BadVersion;
+    if (data[5] != static_cast<uint8_t>(OtaPackageKind::Full) &&
+        data[5] != static_cast<uint8_t>(OtaPackageKind::Delta))
+        return OtaPackageError::BadKind;
+    if (data[6] < OTA_PACKAGE_MIN_WINDOW_BITS || data[6] > OTA_PACKAGE_MAX_WINDOW_BITS)
+        return OtaPackageError::BadWindow;
+    if (data[48] > OTA_PACKAGE_MAX_SIGNATURE)
+        return OtaPackageError::BadSignatureLength;
+
+    using ota_package_detail::read_u32;
+    out.kind = static_cast<OtaPackageKind>(data[5]);
+    out.window_bits = data[6];
+    out.image_size = read_u32(data + 8);
+    out.payload_size = read_u32(data + 12);
+    for (size_t i = 0; i < sizeof(out.image_sha256); ++i)
+        out.image_sha256[i] = data[16 + i];
+    out.signature_len = data[48];
+    for (size_t i = 0; i < OTA_PACKAGE_MAX_SIGNATURE; ++i)
+        out.signature[i] = data[49 + i];
+    return OtaPackageError::None;
+}
+
+/**
+ * @brief Decodes the base descriptor that follows the header of a delta package.
+ */
+inline OtaPackageError decode_ota_delta_base(const uint8_t* data, const size_t len,
+                                             OtaDeltaBase& out) {
+    if (!data || len < OTA_DELTA_BASE_SIZE)
+        return OtaPackageError::TooShort;
+    out.size = ota_package_detail::read_u32(data);
+    for (size_t i = 0; i < sizeof(out.sha256); ++i)
+        out.sha256[i] = data[4 + i];
+    return OtaPackageError::None;
+}
+
+/**
+ * @brief Rebuilds an image from a delta patch fed in pieces of any size.
+ *
+ * Output goes to a sink, `bool sink(const uint8_t* data, size_t len)`, which
+ * returns false to stop. Copied and added bytes are staged in the scratch
+ * buffer, so the sink never sees a pointer into the base; inserted bytes are
+ * passed straight from the input.
+ */
+class OtaDeltaDecoder {
+  public:
+    OtaDeltaDecoder(const uint8_t* base, const size_t base_size, uint8_t* scratch,
+                    const size_t scratch_size)
+        : base_(base), base_size_(base_size), scratch_(scratch), scratch_size_(scratch_size) {}
+
+    /**
+     * @brief Decodes the next @p len bytes of the patch.
+     * @param stopped Set when the sink stopped the decoding.
+     * @return BadDelta for an unknown op or a range outside the base.
+     */
+    template <typename Sink>
+    OtaPackageError feed(const uint8_t* data, size_t len, Sink&& sink, bool& stopped) {
+        stopped = false;
+        while (len > 0) {
+            switch (stage_) {
+            case Stage::Op:
+                op_ = *data++;
+                --len;
+                if (op_ > INSERT)
+                    return OtaPackageError::BadDelta;
+                args_have_ = 0;
+                args_need_ = op_ == INSERT ? 4 : 8;
+                stage_ = Stage::Args;
+                break;
+            case Stage::Args: {
+                const size_t n = args_need_ - args_have_ < len ? args_need_ - args_have_ : len;
+                for (size_t i = 0; i < n; ++i)
+                    args_[args_have_ + i] = data[i];
+                args_have_ += n;
+                data += n;
+                len -= n;
+                if (args_have_ < args_need_)
+                    break;
+                if (op_ == INSERT) {
+                    remaining_ = ota_package_detail::read_u32(args_);
+                } else {
+                    offset_ = ota_package_detail::read_u32(args_);
+                    remaining_ = ota_package_detail::read_u32(args_ + 4);
+                    if (static_cast<uint64_t>(offset_) + remaining_ > base_size_)
+                        return OtaPackageError::BadDelta;
+                }
+                stage_ = Stage::Data;
+                if (op_ == COPY) {
+                    if (!copy(sink)) {
+                        stopped = true;
+                        return OtaPackageError::None;
+                    }
+                    stage_ = Stage::Op;
+                } else if (remaining_ == 0) {
+                    stage_ = Stage::Op;
+                }
+                break;
+            }
+            case Stage::Data: {
+                size_t n = remaining_ < len ? remaining_ : len;
+                if (op_ == ADD && n > scratch_size_)
+                    n = scratch_size_;
+                if (op_ == ADD)
+                    for (size_t i = 0; i < n; ++i)
+                        scratch_[i] = static_cast<uint8_t>(base_[offset_ + i] + data[i]);
+                if (!sink(op_ == ADD ? scratch_ : data, n)) {
+                    stopped = true;
+                    return OtaPackageError::None;
+                }
+                offset_ += static_cast<uint32_t>(n);
+                remaining_ -= static_cast<uint32_t>(n);
+                data += n;
+                len -= n;
+                if (remaining_ == 0)
+                    stage_ = Stage::Op;
+                break;
+            }
+            }
+        }
+        return OtaPackageError::None;
+    }
+
+    /** @brief True between ops, which is where a complete patch ends. */
+    bool at_op_boundary() const { return stage_ == Stage::Op; }
+
+  private:
+    static constexpr uint8_t COPY = 0;
+    static constexpr uint8_t ADD = 1;
+    static constexpr uint8_t INSERT = 2;
+    enum class Stage : uint8_t { Op, Args, Data };
+
+    template <typename Sink> bool copy(Sink& sink) {
+        while (remaining_ > 0) {
+            const size_t n = remaining_ < scratch_size_ ? remaining_ : scratch_size_;
+            for (size_t i = 0; i < n; ++i)
+                scratch_[i] = base_[offset_ + i];
+            if (!sink(static_cast<const uint8_t*>(scratch_), n))
+                return false;
+            offset_ += static_cast<uint32_t>(n);
+            remaining_ -= static_cast<uint32_t>(n);
+        }
+        return true;
+    }
+
+    const uint8_t* base_;
+    size_t base_size_;
+    uint8_t* scratch_;
+    size_t scratch_size_;
+    Stage stage_ = Stage::Op;
+    uint8_t op_ = 0;
+    uint8_t args_[8] = {};
+    size_t args_have_ = 0;
+    size_t args_need_ = 0;
+    uint32_t offset_ = 0;
+    uint32_t remaining_ = 0;
+};
+
+inline const char* ota_package_error_name(const OtaPackageError err) {
+    switch (err) {
+    case OtaPackageError::None:
+        return "none";
+    case OtaPackageError::TooShort:
+        return "too short";
+    case OtaPackageError::BadMagic:
+        return "bad magic";
+    case OtaPackageError::BadVersion:
+        return "unsupported version";
+    case OtaPackageError::BadKind:
+        return "unsupported kind";
+    case OtaPackageError::BadWindow:
+        return "bad window size";
+    case OtaPackageError::BadSignatureLength:
+        return "bad signature length";
+    case OtaPackageError::BadDelta:
+        return "bad delta patch";
+    }
+    return "unknown";
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * @file ota_resume.h
+ * @brief When an interrupted OTA download is saved, retried, continued after
+ * a restart or given up.
+ *
+ * The device keeps one record in NVS for the URL being downloaded: the bytes
+ * already in the update partition and the restarts that continued it since
+ * those bytes last grew. ota.cpp reads and writes the record; the decisions
+ * are made here, free of framework dependencies, so the native tests drive
+ * the same code.
+ */
+
+namespace ota_resume {
+
+struct Config {
+    uint32_t save_every_bytes; // the offset is saved this often while downloading
+    uint8_t max_resume_boots;  // restarts continuing a download without progress
+    uint8_t max_attempts;      // download attempts per trigger
+    uint32_t retry_delay_ms;   // before the next attempt, multiplied by the attempt number
+};
+
+struct Record {
+    uint32_t written; // bytes in the partition, 0 if there is nothing to continue
+    uint8_t boots;    // restarts since written last grew
+};
+
+/**
+ * @brief Whether the offset reached while downloading is due to be saved.
+ */
+inline bool save_due(const Config& cfg, const uint32_t saved, const uint32_t written) {
+    return written - saved >= cfg.save_every_bytes;
+}
+
+/**
+ * @brief The record to save for @p written bytes.
+ *
+ * Only progress resets the restart count; a failure at the same offset does
+ * not, or a download that resets the chip at one spot would never be dropped.
+ */
+inline Record saved(const Record& before, const uint32_t written) {
+    return {written, written > before.written ? uint8_t{0} : before.boots};
+}
+
+/**
+ * @brief Counts a restart that finds a pending download.
+ * @return false if the download is to be dropped: it was already continued
+ * max_resume_boots times without getting any further.
+ */
+inline bool count_boot(const Config& cfg, Record& record) {
+    if (record.boots < UINT8_MAX)
+        ++record.boots;
+    return record.boots <= cfg.max_resume_boots;
+}
+
+enum class Result : uint8_t {
+    Done,    // the image is complete, validated and set to boot
+    Invalid, // a complete image that does not validate, or a refused package
+    Failed,  // anything else: connection, server or flash errors
+};
+
+enum class Action : uint8_t {
+    Install, // restart into the new image
+    Retry,   // try again after delay_ms, continuing at the saved offset
+    Drop,    // give up and forget the record; retrying would not help
+    Keep,    // give up for now; the next trigger or restart continues
+};
+
+struct Next {
+    Action action;
+    uint32_t delay_ms;
+};
+
+/**
+ * @brief What to do after download attempt @p attempt (1-based) ended with @p result.
+ */
+inline Next after_attempt(const Config& cfg, const Result result, const uint8_t attempt) {
+    switch (result) {
+    case Result::Done:
+        return {Action::Install, 0};
+    case Result::Invalid:
+        return {Action::Drop, 0};
+    case Result::Failed:
+        break;
+    }
+    if (attempt < cfg.max_attempts)
+        return {Action::Retry, cfg.retry_delay_ms * attempt};
+    return {Action::Keep, 0};
+}
+
+} // namespace ota_resume
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+
+#include "driver/gpio.h"
+#include "esp_pm.h"
+
+/**
+ * @file power.h
+ * @brief Dynamic frequency scaling and automatic light sleep.
+ *
+ * The CPU runs at CPU_FREQ_MIN_MHZ unless a Boost is alive, and the idle
+ * task puts the chip into light sleep whenever nothing is due for a few
+ * ticks (tickless idle). esp_timer deadlines, WiFi beacons and the
+ * configured wake pin end the sleep.
+ *
+ * Sleep residency and wake-up lateness are measured from the light sleep
+ * callbacks; see get_stats().
+ */
+
+namespace power {
+
+enum class Lock : uint8_t {
+    Render,  // drawing and pushing pixels to the MAX7219 chain
+    Network, // TLS handshakes and downloads
+    Count,
+};
+
+/**
+ * @brief Applies the power management configuration. Call once, early in setup().
+ */
+void start();
+
+/**
+ * @brief Lets a low level on @p pin end light sleep. Call once.
+ *
+ * The pin must be configured for falling-edge interrupts; its interrupt type
+ * is switched to low level during each sleep and restored afterwards.
+ *
+ * Edge interrupts are not detected while the chip sleeps, so after a wake-up
+ * caused by the pin @p handler is called in place of its interrupt handler:
+ * from an idle hook, with interrupts enabled again, before the next sleep.
+ * It must not block.
+ */
+void set_wake_pin(gpio_num_t pin, void (*handler)());
+
+/**
+ * @brief Keeps the CPU at CPU_FREQ_MAX_MHZ for the lifetime of the object.
+ */
+class Boost {
+  public:
+    explicit Boost(Lock lock);
+    ~Boost();
+    Boost(const Boost&) = delete;
+    Boost& operator=(const Boost&) = delete;
+
+  private:
+    esp_pm_lock_handle_t handle_;
+};
+
+struct SleepStats {
+    uint32_t sleeps;
+    int64_t slept_us;      // total time spent in light sleep
+    int64_t window_us;     // time since start(), the base for the residency
+    int64_t last_late_us;  // wake-up after the planned end of the last timed sleep
+    int64_t max_late_us;
+};
+
+SleepStats get_stats();
+
+/**
+ * @brief Logs sleep residency and wake-up lateness.
+ */
+void log_stats();
+
+} // namespace power
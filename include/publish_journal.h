@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file publish_journal.h
+ * @brief Ordered, deduplicated ring of pending publish slots.
+ *
+ * Records which outbound topics changed, in the order of their first change
+ * since they were last sent. A topic that changes again while pending keeps
+ * its place; its latest value is rendered when it is finally sent. The ring
+ * therefore never holds more than one entry per slot and cannot overflow.
+ *
+ * Not thread-safe; mqtt_publisher.cpp holds a spinlock around every call.
+ * test_publish_journal covers the order, the dedupe and a replay after a
+ * reconnect.
+ *
+ * @tparam N Number of slots (ids 0..N-1).
+ */
+template <size_t N> class PublishJournal {
+    static_assert(N <= 255, "slot ids are stored in a byte");
+
+  public:
+    /**
+     * @brief Appends a slot unless it is already pending.
+     * @return true if the slot was added.
+     */
+    bool push(const uint8_t id) {
+        if (id >= N || pending_[id])
+            return false;
+        ring_[(head_ + size_) % N] = id;
+        ++size_;
+        pending_[id] = true;
+        return true;
+    }
+
+    /**
+     * @brief Puts a slot back at the front, e.g. after a failed send.
+     * @return true if the slot was added.
+     */
+    bool push_front(const uint8_t id) {
+        if (id >= N || pending_[id])
+            return false;
+        head_ = (head_ + N - 1) % N;
+        ring_[head_] = id;
+        ++size_;
+        pending_[id] = true;
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest pending slot.
+     * @return false if nothing is pending.
+     */
+    bool pop(uint8_t& id) {
+        if (size_ == 0)
+            return false;
+        id = ring_[head_];
+        head_ = (head_ + 1) % N;
+        --size_;
+        pending_[id] = false;
+        return true;
+    }
+
+    bool pending(const uint8_t id) const { return id < N && pending_[id]; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+  private:
+    uint8_t ring_[N]{};
+    bool pending_[N]{};
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
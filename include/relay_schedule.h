@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+
+#include "local_clock.h"
+
+/**
+ * @file relay_schedule.h
+ * @brief Daily and weekly relay events, fixed or relative to sunrise/sunset.
+ *
+ * Events are kept in a compact table sorted by (anchor, minute, relay), which
+ * is also the layout stored in NVS. Wall-clock events are converted to UTC
+ * through the TIMEZONE rule: an event inside the spring-forward gap fires at
+ * the transition, an event inside the repeated autumn hour fires once, at
+ * its first occurrence. Sun events are computed in UTC for the configured
+ * location and need no conversion.
+ *
+ * Text form, used over MQTT, events separated by ';':
+ *
+ *   <days>,<time>,<relay>,<on|off>
+ *
+ * days: "*" or seven characters Monday..Sunday, '.' or '-' for days off,
+ * e.g. "MTWTF..". time: "HH:MM", "sunrise", "sunset", optionally followed by
+ * a signed offset in minutes, e.g. "sunset-15". relay: 1-based index.
+ *
+ * Only parsing and evaluation, on top of local_clock.h. The native
+ * environment builds relay_schedule.cpp too, so test_relay_schedule runs
+ * the firmware's own parser.
+ */
+
+namespace relay_schedule {
+
+enum class Anchor : uint8_t {
+    Clock = 0,   // minute is the local time of day
+    Sunrise = 1, // minute is an offset from sunrise
+    Sunset = 2,  // minute is an offset from sunset
+};
+
+struct __attribute__((packed)) Event {
+    uint8_t days;   // bit 0 = Sunday ... bit 6 = Saturday (tm_wday)
+    uint8_t anchor; // Anchor
+    int16_t minute;
+    uint8_t relay; // 0-based
+    uint8_t on;
+};
+static_assert(sizeof(Event) == 6, "events are stored packed");
+
+constexpr size_t MAX_EVENTS = 32;
+constexpr uint8_t ALL_DAYS = 0x7F;
+constexpr uint8_t BLOB_VERSION = 1;
+constexpr size_t BLOB_MAX = 2 + MAX_EVENTS * sizeof(Event);
+// Longest event in text form, e.g. ";MTWTF..,sunrise-720,255,off".
+constexpr size_t EVENT_TEXT_MAX = 1 + 7 + 1 + 11 + 1 + 3 + 1 + 3;
+constexpr size_t TEXT_MAX = MAX_EVENTS * EVENT_TEXT_MAX + 1; // with the terminating NUL
+
+struct Location {
+    double latitude;  // degrees north
+    double longitude; // degrees east
+};
+
+class Table {
+  public:
+    void clear() { count_ = 0; }
+
+    /**
+     * @brief Adds an event; call sort() after the last add().
+     */
+    bool add(const Event& event);
+    void sort();
+
+    size_t size() const { return count_; }
+    const Event& operator[](const size_t i) const { return events_[i]; }
+    const Event* begin() const { return events_; }
+    const Event* end() const { return events_ + count_; }
+
+    /**
+     * @brief Parses the text form; the table is left unchanged on error.
+     * @param relay_count Relays that exist; events for other relays are rejected.
+     */
+    bool parse(std::string_view text, size_t relay_count);
+
+    /**
+     * @brief Writes the text form; a buffer of TEXT_MAX bytes always fits.
+     * @return Length written, or -1 if it does not fit.
+     */
+    int format(char* buf, size_t size) const;
+
+    /**
+     * @brief Serializes to the NVS blob layout: version, count, events.
+     */
+    size_t serialize(uint8_t* buf, size_t size) const;
+    bool deserialize(const uint8_t* buf, size_t size);
+
+  private:
+    Event events_[MAX_EVENTS]{};
+    size_t count_ = 0;
+};
+
+/**
+ * @brief Sunrise or sunset (sun centre 0.833 degrees below the horizon) on a
+ * civil day, in UTC.
+ * @param day Days since 1970-01-01 of the date at the location.
+ * @return false during polar day or night.
+ */
+bool sun_event(int64_t day, const Location& loc, bool sunrise, time_t& out);
+
+/**
+ * @brief Converts a local wall time to UTC.
+ *
+ * A time inside the spring-forward gap maps to the transition instant; a
+ * time inside the repeated autumn hour maps to its first occurrence.
+ */
+time_t local_to_utc(int64_t local_seconds, const LocalClock& clock);
+
+/**
+ * @brief Time at which @p event fires on local day @p day.
+ * @return false if it does not fire that day.
+ */
+bool event_time_on(const Event& event, int64_t day, const LocalClock& clock, const Location& loc,
+                   time_t& out);
+
+/**
+ * @brief Finds the first instant strictly after @p after at which any event fires.
+ * @return false if the table is empty or no event fires within a week.
+ */
+bool next_fire_time(const Table& table, time_t after, const LocalClock& clock,
+                    const Location& loc, time_t& out);
+
+/**
+ * @brief Local day (days since 1970-01-01) that contains @p utc.
+ */
+int64_t local_day(time_t utc, const LocalClock& clock);
+
+} // namespace relay_schedule
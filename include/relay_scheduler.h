@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @file relay_scheduler.h
+ * @brief Runs the relay schedule (relay_schedule.h) on the device.
+ *
+ * The event table is kept in NVS. A single one-shot esp_timer is armed for
+ * the next event; nothing polls. Until the time is valid nothing fires.
+ */
+
+namespace relay_scheduler {
+
+using RelayChanged = void (*)(size_t idx);
+
+/**
+ * @brief Loads the schedule and arms the timer. Call after relays_app_init().
+ * @param on_change Called for every relay switched by the schedule, may be null.
+ */
+void start(RelayChanged on_change);
+
+/**
+ * @brief Re-arms the timer, e.g. after the clock was stepped.
+ */
+void reschedule();
+
+/**
+ * @brief Replaces the schedule with the text form and saves it.
+ * @return false if the text is invalid; the current schedule is kept.
+ */
+bool set_from_text(std::string_view text);
+
+/**
+ * @brief Writes the current schedule in text form.
+ * @return Length, or -1 if it does not fit.
+ */
+int format(char* buf, size_t size);
+
+} // namespace relay_scheduler
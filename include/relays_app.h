@@ -2,9 +2,62 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string_view>
 
 constexpr size_t RELAY_COUNT = 3;
 
+using RelayMask = uint16_t; // bit i = relay i
+constexpr RelayMask RELAY_ALL = (1u << RELAY_COUNT) - 1;
+
+struct RelayScene {
+    const char* name;
+    RelayMask on;       // relays switched on
+    RelayMask affected; // relays the scene sets; the others are left alone
+};
+
+struct RelayStats {
+    uint32_t changes;         // calls that changed at least one relay
+    uint32_t commits;         // NVS commits actually done
+    uint32_t last_latency_us; // command received to GPIO written, last change
+    uint32_t max_latency_us;
+};
+
 void relays_app_init();
-void relays_app_set_state(size_t idx, bool on);
+
+/**
+ * @brief Sets a relay. The GPIO changes immediately; the state is persisted
+ * after RELAY_SAVE_DEBOUNCE_MS together with any other change in that window,
+ * by a task of its own so the flash write never blocks the timer task.
+ * @param received_us esp_timer time the command arrived, e.g. when the MQTT
+ * event was dispatched; the latency in RelayStats is counted from there.
+ * 0 counts from this call.
+ */
+void relays_app_set_state(size_t idx, bool on, int64_t received_us = 0);
 bool relays_app_get_state(size_t idx);
+
+/**
+ * @brief Sets several relays at once.
+ *
+ * Outputs change with one write per direction: the GPIO set register, then
+ * the clear register, back to back with interrupts off. Other pins are not
+ * touched. The new states share one NVS commit.
+ * @return The relays whose state changed.
+ */
+RelayMask relays_app_set_mask(RelayMask on, RelayMask affected = RELAY_ALL,
+                              int64_t received_us = 0);
+RelayMask relays_app_get_mask();
+
+/**
+ * @brief Looks up a scene by name or by its 1-based number.
+ * @return nullptr if there is no such scene.
+ */
+const RelayScene* relays_app_find_scene(std::string_view name_or_number);
+
+/**
+ * @brief Writes a pending state change to NVS now.
+ *
+ * Called before OTA and, through a shutdown handler, before every restart.
+ */
+void relays_app_flush();
+
+RelayStats relays_app_get_stats();
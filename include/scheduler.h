@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file scheduler.h
+ * @brief Absolute-deadline periodic scheduling for the timed tasks.
+ *
+ * Each periodic task registers a job and calls wait_next() in its loop.
+ * Deadlines are absolute, so the time spent doing the work never shifts the
+ * period. Wall-clock jobs are aligned to multiples of their period in UTC
+ * (e.g. the start of every minute) and re-aligned when time sync steps the
+ * clock; monotonic jobs run from esp_timer and ignore clock steps.
+ */
+
+namespace scheduler {
+
+enum class Clock : uint8_t {
+    Wall,      // gettimeofday(), aligned to period boundaries
+    Monotonic, // esp_timer_get_time(), anchored at registration
+};
+
+enum class Policy : uint8_t {
+    CatchUp, // run missed deadlines back to back (bounded by MAX_CATCH_UP_PERIODS)
+    Skip,    // drop missed deadlines and continue with the next future one
+};
+
+struct JobStats {
+    uint32_t runs;
+    uint32_t overruns;    // deadlines already passed when the task came back to wait
+    uint32_t skipped;     // deadlines dropped by the Skip policy or the catch-up limit
+    uint32_t clock_steps; // re-alignments after a clock step
+    int64_t last_jitter_us; // wake-up time minus deadline
+    int64_t max_jitter_us;
+    int64_t total_jitter_us;
+};
+
+using JobId = int;
+constexpr JobId INVALID_JOB = -1;
+constexpr size_t MAX_JOBS = 8;
+constexpr uint32_t MAX_CATCH_UP_PERIODS = 3;
+
+/**
+ * @brief Registers a periodic job.
+ *
+ * @param name Static string used in statistics.
+ * @param phase_us Offset of wall-clock deadlines from the period boundary.
+ * @return The job id, or INVALID_JOB if the table is full.
+ */
+JobId register_job(const char* name, Clock clock, int64_t period_us, Policy policy,
+                   int64_t phase_us = 0);
+
+/**
+ * @brief Blocks the calling task until the job's next deadline.
+ *
+ * Must always be called from the same task. Uses the task notification of the
+ * calling task to be woken up early on clock steps.
+ */
+void wait_next(JobId id);
+
+/**
+ * @brief Continues a job after its task deliberately stopped waiting for it,
+ * e.g. while the display was dark.
+ *
+ * The next wait_next() waits for the first deadline after now (the next
+ * boundary for wall-clock jobs) instead of counting the pause as an overrun
+ * with every deadline in it skipped. Call from the job's task, before
+ * wait_next().
+ */
+void resume(JobId id);
+
+/**
+ * @brief Re-aligns all wall-clock jobs after the system clock was stepped.
+ *
+ * Each affected job runs once right away and then continues on the new
+ * boundaries, without replaying or skipping deadlines because of the step.
+ */
+void notify_clock_step();
+
+/**
+ * @brief Changes the period of a job, e.g. for a slower cadence at night.
+ *
+ * Applied by the job's task: the next deadline becomes the earlier of the
+ * current one and one new period from now (the next boundary for wall-clock
+ * jobs). Safe to call from any task.
+ * @return false for an unknown id or a non-positive period.
+ */
+bool set_period(JobId id, int64_t period_us);
+
+/**
+ * @brief Copies the statistics of a job.
+ * @return false for an unknown id.
+ */
+bool get_stats(JobId id, JobStats& out);
+
+const char* job_name(JobId id);
+
+size_t job_count();
+
+/**
+ * @brief Logs jitter and overrun statistics of all jobs.
+ */
+void log_stats();
+
+} // namespace scheduler
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @file task_profiler.h
+ * @brief Per-task CPU, context switch, wake latency and stack statistics.
+ *
+ * Once a second the FreeRTOS run time counters and stack watermarks of all
+ * tasks are sampled into static storage. Context switches are counted by a
+ * tick hook on each core, which sees the task running at every tick; a task
+ * that runs and blocks again between two ticks is not counted, so the
+ * numbers are a lower bound at tick resolution.
+ *
+ * Wake latency is the time from a task becoming ready to it running. It is
+ * recorded where that is known: by the scheduler for the periodic jobs (the
+ * wake-up minus the deadline), and by mark_ready()/mark_running() pairs
+ * around the notifications of the event driven tasks.
+ *
+ * The latest sample is served as JSON on GET /tasks of the development HTTP
+ * server; /tasks?stream=N sends the next N samples as they are taken, one
+ * document per line. Keys per task: "name", "core" (-1 if not pinned),
+ * "prio", "cpu" [%], "switches" per sample period, "wakes" and "wake_max_us"
+ * / "wake_avg_us" since boot, "stack_free" [B].
+ */
+
+namespace task_profiler {
+
+/**
+ * @brief Installs the tick hooks and starts sampling every TASK_PROFILER_PERIOD_MS.
+ */
+void start();
+
+/**
+ * @brief Adds the /tasks handler to a running HTTP server.
+ */
+void register_uri(httpd_handle_t server);
+
+/**
+ * @brief Notes that @p task was just made ready, e.g. right before notifying it.
+ *
+ * Safe to call from an ISR. Only the first call before the task runs counts.
+ */
+void mark_ready(TaskHandle_t task);
+
+/**
+ * @brief Called by a task right after it woke; records the latency since mark_ready().
+ */
+void mark_running();
+
+/**
+ * @brief Records a wake latency measured elsewhere, e.g. against a deadline.
+ */
+void record_wake(TaskHandle_t task, int64_t latency_us);
+
+} // namespace task_profiler
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * @file telemetry.h
+ * @brief Periodic device telemetry published over MQTT.
+ *
+ * Every TELEMETRY_INTERVAL_S the heap, per-task stack watermarks and CPU
+ * load, uptime and forecast fetch statistics are sampled into static
+ * storage and published as one packed JSON object on
+ * MQTT_TOPIC_BASE/telemetry. Only values that changed noticeably since the
+ * last report are included, and nothing is sent when nothing changed. A full
+ * report goes out every TELEMETRY_KEYFRAME_EVERY intervals so a subscriber
+ * that joined late converges.
+ *
+ * A report that does not fit into one message continues in up to two more,
+ * which carry only "up", "part" (1, 2) and the rest of the task list. Tasks
+ * that do not fit at all are reported with the next report. A value counts
+ * as reported once its message was handed to the publisher.
+ *
+ * Report keys: "up" uptime [s], "heap"/"heap_min" free heap [B], "fc_ok",
+ * "fc_err" fetch counts, "fc_ms" last fetch latency, "tasks" an array of
+ * [name, cpu %, free stack B]. "full":1 marks every part of a full report.
+ */
+
+namespace telemetry {
+
+/**
+ * @brief Registers the telemetry topic with the MQTT publisher and starts
+ * sampling. Call before mqtt_app_start().
+ */
+void start();
+
+/**
+ * @brief Changes the sampling interval, e.g. for a slower cadence at night.
+ *
+ * Safe to call from any task, also before start().
+ */
+void set_interval_s(uint32_t seconds);
+
+/**
+ * @brief Records the outcome of one forecast fetch. Safe to call from any task.
+ */
+void record_forecast_fetch(bool ok, uint32_t latency_ms);
+
+} // namespace telemetry
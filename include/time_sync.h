@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @file time_sync.h
+ * @brief System clock synchronization using the ESP-IDF SNTP service.
+ *
+ * The first synchronization (or any offset larger than NTP_STEP_THRESHOLD_MS)
+ * steps the clock with settimeofday(); all later corrections are slewed with
+ * adjtime(), so displayed time never jumps. Nothing here blocks the caller.
+ *
+ * Each sync offset also feeds a least-squares estimate of the oscillator
+ * drift. The estimate is slewed out continuously between syncs and lets the
+ * sync interval grow (up to NTP_MAX_UPDATE_INTERVAL_MS) while the residual
+ * offset stays within TIME_ACCURACY_BOUND_MS. It is kept in NVS across reboots.
+ * The policy itself is in clock_discipline.h.
+ */
+
+namespace time_sync {
+
+enum class Status : uint8_t {
+    NotSynced = 0, // no server response yet, the clock runs from the RTC only
+    Stepped = 1,   // the clock was set at once
+    Slewing = 2,   // a correction is being applied gradually
+    Synced = 3,    // the last correction has been fully applied
+};
+
+/**
+ * @brief Called after each server response, from the lwIP (tcpip) thread, and
+ * with Synced once its slew is complete, from the esp_timer task.
+ *
+ * Must not block; notify a task if more work is needed.
+ * @param offset_us Server time minus local time at the moment of the response.
+ */
+using StatusCallback = void (*)(Status status, int64_t offset_us);
+
+/**
+ * @brief Starts periodic synchronization with NTP_SERVER.
+ *
+ * Returns immediately; the first result is reported through @p callback.
+ */
+void start(StatusCallback callback);
+
+/**
+ * @brief Marks the clock valid if it survived a reset.
+ *
+ * The RTC timer keeps the system time through software resets, watchdog
+ * resets and sleep; only a power-on starts again from 1970. Call before
+ * start(); the first server response then slews instead of stepping when
+ * the offset is small.
+ * @param not_before A time the clock is known to have passed, e.g. from a
+ * snapshot taken before the reset; a clock behind it was reset.
+ * @return true if the clock holds a plausible time.
+ */
+bool adopt_rtc_time(time_t not_before = 0);
+
+/**
+ * @brief Requests a sync now, e.g. after the network link came back.
+ *
+ * No-op before start().
+ */
+void resync();
+
+/**
+ * @brief Returns the current synchronization status.
+ */
+Status status();
+
+/**
+ * @brief Returns the drift correction currently applied, in parts per billion.
+ *
+ * Positive values mean the local oscillator runs fast.
+ */
+int32_t drift_ppb();
+
+/**
+ * @brief Returns the interval until the next scheduled sync.
+ */
+uint32_t sync_interval_ms();
+
+/**
+ * @brief Tells whether the system clock has been set at least once.
+ */
+bool is_time_valid();
+
+/**
+ * @brief Blocks the calling task until the clock is valid or the timeout expires.
+ * @return true if the clock is valid.
+ */
+bool wait_for_valid_time(TickType_t timeout);
+
+} // namespace time_sync
@@ -5,10 +5,18 @@
  * @file time_utils.h
  * @brief Utility functions for time management and formatting.
  *
- * All functions use only POSIX time functions (time, localtime_r, gmtime_r,
- * strftime) for all operations.
+ * Local time is computed by a shared LocalClock (local_clock.h), which parses
+ * the TIMEZONE rule once and advances the cached broken-down time instead of
+ * calling localtime_r() on every tick.
  */
 
+/**
+ * @brief Applies the TIMEZONE rule from config.h to the C library.
+ *
+ * Must be called once at startup, before any local time is computed.
+ */
+void init_timezone();
+
 /**
  * @brief Returns the current time as epoch seconds.
  * 
@@ -27,24 +35,6 @@ int64_t get_current_epoch_second();
  */
 unsigned long get_uptime_millis();
 
- /**
- * @brief Waits until the start of the next minute.
- *
- * This function calculates the time remaining until the next full minute
- * and puts the calling task to sleep for that duration using FreeRTOS's
- * vTaskDelay function.
- */
-void wait_until_next_minute(void);
-
-/**
- * @brief Waits until the start of the next second.
- *
- * This function calculates the time remaining until the next full second
- * and puts the calling task to sleep for that duration using FreeRTOS's
- * vTaskDelay function.
- */
-void wait_until_next_second(void);
-
 /**
  * @brief Returns the current second within the current minute.
  *
@@ -68,7 +58,7 @@ int get_GMT_hour();
  * @brief Retrieves the current local time as a struct tm.
  *
  * This function gets the current system time and converts it to local time
- * using the local timezone settings.
+ * using the TIMEZONE rule. Safe to call from any task.
  * @return struct tm representing the current local time.
  */
 struct tm get_local_time();
@@ -77,9 +67,7 @@ struct tm get_local_time();
  * @brief Returns the current local time as a formatted string.
  *
  * This function retrieves the current system time, converts it to local time,
- * and formats it as a string in the form "🕒 Real time: YYYY-MM-DD HH:MM:SS".
- * It uses only POSIX time functions (time, localtime_r, strftime) for all
- * operations.
+ * and formats it with strftime, by default as "YYYY-MM-DD HH:MM:SS".
  *
  * @return String containing the formatted local time.
  */
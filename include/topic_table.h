@@ -0,0 +1,93 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/**
+ * @file topic_table.h
+ * @brief Fixed-capacity lookup table from MQTT topic to handler.
+ *
+ * Topics are formatted once (e.g. on connect) into inline storage and sorted
+ * by (length, bytes). A lookup is a binary search on the length-prefixed key,
+ * so dispatching a message needs no heap allocation and no formatting.
+ *
+ * Header-only. test_topic_table checks the lookups and compares dispatch
+ * time with a linear scan as the number of relays grows.
+ */
+
+template <size_t CAPACITY, size_t TOPIC_MAX> class TopicTable {
+    static_assert(TOPIC_MAX <= 256, "topic length is stored in a byte");
+
+  public:
+    struct Entry {
+        char topic[TOPIC_MAX];
+        uint8_t len;
+        uint8_t kind; // caller-defined handler type
+        uint8_t arg;  // caller-defined handler argument, e.g. a relay index
+
+        std::string_view view() const { return {topic, len}; }
+    };
+
+    void clear() { size_ = 0; }
+
+    /**
+     * @brief Adds a topic; call build() after the last add().
+     * @return false if the table is full or the topic does not fit.
+     */
+    bool add(const std::string_view topic, const uint8_t kind, const uint8_t arg = 0) {
+        if (size_ >= CAPACITY || topic.size() >= TOPIC_MAX)
+            return false;
+        Entry& e = entries_[size_++];
+        std::memcpy(e.topic, topic.data(), topic.size());
+        e.topic[topic.size()] = '\0';
+        e.len = static_cast<uint8_t>(topic.size());
+        e.kind = kind;
+        e.arg = arg;
+        return true;
+    }
+
+    /**
+     * @brief Sorts the entries for lookup.
+     */
+    void build() { std::sort(entries_, entries_ + size_, less); }
+
+    /**
+     * @brief Finds the entry for a topic.
+     * @return nullptr if the topic is not in the table.
+     */
+    const Entry* find(const std::string_view topic) const {
+        if (topic.size() >= TOPIC_MAX)
+            return nullptr;
+        size_t lo = 0, hi = size_;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            const int c = compare(entries_[mid], topic);
+            if (c == 0)
+                return &entries_[mid];
+            if (c < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return nullptr;
+    }
+
+    size_t size() const { return size_; }
+    const Entry* begin() const { return entries_; }
+    const Entry* end() const { return entries_ + size_; }
+
+  private:
+    // Length first: most topics share a long common prefix, lengths differ cheaply.
+    static int compare(const Entry& e, const std::string_view topic) {
+        if (e.len != topic.size())
+            return e.len < topic.size() ? -1 : 1;
+        return std::memcmp(e.topic, topic.data(), e.len);
+    }
+
+    static bool less(const Entry& a, const Entry& b) { return compare(a, b.view()) < 0; }
+
+    Entry entries_[CAPACITY]{};
+    size_t size_ = 0;
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+
+#include "config.h"
+#include "esp_http_server.h"
+
+/**
+ * @file trace.h
+ * @brief Event tracer for finding where the latency goes between an interrupt and the pixels.
+ *
+ * Every core has a fixed ring of TRACE_EVENTS_PER_CORE events; the newest
+ * events overwrite the oldest. Recording claims a slot with an atomic
+ * increment and stamps it with esp_timer_get_time(), so it takes no lock,
+ * allocates nothing and works from ISRs, also while the flash cache is
+ * disabled. Event names must be string literals; only the pointer is kept.
+ *
+ * GET /trace on the development HTTP server returns the rings in the Chrome
+ * trace event format, to be opened in chrome://tracing or ui.perfetto.dev.
+ * Spans are shown per task, ISR events per core. Recording pauses while the
+ * dump is sent; /trace?clear=1 empties the rings afterwards.
+ *
+ * Without ENABLE_TRACE the trace points compile to nothing.
+ */
+
+namespace trace {
+
+#ifdef ENABLE_TRACE
+void begin(const char* name);
+void end(const char* name);
+void instant(const char* name);
+
+/**
+ * @brief Adds the /trace handler to a running HTTP server.
+ */
+void register_uri(httpd_handle_t server);
+#else
+inline void begin(const char*) {}
+inline void end(const char*) {}
+inline void instant(const char*) {}
+inline void register_uri(httpd_handle_t) {}
+#endif
+
+/**
+ * @brief Traces the enclosing block as one span.
+ */
+class Scope {
+  public:
+    explicit Scope(const char* name) : name_(name) { begin(name_); }
+    ~Scope() { end(name_); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char* name_;
+};
+
+} // namespace trace
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+#include "display_pages.h"
+#include "forecast.h"
+#include "relays_app.h"
+
+/**
+ * @file warm_state.h
+ * @brief Runtime state kept in RTC memory across software resets.
+ *
+ * RTC slow memory is not cleared by esp_restart(), a panic or a watchdog
+ * reset, so the last known time, forecast, relay states and page are kept
+ * there in a CRC-protected snapshot. Each owner refreshes its own part as it
+ * changes; a refresh only copies the part and recomputes the CRC.
+ *
+ * begin() decides between a warm and a cold boot: after a power-on, a
+ * brown-out or an invalid snapshot nothing is restored and the device boots
+ * as before.
+ */
+
+namespace warm_state {
+
+/**
+ * @brief Validates the snapshot left by the previous run. Call first in setup().
+ * @return true if this is a warm boot with a valid snapshot.
+ */
+bool begin();
+
+bool is_warm();
+
+void save_time(time_t now);
+void save_forecast(const ForecastData16& forecast, time_t fetched_at);
+void save_relays(RelayMask mask);
+void save_page(DisplayPage page);
+
+/**
+ * @brief The last valid time saved before the restart.
+ * @return false on a cold boot or if no valid time was saved.
+ */
+bool restored_time(time_t& saved_at);
+
+/**
+ * @return false on a cold boot or if no forecast was saved.
+ */
+bool restored_forecast(ForecastData16& forecast, time_t& fetched_at);
+
+/**
+ * @return false on a cold boot or if the relays were not initialized before the restart.
+ */
+bool restored_relays(RelayMask& mask);
+
+/**
+ * @return false on a cold boot.
+ */
+bool restored_page(DisplayPage& page);
+
+} // namespace warm_state
@@ -0,0 +1,103 @@
+#include "ambient_light.h"
+
+#include "brightness_curve.h"
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+#include <Wire.h>
+
+namespace ambient_light {
+
+namespace {
+constexpr auto TAG = "ALS";
+
+constexpr uint8_t APDS9960_I2C_ADDR = 0x39;
+constexpr uint8_t APDS9960_CICLEAR = 0xE6; // clears the ALS interrupt only
+
+constexpr brightness::CurveConfig CURVE{ALS_DARK_COUNT,        ALS_BRIGHT_COUNT,
+                                       DISPLAY_BRIGHTNESS,    DISPLAY_BRIGHTNESS_MAX,
+                                       ALS_HYSTERESIS_LEVELS, ALS_SMOOTHING_SHIFT};
+
+TaskHandle_t task_handle = nullptr;
+IntensitySetter setter = nullptr;
+
+// Adafruit's clearInterrupt() hits AICLEAR, which would also drop a pending
+// proximity interrupt meant for the gesture task.
+void clear_als_interrupt() {
+    Wire.beginTransmission(APDS9960_I2C_ADDR);
+    Wire.write(APDS9960_CICLEAR);
+    Wire.endTransmission();
+}
+
+uint16_t read_clear(Adafruit_APDS9960& sensor) {
+    uint16_t r, g, b, c;
+    sensor.getColorData(&r, &g, &b, &c);
+    return c;
+}
+
+[[noreturn]] void ambient_light_task(void* pvParameters) {
+    auto& sensor = *static_cast<Adafruit_APDS9960*>(pvParameters);
+    brightness::Controller controller(CURVE);
+    uint8_t applied = 0xFF;
+
+    for (;;) {
+        uint16_t clear = read_clear(sensor);
+        controller.update(clear);
+        // After a step in ambient light keep sampling until the filter catches up;
+        // otherwise the level would stay at a half-way value until the next interrupt.
+        while (!controller.settled(clear, ALS_THRESHOLD_WINDOW_PERCENT)) {
+            vTaskDelay(pdMS_TO_TICKS(ALS_SETTLE_INTERVAL_MS));
+            clear = read_clear(sensor);
+            controller.update(clear);
+        }
+
+        if (controller.level() != applied) {
+            applied = controller.level();
+            ESP_LOGI(TAG, "clear=%u smoothed=%u -> intensity %u", clear, controller.smoothed(),
+                     applied);
+            setter(applied);
+        }
+
+        const brightness::ThresholdWindow w =
+            brightness::interrupt_window(clear, ALS_THRESHOLD_WINDOW_PERCENT);
+        sensor.setIntLimits(w.low, w.high);
+        clear_als_interrupt();
+
+        // The interrupt is the normal wake-up path; the timeout only catches slow drifts
+        // that stay inside the window for a long time.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ALS_IDLE_RESAMPLE_MS));
+    }
+}
+} // namespace
+
+bool start(Adafruit_APDS9960& sensor, const IntensitySetter set_intensity) {
+    setter = set_intensity;
+
+    sensor.setADCIntegrationTime(ALS_INTEGRATION_MS);
+    sensor.setADCGain(APDS9960_AGAIN_4X);
+    sensor.enableColor(true);
+    sensor.enableColorInterrupt();
+
+    if (xTaskCreate(ambient_light_task, "Ambient Light", 3072, &sensor, tskIDLE_PRIORITY + 1,
+                    &task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task");
+        sensor.disableColorInterrupt();
+        sensor.enableColor(false);
+        task_handle = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "Adaptive brightness started");
+    return true;
+}
+
+void IRAM_ATTR notify_from_isr(BaseType_t* higher_priority_task_woken) {
+    if (task_handle)
+        vTaskNotifyGiveFromISR(task_handle, higher_priority_task_woken);
+}
+
+void notify() {
+    if (task_handle)
+        xTaskNotifyGive(task_handle);
+}
+
+} // namespace ambient_light
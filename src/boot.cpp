@@ -0,0 +1,186 @@
+#include "boot.h"
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_private/esp_clk.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+namespace boot {
+
+namespace {
+constexpr auto TAG = "BOOT";
+constexpr EventBits_t ONLINE_DEPS =
+    bit(Stage::LinkUp) | bit(Stage::TimeValid) | bit(Stage::Services) | bit(Stage::Forecast);
+static_assert(STAGE_COUNT <= 24, "event groups carry 24 bits");
+
+constexpr uint32_t RESTART_STAMP_MAGIC = 0x52535453; // "RSTS"
+
+struct Spawned {
+    Stage stage;
+    StageFn fn;
+    EventBits_t deps;
+};
+
+StaticEventGroup_t events_buf;
+EventGroupHandle_t events = xEventGroupCreateStatic(&events_buf);
+portMUX_TYPE stages_lock = portMUX_INITIALIZER_UNLOCKED;
+Profile profile; // guarded by stages_lock
+Spawned spawned[STAGE_COUNT];
+Listener listener = nullptr;
+esp_reset_reason_t reset_reason = ESP_RST_UNKNOWN;
+int64_t reset_to_app_us = -1;
+
+// RTC time of the last esp_restart(), kept through the reset.
+RTC_NOINIT_ATTR uint64_t restart_rtc_us;
+RTC_NOINIT_ATTR uint32_t restart_stamp_magic;
+
+// Taken while static constructors run, before any stage can be marked.
+int64_t app_start_us = -1;
+uint64_t app_start_rtc_us = 0;
+
+__attribute__((constructor)) void on_app_start() {
+    app_start_us = esp_timer_get_time();
+    app_start_rtc_us = esp_clk_rtc_time();
+}
+
+void stamp_restart() {
+    restart_rtc_us = esp_clk_rtc_time();
+    restart_stamp_magic = RESTART_STAMP_MAGIC;
+}
+
+Profile snapshot() {
+    taskENTER_CRITICAL(&stages_lock);
+    const Profile copy = profile;
+    taskEXIT_CRITICAL(&stages_lock);
+    return copy;
+}
+
+// A boot graph changed by mistake shows up here, long before anyone reads the profile.
+void check(const Stage stage) {
+    const Profile copy = snapshot();
+    if (!in_order(copy, stage))
+        ESP_LOGE(TAG, "%s reached before one of the stages it depends on", stage_name(stage));
+    if (stage == Stage::FirstFrame && !first_frame_within(copy, BOOT_FIRST_FRAME_BOUND_US))
+        ESP_LOGE(TAG, "First frame after %lld ms, bound %lld ms",
+                 (copy.at_us(Stage::FirstFrame) - copy.at_us(Stage::AppStart)) / 1000,
+                 BOOT_FIRST_FRAME_BOUND_US / 1000);
+}
+
+void stage_task(void* arg) {
+    const auto* s = static_cast<const Spawned*>(arg);
+    if (s->deps)
+        xEventGroupWaitBits(events, s->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    const int64_t start_us = esp_timer_get_time();
+    s->fn();
+    ESP_LOGI(TAG, "%s took %lld ms", stage_name(s->stage),
+             (esp_timer_get_time() - start_us) / 1000);
+    mark(s->stage);
+    vTaskDelete(nullptr);
+}
+} // namespace
+
+void begin() {
+    reset_reason = esp_reset_reason();
+    const bool restarted = reset_reason == ESP_RST_SW &&
+                           restart_stamp_magic == RESTART_STAMP_MAGIC &&
+                           restart_rtc_us <= app_start_rtc_us;
+    restart_stamp_magic = 0;
+    // The RTC timer starts at power-on and keeps running through esp_restart().
+    if (reset_reason == ESP_RST_POWERON)
+        reset_to_app_us = static_cast<int64_t>(app_start_rtc_us) - app_start_us;
+    else if (restarted)
+        reset_to_app_us = static_cast<int64_t>(app_start_rtc_us - restart_rtc_us) - app_start_us;
+    esp_register_shutdown_handler(stamp_restart);
+
+    taskENTER_CRITICAL(&stages_lock);
+    profile.record(Stage::AppStart, app_start_us);
+    taskEXIT_CRITICAL(&stages_lock);
+    xEventGroupSetBits(events, bit(Stage::AppStart));
+    if (reset_to_app_us >= 0)
+        ESP_LOGI(TAG, "Reset reason %d, application started %lld ms after the reset",
+                 static_cast<int>(reset_reason), reset_to_app_us / 1000);
+    else
+        ESP_LOGI(TAG, "Reset reason %d", static_cast<int>(reset_reason));
+    mark(Stage::Setup);
+}
+
+void mark(const Stage stage) {
+    const int64_t now_us = esp_timer_get_time();
+    taskENTER_CRITICAL(&stages_lock);
+    const bool first = profile.record(stage, now_us);
+    taskEXIT_CRITICAL(&stages_lock);
+    if (!first)
+        return;
+
+    const EventBits_t bits = xEventGroupSetBits(events, bit(stage));
+    ESP_LOGI(TAG, "%s at %lld ms", stage_name(stage), now_us / 1000);
+    check(stage);
+    if (listener)
+        listener(stage);
+    if (stage == Stage::Online)
+        log_profile();
+    if (stage != Stage::Online && (bits & ONLINE_DEPS) == ONLINE_DEPS)
+        mark(Stage::Online);
+}
+
+bool reached(const Stage stage) {
+    return (xEventGroupGetBits(events) & bit(stage)) != 0;
+}
+
+bool wait(const EventBits_t stages, const TickType_t timeout) {
+    return (xEventGroupWaitBits(events, stages, pdFALSE, pdTRUE, timeout) & stages) == stages;
+}
+
+bool spawn(const Stage stage, const StageFn fn, const EventBits_t deps, const uint32_t stack_size,
+           const UBaseType_t priority) {
+    const auto idx = static_cast<size_t>(stage);
+    if (idx >= STAGE_COUNT || !fn)
+        return false;
+    spawned[idx] = {stage, fn, deps};
+    if (xTaskCreate(stage_task, stage_name(stage), stack_size, &spawned[idx], priority, nullptr) !=
+        pdPASS) {
+        ESP_LOGE(TAG, "Failed to start stage %s", stage_name(stage));
+        return false;
+    }
+    return true;
+}
+
+int64_t at_us(const Stage stage) {
+    taskENTER_CRITICAL(&stages_lock);
+    const int64_t at = profile.at_us(stage);
+    taskEXIT_CRITICAL(&stages_lock);
+    return at;
+}
+
+const char* stage_name(const Stage stage) {
+    const auto idx = static_cast<size_t>(stage);
+    return idx < STAGE_COUNT ? STAGE_NAMES[idx] : "?";
+}
+
+int64_t bootloader_us() {
+    return reset_to_app_us;
+}
+
+void set_listener(const Listener on_stage) {
+    listener = on_stage;
+}
+
+int format_profile(char* buf, const size_t size) {
+    return snapshot().format(buf, size, static_cast<int>(reset_reason), reset_to_app_us);
+}
+
+void log_profile() {
+    if (reset_to_app_us >= 0)
+        ESP_LOGI(TAG, "%-10s %7lld ms", "Bootloader", reset_to_app_us / 1000);
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        if (const int64_t at = at_us(static_cast<Stage>(i)); at >= 0)
+            ESP_LOGI(TAG, "%-10s %7lld ms", STAGE_NAMES[i], at / 1000);
+        else
+            ESP_LOGI(TAG, "%-10s pending", STAGE_NAMES[i]);
+    }
+}
+
+} // namespace boot
@@ -108,6 +108,31 @@ void format_temp_at_hour(char* buf, size_t bufsize, ForecastData<STORED_HOURS>&
 template void format_temp_at_hour<FORECAST_HOURS>(char* buf, size_t bufsize,
                                                   ForecastData<FORECAST_HOURS>& data, int hour);
 
+template <uint8_t STORED_HOURS>
+bool forecast_from_packet(const ForecastPacket& packet, const time_t now,
+                          ForecastData<STORED_HOURS>& out) {
+    const time_t current_hour = now - now % 3600;
+    if (current_hour < static_cast<time_t>(packet.start_epoch))
+        return false; // starts in the future: either the packet or our clock is wrong
+    const auto offset = static_cast<size_t>((current_hour - packet.start_epoch) / 3600);
+    if (offset + STORED_HOURS > packet.hours)
+        return false;
+
+    out.start_hour = static_cast<int>(current_hour / 3600 % 24);
+    for (size_t i = 0; i < STORED_HOURS; ++i) {
+        const float temp = packet.temps_c100[offset + i] / 100.f;
+        out.hourly_temps[i] = temp;
+        out.precipitation_probability[i] = packet.precip_percent[offset + i];
+        if (i == 0 || temp < out.min_temp)
+            out.min_temp = temp;
+        if (i == 0 || temp > out.max_temp)
+            out.max_temp = temp;
+    }
+    return true;
+}
+template bool forecast_from_packet<FORECAST_HOURS>(const ForecastPacket& packet, time_t now,
+                                                   ForecastData<FORECAST_HOURS>& out);
+
 void format_temp_range(char* buf, size_t bufsize, float min, float max) {
     if (!buf || bufsize == 0)
         return;
@@ -0,0 +1,281 @@
+#include "local_clock.h"
+
+#include <cctype>
+#include <limits>
+
+namespace {
+
+constexpr int64_t SECONDS_PER_DAY = 86400;
+
+int64_t floor_div(const int64_t a, const int64_t b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+bool is_leap(const int64_t y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+int month_length(const int64_t y, const unsigned m) {
+    static constexpr uint8_t DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return m == 2 && is_leap(y) ? 29 : DAYS[m - 1];
+}
+
+// Inverse of LocalClock::days_from_civil(), see http://howardhinnant.github.io/date_algorithms.html
+void civil_from_days(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    const int64_t era = floor_div(z, 146097);
+    const auto doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+int weekday_from_days(const int64_t days) {
+    const int64_t wd = (days + 4) % 7; // 1970-01-01 was a Thursday
+    return static_cast<int>(wd < 0 ? wd + 7 : wd);
+}
+
+const char* parse_number(const char* p, int& out) {
+    if (!std::isdigit(static_cast<unsigned char>(*p)))
+        return nullptr;
+    out = 0;
+    while (std::isdigit(static_cast<unsigned char>(*p)))
+        out = out * 10 + (*p++ - '0');
+    return p;
+}
+
+// Zone abbreviation: at least three letters, or anything quoted in <...>.
+const char* parse_name(const char* p) {
+    if (*p == '<') {
+        while (*p && *p != '>')
+            ++p;
+        return *p ? p + 1 : nullptr;
+    }
+    const char* start = p;
+    while (std::isalpha(static_cast<unsigned char>(*p)))
+        ++p;
+    return p - start >= 3 ? p : nullptr;
+}
+
+// [+|-]hh[:mm[:ss]]
+const char* parse_hms(const char* p, int32_t& out) {
+    int sign = 1;
+    if (*p == '+' || *p == '-') {
+        sign = *p == '-' ? -1 : 1;
+        ++p;
+    }
+    int h = 0, m = 0, s = 0;
+    if (!(p = parse_number(p, h)))
+        return nullptr;
+    if (*p == ':' && !(p = parse_number(p + 1, m)))
+        return nullptr;
+    if (*p == ':' && !(p = parse_number(p + 1, s)))
+        return nullptr;
+    out = sign * (h * 3600 + m * 60 + s);
+    return p;
+}
+
+const char* parse_rule(const char* p, TzTransitionRule& rule) {
+    int a = 0, b = 0, c = 0;
+    if (*p == 'M') {
+        if (!(p = parse_number(p + 1, a)) || *p != '.' || !(p = parse_number(p + 1, b)) ||
+            *p != '.' || !(p = parse_number(p + 1, c)))
+            return nullptr;
+        if (a < 1 || a > 12 || b < 1 || b > 5 || c > 6)
+            return nullptr;
+        rule.kind = TzTransitionRule::Kind::MonthWeekDay;
+        rule.month = a;
+        rule.week = b;
+        rule.weekday = c;
+    } else if (*p == 'J') {
+        if (!(p = parse_number(p + 1, a)) || a < 1 || a > 365)
+            return nullptr;
+        rule.kind = TzTransitionRule::Kind::Julian1;
+        rule.day = a;
+    } else {
+        if (!(p = parse_number(p, a)) || a > 365)
+            return nullptr;
+        rule.kind = TzTransitionRule::Kind::Julian0;
+        rule.day = a;
+    }
+    rule.time_s = 2 * 3600;
+    if (*p == '/' && !(p = parse_hms(p + 1, rule.time_s)))
+        return nullptr;
+    return p;
+}
+
+} // namespace
+
+int64_t LocalClock::days_from_civil(int64_t y, const unsigned m, const unsigned d) {
+    y -= m <= 2;
+    const int64_t era = floor_div(y, 400);
+    const auto yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+bool LocalClock::set_timezone(const char* posix_tz) {
+    valid_ = false;
+    tz_ = TzInfo{};
+
+    TzInfo tz;
+    const char* p = posix_tz ? parse_name(posix_tz) : nullptr;
+    int32_t offset = 0;
+    if (!p || !(p = parse_hms(p, offset)))
+        return false;
+    // POSIX offsets count westwards: "CET-1" is one hour east of UTC.
+    tz.std_offset_s = -offset;
+
+    if (*p) {
+        if (!(p = parse_name(p)))
+            return false;
+        tz.has_dst = true;
+        tz.dst_offset_s = tz.std_offset_s + 3600;
+        if (*p && *p != ',') {
+            if (!(p = parse_hms(p, offset)))
+                return false;
+            tz.dst_offset_s = -offset;
+        }
+        if (*p == ',') {
+            if (!(p = parse_rule(p + 1, tz.dst_start)) || *p != ',' ||
+                !(p = parse_rule(p + 1, tz.dst_end)))
+                return false;
+        } else {
+            // No rule given: same default as glibc (US rules since 2007).
+            tz.dst_start = {TzTransitionRule::Kind::MonthWeekDay, 3, 2, 0, 0, 2 * 3600};
+            tz.dst_end = {TzTransitionRule::Kind::MonthWeekDay, 11, 1, 0, 0, 2 * 3600};
+        }
+    }
+    if (*p)
+        return false;
+
+    tz_ = tz;
+    return true;
+}
+
+time_t LocalClock::transition_utc(const int64_t year, const TzTransitionRule& rule,
+                                  const int32_t wall_offset_s) const {
+    const int64_t jan1 = days_from_civil(year, 1, 1);
+    int64_t days = 0;
+    switch (rule.kind) {
+    case TzTransitionRule::Kind::MonthWeekDay: {
+        const int64_t first = days_from_civil(year, rule.month, 1);
+        int d = (rule.weekday - weekday_from_days(first) + 7) % 7 + 7 * (rule.week - 1);
+        while (d >= month_length(year, rule.month))
+            d -= 7;
+        days = first + d;
+        break;
+    }
+    case TzTransitionRule::Kind::Julian1:
+        days = jan1 + rule.day - 1 + (is_leap(year) && rule.day >= 60 ? 1 : 0);
+        break;
+    case TzTransitionRule::Kind::Julian0:
+        days = jan1 + rule.day;
+        break;
+    }
+    return static_cast<time_t>(days * SECONDS_PER_DAY + rule.time_s - wall_offset_s);
+}
+
+LocalClock::Period LocalClock::period_at(const time_t utc) const {
+    if (!tz_.has_dst) {
+        return {std::numeric_limits<time_t>::min(), std::numeric_limits<time_t>::max(),
+                tz_.std_offset_s, false};
+    }
+
+    int64_t year;
+    unsigned m, d;
+    civil_from_days(floor_div(utc + tz_.std_offset_s, SECONDS_PER_DAY), year, m, d);
+
+    // Transitions of the surrounding years, in chronological order within each year.
+    struct Transition {
+        time_t at;
+        bool to_dst;
+    };
+    Transition t[6];
+    size_t n = 0;
+    for (int64_t y = year - 1; y <= year + 1; ++y) {
+        const Transition start{transition_utc(y, tz_.dst_start, tz_.std_offset_s), true};
+        const Transition end{transition_utc(y, tz_.dst_end, tz_.dst_offset_s), false};
+        // Southern hemisphere rules end DST before starting it within a year.
+        t[n++] = start.at < end.at ? start : end;
+        t[n++] = start.at < end.at ? end : start;
+    }
+
+    for (size_t i = n - 1; i > 0; --i) {
+        if (t[i - 1].at <= utc && utc < t[i].at) {
+            const bool dst = t[i - 1].to_dst;
+            return {t[i - 1].at, t[i].at, dst ? tz_.dst_offset_s : tz_.std_offset_s, dst};
+        }
+    }
+    // Unreachable for sane rules; fall back to standard time for one day.
+    return {utc, utc + SECONDS_PER_DAY, tz_.std_offset_s, false};
+}
+
+int32_t LocalClock::utc_offset_at(const time_t utc) const {
+    return period_at(utc).offset_s;
+}
+
+time_t LocalClock::next_transition_after(const time_t utc) const {
+    return tz_.has_dst ? period_at(utc).until : 0;
+}
+
+void LocalClock::fill_tm(const int64_t local_s, tm& out) {
+    const int64_t days = floor_div(local_s, SECONDS_PER_DAY);
+    const auto sod = static_cast<int>(local_s - days * SECONDS_PER_DAY);
+    int64_t y;
+    unsigned m, d;
+    civil_from_days(days, y, m, d);
+    out.tm_year = static_cast<int>(y - 1900);
+    out.tm_mon = static_cast<int>(m - 1);
+    out.tm_mday = static_cast<int>(d);
+    out.tm_hour = sod / 3600;
+    out.tm_min = sod / 60 % 60;
+    out.tm_sec = sod % 60;
+    out.tm_wday = weekday_from_days(days);
+    out.tm_yday = static_cast<int>(days - days_from_civil(y, 1, 1));
+}
+
+// Adds less than a day to a broken-down time without leaving the current UTC offset.
+void LocalClock::advance(tm& t, const int64_t seconds) {
+    int64_t sod = t.tm_hour * 3600 + t.tm_min * 60 + t.tm_sec + seconds;
+    if (sod >= SECONDS_PER_DAY) {
+        sod -= SECONDS_PER_DAY;
+        t.tm_wday = (t.tm_wday + 1) % 7;
+        ++t.tm_yday;
+        if (++t.tm_mday > month_length(t.tm_year + 1900, t.tm_mon + 1)) {
+            t.tm_mday = 1;
+            if (++t.tm_mon == 12) {
+                t.tm_mon = 0;
+                ++t.tm_year;
+                t.tm_yday = 0;
+            }
+        }
+    }
+    t.tm_hour = static_cast<int>(sod / 3600);
+    t.tm_min = static_cast<int>(sod / 60 % 60);
+    t.tm_sec = static_cast<int>(sod % 60);
+}
+
+void LocalClock::derive(const time_t utc) {
+    period_ = period_at(utc);
+    fill_tm(static_cast<int64_t>(utc) + period_.offset_s, cached_tm_);
+    cached_tm_.tm_isdst = period_.dst ? 1 : 0;
+    cached_utc_ = utc;
+    valid_ = true;
+    ++derivations_;
+}
+
+tm LocalClock::to_local(const time_t utc) {
+    if (valid_ && utc >= cached_utc_ && utc < period_.until &&
+        utc - cached_utc_ < SECONDS_PER_DAY) {
+        advance(cached_tm_, utc - cached_utc_);
+        cached_utc_ = utc;
+    } else {
+        derive(utc);
+    }
+    return cached_tm_;
+}
@@ -1,5 +1,6 @@
 #include "driver/i2c.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "mdns.h"
@@ -8,13 +9,13 @@
 #include <Arduino.h>
 #include <MD_MAX72xx.h>
 #include <MD_Parola.h>
-#include <NTPClient.h>
 #include <WiFi.h>
-#include <WiFiUdp.h>
 #include <cstdio>
 #include <ctime>
 
+#include "ambient_light.h"
 #include "apds9960.h"
+#include "boot.h"
 #include "config.h"
 #include "display_pages.h"
 #include "font.h"
@@ -23,9 +24,20 @@
 #include "mem_mon.h"
 #include "mqtt.h"
 #include "net_utils.h"
+#include "night_mode.h"
+#include "notifications.h"
 #include "ota.h"
+#include "power.h"
 #include "reboot_control.h"
+#include "relay_scheduler.h"
+#include "relays_app.h"
+#include "scheduler.h"
+#include "task_profiler.h"
+#include "telemetry.h"
+#include "time_sync.h"
 #include "time_utils.h"
+#include "trace.h"
+#include "warm_state.h"
 
 namespace {
 constexpr const char* TAG_MAIN = "MAIN";
@@ -35,15 +47,10 @@ constexpr const char* TAG_GESTURE = "GESTURE";
 constexpr const char* TAG_DISPLAY = "DISPLAY";
 constexpr const char* TAG_I2C = "I2C";
 constexpr const char* TAG_MDNS = "MDNS";
-constexpr const char* TAG_NTP = "NTP";
 } // namespace
 
 volatile DisplayPage current_page = DisplayPage::Time;
 
-WiFiUDP net_UDP;
-NTPClient timeClient(net_UDP, NTP_SERVER, 0, NTP_UPDATE_INTERVAL_MS); // UTC offset 0
-
-bool wifi_enabled = false;
 bool gestures_enabled = false;
 bool forecast_enabled = true;
 
@@ -58,8 +65,18 @@ String time_data = "Err time";
 ForecastData16 forecast_data{};
 ForecastData16 forecast_err_data{0, 0, {0.f}, {0.f}, 0};
 SemaphoreHandle_t display_data_sem;
+#ifdef ENABLE_FORECAST_PUSH
+ForecastPacket pushed_forecast{}; // guarded by display_data_sem
+int64_t pushed_forecast_at_us = 0; // guarded by display_data_sem; 0 until a forecast is pushed
+#endif
 
 static TaskHandle_t gestureTaskHandle = nullptr;
+scheduler::JobId second_job = scheduler::INVALID_JOB;
+volatile scheduler::JobId weather_job = scheduler::INVALID_JOB;
+uint8_t display_intensity = DISPLAY_BRIGHTNESS; // last adaptive level, guarded by display_data_sem
+time_t warm_forecast_at = 0; // fetch time of a forecast kept through a warm restart, 0 if none
+
+constexpr int64_t US_PER_SECOND = 1000000LL;
 
 void display_time(const String& time, MD_Parola& parolaDisplay);
 
@@ -68,6 +85,69 @@ void display_forecast_chart();
 void display_temperature_range();
 void display_precip_chart();
 void display_seconds(int current_second);
+void display_ota_progress(const OtaProgress& progress);
+
+/**
+ * @brief Switches the page and records it in the warm-restart snapshot.
+ *
+ * The caller must hold display_data_sem.
+ */
+void set_page(const DisplayPage page) {
+    current_page = page;
+    warm_state::save_page(page);
+}
+
+#ifdef ENABLE_FORECAST_PUSH
+/**
+ * @brief Refreshes forecast_data from the last pushed forecast.
+ *
+ * The caller must hold display_data_sem.
+ * @return false if there is no recent pushed forecast covering the coming hours.
+ */
+bool apply_pushed_forecast() {
+    if (pushed_forecast_at_us == 0 ||
+        esp_timer_get_time() - pushed_forecast_at_us > FORECAST_PUSH_MAX_AGE_S * US_PER_SECOND)
+        return false;
+    ForecastData16 forecast{};
+    if (!forecast_from_packet(pushed_forecast, time(nullptr), forecast))
+        return false;
+    forecast_data = forecast;
+    warm_state::save_forecast(forecast_data, time(nullptr));
+    return true;
+}
+
+/**
+ * @brief Receives a binary forecast pushed over MQTT (runs in the MQTT task).
+ */
+void onForecastPacket(const uint8_t* data, const size_t len) {
+    static ForecastPacket packet; // decoded outside of the lock
+    if (const ForecastPacketError err = decode_forecast_packet(data, len, packet);
+        err != ForecastPacketError::None) {
+        ESP_LOGW(TAG_WEATHER, "Rejected pushed forecast: %s", forecast_packet_error_name(err));
+        return;
+    }
+    if (xSemaphoreTake(display_data_sem, portMAX_DELAY) != pdTRUE)
+        return;
+    pushed_forecast = packet;
+    pushed_forecast_at_us = esp_timer_get_time();
+    const bool applied = apply_pushed_forecast();
+    xSemaphoreGive(display_data_sem);
+    if (applied) {
+        ESP_LOGI(TAG_WEATHER, "Forecast updated from push (%u hours).", packet.hours);
+        boot::mark(boot::Stage::Forecast);
+    } else {
+        ESP_LOGW(TAG_WEATHER, "Pushed forecast does not cover the coming hours, kept for later.");
+    }
+}
+#endif
+
+int64_t weather_period_us() {
+#ifdef ENABLE_NIGHT_MODE
+    if (night_mode::is_night())
+        return NIGHT_FORECAST_INTERVAL_S * US_PER_SECOND;
+#endif
+    return 3600 * US_PER_SECOND;
+}
 
 /**
  * @brief FreeRTOS task that runs periodically to update the weather forecast.
@@ -75,16 +155,52 @@ void display_seconds(int current_second);
  */
 [[noreturn]] void weatherUpdateTask(void* pvParameters) {
     ESP_LOGI(TAG_WEATHER, "Weather update task started.");
+    // The requested forecast window starts at the current UTC hour.
+    time_sync::wait_for_valid_time(portMAX_DELAY);
+    if (warm_forecast_at != 0) {
+        // A forecast kept through a warm restart is refreshed when it would have been anyway.
+        const int64_t due_us =
+            (warm_forecast_at - time(nullptr)) * US_PER_SECOND + weather_period_us();
+        if (due_us > 0)
+            vTaskDelay(pdMS_TO_TICKS(due_us / 1000));
+    }
+    const scheduler::JobId job = weather_job = scheduler::register_job(
+        "weather", scheduler::Clock::Monotonic, weather_period_us(), scheduler::Policy::Skip);
     for (;;) { // Infinite loop for the task
+#ifdef ENABLE_FORECAST_PUSH
+        bool pushed = false;
+        if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
+            pushed = apply_pushed_forecast();
+            xSemaphoreGive(display_data_sem);
+        }
+        if (pushed) {
+            ESP_LOGI(TAG_WEATHER, "Using pushed forecast, HTTP fetch skipped.");
+            boot::mark(boot::Stage::Forecast);
+            scheduler::wait_next(job);
+            continue;
+        }
+#endif
+        // While the link is down the fetch is postponed, not failed.
+        net_utils::wait_connected(portMAX_DELAY);
         ESP_LOGI(TAG_WEATHER, "Fetching new weather forecast...");
         const int startHour = get_GMT_hour();
-        if (ForecastResult newForecast = get_forecast<FORECAST_HOURS>(startHour); newForecast) {
+        const int64_t fetch_start_us = esp_timer_get_time();
+        ForecastResult newForecast = [startHour] {
+            power::Boost boost(power::Lock::Network); // shortens the TLS handshake
+            trace::Scope span("forecast.fetch");
+            return get_forecast<FORECAST_HOURS>(startHour);
+        }();
+        const auto fetch_ms = static_cast<uint32_t>((esp_timer_get_time() - fetch_start_us) / 1000);
+        telemetry::record_forecast_fetch(newForecast.isOk(), fetch_ms);
+        if (newForecast) {
             if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
                 forecast_data = newForecast.unwrap();
+                warm_state::save_forecast(forecast_data, time(nullptr));
                 xSemaphoreGive(display_data_sem);
                 ESP_LOGI(TAG_WEATHER, "Forecast updated successfully.");
             }
             ESP_LOGI(TAG_WEATHER, "Successfully fetched forecast.");
+            boot::mark(boot::Stage::Forecast);
         } else {
             if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
                 forecast_data = forecast_err_data;
@@ -93,33 +209,57 @@ void display_seconds(int current_second);
             ESP_LOGE(TAG_WEATHER, "Error fetching forecast: %s", newForecast.unwrapErr().c_str());
         }
 
-        // Wait for one hour before the next run
-        constexpr int updateIntervalMs = 3600 * 1000; // 1 hour
-        vTaskDelay(updateIntervalMs / portTICK_PERIOD_MS);
+        scheduler::wait_next(job); // once an hour, less often at night
     }
 }
 
 [[noreturn]] void minuteChangeTask(void* pvParameters) {
     // Task that updates the time display every minute.
+    const scheduler::JobId job = scheduler::register_job(
+        "minute", scheduler::Clock::Wall, 60 * US_PER_SECOND, scheduler::Policy::Skip);
     while (true) {
-        const String tmp = format_time_for_display();
+        const String tmp =
+            time_sync::is_time_valid() ? format_time_for_display() : String("--;--");
+        if (time_sync::is_time_valid())
+            warm_state::save_time(time(nullptr));
+#ifdef ENABLE_NIGHT_MODE
+        if (time_sync::is_time_valid()) {
+            const tm local = get_local_time();
+            night_mode::update(local.tm_hour * 60 + local.tm_min);
+        }
+        // A dark display is not drawn; the time is drawn when it lights up.
+        const bool lit = night_mode::state() != night_mode::State::Night;
+#else
+        constexpr bool lit = true;
+#endif
+        trace::begin("minute.flip");
         if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
-            if (current_page == DisplayPage::Time) {
-                time_data = tmp;
+            time_data = tmp;
+            // The minute flip takes over from a notification; it is shown again later.
+            if (current_page == DisplayPage::Notification)
+                set_page(DisplayPage::Time);
+            if (current_page == DisplayPage::Time && lit) {
                 ESP_LOGI(TAG_TIME, "displayed: %s, current time: %s", time_data.c_str(),
                          get_formatted_local_time().c_str());
                 display_time(time_data, parola_display);
             }
             xSemaphoreGive(display_data_sem);
         }
+        trace::end("minute.flip");
+        boot::mark(boot::Stage::FirstFrame); // only the first minute counts
 
-        wait_until_next_minute();
+        scheduler::wait_next(job);
     }
 }
 
 [[noreturn]] void printStatusTask(void* parameter) {
     // Task that prints device uptime and local time periodically.
     char forecast_buf[12];
+    const scheduler::JobId job = scheduler::register_job(
+        "status", scheduler::Clock::Monotonic, STATUS_UPDATE_INTERVAL_SECONDS * US_PER_SECOND,
+        scheduler::Policy::Skip);
+    constexpr uint32_t STATS_EVERY_RUNS = 60 / STATUS_UPDATE_INTERVAL_SECONDS;
+    uint32_t runs = 0;
     while (true) {
         unsigned long currentMillis = millis();
         String uptime = format_millis(currentMillis);
@@ -128,21 +268,33 @@ void display_seconds(int current_second);
                           forecast_data.max_temp);
         ESP_LOGI(TAG_MAIN, "Device Uptime: %s | Real time: %s | Forecast: %s", uptime.c_str(),
                  localTime.c_str(), forecast_buf);
-        vTaskDelay(pdMS_TO_TICKS(STATUS_UPDATE_INTERVAL_SECONDS * 1000));
+        if (++runs % STATS_EVERY_RUNS == 0) {
+            scheduler::log_stats();
+            const RelayStats relays = relays_app_get_stats();
+            ESP_LOGI(TAG_MAIN,
+                     "Relays: %lu changes, %lu commits, command to GPIO in %lu us (max %lu)",
+                     static_cast<unsigned long>(relays.changes),
+                     static_cast<unsigned long>(relays.commits),
+                     static_cast<unsigned long>(relays.last_latency_us),
+                     static_cast<unsigned long>(relays.max_latency_us));
+            power::log_stats();
+            scheduler::JobStats second{};
+            if (scheduler::get_stats(second_job, second) &&
+                second.max_jitter_us > SECOND_TICK_JITTER_BOUND_US)
+                ESP_LOGW(TAG_MAIN, "Second tick up to %lld us late (bound %lld us)",
+                         second.max_jitter_us, SECOND_TICK_JITTER_BOUND_US);
+        }
+        scheduler::wait_next(job);
     }
 }
 
 void initForecastUpdate() {
     // Initialize the weather forecast task
-    display_data_sem = xSemaphoreCreateMutex();
-    if (display_data_sem == nullptr) {
-        ESP_LOGE(TAG_MAIN, "Failed to create mutex.");
-        forecast_enabled = false; // Disable forecast updates
-    }
-    if (wifi_enabled && forecast_enabled) {
+    if (forecast_enabled) {
         xTaskCreate(weatherUpdateTask, "WeatherUpdate", 8192, nullptr, 1, nullptr);
     } else {
         ESP_LOGW(TAG_WEATHER, "Weather updates are disabled.");
+        boot::mark(boot::Stage::Forecast); // nothing to wait for
     }
 }
 
@@ -165,6 +317,7 @@ ForecastPage detect_forecast_page(uint8_t proximity) {
 }
 
 void processProximity(const ForecastPage page) {
+    trace::Scope span("gesture.draw");
     if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
         switch (page) {
         case ForecastPage::TemperatureRange:
@@ -184,12 +337,35 @@ void processProximity(const ForecastPage page) {
 }
 
 void IRAM_ATTR gpio_isr_handler(void* arg) {
+    // The APDS-9960 has a single INT line shared by the proximity and ALS engines;
+    // each task checks whether the interrupt was meant for it.
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    vTaskNotifyGiveFromISR(gestureTaskHandle, &xHigherPriorityTaskWoken);
+    trace::instant("apds.irq");
+    if (gestureTaskHandle) {
+        task_profiler::mark_ready(gestureTaskHandle);
+        vTaskNotifyGiveFromISR(gestureTaskHandle, &xHigherPriorityTaskWoken);
+    }
+    ambient_light::notify_from_isr(&xHigherPriorityTaskWoken);
     if (xHigherPriorityTaskWoken == pdTRUE)
         portYIELD_FROM_ISR();
 }
 
+// Stands in for gpio_isr_handler() after a light sleep ended by the APDS-9960 line, whose
+// falling edge went unnoticed while the chip slept. Called from the idle task.
+void apds_woke_from_sleep() {
+    trace::instant("apds.wake");
+    if (gestureTaskHandle) {
+        task_profiler::mark_ready(gestureTaskHandle);
+        xTaskNotifyGive(gestureTaskHandle);
+    }
+    ambient_light::notify();
+}
+
+uint8_t read_proximity(Adafruit_APDS9960* sensor) {
+    trace::Scope span("gesture.i2c");
+    return sensor->readProximity();
+}
+
 [[noreturn]] void gestureTask(void* pvParameters) {
     const auto sensor = static_cast<Adafruit_APDS9960*>(pvParameters);
     while (true) {
@@ -197,11 +373,20 @@ void IRAM_ATTR gpio_isr_handler(void* arg) {
         ESP_LOGI(TAG_GESTURE, "Waiting for proximity notification...");
         // Block until notified by ISR. Use ulTaskNotifyTake or semaphore take.
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // clear on exit
-
+        task_profiler::mark_running();
+        trace::instant("gesture.wake");
+        {
+            trace::Scope span("gesture.i2c");
+            if (!sensor->getProximityInterrupt())
+                continue; // ALS interrupt, handled by the ambient light task
+            sensor->disableProximityInterrupt();
+        }
         ESP_LOGI(TAG_GESTURE, "Proximity notification detected");
-        sensor->disableProximityInterrupt();
+#ifdef ENABLE_NIGHT_MODE
+        night_mode::peek();
+#endif
         if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
-            current_page = DisplayPage::Forecast;
+            set_page(DisplayPage::Forecast);
             xSemaphoreGive(display_data_sem);
         }
         vTaskDelay(pdMS_TO_TICKS(10));
@@ -210,7 +395,7 @@ void IRAM_ATTR gpio_isr_handler(void* arg) {
         ESP_LOGI(TAG_GESTURE, "Waiting for proximity leave...");
         uint8_t proximity;
         auto last_page = ForecastPage::None;
-        while ((proximity = sensor->readProximity()) > 2) {
+        while ((proximity = read_proximity(sensor)) > 2) {
             if (const ForecastPage page = detect_forecast_page(proximity); page != last_page) {
                 processProximity(page);
                 last_page = page;
@@ -231,7 +416,7 @@ void IRAM_ATTR gpio_isr_handler(void* arg) {
             vTaskDelay(pdMS_TO_TICKS(left));
         }
         if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
-            current_page = DisplayPage::Time;
+            set_page(DisplayPage::Time);
             display_time(time_data, parola_display);
             xSemaphoreGive(display_data_sem);
         }
@@ -240,17 +425,192 @@ void IRAM_ATTR gpio_isr_handler(void* arg) {
     }
 }
 
-void ntpUpdateTask(void* pvParameters) {
-    // TODO: Toggle `wifi_enabled` depending on WiFi status.
-    while (wifi_enabled) {
-        vTaskDelay(pdMS_TO_TICKS(60 * 60 * 1000)); // sync with NTP servers once an hour
-        if (timeClient.update()) {
-            ESP_LOGI(TAG_NTP, "Update successful");
+#ifdef ENABLE_NOTIFICATIONS
+enum class NotifyOutcome : uint8_t {
+    Shown,
+    Interrupted, // the clock or a forecast page took the display
+    Preempted,   // a more important message arrived
+};
+
+/**
+ * @brief Shows one notification, scrolling it if it is wider than the matrix.
+ *
+ * The display mutex is only held for single animation steps, so the minute
+ * flip and the gesture pages can take over at any time.
+ */
+NotifyOutcome show_notification(const notifications::Entry& entry) {
+    if (xSemaphoreTake(display_data_sem, portMAX_DELAY) != pdTRUE)
+        return NotifyOutcome::Interrupted;
+    if (current_page != DisplayPage::Time) {
+        xSemaphoreGive(display_data_sem);
+        return NotifyOutcome::Interrupted;
+    }
+    set_page(DisplayPage::Notification);
+    const bool scroll = parola_display.getTextColumns(entry.text) > MATRIX_WIDTH;
+    parola_display.displayClear();
+    if (scroll) {
+        parola_display.displayText(entry.text, PA_LEFT, NOTIFY_SCROLL_SPEED_MS, 0, PA_SCROLL_LEFT,
+                                   PA_SCROLL_LEFT);
+    } else {
+        parola_display.setTextAlignment(PA_CENTER);
+        parola_display.print(entry.text);
+    }
+    xSemaphoreGive(display_data_sem);
+
+    const int64_t show_until_us = esp_timer_get_time() + NOTIFY_SHOW_MS * 1000LL;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(scroll ? NOTIFY_SCROLL_SPEED_MS : 100));
+        if (xSemaphoreTake(display_data_sem, portMAX_DELAY) != pdTRUE)
+            continue;
+        NotifyOutcome outcome = NotifyOutcome::Shown;
+        bool done = true;
+        if (current_page != DisplayPage::Notification)
+            outcome = NotifyOutcome::Interrupted;
+        else if (notifications::top_priority() > entry.priority)
+            outcome = NotifyOutcome::Preempted;
+        else if (scroll) {
+            power::Boost boost(power::Lock::Render);
+            done = parola_display.displayAnimate();
         } else {
-            ESP_LOGE(TAG_NTP, "Update failed");
+            done = esp_timer_get_time() >= show_until_us;
+        }
+        if (done && current_page == DisplayPage::Notification) {
+            set_page(DisplayPage::Time);
+            display_time(time_data, parola_display);
         }
+        xSemaphoreGive(display_data_sem);
+        if (done)
+            return outcome;
+    }
+}
+
+[[noreturn]] void notificationTask(void* /*pvParameters*/) {
+    static notifications::Entry entry; // displayText() keeps a pointer to the text
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        task_profiler::mark_running();
+#ifdef ENABLE_NIGHT_MODE
+        // Messages wait for the morning (or a peek); their TTL still applies.
+        night_mode::wait_until_lit(portMAX_DELAY);
+#endif
+        while (notifications::take(entry)) {
+            switch (show_notification(entry)) {
+            case NotifyOutcome::Shown:
+                break;
+            case NotifyOutcome::Preempted:
+                notifications::put_back(entry);
+                break;
+            case NotifyOutcome::Interrupted:
+                notifications::put_back(entry);
+                vTaskDelay(pdMS_TO_TICKS(NOTIFY_RESUME_DELAY_MS));
+                break;
+            }
+        }
+    }
+}
+#endif
+
+void onTimeSyncStatus(const time_sync::Status status, int64_t /*offset_us*/) {
+    if (status != time_sync::Status::NotSynced) {
+        boot::mark(boot::Stage::TimeValid);
+        warm_state::save_time(time(nullptr));
+    }
+    // A step moves the minute and second boundaries; slewing keeps them in place.
+    if (status == time_sync::Status::Stepped) {
+        scheduler::notify_clock_step();
+#ifdef ENABLE_RELAY_SCHEDULE
+        relay_scheduler::reschedule();
+#endif
+    }
+}
+
+#ifdef ENABLE_NIGHT_MODE
+/**
+ * @brief Darkens or lights the display and switches the background cadence.
+ */
+void onNightModeChange(const night_mode::State state) {
+    const bool dark = state == night_mode::State::Night;
+    if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
+        if (NIGHT_DISPLAY_OFF)
+            parola_display.displayShutdown(dark);
+        else
+            parola_display.setIntensity(dark ? DISPLAY_BRIGHTNESS : display_intensity);
+        if (!dark && current_page == DisplayPage::Time)
+            display_time(time_data, parola_display);
+        xSemaphoreGive(display_data_sem);
+    }
+    const bool night = state != night_mode::State::Day;
+    scheduler::set_period(weather_job, weather_period_us());
+    telemetry::set_interval_s(night ? NIGHT_TELEMETRY_INTERVAL_S : TELEMETRY_INTERVAL_S);
+}
+#endif
+
+/**
+ * @brief Shows the OTA progress on the clock page and publishes it (runs in the OTA task).
+ *
+ * A forecast page or a notification is not interrupted; the progress shows up
+ * again with the next percent.
+ */
+void onOtaProgress(const OtaProgress& progress) {
+#ifdef ENABLE_MQTT
+    mqtt_ota_progress_changed();
+#endif
+    if (xSemaphoreTake(display_data_sem, portMAX_DELAY) != pdTRUE)
+        return;
+    const bool active = progress.state == OtaState::Downloading ||
+                        progress.state == OtaState::Verifying || progress.state == OtaState::Done;
+    if (active && (current_page == DisplayPage::Time || current_page == DisplayPage::Update)) {
+        set_page(DisplayPage::Update);
+        display_ota_progress(progress);
+    } else if (!active && current_page == DisplayPage::Update) {
+        set_page(DisplayPage::Time);
+        display_time(time_data, parola_display);
+    }
+    xSemaphoreGive(display_data_sem);
+}
+
+/**
+ * @brief Starts the network services on the first link-up, then follows the link.
+ *
+ * Nothing here runs on the Arduino task, so the clock is up before WiFi is.
+ */
+[[noreturn]] void networkServicesTask(void* /*pvParameters*/) {
+    net_utils::wait_connected(portMAX_DELAY);
+    boot::mark(boot::Stage::LinkUp);
+    ESP_LOGI(TAG_MAIN, "Network up, starting services");
+    time_sync::start(onTimeSyncStatus);
+    ota_set_progress_listener(onOtaProgress);
+    ota_app_start();
+#ifdef ENABLE_MQTT
+#ifdef ENABLE_TELEMETRY
+    telemetry::start();
+#endif
+#ifdef ENABLE_FORECAST_PUSH
+    if (forecast_enabled)
+        mqtt_set_forecast_handler(onForecastPacket);
+#endif
+    // MQTT publishes the relay states, so they must be restored first.
+    boot::wait(boot::bit(boot::Stage::Relays), portMAX_DELAY);
+    mqtt_app_start();
+#endif
+#ifdef ENABLE_MDNS
+    setup_mdns();
+#endif
+    boot::mark(boot::Stage::Services);
+
+    for (;;) {
+        net_utils::wait_disconnected(portMAX_DELAY);
+        ESP_LOGW(TAG_MAIN, "Network down");
+#ifdef ENABLE_MQTT
+        mqtt_app_link_changed(false);
+#endif
+        net_utils::wait_connected(portMAX_DELAY);
+        ESP_LOGI(TAG_MAIN, "Network back");
+        time_sync::resync();
+#ifdef ENABLE_MQTT
+        mqtt_app_link_changed(true);
+#endif
     }
-    vTaskDelete(nullptr);
 }
 
 void prepareMatrixDisplay(MD_Parola& display) {
@@ -258,6 +618,7 @@ void prepareMatrixDisplay(MD_Parola& display) {
     display.displayClear();
     display.setIntensity(DISPLAY_BRIGHTNESS);
     display.addChar(Icons::RAIN_CODE, Icons::RAIN_DATA);
+    display.addChar(Icons::SUN_CODE, Icons::SUN_DATA);
     display.addChar(Icons::WIDE_COLON_CODE, Icons::WIDE_COLON_DATA);
     display.addChar(Icons::DEG_C_CODE, Icons::DEG_C_DATA);
     display.addChar('7', Icons::OTHER_7);
@@ -265,7 +626,23 @@ void prepareMatrixDisplay(MD_Parola& display) {
     ESP_LOGI(TAG_DISPLAY, "Matrix display initialized");
 }
 
+void set_display_intensity(const uint8_t level) {
+    if (xSemaphoreTake(display_data_sem, portMAX_DELAY) == pdTRUE) {
+        display_intensity = level;
+#ifdef ENABLE_NIGHT_MODE
+        // While dark the level is only remembered for the next peek or the morning.
+        const bool apply = night_mode::state() != night_mode::State::Night;
+#else
+        constexpr bool apply = true;
+#endif
+        if (apply)
+            parola_display.setIntensity(level);
+        xSemaphoreGive(display_data_sem);
+    }
+}
+
 void display_forecast_chart() {
+    power::Boost boost(power::Lock::Render);
     parola_display.displayClear();
     parola_display.setTextAlignment(PA_LEFT);
     parola_display.setFont(customFont);
@@ -281,6 +658,7 @@ void display_forecast_chart() {
 }
 
 void display_precip_chart() {
+    power::Boost boost(power::Lock::Render);
     parola_display.displayClear();
     constexpr char icon_str[2] = {Icons::RAIN_CODE, '\0'};
     parola_display.print(icon_str);
@@ -298,6 +676,7 @@ void display_seconds(const int current_second) {
     if (const int current_second_column =
             max_columns - 1 - map(current_second, 0, 59, 0, max_columns - 1);
         current_second_column != last_column) {
+        power::Boost boost(power::Lock::Render);
         parola_display.getGraphicObject()->setPoint(ROW_SIZE - 1, current_second_column, true);
         parola_display.getGraphicObject()->setPoint(ROW_SIZE - 1, last_column, false);
         last_column = current_second_column;
@@ -305,6 +684,7 @@ void display_seconds(const int current_second) {
 }
 
 void display_temperature_range() {
+    power::Boost boost(power::Lock::Render);
     parola_display.setTextAlignment(PA_LEFT);
     char forecast_buf[12];
     format_temp_range(forecast_buf, sizeof(forecast_buf), forecast_data.min_temp,
@@ -312,51 +692,142 @@ void display_temperature_range() {
     parola_display.printf("%s", forecast_buf);
 }
 
+void display_ota_progress(const OtaProgress& progress) {
+    power::Boost boost(power::Lock::Render);
+    const int percent =
+        progress.total > 0 ? static_cast<int>(progress.received * 100LL / progress.total) : 0;
+    parola_display.setTextAlignment(PA_CENTER);
+    parola_display.printf("%d%%", percent);
+    // Progress bar on the bottom row, filling up from the left like the seconds indicator.
+    MD_MAX72XX* matrix = parola_display.getGraphicObject();
+    const int columns = static_cast<int>(matrix->getColumnCount());
+    for (int i = 0; i < columns * percent / 100; ++i)
+        matrix->setPoint(ROW_SIZE - 1, columns - 1 - i, true);
+}
+
 void display_time(const String& time, MD_Parola& parolaDisplay) {
+    power::Boost boost(power::Lock::Render);
     parolaDisplay.setTextAlignment(PA_CENTER);
     parolaDisplay.printf("%s", time.c_str());
 }
 
+/**
+ * @brief Takes over a forecast kept through a warm restart unless it is due for a refresh.
+ *
+ * Called from setup() before the tasks using forecast_data are started.
+ */
+void restore_forecast() {
+    ForecastData16 forecast{};
+    time_t fetched_at = 0;
+    if (!warm_state::restored_forecast(forecast, fetched_at))
+        return;
+    const time_t age = time(nullptr) - fetched_at;
+    if (age < 0 || age * US_PER_SECOND >= weather_period_us())
+        return;
+    forecast_data = forecast;
+    warm_forecast_at = fetched_at;
+    boot::mark(boot::Stage::Forecast);
+    ESP_LOGI(TAG_WEATHER, "Forecast kept through restart, fetched %lld s ago",
+             static_cast<long long>(age));
+}
+
+/**
+ * @brief Boot stage: restores the relays and starts their schedule.
+ *
+ * Relays work without the network; the schedule fires once time is synced.
+ */
+void startRelays() {
+    relays_app_init();
+#ifdef ENABLE_RELAY_SCHEDULE
+#ifdef ENABLE_MQTT
+    relay_scheduler::start(mqtt_relay_state_changed);
+#else
+    relay_scheduler::start(nullptr);
+#endif
+#endif
+}
+
+/**
+ * @brief Boot stage: configures the APDS-9960 and starts the tasks reading it.
+ */
+void startSensors() {
+    gestures_enabled = setupAPDS9960(apds, APDS_INT_PIN, gpio_isr_handler);
+    if (!gestures_enabled)
+        return;
+    power::set_wake_pin(APDS_INT_PIN, apds_woke_from_sleep);
+#ifdef ENABLE_AMBIENT_BRIGHTNESS
+    ambient_light::start(apds, set_display_intensity);
+#endif
+    xTaskCreate(gestureTask, "gestureTask", 4096, &apds, 5, &gestureTaskHandle);
+}
+
 void setup() {
+    boot::begin();
     initSerial();
 
+    // After a software reset the snapshot replaces the slow parts of the cold boot.
+    warm_state::begin();
+
+    // Before any driver is installed, so they all see the final clock configuration.
+    power::start();
+
     reboot_control::handleRebootStormDetection();
 
+    init_timezone();
+
     gpio_install_isr_service(ESP_INTR_FLAG_SHARED);
 
+    display_data_sem = xSemaphoreCreateMutex();
+    if (display_data_sem == nullptr) {
+        ESP_LOGE(TAG_MAIN, "Failed to create mutex.");
+        forecast_enabled = false; // Disable forecast updates
+    }
+
     // Initialize I2C
     Wire.begin(I2C_SDA, I2C_SCL, I2C_FREQ_HZ);
     ESP_LOGI(TAG_I2C, "I2C initialized");
 
     prepareMatrixDisplay(parola_display);
-
-    wifi_enabled = net_utils::setup_wifi();
-    if (wifi_enabled) {
-        parola_display.displayClear();
-        parola_display.print("NTP...");
-        net_utils::setup_NTP(timeClient);
-        initForecastUpdate();
-        ota_app_start();
-#ifdef ENABLE_MQTT
-        mqtt_app_start();
+    boot::mark(boot::Stage::Display);
+
+    // The first frame shows the time kept through a reset, or "--;--" after a power-on.
+    time_t saved_at = 0;
+    warm_state::restored_time(saved_at);
+    if (time_sync::adopt_rtc_time(saved_at)) {
+        boot::mark(boot::Stage::TimeValid);
+        if (forecast_enabled)
+            restore_forecast();
+    }
+    if (DisplayPage page; warm_state::restored_page(page) && page != DisplayPage::Time)
+        ESP_LOGI(TAG_DISPLAY, "Restart interrupted page %u, showing the time",
+                 static_cast<unsigned>(page));
+#ifdef ENABLE_NIGHT_MODE
+    night_mode::start(onNightModeChange);
 #endif
-#ifdef ENABLE_MDNS
-        setup_mdns();
+#ifdef ENABLE_TASK_PROFILER
+    task_profiler::start(); // before the HTTP server comes up and asks for /tasks
 #endif
-        xTaskCreate(ntpUpdateTask, "Sync Time", 2048, nullptr, tskIDLE_PRIORITY, nullptr);
-    }
+    xTaskCreate(minuteChangeTask, "Minute Change", 4096, nullptr, 1, nullptr);
 
-    // Setup APDS9960 gesture sensor
-    gestures_enabled = setupAPDS9960(apds, APDS_INT_PIN, gpio_isr_handler);
+    // Everything below runs in parallel and does not hold up the clock.
+    boot::spawn(boot::Stage::Relays, startRelays, 0, 4096, 2);
+    boot::spawn(boot::Stage::Sensors, startSensors, 0, 4096, 2);
+
+    // Connects in the background; services start once the link is up.
+    net_utils::start();
+    xTaskCreate(networkServicesTask, "Net Services", 4096, nullptr, 2, nullptr);
+    initForecastUpdate();
 
-    // Power saving
+    // Power saving; the CPU frequency is managed by power::start()
     btStop(); // disables Bluetooth
-    setCpuFrequencyMhz(80);
 
-    xTaskCreate(minuteChangeTask, "Minute Change", 4096, nullptr, 1, nullptr);
     xTaskCreate(printStatusTask, "Print Status", 4096, nullptr, tskIDLE_PRIORITY, nullptr);
-    if (gestures_enabled)
-        xTaskCreate(gestureTask, "gestureTask", 4096, &apds, 5, &gestureTaskHandle);
+#ifdef ENABLE_NOTIFICATIONS
+    TaskHandle_t notification_task = nullptr;
+    if (xTaskCreate(notificationTask, "Notifications", 3072, nullptr, 1, &notification_task) ==
+        pdPASS)
+        notifications::set_listener(notification_task);
+#endif
 #ifdef DEBUG_MEM
     xTaskCreatePinnedToCore(heap_monitor_task, "heapMon", 4096, nullptr, tskIDLE_PRIORITY + 1,
                             nullptr, tskNO_AFFINITY);
@@ -379,9 +850,18 @@ void setup_mdns() {
 }
 
 void loop() {
-    const tm currentTime = get_local_time();
-    const int currentSecond = currentTime.tm_sec;
-    wait_until_next_second();
+    if (second_job == scheduler::INVALID_JOB)
+        second_job = scheduler::register_job("second", scheduler::Clock::Wall, US_PER_SECOND,
+                                             scheduler::Policy::Skip);
+#ifdef ENABLE_NIGHT_MODE
+    // No seconds indicator while the display is dark; the task sleeps until it lights up.
+    if (!night_mode::wait_until_lit(0)) {
+        night_mode::wait_until_lit(portMAX_DELAY);
+        scheduler::resume(second_job); // the night is not an overrun
+    }
+#endif
+    scheduler::wait_next(second_job);
+    const int currentSecond = get_local_time().tm_sec;
     if (current_page == DisplayPage::Time)
         display_seconds(currentSecond);
 }
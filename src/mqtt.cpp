@@ -1,17 +1,107 @@
 #include "mqtt.h"
+#include "boot.h"
 #include "config.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "mqtt_client.h"
+#include "mqtt_publisher.h"
+#include "notifications.h"
 #include "ota.h"
+#include "relay_schedule.h"
+#include "relay_scheduler.h"
 #include "relays_app.h"
-#include <string>
+#include "topic_table.h"
+#include "trace.h"
+#include <string_view>
 
 namespace {
 constexpr auto TAG = "MQTT";
 constexpr auto MQTT_OTA_TOPIC = "device/ota/url";
 esp_mqtt_client_handle_t mqtt_client = nullptr;
+bool client_running = false;
+
+enum class TopicKind : uint8_t {
+    Ota,
+    RelayCommand,
+    Forecast,
+    Notify,
+    ScheduleSet,
+    GroupCommand,
+};
+
+enum class SwitchCommand : uint8_t {
+    Off,
+    On,
+    Invalid,
+};
+
+constexpr size_t MQTT_TOPIC_MAX = 64;
+// Every topic the device subscribes to, built once per connection.
+TopicTable<RELAY_COUNT + 5, MQTT_TOPIC_MAX> subscribed_topics;
+ForecastPacketHandler forecast_handler = nullptr;
+
+mqtt_publisher::SlotId discovery_slots[RELAY_COUNT];
+mqtt_publisher::SlotId state_slots[RELAY_COUNT];
+mqtt_publisher::SlotId schedule_slot = mqtt_publisher::INVALID_SLOT;
+mqtt_publisher::SlotId group_state_slot = mqtt_publisher::INVALID_SLOT;
+mqtt_publisher::SlotId boot_slot = mqtt_publisher::INVALID_SLOT;
+mqtt_publisher::SlotId ota_slot = mqtt_publisher::INVALID_SLOT;
+// Set after the first connection since boot has announced every topic.
+bool announced = false;
+
+SwitchCommand parse_switch_payload(const std::string_view payload) {
+    if (payload == "ON" || payload == "on" || payload == "1")
+        return SwitchCommand::On;
+    if (payload == "OFF" || payload == "off" || payload == "0")
+        return SwitchCommand::Off;
+    return SwitchCommand::Invalid;
+}
+
+// Unsigned number in decimal, 0x hex or 0b binary.
+bool parse_mask(std::string_view s, RelayMask& out) {
+    unsigned base = 10;
+    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'b')) {
+        base = s[1] == 'x' ? 16 : 2;
+        s.remove_prefix(2);
+    }
+    if (s.empty())
+        return false;
+    uint32_t v = 0;
+    for (const char c : s) {
+        unsigned digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        if (digit >= base || (v = v * base + digit) > RELAY_ALL)
+            return false;
+    }
+    out = static_cast<RelayMask>(v);
+    return true;
+}
+
+// "scene:<name|number>" or "<on mask>[/<affected mask>]".
+bool parse_group_payload(const std::string_view payload, RelayMask& on, RelayMask& affected) {
+    constexpr std::string_view SCENE_PREFIX = "scene:";
+    if (payload.substr(0, SCENE_PREFIX.size()) == SCENE_PREFIX) {
+        const RelayScene* scene = relays_app_find_scene(payload.substr(SCENE_PREFIX.size()));
+        if (!scene)
+            return false;
+        on = scene->on;
+        affected = scene->affected;
+        return true;
+    }
+    const size_t slash = payload.find('/');
+    affected = RELAY_ALL;
+    return parse_mask(payload.substr(0, slash), on) &&
+           (slash == std::string_view::npos || parse_mask(payload.substr(slash + 1), affected));
+}
 } // namespace
 
 static void build_relay_topic(char* buf, size_t buf_sz, const char* purpose, size_t relay_idx) {
@@ -24,41 +114,192 @@ static void build_discovery_topic(char* buf, const size_t buf_sz, const size_t i
                   static_cast<unsigned>(idx + 1));
 }
 
-static void publish_relay_state(esp_mqtt_client_handle_t client, size_t idx) {
-    char topic[64];
-    build_relay_topic(topic, sizeof(topic), "state", idx);
-    const char* msg = relays_app_get_state(idx) ? "ON" : "OFF";
-    const int msg_id = esp_mqtt_client_publish(client, topic, msg, 0, 0, 1);
-    ESP_LOGI(TAG, "Published %s -> %s (msg_id=%d)", topic, msg, msg_id);
+static int render_relay_state(const size_t idx, char* topic, const size_t topic_sz, char* payload,
+                              const size_t payload_sz) {
+    build_relay_topic(topic, topic_sz, "state", idx);
+    return std::snprintf(payload, payload_sz, "%s", relays_app_get_state(idx) ? "ON" : "OFF");
 }
 
-static void publish_relay_discovery(esp_mqtt_client_handle_t client, size_t idx) {
-    char topic[128];
-    build_discovery_topic(topic, sizeof(topic), idx);
+static int render_relay_discovery(const size_t idx, char* topic, const size_t topic_sz,
+                                  char* payload, const size_t payload_sz) {
+    build_discovery_topic(topic, topic_sz, idx);
 
     char state_topic[64], cmd_topic[64];
     build_relay_topic(state_topic, sizeof(state_topic), "state", idx);
     build_relay_topic(cmd_topic, sizeof(cmd_topic), "command", idx);
 
-    char payload[512];
-    std::snprintf(
-        payload, sizeof(payload),
+    const int len = std::snprintf(
+        payload, payload_sz,
         R"({"name":"%s light%u","uniq_id":"%s_light%u","cmd_t":"%s","stat_t":"%s","qos":0,"pl_on":"ON","pl_off":"OFF","~":""})",
         DEVICE_NAME, static_cast<unsigned>(idx + 1), DEVICE_NAME, static_cast<unsigned>(idx + 1),
         cmd_topic, state_topic);
+    return len < static_cast<int>(payload_sz) ? len : -1;
+}
 
-    const int msg_id = esp_mqtt_client_publish(client, topic, payload, 0, 0, 1);
-    ESP_LOGI(TAG, "Published discovery %s (msg_id=%d)", topic, msg_id);
+static int render_group_state(size_t /*arg*/, char* topic, const size_t topic_sz, char* payload,
+                              const size_t payload_sz) {
+    std::snprintf(topic, topic_sz, "%s/group/state", MQTT_TOPIC_BASE);
+    const RelayMask mask = relays_app_get_mask();
+    int len = std::snprintf(payload, payload_sz, R"({"mask":%u)", static_cast<unsigned>(mask));
+    for (size_t i = 0; i < RELAY_COUNT && len > 0 && static_cast<size_t>(len) < payload_sz; ++i)
+        len += std::snprintf(payload + len, payload_sz - len, R"(,"light%u":"%s")",
+                             static_cast<unsigned>(i + 1), mask & (1u << i) ? "ON" : "OFF");
+    if (len < 0 || static_cast<size_t>(len) + 1 >= payload_sz)
+        return -1;
+    payload[len++] = '}';
+    payload[len] = '\0';
+    return len;
 }
 
-static void subscribe_relay_topics(esp_mqtt_client_handle_t client) {
+#ifdef ENABLE_RELAY_SCHEDULE
+static_assert(relay_schedule::TEXT_MAX <= mqtt_publisher::PAYLOAD_MAX,
+              "a full schedule must fit into the retained schedule message");
+
+static int render_schedule(size_t /*arg*/, char* topic, const size_t topic_sz, char* payload,
+                           const size_t payload_sz) {
+    std::snprintf(topic, topic_sz, "%s/schedule", MQTT_TOPIC_BASE);
+    return relay_scheduler::format(payload, payload_sz);
+}
+#endif
+
+static int render_boot_profile(size_t /*arg*/, char* topic, const size_t topic_sz, char* payload,
+                               const size_t payload_sz) {
+    std::snprintf(topic, topic_sz, "%s/boot", MQTT_TOPIC_BASE);
+    return boot::format_profile(payload, payload_sz);
+}
+
+static int render_ota_progress(size_t /*arg*/, char* topic, const size_t topic_sz, char* payload,
+                               const size_t payload_sz) {
+    std::snprintf(topic, topic_sz, "%s/ota", MQTT_TOPIC_BASE);
+    const OtaProgress progress = ota_get_progress();
+    const int len = std::snprintf(
+        payload, payload_sz, R"({"state":"%s","received":%lu,"total":%ld,"attempt":%u})",
+        ota_state_name(progress.state), static_cast<unsigned long>(progress.received),
+        static_cast<long>(progress.total), static_cast<unsigned>(progress.attempt));
+    return len < static_cast<int>(payload_sz) ? len : -1;
+}
+
+// The profile is published once complete, and again with every announcement.
+static void on_boot_stage(const boot::Stage stage) {
+    if (stage == boot::Stage::Online)
+        mqtt_publisher::mark_dirty(boot_slot);
+}
+
+static void register_publish_slots() {
+    // Discovery slots come first so Home Assistant sees each entity before its state.
+    for (size_t i = 0; i < RELAY_COUNT; ++i)
+        discovery_slots[i] = mqtt_publisher::add_slot(render_relay_discovery, i, 0, true);
+    for (size_t i = 0; i < RELAY_COUNT; ++i)
+        state_slots[i] = mqtt_publisher::add_slot(render_relay_state, i, 0, true);
+    group_state_slot = mqtt_publisher::add_slot(render_group_state, 0, 0, true);
+#ifdef ENABLE_RELAY_SCHEDULE
+    schedule_slot = mqtt_publisher::add_slot(render_schedule, 0, 0, true);
+#endif
+    boot_slot = mqtt_publisher::add_slot(render_boot_profile, 0, 0, true);
+    ota_slot = mqtt_publisher::add_slot(render_ota_progress, 0, 0, false);
+    boot::set_listener(on_boot_stage);
+}
+
+static void build_topic_table() {
+    subscribed_topics.clear();
+    subscribed_topics.add(MQTT_OTA_TOPIC, static_cast<uint8_t>(TopicKind::Ota));
     for (size_t i = 0; i < RELAY_COUNT; ++i) {
-        char topic[64];
+        char topic[MQTT_TOPIC_MAX];
         build_relay_topic(topic, sizeof(topic), "command", i);
-        int msg_id = esp_mqtt_client_subscribe(client, topic, 0);
-        ESP_LOGI(TAG, "Subscribed to %s (msg_id=%d)", topic, msg_id);
-        publish_relay_discovery(client, i);
-        publish_relay_state(client, i);
+        if (!subscribed_topics.add(topic, static_cast<uint8_t>(TopicKind::RelayCommand), i))
+            ESP_LOGE(TAG, "Topic table full or topic too long: %s", topic);
+    }
+    {
+        char topic[MQTT_TOPIC_MAX];
+        std::snprintf(topic, sizeof(topic), "%s/group/command", MQTT_TOPIC_BASE);
+        subscribed_topics.add(topic, static_cast<uint8_t>(TopicKind::GroupCommand));
+    }
+    if (forecast_handler) {
+        char topic[MQTT_TOPIC_MAX];
+        std::snprintf(topic, sizeof(topic), "%s/forecast", MQTT_TOPIC_BASE);
+        subscribed_topics.add(topic, static_cast<uint8_t>(TopicKind::Forecast));
+    }
+#ifdef ENABLE_NOTIFICATIONS
+    {
+        char topic[MQTT_TOPIC_MAX];
+        std::snprintf(topic, sizeof(topic), "%s/notify", MQTT_TOPIC_BASE);
+        subscribed_topics.add(topic, static_cast<uint8_t>(TopicKind::Notify));
+    }
+#endif
+#ifdef ENABLE_RELAY_SCHEDULE
+    {
+        char topic[MQTT_TOPIC_MAX];
+        std::snprintf(topic, sizeof(topic), "%s/schedule/set", MQTT_TOPIC_BASE);
+        subscribed_topics.add(topic, static_cast<uint8_t>(TopicKind::ScheduleSet));
+    }
+#endif
+    subscribed_topics.build();
+}
+
+static void subscribe_topics(esp_mqtt_client_handle_t client) {
+    for (const auto& entry : subscribed_topics) {
+        const int msg_id = esp_mqtt_client_subscribe(client, entry.topic, 0);
+        ESP_LOGI(TAG, "Subscribed to %s (msg_id=%d)", entry.topic, msg_id);
+    }
+}
+
+// Queues the full discovery and state burst; the publisher task sends it in batches.
+static void announce_all() {
+    for (size_t i = 0; i < RELAY_COUNT; ++i) {
+        mqtt_publisher::mark_dirty(discovery_slots[i]);
+        mqtt_publisher::mark_dirty(state_slots[i]);
+    }
+    mqtt_publisher::mark_dirty(group_state_slot);
+    mqtt_publisher::mark_dirty(schedule_slot);
+    if (boot::reached(boot::Stage::Online))
+        mqtt_publisher::mark_dirty(boot_slot);
+}
+
+void mqtt_relay_state_changed(const size_t idx) {
+    if (idx < RELAY_COUNT && mqtt_client) {
+        mqtt_publisher::mark_dirty(state_slots[idx]);
+        mqtt_publisher::mark_dirty(group_state_slot);
+    }
+}
+
+static void handle_group_command(const std::string_view payload, const int64_t received_us) {
+    RelayMask on = 0, affected = 0;
+    if (!parse_group_payload(payload, on, affected)) {
+        ESP_LOGW(TAG, "Invalid group command: %.*s", static_cast<int>(payload.size()),
+                 payload.data());
+        return;
+    }
+    const RelayMask changed = relays_app_set_mask(on, affected, received_us);
+    ESP_LOGI(TAG, "Group command %.*s, changed 0x%x", static_cast<int>(payload.size()),
+             payload.data(), changed);
+    if (!changed)
+        return;
+    mqtt_publisher::mark_dirty(group_state_slot);
+    // Home Assistant entities follow the per-relay topics; the queue coalesces these.
+    for (size_t i = 0; i < RELAY_COUNT; ++i)
+        if (changed & (1u << i))
+            mqtt_publisher::mark_dirty(state_slots[i]);
+}
+
+static void handle_relay_command(const size_t idx, const std::string_view payload,
+                                 const int64_t received_us) {
+    if (payload.empty())
+        return;
+    ESP_LOGI(TAG, "light%u <- %.*s", static_cast<unsigned>(idx + 1),
+             static_cast<int>(payload.size()), payload.data());
+    switch (parse_switch_payload(payload)) {
+    case SwitchCommand::On:
+        relays_app_set_state(idx, true, received_us);
+        mqtt_relay_state_changed(idx);
+        break;
+    case SwitchCommand::Off:
+        relays_app_set_state(idx, false, received_us);
+        mqtt_relay_state_changed(idx);
+        break;
+    case SwitchCommand::Invalid:
+        ESP_LOGW(TAG, "Unknown payload for light%u: %.*s", static_cast<unsigned>(idx + 1),
+                 static_cast<int>(payload.size()), payload.data());
+        break;
     }
 }
 
@@ -77,21 +318,34 @@ static void handle_ota_topic(const esp_mqtt_event_t* event) {
     }
 }
 
+void mqtt_set_forecast_handler(const ForecastPacketHandler handler) { forecast_handler = handler; }
+
+void mqtt_ota_progress_changed() { mqtt_publisher::mark_dirty(ota_slot); }
+
 static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id,
                                void* event_data) {
     const auto* event = static_cast<const esp_mqtt_event_handle_t>(event_data);
+    trace::Scope span("mqtt.event");
 
     switch (event->event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
 
-        esp_mqtt_client_subscribe(event->client, MQTT_OTA_TOPIC, 0);
-
-        subscribe_relay_topics(event->client);
+        build_topic_table();
+        subscribe_topics(event->client);
+        // Retained topics on the broker may predate this boot, so refresh them once.
+        // Later reconnects only replay what changed while offline.
+        if (!announced) {
+            announce_all();
+            announced = true;
+        }
+        ESP_LOGI(TAG, "%u message(s) to replay", static_cast<unsigned>(mqtt_publisher::pending()));
+        mqtt_publisher::set_connected(true);
         break;
 
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+        mqtt_publisher::set_connected(false);
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
@@ -103,38 +357,44 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
         break;
 
     case MQTT_EVENT_PUBLISHED:
-        ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
         break;
 
     case MQTT_EVENT_DATA: {
-        std::string topic(event->topic, event->topic_len);
-        std::string payload(event->data, event->data_len);
-        ESP_LOGI(TAG, "MQTT_EVENT_DATA topic=%s payload=%s", topic.c_str(), payload.c_str());
-
-        // OTA
-        if (topic == MQTT_OTA_TOPIC) {
+        // Relay latency is counted from here, the dispatch of the event, to the GPIO write.
+        const int64_t received_us = esp_timer_get_time();
+        // Only whole messages are handled; all our payloads fit into one event.
+        if (event->current_data_offset != 0 || event->data_len != event->total_data_len)
+            break;
+        const std::string_view topic(event->topic, event->topic_len);
+        const std::string_view payload(event->data, event->data_len);
+        const auto* entry = subscribed_topics.find(topic);
+        if (!entry)
+            break;
+        ESP_LOGI(TAG, "MQTT_EVENT_DATA topic=%.*s (%d bytes)", event->topic_len, event->topic,
+                 event->data_len);
+        switch (static_cast<TopicKind>(entry->kind)) {
+        case TopicKind::Ota:
             handle_ota_topic(event);
             break;
-        }
-
-        // Relays
-        for (size_t i = 0; i < RELAY_COUNT; ++i) {
-            char expected[64];
-            build_relay_topic(expected, sizeof(expected), "command", i);
-            if (topic == expected) {
-                if (!payload.empty()) {
-                    if (payload == "ON" || payload == "on" || payload == "1") {
-                        relays_app_set_state(i, true);
-                        publish_relay_state(mqtt_client, i);
-                    } else if (payload == "OFF" || payload == "off" || payload == "0") {
-                        relays_app_set_state(i, false);
-                        publish_relay_state(mqtt_client, i);
-                    } else {
-                        ESP_LOGW(TAG, "Unknown payload for %s: %s", expected, payload.c_str());
-                    }
-                }
-                break;
-            }
+        case TopicKind::RelayCommand:
+            handle_relay_command(entry->arg, payload, received_us);
+            break;
+        case TopicKind::Forecast:
+            // Binary payload, validated by the receiver.
+            forecast_handler(reinterpret_cast<const uint8_t*>(event->data), event->data_len);
+            break;
+        case TopicKind::Notify:
+            notifications::post_payload(payload);
+            break;
+        case TopicKind::GroupCommand:
+            handle_group_command(payload, received_us);
+            break;
+        case TopicKind::ScheduleSet:
+            // The retained schedule topic always shows what is in effect.
+            relay_scheduler::set_from_text(payload);
+            mqtt_publisher::mark_dirty(schedule_slot);
+            break;
         }
         break;
     }
@@ -151,7 +411,7 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
 void mqtt_app_start() {
     ESP_LOGI(TAG, "Starting MQTT client...");
 
-    relays_app_init();
+    register_publish_slots();
 
     char uri[64];
     std::snprintf(uri, sizeof(uri), "mqtt://%s:%u", MQTT_BROKER_IP,
@@ -169,12 +429,31 @@ void mqtt_app_start() {
         return;
     }
 
+    mqtt_publisher::start(mqtt_client);
     esp_mqtt_client_register_event(mqtt_client, static_cast<esp_mqtt_event_id_t>(ESP_EVENT_ANY_ID),
                                    mqtt_event_handler, nullptr);
 
     if (esp_err_t err = esp_mqtt_client_start(mqtt_client); err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start MQTT client: %d", err);
     } else {
+        client_running = true;
         ESP_LOGI(TAG, "MQTT client started successfully");
     }
 }
+
+void mqtt_app_link_changed(const bool up) {
+    if (!mqtt_client || up == client_running)
+        return;
+    if (up) {
+        // Connect right away instead of waiting out the client's reconnect timeout.
+        client_running = esp_mqtt_client_start(mqtt_client) == ESP_OK;
+        ESP_LOGI(TAG, "Link up, client %s", client_running ? "restarted" : "failed to restart");
+    } else {
+        // Nothing is reachable; stop the futile connection attempts. The journal keeps
+        // collecting changes and is replayed after the next connect.
+        mqtt_publisher::set_connected(false);
+        if (esp_mqtt_client_stop(mqtt_client) == ESP_OK)
+            client_running = false;
+        ESP_LOGI(TAG, "Link down, client stopped");
+    }
+}
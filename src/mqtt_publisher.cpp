@@ -0,0 +1,174 @@
+#include "mqtt_publisher.h"
+
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "publish_journal.h"
+#include "task_profiler.h"
+#include "trace.h"
+#include <atomic>
+
+namespace mqtt_publisher {
+
+namespace {
+constexpr auto TAG = "MQTT_PUB";
+constexpr uint32_t PUBLISHER_TASK_STACK_SIZE = 4096;
+constexpr UBaseType_t PUBLISHER_TASK_PRIORITY = 2; // below the MQTT client task
+
+struct Slot {
+    RenderFn render;
+    size_t arg;
+    int qos;
+    bool retain;
+};
+
+Slot slots[MAX_SLOTS];
+size_t slot_count = 0;
+esp_mqtt_client_handle_t mqtt_client = nullptr;
+TaskHandle_t task_handle = nullptr;
+std::atomic<bool> connected{false};
+
+// Slots changed since they were last sent, oldest change first.
+PublishJournal<MAX_SLOTS> journal;
+portMUX_TYPE journal_lock = portMUX_INITIALIZER_UNLOCKED;
+PublisherStats stats{}; // guarded by journal_lock
+
+// Only the publisher task renders, so one set of buffers is enough.
+char topic_buf[TOPIC_MAX];
+char payload_buf[PAYLOAD_MAX];
+
+void wait_for_outbox_space() {
+    while (connected && esp_mqtt_client_get_outbox_size(mqtt_client) > MQTT_OUTBOX_LIMIT_BYTES)
+        vTaskDelay(pdMS_TO_TICKS(MQTT_PUBLISH_BATCH_PAUSE_MS));
+}
+
+bool take_next(uint8_t& id) {
+    taskENTER_CRITICAL(&journal_lock);
+    const bool found = journal.pop(id);
+    taskEXIT_CRITICAL(&journal_lock);
+    return found;
+}
+
+// Counts a failed enqueue and puts the slot back to be sent first on the next drain.
+void requeue_front(const uint8_t id) {
+    taskENTER_CRITICAL(&journal_lock);
+    ++stats.failed;
+    // If the slot changed again meanwhile it is already queued further back.
+    journal.push_front(id);
+    taskEXIT_CRITICAL(&journal_lock);
+}
+
+void count_published() {
+    taskENTER_CRITICAL(&journal_lock);
+    ++stats.published;
+    taskEXIT_CRITICAL(&journal_lock);
+}
+
+// Drains the journal in order; returns false if it had to stop early.
+bool drain_journal() {
+    size_t sent_in_batch = 0;
+    uint8_t id;
+    while (connected) {
+        wait_for_outbox_space();
+        if (!take_next(id))
+            return true;
+
+        // Rendered after leaving the journal: a change arriving meanwhile queues it again.
+        trace::Scope span("mqtt.publish");
+        const Slot& slot = slots[id];
+        const int len = slot.render(slot.arg, topic_buf, sizeof(topic_buf), payload_buf,
+                                    sizeof(payload_buf));
+        if (len < 0)
+            continue;
+        // Enqueued even at QoS 0, so every message passes through the outbox that
+        // wait_for_outbox_space() watches, and the send happens in the MQTT task.
+        const int msg_id = esp_mqtt_client_enqueue(mqtt_client, topic_buf, payload_buf, len,
+                                                   slot.qos, slot.retain, true);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Enqueue to %s failed (%d), will retry", topic_buf, msg_id);
+            requeue_front(id);
+            return false;
+        }
+        count_published();
+        ESP_LOGD(TAG, "Published %s (%d bytes, msg_id=%d)", topic_buf, len, msg_id);
+
+        if (++sent_in_batch >= MQTT_PUBLISH_BATCH_SIZE) {
+            // Rate limit: let the MQTT task drain the outbox before the next batch.
+            sent_in_batch = 0;
+            vTaskDelay(pdMS_TO_TICKS(MQTT_PUBLISH_BATCH_PAUSE_MS));
+        }
+    }
+    return false;
+}
+
+[[noreturn]] void publisher_task(void* /*pvParameters*/) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        task_profiler::mark_running();
+        while (connected && !drain_journal())
+            vTaskDelay(pdMS_TO_TICKS(MQTT_PUBLISH_RETRY_MS));
+    }
+}
+} // namespace
+
+SlotId add_slot(const RenderFn render, const size_t arg, const int qos, const bool retain) {
+    if (slot_count >= MAX_SLOTS || !render) {
+        ESP_LOGE(TAG, "Cannot add publish slot");
+        return INVALID_SLOT;
+    }
+    Slot& slot = slots[slot_count];
+    slot.render = render;
+    slot.arg = arg;
+    slot.qos = qos;
+    slot.retain = retain;
+    return static_cast<SlotId>(slot_count++);
+}
+
+void mark_dirty(const SlotId slot) {
+    if (slot < 0 || static_cast<size_t>(slot) >= slot_count)
+        return;
+    taskENTER_CRITICAL(&journal_lock);
+    if (journal.push(static_cast<uint8_t>(slot)))
+        ++stats.queued;
+    else
+        ++stats.coalesced;
+    taskEXIT_CRITICAL(&journal_lock);
+    if (task_handle && connected) {
+        task_profiler::mark_ready(task_handle);
+        xTaskNotifyGive(task_handle);
+    }
+}
+
+void start(const esp_mqtt_client_handle_t client) {
+    mqtt_client = client;
+    if (xTaskCreate(publisher_task, "MQTT Publisher", PUBLISHER_TASK_STACK_SIZE, nullptr,
+                    PUBLISHER_TASK_PRIORITY, &task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create publisher task");
+        task_handle = nullptr;
+    }
+}
+
+void set_connected(const bool is_connected) {
+    connected = is_connected;
+    if (is_connected && task_handle) {
+        task_profiler::mark_ready(task_handle);
+        xTaskNotifyGive(task_handle);
+    }
+}
+
+size_t pending() {
+    taskENTER_CRITICAL(&journal_lock);
+    const size_t n = journal.size();
+    taskEXIT_CRITICAL(&journal_lock);
+    return n;
+}
+
+PublisherStats get_stats() {
+    taskENTER_CRITICAL(&journal_lock);
+    const PublisherStats copy = stats;
+    taskEXIT_CRITICAL(&journal_lock);
+    return copy;
+}
+
+} // namespace mqtt_publisher
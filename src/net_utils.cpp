@@ -1,71 +1,199 @@
-#include <NTPClient.h>
+#include "net_utils.h"
+
 #include <WiFi.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
 #include "config.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/task.h"
+#include "nvs.h"
 #include "secrets.h"
-#include "time_utils.h"
 
 namespace net_utils {
 
+namespace {
+constexpr auto TAG = "WIFI";
+constexpr char NVS_NAMESPACE[] = "wifi";
+constexpr char NVS_KEY_LINK[] = "link";
+constexpr uint8_t LINK_CACHE_VERSION = 1;
+
+// Notifications from the WiFi event callback to the manager task.
+constexpr uint32_t NOTIFY_GOT_IP = BIT0;
+constexpr uint32_t NOTIFY_DISCONNECTED = BIT1;
+
+// Access point of the last successful connection.
+struct __attribute__((packed)) LinkCache {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+};
+
+StaticEventGroup_t events_buf;
+EventGroupHandle_t link_events = xEventGroupCreateStatic(&events_buf);
+TaskHandle_t manager_task = nullptr;
+
+bool load_cache(LinkCache& out) {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+    size_t size = sizeof(out);
+    const bool ok = nvs_get_blob(handle, NVS_KEY_LINK, &out, &size) == ESP_OK &&
+                    size == sizeof(out) && out.version == LINK_CACHE_VERSION && out.channel != 0;
+    nvs_close(handle);
+    return ok;
+}
+
+void save_cache(const LinkCache& cache) {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    if (nvs_set_blob(handle, NVS_KEY_LINK, &cache, sizeof(cache)) == ESP_OK &&
+        nvs_commit(handle) == ESP_OK)
+        ESP_LOGI(TAG, "Cached AP " MACSTR " on channel %u", MAC2STR(cache.bssid), cache.channel);
+    nvs_close(handle);
+}
+
+void set_link(const bool up) {
+    xEventGroupClearBits(link_events, up ? LINK_DOWN_BIT : LINK_UP_BIT);
+    xEventGroupSetBits(link_events, up ? LINK_UP_BIT : LINK_DOWN_BIT);
+}
+
 /**
- * @brief Sets up the WiFi connection.
- *
- * This function attempts to connect to the specified WiFi network using the credentials
- * defined in the secrets.h file. It will retry for a maximum of 20 seconds before giving up.
- * If the connection is successful, it returns true; otherwise, it returns false.
- *
- * @return true if WiFi is connected, false otherwise.
+ * @brief Runs in the Arduino event task; keeps the link bits current and wakes the manager.
  */
-bool setup_wifi() {
-    Serial.println("Connecting to WiFi...");
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    delay(2000); // Give some time for WiFi to connect
-
-    int retries = 20;
-    while (WiFi.status() != WL_CONNECTED && retries > 0) {
-        delay(5000);
-        Serial.println("  still waiting for WiFi...");
-        retries--;
+void on_wifi_event(const arduino_event_id_t event, const arduino_event_info_t info) {
+    switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        set_link(true);
+        xTaskNotify(manager_task, NOTIFY_GOT_IP, eSetBits);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        // Still associated; DHCP keeps trying on its own.
+        set_link(false);
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        ESP_LOGI(TAG, "Disconnected, reason %u", info.wifi_sta_disconnected.reason);
+        set_link(false);
+        xTaskNotify(manager_task, NOTIFY_DISCONNECTED, eSetBits);
+        break;
+    default:
+        break;
     }
+}
 
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("Failed to connect to WiFi, disabling WiFi.");
-        WiFi.mode(WIFI_OFF); // Disable WiFi if not connected
-        return false;
+void connect(const LinkCache* cache) {
+    if (cache) {
+        ESP_LOGI(TAG, "Connecting to %s via " MACSTR " on channel %u", WIFI_SSID,
+                 MAC2STR(cache->bssid), cache->channel);
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD, cache->channel, cache->bssid, false);
+    } else {
+        ESP_LOGI(TAG, "Connecting to %s (full scan)", WIFI_SSID);
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD, 0, nullptr, false);
     }
+    // WiFi.begin() has no parameter for the listen interval used in modem sleep.
+    wifi_config_t config{};
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK) {
+        config.sta.listen_interval = WIFI_LISTEN_INTERVAL;
+        esp_wifi_set_config(WIFI_IF_STA, &config);
+    }
+    esp_wifi_connect();
+}
 
-    Serial.println("WiFi connected! IP: " + WiFi.localIP().toString());
-    return true;
+uint32_t backoff_ms(const uint32_t failures) {
+    const uint32_t shift = std::min<uint32_t>(failures, 16);
+    const uint32_t base = std::min<uint32_t>(WIFI_RETRY_MIN_MS << shift, WIFI_RETRY_MAX_MS);
+    return base + esp_random() % (base / 4 + 1);
 }
 
 /**
- * @brief Sets up the NTP client for time synchronization.
+ * @brief Owns every connection attempt, so retries never pile up.
  *
- * This function initializes the NTP client with the specified server and updates the local
- * system time. It also sets the timezone based on the TIMEZONE macro defined in secrets.h.
- *
- * @param time_client Reference to the NTPClient instance to be set up.
+ * A reconnect after a working link first tries the cached AP; a failed
+ * attempt falls back to a full scan and the next attempts back off.
  */
-void setup_NTP(NTPClient& time_client) {
-    time_client.begin();
-    while ( !time_client.update() ) {
-        Serial.println("[NTP] still waiting for first synchronisation...");
-        delay(10000);
+[[noreturn]] void manager_task_fn(void* /*pvParameters*/) {
+    LinkCache cache{};
+    bool cache_valid = load_cache(cache);
+    bool was_up = false;
+    uint32_t failures = 0;
+    int64_t attempt_start_us = esp_timer_get_time();
+    connect(cache_valid ? &cache : nullptr);
+
+    for (;;) {
+        uint32_t notified = 0;
+        xTaskNotifyWait(0, ULONG_MAX, &notified, portMAX_DELAY);
+
+        if (notified & NOTIFY_GOT_IP) {
+            ESP_LOGI(TAG, "Connected in %lld ms, IP %s",
+                     (esp_timer_get_time() - attempt_start_us) / 1000,
+                     WiFi.localIP().toString().c_str());
+            failures = 0;
+            was_up = true;
+            LinkCache current{LINK_CACHE_VERSION, static_cast<uint8_t>(WiFi.channel()), {}};
+            if (const uint8_t* bssid = WiFi.BSSID())
+                std::memcpy(current.bssid, bssid, sizeof(current.bssid));
+            // Roaming or a channel change is rare; avoid a flash write on every reconnect.
+            if (!cache_valid || std::memcmp(&current, &cache, sizeof(cache)) != 0) {
+                cache = current;
+                cache_valid = true;
+                save_cache(cache);
+            }
+        }
+
+        if ((notified & NOTIFY_DISCONNECTED) && !is_connected()) {
+            const bool use_cache = cache_valid && was_up;
+            uint32_t delay_ms = 0;
+            if (!was_up)
+                delay_ms = backoff_ms(failures++);
+            was_up = false;
+            if (delay_ms > 0) {
+                ESP_LOGI(TAG, "Retrying in %lu ms", static_cast<unsigned long>(delay_ms));
+                vTaskDelay(pdMS_TO_TICKS(delay_ms));
+            }
+            // Drop whatever arrived while waiting; the attempt below starts afresh.
+            xTaskNotifyStateClear(nullptr);
+            ulTaskNotifyValueClear(nullptr, ULONG_MAX);
+            attempt_start_us = esp_timer_get_time();
+            connect(use_cache ? &cache : nullptr);
+        }
     }
-    Serial.printf("Synchronised UTC time: %s\n", time_client.getFormattedTime().c_str());
+}
+} // namespace
 
-    time_t utc = time_client.getEpochTime();
+void start() {
+    if (manager_task)
+        return;
+    set_link(false);
+    WiFi.persistent(false); // credentials come from secrets.h, not the WiFi driver's NVS
+    WiFi.setAutoReconnect(false); // the manager task decides when to retry
+    WiFi.mode(WIFI_STA);
+    // The radio wakes for every WIFI_LISTEN_INTERVAL-th beacon; light sleep fills the gaps.
+    WiFi.setSleep(WIFI_PS_MAX_MODEM);
+    WiFi.onEvent(on_wifi_event);
+    xTaskCreate(manager_task_fn, "WiFi Manager", 3072, nullptr, 2, &manager_task);
+}
 
-    // Set ESP32 system time (RTC)
-    struct timeval tv;
-    tv.tv_sec = utc;
-    tv.tv_usec = 0;
-    settimeofday(&tv, nullptr);
+EventGroupHandle_t events() {
+    return link_events;
+}
 
-    setenv("TZ", TIMEZONE, 1);
-    tzset();
+bool is_connected() {
+    return (xEventGroupGetBits(link_events) & LINK_UP_BIT) != 0;
+}
+
+bool wait_connected(const TickType_t timeout) {
+    return (xEventGroupWaitBits(link_events, LINK_UP_BIT, pdFALSE, pdTRUE, timeout) &
+            LINK_UP_BIT) != 0;
+}
 
-    // Now localtime() will use timezone with DST
-    Serial.printf("Synchronised local time: %s\n", get_formatted_local_time().c_str());
+bool wait_disconnected(const TickType_t timeout) {
+    return (xEventGroupWaitBits(link_events, LINK_DOWN_BIT, pdFALSE, pdTRUE, timeout) &
+            LINK_DOWN_BIT) != 0;
 }
 
-} // namespace net_utils
\ No newline at end of file
+} // namespace net_utils
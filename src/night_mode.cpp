@@ -0,0 +1,127 @@
+#include "night_mode.h"
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+
+namespace night_mode {
+
+namespace {
+constexpr auto TAG = "NIGHT";
+constexpr EventBits_t LIT_BIT = BIT0;
+
+StaticEventGroup_t events_buf;
+EventGroupHandle_t events = xEventGroupCreateStatic(&events_buf);
+portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+// Serializes transitions, so the listener sees them in order. Never taken by state().
+StaticSemaphore_t transition_buf;
+SemaphoreHandle_t transition_lock = xSemaphoreCreateMutexStatic(&transition_buf);
+Listener listener = nullptr;
+esp_timer_handle_t peek_timer = nullptr;
+bool night = false;   // guarded by state_lock
+bool peeking = false; // guarded by state_lock
+
+State current_state() {
+    return !night ? State::Day : peeking ? State::Peek : State::Night;
+}
+
+const char* state_name(const State s) {
+    switch (s) {
+    case State::Day:
+        return "day";
+    case State::Night:
+        return "night";
+    case State::Peek:
+        return "peek";
+    }
+    return "?";
+}
+
+// Called with transition_lock held, after the flags were changed under state_lock.
+void publish(const State before, const State after) {
+    if (before == after)
+        return;
+    if (after == State::Night)
+        xEventGroupClearBits(events, LIT_BIT);
+    else
+        xEventGroupSetBits(events, LIT_BIT);
+    ESP_LOGI(TAG, "%s -> %s", state_name(before), state_name(after));
+    if (listener)
+        listener(after);
+}
+
+void peek_timeout_cb(void* /*arg*/) {
+    xSemaphoreTake(transition_lock, portMAX_DELAY);
+    taskENTER_CRITICAL(&state_lock);
+    const State before = current_state();
+    peeking = false;
+    const State after = current_state();
+    taskEXIT_CRITICAL(&state_lock);
+    publish(before, after);
+    xSemaphoreGive(transition_lock);
+}
+} // namespace
+
+void start(const Listener on_change) {
+    listener = on_change;
+    xEventGroupSetBits(events, LIT_BIT);
+    const esp_timer_create_args_t timer_args = {
+        .callback = peek_timeout_cb,
+        .name = "night_peek",
+    };
+    esp_timer_create(&timer_args, &peek_timer);
+}
+
+void update(const int minute_of_day) {
+    const bool inside = in_window(static_cast<uint16_t>(minute_of_day), NIGHT_START_MINUTE,
+                                  NIGHT_END_MINUTE);
+    xSemaphoreTake(transition_lock, portMAX_DELAY);
+    taskENTER_CRITICAL(&state_lock);
+    const State before = current_state();
+    night = inside;
+    if (!inside)
+        peeking = false;
+    const State after = current_state();
+    taskEXIT_CRITICAL(&state_lock);
+    if (!inside && peek_timer)
+        esp_timer_stop(peek_timer);
+    publish(before, after);
+    xSemaphoreGive(transition_lock);
+}
+
+void peek() {
+    if (!peek_timer)
+        return;
+    xSemaphoreTake(transition_lock, portMAX_DELAY);
+    taskENTER_CRITICAL(&state_lock);
+    const State before = current_state();
+    if (night)
+        peeking = true;
+    const State after = current_state();
+    taskEXIT_CRITICAL(&state_lock);
+    if (after == State::Peek) {
+        esp_timer_stop(peek_timer);
+        esp_timer_start_once(peek_timer, NIGHT_PEEK_MS * 1000ULL);
+        publish(before, after);
+    }
+    xSemaphoreGive(transition_lock);
+}
+
+State state() {
+    taskENTER_CRITICAL(&state_lock);
+    const State s = current_state();
+    taskEXIT_CRITICAL(&state_lock);
+    return s;
+}
+
+bool is_night() {
+    return state() != State::Day;
+}
+
+bool wait_until_lit(const TickType_t timeout) {
+    return (xEventGroupWaitBits(events, LIT_BIT, pdFALSE, pdTRUE, timeout) & LIT_BIT) != 0;
+}
+
+} // namespace night_mode
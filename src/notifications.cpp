@@ -0,0 +1,124 @@
+#include "notifications.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "icons.h"
+#include "task_profiler.h"
+#include <cstdlib>
+
+namespace notifications {
+
+namespace {
+constexpr auto TAG = "NOTIFY";
+
+NotificationQueue<NOTIFY_QUEUE_CAPACITY, TEXT_MAX> queue;
+portMUX_TYPE queue_lock = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t listener = nullptr;
+
+struct IconToken {
+    std::string_view token;
+    char code;
+};
+
+constexpr IconToken ICON_TOKENS[] = {
+    {":rain:", static_cast<char>(Icons::RAIN_CODE)},
+    {":sun:", static_cast<char>(Icons::SUN_CODE)},
+    {":deg:", static_cast<char>(Icons::DEG_C_CODE)},
+};
+
+// Parses a decimal field terminated by '|'; returns false if there is none.
+bool take_field(std::string_view& s, uint32_t& value) {
+    const size_t bar = s.find('|');
+    if (bar == std::string_view::npos || bar == 0 || bar > 5)
+        return false;
+    uint32_t v = 0;
+    for (size_t i = 0; i < bar; ++i) {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    value = v;
+    s.remove_prefix(bar + 1);
+    return true;
+}
+
+size_t expand_icons(const std::string_view in, char* out, const size_t out_size) {
+    size_t len = 0;
+    for (size_t i = 0; i < in.size() && len + 1 < out_size;) {
+        bool replaced = false;
+        if (in[i] == ':') {
+            for (const auto& icon : ICON_TOKENS) {
+                if (in.substr(i, icon.token.size()) == icon.token) {
+                    out[len++] = icon.code;
+                    i += icon.token.size();
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced)
+            out[len++] = in[i++];
+    }
+    return len;
+}
+} // namespace
+
+void set_listener(const TaskHandle_t task) { listener = task; }
+
+bool post(const std::string_view text, const uint8_t priority, uint32_t ttl_s) {
+    if (text.empty())
+        return false;
+    if (ttl_s == 0)
+        ttl_s = NOTIFY_DEFAULT_TTL_S;
+    else if (ttl_s > NOTIFY_MAX_TTL_S)
+        ttl_s = NOTIFY_MAX_TTL_S;
+    const int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&queue_lock);
+    const bool queued = queue.push(text, priority, now + ttl_s * 1000000LL, now);
+    taskEXIT_CRITICAL(&queue_lock);
+    if (!queued) {
+        ESP_LOGW(TAG, "Queue full, dropped message with priority %u", priority);
+        return false;
+    }
+    if (listener) {
+        task_profiler::mark_ready(listener);
+        xTaskNotifyGive(listener);
+    }
+    return true;
+}
+
+bool post_payload(std::string_view payload) {
+    uint32_t priority = NOTIFY_DEFAULT_PRIORITY;
+    uint32_t ttl_s = NOTIFY_DEFAULT_TTL_S;
+    std::string_view rest = payload;
+    if (uint32_t p = 0, t = 0; take_field(rest, p) && take_field(rest, t)) {
+        priority = p > UINT8_MAX ? UINT8_MAX : p;
+        ttl_s = t;
+        payload = rest;
+    }
+    char text[TEXT_MAX];
+    const size_t len = expand_icons(payload, text, sizeof(text));
+    return post({text, len}, static_cast<uint8_t>(priority), ttl_s);
+}
+
+bool take(Entry& out) {
+    taskENTER_CRITICAL(&queue_lock);
+    const bool found = queue.pop(out, esp_timer_get_time());
+    taskEXIT_CRITICAL(&queue_lock);
+    return found;
+}
+
+void put_back(const Entry& entry) {
+    taskENTER_CRITICAL(&queue_lock);
+    queue.requeue(entry, esp_timer_get_time());
+    taskEXIT_CRITICAL(&queue_lock);
+}
+
+int top_priority() {
+    taskENTER_CRITICAL(&queue_lock);
+    const int priority = queue.top_priority(esp_timer_get_time());
+    taskEXIT_CRITICAL(&queue_lock);
+    return priority;
+}
+
+} // namespace notifications
@@ -1,9 +1,29 @@
 #include "freertos/FreeRTOS.h"
 #include "ota.h"
+#include "config.h"
+#include "ota_package.h"
+#include "ota_resume.h"
+#include "power.h"
+#include "relays_app.h"
+#include "task_profiler.h"
+#include "trace.h"
 #include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "esp_https_ota.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include "nvs.h"
+#include "rom/miniz.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string_view>
 
 // --- Module-Private Constants ---
 namespace {
@@ -11,14 +31,513 @@ namespace {
     constexpr size_t OTA_URL_MAX_LENGTH = 256;
     constexpr size_t OTA_URL_QUEUE_LENGTH = 1;
     constexpr uint32_t OTA_TASK_STACK_SIZE = 8192;
-    constexpr UBaseType_t OTA_TASK_PRIORITY = 5;
+    // Below the gesture task and level with the minute task, which it never preempts.
+    constexpr UBaseType_t OTA_TASK_PRIORITY = 1;
     constexpr uint32_t DEV_TRIGGER_TASK_STACK_SIZE = 4096;
     constexpr UBaseType_t DEV_TRIGGER_TASK_PRIORITY = 4;
+    constexpr char NVS_NAMESPACE[] = "ota";
+    constexpr char NVS_KEY_URL[] = "url";
+    constexpr char NVS_KEY_WRITTEN[] = "written";
+    constexpr char NVS_KEY_BOOTS[] = "boots"; // restarts since the offset last moved
+    constexpr ota_resume::Config RESUME{OTA_SAVE_EVERY_BYTES, OTA_MAX_RESUME_BOOTS,
+                                        OTA_MAX_ATTEMPTS, OTA_RETRY_DELAY_MS};
+
+    portMUX_TYPE progress_lock = portMUX_INITIALIZER_UNLOCKED;
+    OtaProgress progress{OtaState::Idle, 0, -1, 0}; // guarded by progress_lock
+    OtaProgressListener progress_listener = nullptr;
 }
 
+#ifdef ENABLE_OTA_SIGNATURE
+// With the placeholder key every package would be refused, so fail the build instead.
+static_assert(std::string_view(OTA_SIGNING_PUBLIC_KEY_PEM).find("REPLACE_WITH") ==
+                  std::string_view::npos,
+              "ENABLE_OTA_SIGNATURE needs the key printed by ota_pack.py --pubkey in config.h");
+#endif
+
 // --- Module Globals ---
 QueueHandle_t otaUrlQueue;
 
+// =========================================================================
+// Download State
+// =========================================================================
+namespace {
+    void report(const OtaState state, const uint32_t received, const int32_t total,
+                const uint8_t attempt) {
+        taskENTER_CRITICAL(&progress_lock);
+        progress = {state, received, total, attempt};
+        const OtaProgress copy = progress;
+        taskEXIT_CRITICAL(&progress_lock);
+        if (progress_listener)
+            progress_listener(copy);
+    }
+
+    // The interrupted download to continue, empty unless it was for the same URL.
+    ota_resume::Record load_record(const char* url) {
+        ota_resume::Record record{0, 0};
+        nvs_handle_t handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+            return record;
+        char saved_url[OTA_URL_MAX_LENGTH] = {0};
+        size_t url_len = sizeof(saved_url);
+        if (nvs_get_str(handle, NVS_KEY_URL, saved_url, &url_len) == ESP_OK &&
+            strcmp(saved_url, url) == 0) {
+            if (nvs_get_u32(handle, NVS_KEY_WRITTEN, &record.written) != ESP_OK)
+                record.written = 0;
+            if (nvs_get_u8(handle, NVS_KEY_BOOTS, &record.boots) != ESP_OK)
+                record.boots = 0;
+        }
+        nvs_close(handle);
+        return record;
+    }
+
+    bool load_pending_url(char* url, size_t size) {
+        nvs_handle_t handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+            return false;
+        const bool found = nvs_get_str(handle, NVS_KEY_URL, url, &size) == ESP_OK;
+        nvs_close(handle);
+        return found;
+    }
+
+    void save_resume_offset(const char* url, const size_t written) {
+        const ota_resume::Record record =
+            ota_resume::saved(load_record(url), static_cast<uint32_t>(written));
+        nvs_handle_t handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        esp_err_t r = nvs_set_str(handle, NVS_KEY_URL, url);
+        if (r == ESP_OK)
+            r = nvs_set_u32(handle, NVS_KEY_WRITTEN, record.written);
+        if (r == ESP_OK)
+            r = nvs_set_u8(handle, NVS_KEY_BOOTS, record.boots);
+        if (r == ESP_OK)
+            r = nvs_commit(handle);
+        nvs_close(handle);
+        if (r != ESP_OK)
+            ESP_LOGW(TAG, "Failed to save the download offset: %s", esp_err_to_name(r));
+    }
+
+    // Counts a restart that finds the download of @p url pending; false if it is to be dropped.
+    bool count_resume_boot(const char* url, uint8_t& boots) {
+        ota_resume::Record record = load_record(url);
+        const bool resume = ota_resume::count_boot(RESUME, record);
+        boots = record.boots;
+        nvs_handle_t handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+            return resume;
+        if (nvs_set_u8(handle, NVS_KEY_BOOTS, boots) == ESP_OK)
+            nvs_commit(handle);
+        nvs_close(handle);
+        return resume;
+    }
+
+    ota_resume::Result result_of(const esp_err_t err) {
+        if (err == ESP_OK)
+            return ota_resume::Result::Done;
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED)
+            return ota_resume::Result::Invalid;
+        return ota_resume::Result::Failed;
+    }
+
+    void clear_resume_offset() {
+        nvs_handle_t handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        nvs_erase_all(handle);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    /**
+     * @brief One download attempt, continuing at @p written bytes.
+     *
+     * On return @p written holds the bytes in the partition, also after a failure.
+     */
+    esp_err_t download(const char* url, size_t& written, const uint8_t attempt) {
+        const esp_http_client_config_t http_config = {
+            .url = url,
+            .cert_pem = nullptr, // Setting this to nullptr allows plain HTTP URLs.
+            .timeout_ms = 15000,
+            .buffer_size = OTA_HTTP_BUFFER_SIZE, // bytes read and written per chunk
+            .keep_alive_enable = true,
+        };
+        const esp_https_ota_config_t ota_config = {
+            .http_config = &http_config,
+            .partial_http_download = true, // Range requests bound the server-side buffering
+            .max_http_request_size = OTA_HTTP_REQUEST_SIZE,
+            .ota_resumption = written > 0,
+            .ota_image_bytes_written = written,
+        };
+
+        esp_https_ota_handle_t handle = nullptr;
+        esp_err_t err = esp_https_ota_begin(&ota_config, &handle);
+        if (err != ESP_OK)
+            return err;
+        const int32_t total = esp_https_ota_get_image_size(handle);
+        size_t saved = written;
+        int last_percent = -1;
+        report(OtaState::Downloading, written, total, attempt);
+        for (;;) {
+            {
+                power::Boost boost(power::Lock::Network);
+                err = esp_https_ota_perform(handle);
+            }
+            if (err != ESP_ERR_HTTPS_OTA_IN_PROGRESS)
+                break;
+            written = static_cast<size_t>(esp_https_ota_get_image_len_read(handle));
+            if (ota_resume::save_due(RESUME, saved, written)) {
+                save_resume_offset(url, written);
+                saved = written;
+            }
+            if (const int percent = total > 0 ? static_cast<int>(written * 100 / total) : -1;
+                percent != last_percent) {
+                report(OtaState::Downloading, written, total, attempt);
+                last_percent = percent;
+            }
+            // The only point where the clock and the sensors get the CPU back for sure.
+            vTaskDelay(pdMS_TO_TICKS(OTA_CHUNK_PAUSE_MS));
+        }
+        written = static_cast<size_t>(esp_https_ota_get_image_len_read(handle));
+        if (err == ESP_OK && !esp_https_ota_is_complete_data_received(handle))
+            err = ESP_ERR_INVALID_SIZE;
+        if (err != ESP_OK) {
+            save_resume_offset(url, written);
+            esp_https_ota_abort(handle);
+            return err;
+        }
+
+        report(OtaState::Verifying, written, total, attempt);
+        return esp_https_ota_finish(handle); // validates the image, then sets the boot partition
+    }
+}
+
+// =========================================================================
+// Compressed Packages (see ota_package.h)
+// =========================================================================
+namespace {
+    using Buffer = std::unique_ptr<uint8_t, void (*)(void*)>;
+
+    Buffer allocate(const size_t size) {
+        return {static_cast<uint8_t*>(malloc(size)), free};
+    }
+
+    // Reads @p len bytes unless the response ends first; returns the bytes read.
+    size_t read_fully(esp_http_client_handle_t client, uint8_t* buf, const size_t len) {
+        size_t got = 0;
+        while (got < len) {
+            const int n = esp_http_client_read(client, reinterpret_cast<char*>(buf + got),
+                                               static_cast<int>(len - got));
+            if (n <= 0)
+                break;
+            got += static_cast<size_t>(n);
+        }
+        return got;
+    }
+
+    // A signature that is there must hold; with ENABLE_OTA_SIGNATURE one is also required.
+    bool signature_valid(const uint8_t* raw_header, const OtaPackageHeader& header) {
+        if (header.signature_len == 0) {
+#ifdef ENABLE_OTA_SIGNATURE
+            return false;
+#else
+            return true;
+#endif
+        }
+        uint8_t hash[32];
+        if (mbedtls_sha256(raw_header, OTA_PACKAGE_SIGNED_SIZE, hash, 0) != 0)
+            return false;
+        mbedtls_pk_context key;
+        mbedtls_pk_init(&key);
+        const bool valid =
+            mbedtls_pk_parse_public_key(
+                &key, reinterpret_cast<const unsigned char*>(OTA_SIGNING_PUBLIC_KEY_PEM),
+                sizeof(OTA_SIGNING_PUBLIC_KEY_PEM)) == 0 &&
+            mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, hash, sizeof(hash), header.signature,
+                              header.signature_len) == 0;
+        mbedtls_pk_free(&key);
+        return valid;
+    }
+
+    // Hashes the image as it is rebuilt and writes it to the update partition.
+    struct ImageWriter {
+        esp_ota_handle_t ota;
+        mbedtls_sha256_context sha;
+        size_t written;
+        size_t size;
+
+        esp_err_t write(const uint8_t* data, const size_t len) {
+            if (len > size - written)
+                return ESP_ERR_OTA_VALIDATE_FAILED; // more than the header announced
+            mbedtls_sha256_update(&sha, data, len);
+            written += len;
+            return esp_ota_write(ota, data, len);
+        }
+    };
+
+    /**
+     * @brief Inflates the payload from @p client and passes it on to @p sink.
+     *
+     * Memory use is bounded by the window, one input chunk and the inflater state,
+     * whatever the compression ratio: output is passed on whenever the window fills.
+     * @p sink is `esp_err_t sink(const uint8_t* data, size_t len)`.
+     */
+    template <typename Sink>
+    esp_err_t inflate_payload(esp_http_client_handle_t client, const OtaPackageHeader& header,
+                              const size_t consumed, const int32_t total, const uint8_t attempt,
+                              Sink&& sink) {
+        const size_t window_size = size_t{1} << header.window_bits;
+        Buffer state = allocate(sizeof(tinfl_decompressor));
+        Buffer window = allocate(window_size);
+        Buffer input = allocate(OTA_HTTP_BUFFER_SIZE);
+        if (!state || !window || !input)
+            return ESP_ERR_NO_MEM;
+        auto* inflater = reinterpret_cast<tinfl_decompressor*>(state.get());
+        tinfl_init(inflater);
+
+        esp_err_t err = ESP_OK;
+        tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+        size_t payload_read = 0;
+        size_t out_pos = 0;
+        int last_percent = -1;
+        while (err == ESP_OK && status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            const size_t want =
+                std::min<size_t>(OTA_HTTP_BUFFER_SIZE, header.payload_size - payload_read);
+            int n = 0;
+            if (want > 0) {
+                power::Boost boost(power::Lock::Network);
+                n = esp_http_client_read(client, reinterpret_cast<char*>(input.get()),
+                                         static_cast<int>(want));
+            }
+            if (n <= 0) {
+                err = ESP_ERR_INVALID_SIZE; // connection lost, or the payload ends early
+                break;
+            }
+            payload_read += static_cast<size_t>(n);
+            const int flags = payload_read < header.payload_size ? TINFL_FLAG_HAS_MORE_INPUT : 0;
+            const uint8_t* next = input.get();
+            size_t avail = static_cast<size_t>(n);
+            do {
+                size_t in_bytes = avail;
+                size_t out_bytes = window_size - out_pos;
+                status = tinfl_decompress(inflater, next, &in_bytes, window.get(),
+                                          window.get() + out_pos, &out_bytes, flags);
+                next += in_bytes;
+                avail -= in_bytes;
+                if (out_bytes > 0) {
+                    err = sink(window.get() + out_pos, out_bytes);
+                    out_pos = (out_pos + out_bytes) & (window_size - 1);
+                }
+            } while (err == ESP_OK && status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+            const auto received = static_cast<uint32_t>(consumed + payload_read);
+            if (const int percent = total > 0 ? static_cast<int>(received * 100LL / total) : -1;
+                percent != last_percent) {
+                report(OtaState::Downloading, received, total, attempt);
+                last_percent = percent;
+            }
+            vTaskDelay(pdMS_TO_TICKS(OTA_CHUNK_PAUSE_MS));
+        }
+        // A corrupt stream will not get better by downloading it again.
+        if (err == ESP_OK && status != TINFL_STATUS_DONE)
+            err = ESP_ERR_OTA_VALIDATE_FAILED;
+        return err;
+    }
+
+    /**
+     * @brief Rebuilds the image of @p header in @p partition, from the payload alone
+     *        or, with a @p base, from the payload applied as a patch to it.
+     */
+    esp_err_t install_image(esp_http_client_handle_t client, const OtaPackageHeader& header,
+                            const esp_partition_t* partition, const uint8_t* base,
+                            const size_t base_size, const size_t consumed, const int32_t total,
+                            const uint8_t attempt) {
+        ImageWriter writer{};
+        writer.size = header.image_size;
+        // Sectors are erased as the writes reach them, not all up front: a full erase of
+        // the partition would stall flash access for seconds before the first byte.
+        esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &writer.ota);
+        if (err != ESP_OK)
+            return err;
+        mbedtls_sha256_init(&writer.sha);
+        mbedtls_sha256_starts(&writer.sha, 0);
+
+        // Measured, not just the sum of our buffers: the HTTP client and TLS allocate too.
+        const size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        heap_caps_monitor_local_minimum_free_size_start();
+        const int64_t start_us = esp_timer_get_time();
+        size_t buffers = sizeof(tinfl_decompressor) + (size_t{1} << header.window_bits) +
+                         OTA_HTTP_BUFFER_SIZE;
+        if (!base) {
+            err = inflate_payload(client, header, consumed, total, attempt,
+                                  [&](const uint8_t* data, const size_t len) {
+                                      return writer.write(data, len);
+                                  });
+        } else if (Buffer scratch = allocate(OTA_HTTP_BUFFER_SIZE); !scratch) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            buffers += OTA_HTTP_BUFFER_SIZE;
+            OtaDeltaDecoder patch(base, base_size, scratch.get(), OTA_HTTP_BUFFER_SIZE);
+            err = inflate_payload(
+                client, header, consumed, total, attempt,
+                [&](const uint8_t* data, const size_t len) {
+                    esp_err_t write_err = ESP_OK;
+                    bool stopped = false;
+                    const OtaPackageError e = patch.feed(
+                        data, len,
+                        [&](const uint8_t* out, const size_t out_len) {
+                            write_err = writer.write(out, out_len);
+                            return write_err == ESP_OK;
+                        },
+                        stopped);
+                    if (e != OtaPackageError::None) {
+                        ESP_LOGE(TAG, "Rejected package: %s", ota_package_error_name(e));
+                        return ESP_ERR_OTA_VALIDATE_FAILED;
+                    }
+                    return write_err;
+                });
+            if (err == ESP_OK && !patch.at_op_boundary())
+                err = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        const int64_t elapsed_us = esp_timer_get_time() - start_us;
+        const size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+        heap_caps_monitor_local_minimum_free_size_stop();
+        const size_t peak_heap = free_before > min_free ? free_before - min_free : 0;
+
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&writer.sha, digest);
+        mbedtls_sha256_free(&writer.sha);
+        if (err == ESP_OK && (writer.written != header.image_size ||
+                              memcmp(digest, header.image_sha256, sizeof(digest)) != 0)) {
+            ESP_LOGE(TAG, "Package content does not match its header (%u of %u bytes)",
+                     static_cast<unsigned>(writer.written),
+                     static_cast<unsigned>(header.image_size));
+            err = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        if (err != ESP_OK) {
+            esp_ota_abort(writer.ota);
+            return err;
+        }
+        ESP_LOGI(TAG,
+                 "Rebuilt %u bytes from %u in %lld ms (%lld KiB/s), heap peak %u bytes "
+                 "(%u of them buffers, inflater state %u), %u free at least",
+                 static_cast<unsigned>(writer.written),
+                 static_cast<unsigned>(consumed + header.payload_size), elapsed_us / 1000,
+                 writer.written * 1000000LL / 1024 / std::max<int64_t>(elapsed_us, 1),
+                 static_cast<unsigned>(peak_heap), static_cast<unsigned>(buffers),
+                 static_cast<unsigned>(sizeof(tinfl_decompressor)),
+                 static_cast<unsigned>(min_free));
+
+        report(OtaState::Verifying, static_cast<uint32_t>(consumed + header.payload_size), total,
+               attempt);
+        err = esp_ota_end(writer.ota); // validates the app image itself
+        if (err == ESP_OK)
+            err = esp_ota_set_boot_partition(partition);
+        return err;
+    }
+
+    /**
+     * @brief Checks that the running image is the base of a delta package and maps it.
+     */
+    esp_err_t map_delta_base(esp_http_client_handle_t client, const uint8_t*& base,
+                             size_t& base_size, esp_partition_mmap_handle_t& mapping) {
+        uint8_t raw[OTA_DELTA_BASE_SIZE];
+        OtaDeltaBase expected{};
+        if (decode_ota_delta_base(raw, read_fully(client, raw, sizeof(raw)), expected) !=
+            OtaPackageError::None)
+            return ESP_ERR_INVALID_SIZE;
+
+        const esp_partition_t* running = esp_ota_get_running_partition();
+        if (!running || expected.size > running->size) {
+            ESP_LOGE(TAG, "Rejected package: base of %u bytes is not the running image",
+                     static_cast<unsigned>(expected.size));
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        const void* mapped = nullptr;
+        if (const esp_err_t err = esp_partition_mmap(running, 0, expected.size,
+                                                     ESP_PARTITION_MMAP_DATA, &mapped, &mapping);
+            err != ESP_OK)
+            return err;
+
+        uint8_t digest[32];
+        mbedtls_sha256(static_cast<const uint8_t*>(mapped), expected.size, digest, 0);
+        if (memcmp(digest, expected.sha256, sizeof(digest)) != 0) {
+            ESP_LOGE(TAG, "Rejected package: patch is for another base image");
+            esp_partition_munmap(mapping);
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        base = static_cast<const uint8_t*>(mapped);
+        base_size = expected.size;
+        return ESP_OK;
+    }
+
+    /**
+     * @brief Installs the package served at @p url.
+     * @return ESP_ERR_NOT_SUPPORTED if the URL serves a plain image instead.
+     */
+    esp_err_t install_package(const char* url, const uint8_t attempt) {
+        const esp_http_client_config_t http_config = {
+            .url = url,
+            .cert_pem = nullptr,
+            .timeout_ms = 15000,
+            .buffer_size = OTA_HTTP_BUFFER_SIZE,
+            .keep_alive_enable = true,
+        };
+        esp_http_client_handle_t client = esp_http_client_init(&http_config);
+        if (!client)
+            return ESP_ERR_NO_MEM;
+
+        esp_err_t err = esp_http_client_open(client, 0);
+        if (err == ESP_OK) {
+            const int64_t length = esp_http_client_fetch_headers(client);
+            const int32_t total = length > 0 ? static_cast<int32_t>(length) : -1;
+            uint8_t raw[OTA_PACKAGE_HEADER_SIZE];
+            OtaPackageHeader header{};
+            const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+            if (esp_http_client_get_status_code(client) != 200) {
+                err = ESP_FAIL;
+            } else if (const size_t got = read_fully(client, raw, sizeof(raw));
+                       !is_ota_package(raw, got)) {
+                err = ESP_ERR_NOT_SUPPORTED;
+            } else if (const OtaPackageError e = decode_ota_package_header(raw, got, header);
+                       e != OtaPackageError::None) {
+                ESP_LOGE(TAG, "Rejected package: %s", ota_package_error_name(e));
+                err = ESP_ERR_OTA_VALIDATE_FAILED;
+            } else if (!signature_valid(raw, header)) {
+                ESP_LOGE(TAG, "Rejected package: signature not valid");
+                err = ESP_ERR_OTA_VALIDATE_FAILED;
+            } else if (!partition || header.image_size > partition->size) {
+                ESP_LOGE(TAG, "Rejected package: image of %u bytes does not fit",
+                         static_cast<unsigned>(header.image_size));
+                err = ESP_ERR_OTA_VALIDATE_FAILED;
+            } else if (header.kind == OtaPackageKind::Delta) {
+                const uint8_t* base = nullptr;
+                size_t base_size = 0;
+                esp_partition_mmap_handle_t mapping = 0;
+                err = map_delta_base(client, base, base_size, mapping);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "Delta package: %u bytes from a %u byte patch on %u bytes",
+                             static_cast<unsigned>(header.image_size),
+                             static_cast<unsigned>(header.payload_size),
+                             static_cast<unsigned>(base_size));
+                    err = install_image(client, header, partition, base, base_size,
+                                        OTA_PACKAGE_HEADER_SIZE + OTA_DELTA_BASE_SIZE, total,
+                                        attempt);
+                    esp_partition_munmap(mapping);
+                }
+            } else {
+                ESP_LOGI(TAG, "Package: %u bytes deflated to %u, window %u bytes",
+                         static_cast<unsigned>(header.image_size),
+                         static_cast<unsigned>(header.payload_size), 1u << header.window_bits);
+                err = install_image(client, header, partition, nullptr, 0,
+                                    OTA_PACKAGE_HEADER_SIZE, total, attempt);
+            }
+        }
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        return err;
+    }
+}
+
 // =========================================================================
 // Production OTA Update Task
 // =========================================================================
@@ -27,34 +546,58 @@ void otaUpdateTask(void* pvParameters) {
     char urlBuffer[OTA_URL_MAX_LENGTH];
 
     for (;;) {
-        if (xQueueReceive(otaUrlQueue, &urlBuffer, portMAX_DELAY) == pdPASS) {
-            ESP_LOGI(TAG, "OTA task received URL: %s", urlBuffer);
-
-            // Step 1: Configure the underlying HTTP client.
-            // This is the same as before, but we'll name it http_config for clarity.
-            const esp_http_client_config_t http_config = {
-                .url = urlBuffer,
-                .cert_pem = nullptr, // Setting this to nullptr allows plain HTTP URLs.
-                .timeout_ms = 15000,
-                .keep_alive_enable = true,
-            };
-
-            // Step 2: Create the new, required esp_https_ota_config_t struct.
-            // This struct wraps the HTTP client configuration.
-            const esp_https_ota_config_t ota_config = {
-                .http_config = &http_config,
-            };
-
-            // Step 3: Call esp_https_ota() with a pointer to the new ota_config struct.
-            const esp_err_t ret = esp_https_ota(&ota_config);
-
-            if (ret == ESP_OK) {
-                ESP_LOGI(TAG, "OTA update successful. Rebooting now.");
-                vTaskDelay(pdMS_TO_TICKS(1000));
-                esp_restart();
-            } else {
-                ESP_LOGE(TAG, "OTA update failed: %s", esp_err_to_name(ret));
+        if (xQueueReceive(otaUrlQueue, &urlBuffer, portMAX_DELAY) != pdPASS)
+            continue;
+        ESP_LOGI(TAG, "OTA task received URL: %s", urlBuffer);
+        // Pending relay state must not wait behind a long flash write.
+        relays_app_flush();
+
+        if (const size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+            free_heap < OTA_MIN_FREE_HEAP) {
+            ESP_LOGE(TAG, "Only %u bytes of heap free, update refused",
+                     static_cast<unsigned>(free_heap));
+            report(OtaState::Failed, 0, -1, 0);
+            continue;
+        }
+
+        size_t written = load_record(urlBuffer).written;
+        esp_err_t ret = ESP_FAIL;
+        ota_resume::Next next{ota_resume::Action::Keep, 0};
+        for (uint8_t attempt = 1;; ++attempt) {
+            if (written > 0)
+                ESP_LOGI(TAG, "Resuming at %u bytes", static_cast<unsigned>(written));
+            // Packages are inflated as they arrive and always start over; plain images resume.
+            ret = install_package(urlBuffer, attempt);
+            if (ret == ESP_ERR_NOT_SUPPORTED) {
+#ifdef ENABLE_OTA_SIGNATURE
+                ESP_LOGE(TAG, "Not a signed package, update refused");
+                ret = ESP_ERR_OTA_VALIDATE_FAILED;
+#else
+                ret = download(urlBuffer, written, attempt);
+#endif
             }
+            // A complete image that does not validate will not get better by retrying.
+            next = ota_resume::after_attempt(RESUME, result_of(ret), attempt);
+            if (next.action != ota_resume::Action::Retry)
+                break;
+            ESP_LOGW(TAG, "Attempt %u failed at %u bytes: %s", attempt,
+                     static_cast<unsigned>(written), esp_err_to_name(ret));
+            vTaskDelay(pdMS_TO_TICKS(next.delay_ms));
+        }
+
+        if (next.action == ota_resume::Action::Install) {
+            clear_resume_offset();
+            const OtaProgress last = ota_get_progress();
+            report(OtaState::Done, last.received, last.total, 0);
+            ESP_LOGI(TAG, "OTA update successful. Rebooting now.");
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            esp_restart();
+        } else {
+            // Unless dropped, the offset stays saved and the next trigger or restart continues.
+            if (next.action == ota_resume::Action::Drop)
+                clear_resume_offset();
+            report(OtaState::Failed, written, -1, 0);
+            ESP_LOGE(TAG, "OTA update failed: %s", esp_err_to_name(ret));
         }
     }
 }
@@ -103,6 +646,10 @@ namespace DevTrigger {
 
         if (httpd_start(&server, &config) == ESP_OK) {
             httpd_register_uri_handler(server, &ota_trigger_uri);
+#ifdef ENABLE_TASK_PROFILER
+            task_profiler::register_uri(server);
+#endif
+            trace::register_uri(server);
             ESP_LOGI(TAG, "Development OTA trigger server is running.");
         } else {
             ESP_LOGE(TAG, "Error starting dev trigger server!");
@@ -112,7 +659,7 @@ namespace DevTrigger {
 } // namespace DevTrigger
 
 // =========================================================================
-// Public Start Function
+// Public Functions
 // =========================================================================
 void ota_app_start() {
     otaUrlQueue = xQueueCreate(OTA_URL_QUEUE_LENGTH, OTA_URL_MAX_LENGTH);
@@ -121,6 +668,48 @@ void ota_app_start() {
         return;
     }
 
+    // A download interrupted by a restart continues without a new trigger, unless it has
+    // already been continued OTA_MAX_RESUME_BOOTS times without getting any further, e.g.
+    // because something in the download itself keeps resetting the chip.
+    if (char url[OTA_URL_MAX_LENGTH]; load_pending_url(url, sizeof(url))) {
+        if (uint8_t boots = 0; !count_resume_boot(url, boots)) {
+            ESP_LOGE(TAG, "Update from %s made no progress in %u restarts, dropped", url,
+                     static_cast<unsigned>(boots - 1));
+            clear_resume_offset();
+        } else {
+            ESP_LOGI(TAG, "Continuing the interrupted update from %s (restart %u)", url,
+                     static_cast<unsigned>(boots));
+            xQueueSend(otaUrlQueue, url, 0);
+        }
+    }
+
     xTaskCreate(otaUpdateTask, "OTA Update Task", OTA_TASK_STACK_SIZE, nullptr, OTA_TASK_PRIORITY, nullptr);
     xTaskCreate(DevTrigger::dev_ota_trigger_task, "Dev OTA Trigger", DEV_TRIGGER_TASK_STACK_SIZE, nullptr, DEV_TRIGGER_TASK_PRIORITY, nullptr);
-}
\ No newline at end of file
+}
+
+void ota_set_progress_listener(const OtaProgressListener listener) {
+    progress_listener = listener;
+}
+
+OtaProgress ota_get_progress() {
+    taskENTER_CRITICAL(&progress_lock);
+    const OtaProgress copy = progress;
+    taskEXIT_CRITICAL(&progress_lock);
+    return copy;
+}
+
+const char* ota_state_name(const OtaState state) {
+    switch (state) {
+    case OtaState::Idle:
+        return "idle";
+    case OtaState::Downloading:
+        return "downloading";
+    case OtaState::Verifying:
+        return "verifying";
+    case OtaState::Done:
+        return "done";
+    case OtaState::Failed:
+        return "failed";
+    }
+    return "?";
+}
@@ -0,0 +1,151 @@
+#include "power.h"
+
+#include "config.h"
+#include "esp_freertos_hooks.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+#include <atomic>
+
+namespace power {
+
+namespace {
+constexpr auto TAG = "POWER";
+constexpr const char* LOCK_NAMES[] = {"render", "network"};
+static_assert(sizeof(LOCK_NAMES) / sizeof(LOCK_NAMES[0]) == static_cast<size_t>(Lock::Count));
+
+esp_pm_lock_handle_t locks[static_cast<size_t>(Lock::Count)]{};
+gpio_num_t wake_pin = GPIO_NUM_NC;
+void (*wake_handler)() = nullptr;
+gpio_int_type_t wake_pin_intr = GPIO_INTR_NEGEDGE;
+// Set by on_sleep_exit(), handed to wake_handler by the idle hook once interrupts are back on.
+std::atomic<bool> pin_woke{false};
+
+// Written from the idle task with interrupts disabled, read by get_stats().
+portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+SleepStats stats{};
+int64_t started_us = 0;
+int64_t planned_sleep_us = 0;
+bool pin_armed = false;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// The sleep callbacks run from the idle task with interrupts off and the flash cache possibly
+// disabled, so the pin is switched through the inline low level GPIO functions, not the driver.
+// The other core is stalled meanwhile, so the registers need no lock.
+esp_err_t IRAM_ATTR on_sleep_enter(const int64_t sleep_time_us, void* /*arg*/) {
+    planned_sleep_us = sleep_time_us;
+    // Only level wake-ups work in light sleep. A line that is already low belongs
+    // to an event still being handled and would end every sleep at once.
+    pin_armed = wake_pin != GPIO_NUM_NC && gpio_ll_get_level(&GPIO, wake_pin) != 0;
+    if (pin_armed) {
+        gpio_ll_set_intr_type(&GPIO, wake_pin, GPIO_INTR_LOW_LEVEL);
+        gpio_ll_wakeup_enable(&GPIO, wake_pin);
+    }
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR on_sleep_exit(const int64_t slept_us, void* /*arg*/) {
+    const esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    if (pin_armed) {
+        gpio_ll_wakeup_disable(&GPIO, wake_pin);
+        gpio_ll_set_intr_type(&GPIO, wake_pin, wake_pin_intr);
+        if (cause == ESP_SLEEP_WAKEUP_GPIO)
+            pin_woke.store(true, std::memory_order_relaxed);
+    }
+
+    taskENTER_CRITICAL_ISR(&stats_lock);
+    stats.sleeps++;
+    stats.slept_us += slept_us;
+    if (cause == ESP_SLEEP_WAKEUP_TIMER) {
+        const int64_t late_us = slept_us - planned_sleep_us;
+        stats.last_late_us = late_us;
+        if (late_us > stats.max_late_us)
+            stats.max_late_us = late_us;
+    }
+    taskEXIT_CRITICAL_ISR(&stats_lock);
+    return ESP_OK;
+}
+
+// Runs in the idle loop after the sleep returned, before the next one, with interrupts on.
+bool deliver_wake() {
+    if (pin_woke.exchange(false, std::memory_order_relaxed) && wake_handler)
+        wake_handler();
+    return true;
+}
+#endif
+} // namespace
+
+void start() {
+    started_us = esp_timer_get_time();
+#if CONFIG_PM_ENABLE
+    const esp_pm_config_t config = {
+        .max_freq_mhz = CPU_FREQ_MAX_MHZ,
+        .min_freq_mhz = CPU_FREQ_MIN_MHZ,
+#ifdef ENABLE_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#else
+        .light_sleep_enable = false,
+#endif
+    };
+    if (const esp_err_t err = esp_pm_configure(&config); err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+        return;
+    }
+    for (size_t i = 0; i < static_cast<size_t>(Lock::Count); ++i)
+        esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, LOCK_NAMES[i], &locks[i]);
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t callbacks = {};
+    callbacks.enter_cb = on_sleep_enter;
+    callbacks.exit_cb = on_sleep_exit;
+    esp_pm_light_sleep_register_cbs(&callbacks);
+#endif
+    ESP_LOGI(TAG, "DFS %d-%d MHz, light sleep %s", CPU_FREQ_MIN_MHZ, CPU_FREQ_MAX_MHZ,
+             config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_ENABLE is off, running at a fixed frequency");
+#endif
+}
+
+void set_wake_pin(const gpio_num_t pin, void (*handler)()) {
+    wake_handler = handler;
+    wake_pin = pin;
+    esp_sleep_enable_gpio_wakeup();
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    // Light sleep is entered from the idle task of either core.
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core)
+        if (esp_register_freertos_idle_hook_for_cpu(deliver_wake, core) != ESP_OK)
+            ESP_LOGE(TAG, "Cannot install the wake hook on core %d", core);
+#endif
+}
+
+Boost::Boost(const Lock lock) : handle_(locks[static_cast<size_t>(lock)]) {
+    if (handle_)
+        esp_pm_lock_acquire(handle_);
+}
+
+Boost::~Boost() {
+    if (handle_)
+        esp_pm_lock_release(handle_);
+}
+
+SleepStats get_stats() {
+    taskENTER_CRITICAL(&stats_lock);
+    SleepStats out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+    out.window_us = esp_timer_get_time() - started_us;
+    return out;
+}
+
+void log_stats() {
+    const SleepStats s = get_stats();
+    const int64_t permille = s.window_us > 0 ? s.slept_us * 1000 / s.window_us : 0;
+    ESP_LOGI(TAG, "Light sleep: %lu sleeps, residency %lld.%lld%%, wake-up late %lld us (max %lld)",
+             static_cast<unsigned long>(s.sleeps), permille / 10, permille % 10, s.last_late_us,
+             s.max_late_us);
+}
+
+} // namespace power
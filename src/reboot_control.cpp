@@ -1,94 +1,135 @@
 #include "reboot_control.h"
 
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs.h"
 
-#include <HardwareSerial.h>
-
 // Reboot storm detection mechanism.
+//
+// Restarts are counted in RTC memory, which survives everything except a
+// power-on and possibly a brown-out, so a crash loop never touches flash.
+// NVS is the fallback: it is read after a power-on and written only after a
+// brown-out, where RTC memory cannot be trusted.
 namespace reboot_control {
 
+namespace {
+constexpr auto TAG = "REBOOT";
 constexpr uint8_t MAX_REBOOTS = 3;
 constexpr uint32_t STABLE_RUNTIME_MS = 20000;
-constexpr uint32_t SLEEP_TIME_ON_STORM_US = 30000000;
-const char NVS_NAMESPACE[] = "reboots";
-const char VAR_NAME[] = "reboot_count";
+constexpr uint64_t SLEEP_TIME_ON_STORM_US = 30000000;
+constexpr char NVS_NAMESPACE[] = "reboots";
+constexpr char VAR_NAME[] = "reboot_count";
+constexpr uint32_t RTC_COUNTER_MAGIC = 0x52424f4f; // "RBOO"
 
-ByteResult increment_reboot_count() {
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK)
-        return ByteResult::Err("RebootControl: Failed to open NVS namespace");
+struct RtcCounter {
+    uint32_t magic;
+    uint8_t count;     // restarts without a stable runtime in between
+    uint8_t nvs_count; // last value known to be in NVS
+    uint16_t check;
+};
 
-    uint8_t count = 0;
-    esp_err_t r = nvs_get_u8(handle, VAR_NAME, &count);
-    if (r != ESP_OK && r != ESP_ERR_NVS_NOT_FOUND) {
-        nvs_close(handle);
-        return ByteResult::Err("RebootControl: Failed to read reboot count from NVS");
-    }
-    count++;
-    nvs_set_u8(handle, VAR_NAME, count);
-    r = nvs_commit(handle);
-    if (r != ESP_OK) {
-        nvs_close(handle);
-        return ByteResult::Err("RebootControl: Failed to commit reboot count to NVS");
-    }
-    nvs_close(handle);
+RTC_NOINIT_ATTR RtcCounter rtc_counter;
+
+uint16_t check_of(const RtcCounter& c) {
+    return static_cast<uint16_t>(~(c.count | c.nvs_count << 8));
+}
+
+bool rtc_counter_valid() {
+    return rtc_counter.magic == RTC_COUNTER_MAGIC && rtc_counter.check == check_of(rtc_counter);
+}
 
-    Serial.printf("RebootControl: Reboot count: %d\n", count);
+void set_rtc_counter(const uint8_t count, const uint8_t nvs_count) {
+    rtc_counter.magic = RTC_COUNTER_MAGIC;
+    rtc_counter.count = count;
+    rtc_counter.nvs_count = nvs_count;
+    rtc_counter.check = check_of(rtc_counter);
+}
 
+ByteResult read_nvs_count() {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return ByteResult::Ok(0); // namespace not created yet
+    uint8_t count = 0;
+    const esp_err_t r = nvs_get_u8(handle, VAR_NAME, &count);
+    nvs_close(handle);
+    if (r != ESP_OK && r != ESP_ERR_NVS_NOT_FOUND)
+        return ByteResult::Err("Failed to read reboot count from NVS");
     return ByteResult::Ok(count);
 }
 
-ByteResult reset_reboot_count() {
+ByteResult write_nvs_count(const uint8_t count) {
     nvs_handle_t handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK)
-        return ByteResult::Err("RebootControl: Failed to open NVS namespace");
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return ByteResult::Err("Failed to open NVS namespace");
+    esp_err_t r = nvs_set_u8(handle, VAR_NAME, count);
+    if (r == ESP_OK)
+        r = nvs_commit(handle);
+    nvs_close(handle);
+    if (r != ESP_OK)
+        return ByteResult::Err("Failed to commit reboot count to NVS");
+    return ByteResult::Ok(count);
+}
 
-    nvs_set_u8(handle, VAR_NAME, 0);
-    esp_err_t r = nvs_commit(handle);
-    if (r != ESP_OK) {
-        nvs_close(handle);
-        return ByteResult::Err("RebootControl: Failed to commit reboot count to NVS");
+uint8_t count_this_boot() {
+    const esp_reset_reason_t reason = esp_reset_reason();
+    const bool brownout = reason == ESP_RST_BROWNOUT;
+    uint8_t count = 0;
+    uint8_t nvs_count = 0;
+    if (reason != ESP_RST_POWERON && !brownout && rtc_counter_valid()) {
+        count = rtc_counter.count;
+        nvs_count = rtc_counter.nvs_count;
+    } else if (const ByteResult res = read_nvs_count(); res) {
+        count = nvs_count = res.unwrap();
+    } else {
+        ESP_LOGW(TAG, "%s", res.unwrapErr());
     }
-    nvs_close(handle);
+    if (count < UINT8_MAX)
+        ++count;
+    if (brownout) {
+        if (const ByteResult res = write_nvs_count(count); res)
+            nvs_count = count;
+        else
+            ESP_LOGW(TAG, "%s", res.unwrapErr());
+    }
+    set_rtc_counter(count, nvs_count);
+    ESP_LOGI(TAG, "Reboot count: %u (reset reason %d)", static_cast<unsigned>(count),
+             static_cast<int>(reason));
+    return count;
+}
 
-    Serial.println("RebootControl: Reboot count reset.");
-    return ByteResult::Ok(0);
+void reset_reboot_count() {
+    const uint8_t nvs_count = rtc_counter.nvs_count;
+    set_rtc_counter(0, nvs_count);
+    if (nvs_count == 0)
+        return;
+    if (const ByteResult res = write_nvs_count(0); res)
+        set_rtc_counter(0, 0);
+    else
+        ESP_LOGW(TAG, "%s", res.unwrapErr());
 }
 
-void reset_reboot_counter_task(void* param) {
+void reset_reboot_counter_task(void* /*param*/) {
     vTaskDelay(pdMS_TO_TICKS(STABLE_RUNTIME_MS));
-    ByteResult res = reset_reboot_count();
-    if (!res) {
-        Serial.println(res.unwrapErr());
-        return;
-    } else {
-        Serial.println("Device runtime stable. Reboot counter reset.");
-    }
-    vTaskDelete(NULL); // Delete the task
+    reset_reboot_count();
+    ESP_LOGI(TAG, "Device runtime stable. Reboot counter reset.");
+    vTaskDelete(nullptr);
 }
+} // namespace
 
 void handleRebootStormDetection() {
-    // Reboot storm detection mechanism.
-    ByteResult res = increment_reboot_count();
-    if (!res) {
-        Serial.println(res.unwrapErr());
-        return;
-    }
-    uint8_t reboot_count = res.unwrap();
-    if (reboot_count >= MAX_REBOOTS) {
-        Serial.println("Reboot storm detected! Entering deep sleep for " +
-                       String(SLEEP_TIME_ON_STORM_US) + " ms");
+    if (count_this_boot() >= MAX_REBOOTS) {
+        ESP_LOGE(TAG, "Reboot storm detected! Entering deep sleep for %llu ms",
+                 SLEEP_TIME_ON_STORM_US / 1000);
         reset_reboot_count();
         esp_sleep_enable_timer_wakeup(SLEEP_TIME_ON_STORM_US);
         esp_deep_sleep_start();
     }
     // Monitor uptime to reset reboot counter after stable runtime.
-    xTaskCreate(reboot_control::reset_reboot_counter_task, "ResetRebootCounter", 2048, NULL, 1,
-                NULL);
+    xTaskCreate(reset_reboot_counter_task, "ResetRebootCounter", 2048, nullptr, 1, nullptr);
 }
 
 } // namespace reboot_control
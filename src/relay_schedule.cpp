@@ -0,0 +1,303 @@
+#include "relay_schedule.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace relay_schedule {
+
+namespace {
+
+constexpr int64_t SECONDS_PER_DAY = 86400;
+constexpr int MAX_SUN_OFFSET_MIN = 12 * 60;
+constexpr char DAY_LETTERS[] = "MTWTFSS"; // Monday first, as written by people
+constexpr double DEG = M_PI / 180.0;
+
+int64_t floor_div(const int64_t a, const int64_t b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+int weekday(const int64_t day) {
+    const int64_t wd = (day + 4) % 7; // 1970-01-01 was a Thursday
+    return static_cast<int>(wd < 0 ? wd + 7 : wd);
+}
+
+bool before(const Event& a, const Event& b) {
+    if (a.anchor != b.anchor)
+        return a.anchor < b.anchor;
+    if (a.minute != b.minute)
+        return a.minute < b.minute;
+    return a.relay < b.relay;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\n' || s.front() == '\r'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\n' || s.back() == '\r'))
+        s.remove_suffix(1);
+    return s;
+}
+
+// Splits off the text up to the next separator.
+std::string_view next_field(std::string_view& s, const char sep) {
+    const size_t pos = s.find(sep);
+    const std::string_view field = trim(s.substr(0, pos));
+    s.remove_prefix(pos == std::string_view::npos ? s.size() : pos + 1);
+    return field;
+}
+
+bool parse_int(std::string_view s, int& out) {
+    bool negative = false;
+    if (!s.empty() && (s.front() == '+' || s.front() == '-')) {
+        negative = s.front() == '-';
+        s.remove_prefix(1);
+    }
+    if (s.empty() || s.size() > 4)
+        return false;
+    int v = 0;
+    for (const char c : s) {
+        if (c < '0' || c > '9')
+            return false;
+        v = v * 10 + (c - '0');
+    }
+    out = negative ? -v : v;
+    return true;
+}
+
+bool parse_days(const std::string_view s, uint8_t& out) {
+    if (s == "*") {
+        out = ALL_DAYS;
+        return true;
+    }
+    if (s.size() != 7)
+        return false;
+    out = 0;
+    for (size_t i = 0; i < 7; ++i)
+        if (s[i] != '.' && s[i] != '-')
+            out |= 1u << ((i + 1) % 7);
+    return out != 0;
+}
+
+constexpr std::pair<std::string_view, Anchor> SUN_ANCHORS[] = {
+    {"sunrise", Anchor::Sunrise},
+    {"sunset", Anchor::Sunset},
+};
+
+bool parse_time(const std::string_view s, Event& e) {
+    for (const auto& [name, anchor] : SUN_ANCHORS) {
+        if (s.substr(0, name.size()) != name)
+            continue;
+        int offset = 0;
+        if (s.size() > name.size() && !parse_int(s.substr(name.size()), offset))
+            return false;
+        if (offset < -MAX_SUN_OFFSET_MIN || offset > MAX_SUN_OFFSET_MIN)
+            return false;
+        e.anchor = static_cast<uint8_t>(anchor);
+        e.minute = static_cast<int16_t>(offset);
+        return true;
+    }
+    const size_t colon = s.find(':');
+    int h = 0, m = 0;
+    if (colon == std::string_view::npos || !parse_int(s.substr(0, colon), h) ||
+        !parse_int(s.substr(colon + 1), m) || h < 0 || h > 23 || m < 0 || m > 59)
+        return false;
+    e.anchor = static_cast<uint8_t>(Anchor::Clock);
+    e.minute = static_cast<int16_t>(h * 60 + m);
+    return true;
+}
+
+bool parse_action(const std::string_view s, uint8_t& on) {
+    if (s == "on" || s == "ON" || s == "1")
+        on = 1;
+    else if (s == "off" || s == "OFF" || s == "0")
+        on = 0;
+    else
+        return false;
+    return true;
+}
+
+} // namespace
+
+bool Table::add(const Event& event) {
+    if (count_ >= MAX_EVENTS || event.days == 0 || event.anchor > 2)
+        return false;
+    events_[count_++] = event;
+    return true;
+}
+
+void Table::sort() { std::sort(events_, events_ + count_, before); }
+
+bool Table::parse(std::string_view text, const size_t relay_count) {
+    Table parsed;
+    while (!text.empty()) {
+        std::string_view item = next_field(text, ';');
+        if (item.empty())
+            continue;
+        Event e{};
+        int relay = 0;
+        const std::string_view days = next_field(item, ',');
+        const std::string_view time = next_field(item, ',');
+        const std::string_view relay_field = next_field(item, ',');
+        const std::string_view action = next_field(item, ',');
+        if (!item.empty() || !parse_days(days, e.days) || !parse_time(time, e) ||
+            !parse_int(relay_field, relay) || relay < 1 ||
+            static_cast<size_t>(relay) > relay_count || !parse_action(action, e.on))
+            return false;
+        e.relay = static_cast<uint8_t>(relay - 1);
+        if (!parsed.add(e))
+            return false;
+    }
+    parsed.sort();
+    *this = parsed;
+    return true;
+}
+
+int Table::format(char* buf, const size_t size) const {
+    size_t len = 0;
+    for (size_t i = 0; i < count_; ++i) {
+        const Event& e = events_[i];
+        char days[8];
+        if (e.days == ALL_DAYS) {
+            std::strcpy(days, "*");
+        } else {
+            for (size_t d = 0; d < 7; ++d)
+                days[d] = e.days & (1u << ((d + 1) % 7)) ? DAY_LETTERS[d] : '.';
+            days[7] = '\0';
+        }
+        char time[16];
+        switch (static_cast<Anchor>(e.anchor)) {
+        case Anchor::Clock:
+            std::snprintf(time, sizeof(time), "%02d:%02d", e.minute / 60, e.minute % 60);
+            break;
+        case Anchor::Sunrise:
+        case Anchor::Sunset:
+            std::snprintf(time, sizeof(time), e.minute ? "%s%+d" : "%s",
+                          e.anchor == static_cast<uint8_t>(Anchor::Sunrise) ? "sunrise" : "sunset",
+                          e.minute);
+            break;
+        }
+        const int n = std::snprintf(buf + len, size - len, "%s%s,%s,%u,%s", i ? ";" : "", days,
+                                    time, e.relay + 1u, e.on ? "on" : "off");
+        if (n < 0 || static_cast<size_t>(n) >= size - len)
+            return -1;
+        len += n;
+    }
+    if (size == 0)
+        return -1;
+    buf[len] = '\0';
+    return static_cast<int>(len);
+}
+
+size_t Table::serialize(uint8_t* buf, const size_t size) const {
+    const size_t needed = 2 + count_ * sizeof(Event);
+    if (size < needed)
+        return 0;
+    buf[0] = BLOB_VERSION;
+    buf[1] = static_cast<uint8_t>(count_);
+    std::memcpy(buf + 2, events_, count_ * sizeof(Event));
+    return needed;
+}
+
+bool Table::deserialize(const uint8_t* buf, const size_t size) {
+    if (size < 2 || buf[0] != BLOB_VERSION || buf[1] > MAX_EVENTS ||
+        size != 2 + buf[1] * sizeof(Event))
+        return false;
+    Table loaded;
+    for (size_t i = 0; i < buf[1]; ++i) {
+        Event e;
+        std::memcpy(&e, buf + 2 + i * sizeof(Event), sizeof(Event));
+        if (!loaded.add(e))
+            return false;
+    }
+    loaded.sort();
+    *this = loaded;
+    return true;
+}
+
+// Sunrise equation (https://en.wikipedia.org/wiki/Sunrise_equation), accurate to about a minute.
+bool sun_event(const int64_t day, const Location& loc, const bool sunrise, time_t& out) {
+    const double n = static_cast<double>(day + 2440588 - 2451545) + 0.0008;
+    const double mean_noon = n - loc.longitude / 360.0;
+    const double m = std::fmod(357.5291 + 0.98560028 * mean_noon, 360.0);
+    const double c = 1.9148 * std::sin(m * DEG) + 0.02 * std::sin(2 * m * DEG) +
+                     0.0003 * std::sin(3 * m * DEG);
+    const double lambda = std::fmod(m + c + 180.0 + 102.9372, 360.0);
+    const double transit =
+        2451545.0 + mean_noon + 0.0053 * std::sin(m * DEG) - 0.0069 * std::sin(2 * lambda * DEG);
+    const double sin_decl = std::sin(lambda * DEG) * std::sin(23.4397 * DEG);
+    const double cos_decl = std::cos(std::asin(sin_decl));
+    const double cos_hour_angle =
+        (std::sin(-0.833 * DEG) - std::sin(loc.latitude * DEG) * sin_decl) /
+        (std::cos(loc.latitude * DEG) * cos_decl);
+    if (cos_hour_angle < -1.0 || cos_hour_angle > 1.0)
+        return false;
+    const double hour_angle = std::acos(cos_hour_angle) / DEG;
+    const double julian = transit + (sunrise ? -hour_angle : hour_angle) / 360.0;
+    out = static_cast<time_t>(std::llround((julian - 2440587.5) * SECONDS_PER_DAY));
+    return true;
+}
+
+time_t local_to_utc(const int64_t local_seconds, const LocalClock& clock) {
+    const TzInfo& tz = clock.timezone();
+    const auto as_std = static_cast<time_t>(local_seconds - tz.std_offset_s);
+    if (!tz.has_dst)
+        return as_std;
+    const auto as_dst = static_cast<time_t>(local_seconds - tz.dst_offset_s);
+    const bool std_valid = clock.utc_offset_at(as_std) == tz.std_offset_s;
+    const bool dst_valid = clock.utc_offset_at(as_dst) == tz.dst_offset_s;
+    if (std_valid && dst_valid)
+        return std::min(as_std, as_dst); // repeated hour: first occurrence
+    if (std_valid)
+        return as_std;
+    if (dst_valid)
+        return as_dst;
+    // Skipped hour: the wall time never happens, fire when the clock jumps over it.
+    return clock.next_transition_after(std::min(as_std, as_dst));
+}
+
+int64_t local_day(const time_t utc, const LocalClock& clock) {
+    return floor_div(static_cast<int64_t>(utc) + clock.utc_offset_at(utc), SECONDS_PER_DAY);
+}
+
+bool event_time_on(const Event& event, const int64_t day, const LocalClock& clock,
+                   const Location& loc, time_t& out) {
+    if (!(event.days & (1u << weekday(day))))
+        return false;
+    switch (static_cast<Anchor>(event.anchor)) {
+    case Anchor::Clock:
+        out = local_to_utc(day * SECONDS_PER_DAY + event.minute * 60, clock);
+        return true;
+    case Anchor::Sunrise:
+    case Anchor::Sunset: {
+        time_t sun;
+        if (!sun_event(day, loc, event.anchor == static_cast<uint8_t>(Anchor::Sunrise), sun))
+            return false;
+        out = sun + event.minute * 60;
+        return true;
+    }
+    }
+    return false;
+}
+
+bool next_fire_time(const Table& table, const time_t after, const LocalClock& clock,
+                    const Location& loc, time_t& out) {
+    bool found = false;
+    const int64_t today = local_day(after, clock);
+    // Sun offsets can move an event into the neighbouring day, so start one day early.
+    for (int64_t day = today - 1; day <= today + 8; ++day) {
+        for (const Event& e : table) {
+            time_t t;
+            if (event_time_on(e, day, clock, loc, t) && t > after && (!found || t < out)) {
+                out = t;
+                found = true;
+            }
+        }
+        if (found && day > today)
+            break;
+    }
+    return found;
+}
+
+} // namespace relay_schedule
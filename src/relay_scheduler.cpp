@@ -0,0 +1,159 @@
+#include "relay_scheduler.h"
+
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "relay_schedule.h"
+#include "relays_app.h"
+#include "time_sync.h"
+#include <algorithm>
+
+namespace relay_scheduler {
+
+namespace {
+constexpr auto TAG = "SCHEDULE";
+constexpr char NVS_NAMESPACE[] = "schedule";
+constexpr char NVS_KEY_EVENTS[] = "events";
+// Re-evaluate at least this often, so clock slewing never accumulates.
+constexpr int64_t MAX_ARM_S = 60 * 60;
+constexpr relay_schedule::Location LOCATION{LOCATION_LATITUDE, LOCATION_LONGITUDE};
+
+relay_schedule::Table table;
+LocalClock tz_clock;
+SemaphoreHandle_t lock = nullptr; // guards table, tz_clock and the fields below
+esp_timer_handle_t timer = nullptr;
+RelayChanged relay_changed = nullptr;
+time_t armed_for = 0;  // UTC of the event the timer is armed for, 0 if none
+time_t last_fired = 0; // events at or before this instant have been handled
+
+void load() {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return;
+    uint8_t blob[relay_schedule::BLOB_MAX];
+    size_t size = sizeof(blob);
+    if (nvs_get_blob(handle, NVS_KEY_EVENTS, blob, &size) == ESP_OK &&
+        !table.deserialize(blob, size))
+        ESP_LOGW(TAG, "Stored schedule is invalid, ignored");
+    nvs_close(handle);
+}
+
+void save() {
+    uint8_t blob[relay_schedule::BLOB_MAX];
+    const size_t size = table.serialize(blob, sizeof(blob));
+    nvs_handle_t handle;
+    esp_err_t r = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (r == ESP_OK) {
+        r = nvs_set_blob(handle, NVS_KEY_EVENTS, blob, size);
+        if (r == ESP_OK)
+            r = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (r != ESP_OK)
+        ESP_LOGW(TAG, "Failed to save schedule: %d", r);
+}
+
+// Runs every event due at `at`; called with the lock held.
+void fire(const time_t at) {
+    const int64_t day = relay_schedule::local_day(at, tz_clock);
+    for (const auto& event : table) {
+        // Sun offsets can move an event across midnight, so check the previous day too.
+        for (int64_t d = day - 1; d <= day; ++d) {
+            time_t t;
+            if (!relay_schedule::event_time_on(event, d, tz_clock, LOCATION, t) || t != at)
+                continue;
+            ESP_LOGI(TAG, "light%u -> %s", event.relay + 1u, event.on ? "ON" : "OFF");
+            if (relays_app_get_state(event.relay) != static_cast<bool>(event.on)) {
+                relays_app_set_state(event.relay, event.on);
+                if (relay_changed)
+                    relay_changed(event.relay);
+            }
+        }
+    }
+    last_fired = at;
+}
+
+// Arms the timer for the next event; called with the lock held.
+void arm(const time_t now) {
+    esp_timer_stop(timer);
+    armed_for = 0;
+    if (!time_sync::is_time_valid())
+        return;
+    time_t next;
+    const time_t after = std::max(now, last_fired);
+    if (!relay_schedule::next_fire_time(table, after, tz_clock, LOCATION, next)) {
+        ESP_LOGI(TAG, "No events scheduled");
+        return;
+    }
+    armed_for = next;
+    const int64_t delay_s = std::min<int64_t>(next - now, MAX_ARM_S);
+    esp_timer_start_once(timer, std::max<int64_t>(delay_s, 0) * 1000000LL);
+    ESP_LOGI(TAG, "Next event in %lld s", static_cast<long long>(next - now));
+}
+
+void timer_cb(void* /*arg*/) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const time_t now = time(nullptr);
+    if (armed_for != 0 && now >= armed_for)
+        fire(armed_for);
+    arm(now);
+    xSemaphoreGive(lock);
+}
+} // namespace
+
+void start(const RelayChanged on_change) {
+    relay_changed = on_change;
+    lock = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t timer_args = {
+        .callback = timer_cb,
+        .name = "relay_sched",
+    };
+    if (!lock || esp_timer_create(&timer_args, &timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start relay scheduler");
+        return;
+    }
+    tz_clock.set_timezone(TIMEZONE);
+    load();
+    ESP_LOGI(TAG, "Loaded %u event(s)", static_cast<unsigned>(table.size()));
+    reschedule();
+}
+
+void reschedule() {
+    if (!timer)
+        return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const time_t now = time(nullptr);
+    // After a step the events between the old and the new time are skipped, not replayed.
+    last_fired = now;
+    arm(now);
+    xSemaphoreGive(lock);
+}
+
+bool set_from_text(const std::string_view text) {
+    if (!timer)
+        return false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const bool ok = table.parse(text, RELAY_COUNT);
+    if (ok) {
+        save();
+        arm(time(nullptr));
+    }
+    xSemaphoreGive(lock);
+    ESP_LOGI(TAG, ok ? "Schedule updated, %u event(s)" : "Rejected schedule, keeping %u event(s)",
+             static_cast<unsigned>(table.size()));
+    return ok;
+}
+
+int format(char* buf, const size_t size) {
+    if (!timer)
+        return -1;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const int len = table.format(buf, size);
+    xSemaphoreGive(lock);
+    return len;
+}
+
+} // namespace relay_scheduler
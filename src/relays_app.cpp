@@ -1,12 +1,18 @@
 #include "relays_app.h"
 #include "config.h"
+#include "task_profiler.h"
+#include "warm_state.h"
 
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
 #include <array>
 #include <cstdio>
 
@@ -14,11 +20,44 @@ static auto TAG = "relays_app";
 
 static constexpr gpio_num_t RELAY_GPIOS[RELAY_COUNT] = {RELAY_GPIO_1, RELAY_GPIO_2, RELAY_GPIO_3};
 
+static constexpr bool gpios_in_low_bank() {
+    for (const auto gpio : RELAY_GPIOS)
+        if (gpio >= 32)
+            return false;
+    return true;
+}
+static_assert(gpios_in_low_bank(), "batched writes use the GPIO0-31 set/clear registers");
+
+// Scenes for the group topic, addressed by name or 1-based position.
+static constexpr RelayScene RELAY_SCENES[] = {
+    {"off", 0, RELAY_ALL},
+    {"on", RELAY_ALL, RELAY_ALL},
+    {"evening", 0b001, RELAY_ALL},
+    {"night", 0, 0b011},
+};
+
 struct RelayState {
     bool on = false;
 };
 
+// Layout of the NVS_KEY_STATE blob.
+struct __attribute__((packed)) RelayBlob {
+    uint8_t version;
+    uint8_t count;
+    uint16_t mask; // bit i = relay i on
+};
+static_assert(RELAY_COUNT <= 16, "relay states are stored in a 16-bit mask");
+static constexpr uint8_t RELAY_BLOB_VERSION = 1;
+
 static std::array<RelayState, RELAY_COUNT> g_states{};
+static bool g_dirty = false;
+static RelayStats g_stats{}; // changes count calls that changed a relay, a batch is one
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t g_save_timer = nullptr;
+static TaskHandle_t g_save_task = nullptr;
+
+static constexpr uint32_t SAVE_TASK_STACK_SIZE = 3072;
+static constexpr UBaseType_t SAVE_TASK_PRIORITY = 1;
 
 static inline int logical_to_level(const bool on) {
     return (RELAY_ACTIVE_HIGH ? (on ? 1 : 0) : (on ? 0 : 1));
@@ -34,38 +73,87 @@ static esp_err_t nvs_init_and_erase_if_needed() {
     return r;
 }
 
-static bool nvs_load_state(const size_t idx, bool& out_on) {
-    nvs_handle_t handle;
-    char key[16];
-    std::snprintf(key, sizeof(key), NVS_KEY_FMT, static_cast<unsigned>(idx + 1));
-    esp_err_t r = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
-    if (r != ESP_OK)
+static bool nvs_load_blob(const nvs_handle_t handle, RelayMask& out_mask) {
+    RelayBlob blob{};
+    size_t size = sizeof(blob);
+    if (nvs_get_blob(handle, NVS_KEY_STATE, &blob, &size) != ESP_OK || size != sizeof(blob) ||
+        blob.version != RELAY_BLOB_VERSION)
         return false;
-    uint8_t val = 0;
-    r = nvs_get_u8(handle, key, &val);
-    nvs_close(handle);
-    if (r == ESP_OK) {
-        out_on = (val != 0);
-        return true;
+    out_mask = blob.mask;
+    return true;
+}
+
+// Reads the per-relay keys written by older firmware and removes them.
+static bool nvs_migrate_legacy(const nvs_handle_t handle, RelayMask& out_mask) {
+    bool found = false;
+    out_mask = 0;
+    for (size_t i = 0; i < RELAY_COUNT; ++i) {
+        char key[16];
+        std::snprintf(key, sizeof(key), NVS_KEY_FMT, static_cast<unsigned>(i + 1));
+        uint8_t val = 0;
+        if (nvs_get_u8(handle, key, &val) == ESP_OK) {
+            found = true;
+            if (val)
+                out_mask |= 1u << i;
+            nvs_erase_key(handle, key);
+        }
     }
-    return false;
+    return found;
 }
 
-static esp_err_t nvs_save_state(const size_t idx, const bool on) {
-    nvs_handle_t handle;
-    char key[16];
-    std::snprintf(key, sizeof(key), NVS_KEY_FMT, static_cast<unsigned>(idx + 1));
-    esp_err_t r = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (r != ESP_OK)
-        return r;
-    const uint8_t val = on ? 1 : 0;
-    r = nvs_set_u8(handle, key, val);
+static esp_err_t nvs_save_mask(const nvs_handle_t handle, const RelayMask mask) {
+    const RelayBlob blob{RELAY_BLOB_VERSION, static_cast<uint8_t>(RELAY_COUNT), mask};
+    esp_err_t r = nvs_set_blob(handle, NVS_KEY_STATE, &blob, sizeof(blob));
     if (r == ESP_OK)
         r = nvs_commit(handle);
-    nvs_close(handle);
     return r;
 }
 
+static RelayMask load_mask() {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return 0;
+    RelayMask mask = 0;
+    if (nvs_load_blob(handle, mask)) {
+        ESP_LOGI(TAG, "Loaded relay states 0x%04x", mask);
+    } else if (nvs_migrate_legacy(handle, mask)) {
+        ESP_LOGI(TAG, "Migrated legacy relay keys, states 0x%04x", mask);
+        if (const esp_err_t r = nvs_save_mask(handle, mask); r != ESP_OK)
+            ESP_LOGW(TAG, "Failed to save migrated states: %d", r);
+    } else {
+        ESP_LOGI(TAG, "No saved relay states, default OFF");
+    }
+    nvs_close(handle);
+    return mask;
+}
+
+static RelayMask current_mask() {
+    RelayMask mask = 0;
+    for (size_t i = 0; i < RELAY_COUNT; ++i)
+        if (g_states[i].on)
+            mask |= 1u << i;
+    return mask;
+}
+
+// An NVS commit can wait for a flash page erase; that must not hold up the esp_timer task,
+// which runs every other timer callback of the system.
+[[noreturn]] static void save_task(void* /*arg*/) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        task_profiler::mark_running();
+        relays_app_flush();
+    }
+}
+
+static void save_timer_cb(void* /*arg*/) {
+    task_profiler::mark_ready(g_save_task);
+    xTaskNotifyGive(g_save_task);
+}
+
+static void apply_level(const size_t idx, const bool on) {
+    gpio_set_level(RELAY_GPIOS[idx], logical_to_level(on));
+}
+
 void relays_app_init() {
     ESP_LOGI(TAG, "Initializing relays app...");
 
@@ -84,28 +172,115 @@ void relays_app_init() {
     }
     gpio_config(&io_conf);
 
+    // Restoring the saved states does not write them back, unless the snapshot taken
+    // before a warm restart holds a change that did not reach NVS yet.
+    RelayMask mask = load_mask();
+    if (RelayMask warm = 0; warm_state::restored_relays(warm) && warm != mask) {
+        ESP_LOGI(TAG, "Using unsaved relay states 0x%04x from before the restart", warm);
+        mask = warm;
+        g_dirty = true;
+    }
+    warm_state::save_relays(mask);
     for (size_t i = 0; i < RELAY_COUNT; ++i) {
-        bool on = false;
-        if (nvs_load_state(i, on)) {
-            ESP_LOGI(TAG, "Loaded r%u = %u", unsigned(i + 1), unsigned(on));
-        } else {
-            ESP_LOGI(TAG, "No saved state for r%u, default OFF", unsigned(i + 1));
-        }
-        relays_app_set_state(i, on);
+        g_states[i].on = mask & (1u << i);
+        apply_level(i, g_states[i].on);
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = save_timer_cb,
+        .name = "relay_save",
+    };
+    if (xTaskCreate(save_task, "Relay Save", SAVE_TASK_STACK_SIZE, nullptr, SAVE_TASK_PRIORITY,
+                    &g_save_task) != pdPASS) {
+        g_save_task = nullptr;
+        ESP_LOGE(TAG, "Failed to create save task, states are saved immediately");
+    } else if (esp_timer_create(&timer_args, &g_save_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create save timer, states are saved immediately");
     }
+    esp_register_shutdown_handler(relays_app_flush);
+    if (g_dirty && g_save_timer)
+        esp_timer_start_once(g_save_timer, RELAY_SAVE_DEBOUNCE_MS * 1000ULL);
+    else if (g_dirty)
+        relays_app_flush();
 
     ESP_LOGI(TAG, "Relays app initialized");
 }
 
-void relays_app_set_state(size_t idx, bool on) {
+void relays_app_set_state(size_t idx, bool on, const int64_t received_us) {
     if (idx >= RELAY_COUNT)
         return;
-    g_states[idx].on = on;
-    const int level = logical_to_level(on);
-    gpio_set_level(RELAY_GPIOS[idx], level);
-    if (const esp_err_t r = nvs_save_state(idx, on); r != ESP_OK) {
-        ESP_LOGW(TAG, "Failed save state r%u: %d", unsigned(idx + 1), r);
+    const auto bit = static_cast<RelayMask>(1u << idx);
+    relays_app_set_mask(on ? bit : 0, bit, received_us);
+}
+
+RelayMask relays_app_set_mask(RelayMask on, RelayMask affected, const int64_t received_us) {
+    affected &= RELAY_ALL;
+    uint32_t set_bits = 0, clear_bits = 0;
+    for (size_t i = 0; i < RELAY_COUNT; ++i) {
+        if (affected & (1u << i)) {
+            if (logical_to_level(on & (1u << i)))
+                set_bits |= 1u << RELAY_GPIOS[i];
+            else
+                clear_bits |= 1u << RELAY_GPIOS[i];
+        }
     }
+
+    const int64_t start_us = received_us ? received_us : esp_timer_get_time();
+    taskENTER_CRITICAL(&g_lock);
+    // The set/clear registers touch only the relay pins; a read-modify-write of GPIO_OUT_REG
+    // could undo a display clock edge bit-banged on another core in between.
+    REG_WRITE(GPIO_OUT_W1TS_REG, set_bits);
+    REG_WRITE(GPIO_OUT_W1TC_REG, clear_bits);
+    const auto latency_us = static_cast<uint32_t>(esp_timer_get_time() - start_us);
+    const RelayMask before = current_mask();
+    for (size_t i = 0; i < RELAY_COUNT; ++i)
+        if (affected & (1u << i))
+            g_states[i].on = on & (1u << i);
+    const RelayMask after = current_mask();
+    const RelayMask changed = before ^ after;
+    if (changed) {
+        g_dirty = true;
+        warm_state::save_relays(after); // in order with concurrent calls
+    }
+    if (changed) {
+        ++g_stats.changes;
+        g_stats.last_latency_us = latency_us;
+        if (latency_us > g_stats.max_latency_us)
+            g_stats.max_latency_us = latency_us;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+
+    // The window starts at the first change, so a steady stream of commands
+    // cannot postpone the write indefinitely.
+    if (!changed)
+        return 0;
+    if (!g_save_timer)
+        relays_app_flush();
+    else if (!esp_timer_is_active(g_save_timer))
+        esp_timer_start_once(g_save_timer, RELAY_SAVE_DEBOUNCE_MS * 1000ULL);
+    return changed;
+}
+
+RelayMask relays_app_get_mask() {
+    taskENTER_CRITICAL(&g_lock);
+    const RelayMask mask = current_mask();
+    taskEXIT_CRITICAL(&g_lock);
+    return mask;
+}
+
+const RelayScene* relays_app_find_scene(const std::string_view name_or_number) {
+    size_t number = 0;
+    for (const char c : name_or_number) {
+        if (c < '0' || c > '9' || number > 999) {
+            number = 0;
+            break;
+        }
+        number = number * 10 + (c - '0');
+    }
+    for (size_t i = 0; i < sizeof(RELAY_SCENES) / sizeof(RELAY_SCENES[0]); ++i)
+        if (number == i + 1 || name_or_number == RELAY_SCENES[i].name)
+            return &RELAY_SCENES[i];
+    return nullptr;
 }
 
 bool relays_app_get_state(size_t idx) {
@@ -113,3 +288,41 @@ bool relays_app_get_state(size_t idx) {
         return false;
     return g_states[idx].on;
 }
+
+void relays_app_flush() {
+    if (g_save_timer)
+        esp_timer_stop(g_save_timer);
+
+    taskENTER_CRITICAL(&g_lock);
+    const bool dirty = g_dirty;
+    const RelayMask mask = current_mask();
+    g_dirty = false;
+    taskEXIT_CRITICAL(&g_lock);
+    if (!dirty)
+        return;
+
+    nvs_handle_t handle;
+    esp_err_t r = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (r == ESP_OK) {
+        r = nvs_save_mask(handle, mask);
+        nvs_close(handle);
+    }
+    if (r != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save relay states: %d", r);
+        taskENTER_CRITICAL(&g_lock);
+        g_dirty = true;
+        taskEXIT_CRITICAL(&g_lock);
+        return;
+    }
+    taskENTER_CRITICAL(&g_lock);
+    ++g_stats.commits;
+    taskEXIT_CRITICAL(&g_lock);
+    ESP_LOGI(TAG, "Saved relay states 0x%04x", mask);
+}
+
+RelayStats relays_app_get_stats() {
+    taskENTER_CRITICAL(&g_lock);
+    const RelayStats stats = g_stats;
+    taskEXIT_CRITICAL(&g_lock);
+    return stats;
+}
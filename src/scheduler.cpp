@@ -0,0 +1,231 @@
+#include "scheduler.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "task_profiler.h"
+#include <atomic>
+#include <sys/time.h>
+
+namespace scheduler {
+
+namespace {
+constexpr auto TAG = "SCHED";
+
+struct Job {
+    const char* name;
+    Clock clock;
+    Policy policy;
+    int64_t period_us;
+    int64_t phase_us;
+    int64_t deadline_us; // next deadline, in the job's clock
+    TaskHandle_t task;
+    std::atomic<bool> step_pending;
+    std::atomic<int64_t> pending_period_us; // 0 when unchanged, applied by the owning task
+    bool resumed; // set by resume(), only touched by the owning task
+    JobStats stats;
+};
+
+Job jobs[MAX_JOBS];
+size_t jobs_used = 0;
+portMUX_TYPE jobs_lock = portMUX_INITIALIZER_UNLOCKED;
+
+int64_t now_us(const Clock clock) {
+    if (clock == Clock::Monotonic)
+        return esp_timer_get_time();
+    timeval tv{};
+    gettimeofday(&tv, nullptr);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000LL + tv.tv_usec;
+}
+
+int64_t floor_div(const int64_t a, const int64_t b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+// First wall-clock boundary strictly after `now`.
+int64_t aligned_after(const Job& job, const int64_t now) {
+    return (floor_div(now - job.phase_us, job.period_us) + 1) * job.period_us + job.phase_us;
+}
+
+// First deadline after `now`: the next boundary, or one period from now for monotonic jobs.
+int64_t next_after(const Job& job, const int64_t now) {
+    return job.clock == Clock::Wall ? aligned_after(job, now) : now + job.period_us;
+}
+
+// Moves the deadline past the one just served, applying the overrun policy.
+void advance(Job& job, const int64_t now) {
+    int64_t next = job.deadline_us + job.period_us;
+    if (next > now) {
+        job.deadline_us = next;
+        return;
+    }
+    uint32_t missed = 0;
+    if (job.policy == Policy::Skip || now - next >= MAX_CATCH_UP_PERIODS * job.period_us) {
+        missed = static_cast<uint32_t>((now - next) / job.period_us) + 1;
+        next += static_cast<int64_t>(missed) * job.period_us;
+    }
+    job.deadline_us = next;
+
+    taskENTER_CRITICAL(&jobs_lock);
+    job.stats.overruns++;
+    job.stats.skipped += missed;
+    taskEXIT_CRITICAL(&jobs_lock);
+}
+
+void record_run(Job& job, const int64_t jitter_us, const bool stepped) {
+    taskENTER_CRITICAL(&jobs_lock);
+    job.stats.runs++;
+    if (stepped) {
+        job.stats.clock_steps++;
+    } else {
+        job.stats.last_jitter_us = jitter_us;
+        job.stats.total_jitter_us += jitter_us;
+        if (jitter_us > job.stats.max_jitter_us)
+            job.stats.max_jitter_us = jitter_us;
+    }
+    taskEXIT_CRITICAL(&jobs_lock);
+    if (!stepped)
+        task_profiler::record_wake(job.task, jitter_us);
+}
+} // namespace
+
+JobId register_job(const char* name, const Clock clock, const int64_t period_us,
+                   const Policy policy, const int64_t phase_us) {
+    if (period_us <= 0)
+        return INVALID_JOB;
+
+    const int64_t now = now_us(clock);
+
+    // The job is filled in before it becomes visible to notify_clock_step().
+    taskENTER_CRITICAL(&jobs_lock);
+    if (jobs_used >= MAX_JOBS) {
+        taskEXIT_CRITICAL(&jobs_lock);
+        ESP_LOGE(TAG, "No free slot for job %s", name);
+        return INVALID_JOB;
+    }
+    const auto id = static_cast<JobId>(jobs_used);
+    Job& job = jobs[id];
+    job.name = name;
+    job.clock = clock;
+    job.policy = policy;
+    job.period_us = period_us;
+    job.phase_us = phase_us;
+    job.task = nullptr;
+    job.step_pending = false;
+    job.pending_period_us = 0;
+    job.resumed = false;
+    job.stats = {};
+    job.deadline_us = next_after(job, now);
+    jobs_used++;
+    taskEXIT_CRITICAL(&jobs_lock);
+
+    ESP_LOGI(TAG, "Registered job %s (%s, %lld ms)", name,
+             clock == Clock::Wall ? "wall" : "monotonic", period_us / 1000);
+    return id;
+}
+
+void wait_next(const JobId id) {
+    if (id < 0 || static_cast<size_t>(id) >= jobs_used)
+        return;
+    Job& job = jobs[id];
+    if (!job.task) {
+        job.task = xTaskGetCurrentTaskHandle();
+    } else if (job.resumed) {
+        // Deadlines passed during the pause were not missed, nothing was due.
+        job.resumed = false;
+        job.deadline_us = next_after(job, now_us(job.clock));
+    } else {
+        // The previous deadline was served by the work the caller just finished.
+        advance(job, now_us(job.clock));
+    }
+
+    for (;;) {
+        if (const int64_t period_us = job.pending_period_us.exchange(0); period_us > 0) {
+            const int64_t now = now_us(job.clock);
+            job.period_us = period_us;
+            // A shorter period must not wait out a deadline set under the longer one.
+            const int64_t next = next_after(job, now);
+            if (next < job.deadline_us)
+                job.deadline_us = next;
+        }
+        if (job.step_pending.exchange(false)) {
+            const int64_t now = now_us(job.clock);
+            job.deadline_us = aligned_after(job, now) - job.period_us;
+            record_run(job, 0, true);
+            return;
+        }
+        const int64_t now = now_us(job.clock);
+        const int64_t remaining_us = job.deadline_us - now;
+        if (remaining_us <= 0) {
+            record_run(job, -remaining_us, false);
+            return;
+        }
+        // Round up: waking a tick early would only cost another loop iteration.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((remaining_us + 999) / 1000));
+    }
+}
+
+void resume(const JobId id) {
+    if (id < 0 || static_cast<size_t>(id) >= jobs_used)
+        return;
+    jobs[id].resumed = true;
+}
+
+void notify_clock_step() {
+    for (size_t i = 0; i < jobs_used; ++i) {
+        Job& job = jobs[i];
+        if (job.clock != Clock::Wall)
+            continue;
+        job.step_pending = true;
+        if (job.task)
+            xTaskNotifyGive(job.task);
+    }
+}
+
+bool set_period(const JobId id, const int64_t period_us) {
+    if (id < 0 || static_cast<size_t>(id) >= jobs_used || period_us <= 0)
+        return false;
+    Job& job = jobs[id];
+    if (job.period_us == period_us && job.pending_period_us == 0)
+        return true;
+    job.pending_period_us = period_us;
+    if (job.task)
+        xTaskNotifyGive(job.task);
+    return true;
+}
+
+bool get_stats(const JobId id, JobStats& out) {
+    if (id < 0 || static_cast<size_t>(id) >= jobs_used)
+        return false;
+    taskENTER_CRITICAL(&jobs_lock);
+    out = jobs[id].stats;
+    taskEXIT_CRITICAL(&jobs_lock);
+    return true;
+}
+
+const char* job_name(const JobId id) {
+    if (id < 0 || static_cast<size_t>(id) >= jobs_used)
+        return nullptr;
+    return jobs[id].name;
+}
+
+size_t job_count() {
+    return jobs_used;
+}
+
+void log_stats() {
+    for (size_t i = 0; i < jobs_used; ++i) {
+        JobStats s{};
+        get_stats(static_cast<JobId>(i), s);
+        const uint32_t timed_runs = s.runs - s.clock_steps;
+        ESP_LOGI(TAG, "%-12s runs=%lu jitter last/avg/max=%lld/%lld/%lld us overruns=%lu "
+                      "skipped=%lu steps=%lu",
+                 jobs[i].name, static_cast<unsigned long>(s.runs), s.last_jitter_us,
+                 timed_runs ? s.total_jitter_us / timed_runs : 0LL, s.max_jitter_us,
+                 static_cast<unsigned long>(s.overruns), static_cast<unsigned long>(s.skipped),
+                 static_cast<unsigned long>(s.clock_steps));
+    }
+}
+
+} // namespace scheduler
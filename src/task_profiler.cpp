@@ -0,0 +1,302 @@
+#include "task_profiler.h"
+
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_freertos_hooks.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace task_profiler {
+
+namespace {
+constexpr auto TAG = "PROFILER";
+constexpr size_t MAX_TASKS = 32;
+constexpr uint32_t SAMPLER_TASK_STACK_SIZE = 3072;
+constexpr UBaseType_t SAMPLER_TASK_PRIORITY = 1;
+constexpr uint32_t STREAM_POLL_MS = 50;
+
+// Written by the hooks (tick ISR, ISRs, tasks) under record_lock.
+struct Record {
+    TaskHandle_t task;
+    int64_t ready_at; // 0 unless marked ready and not yet running
+    uint32_t switches;
+    uint32_t wakes;
+    uint32_t wake_max_us;
+    uint64_t wake_total_us;
+    // Used by the sampler only.
+    uint32_t run_time;
+    uint32_t switches_sampled;
+    bool sampled; // run_time holds a value
+    bool seen;
+};
+
+// What /tasks serves; written by the sampler under sample_mutex.
+struct TaskSample {
+    char name[configMAX_TASK_NAME_LEN];
+    int8_t core;
+    uint8_t priority;
+    uint16_t cpu_permille;
+    uint32_t switches;
+    uint32_t wakes;
+    uint32_t wake_max_us;
+    uint32_t wake_avg_us;
+    uint32_t stack_free;
+};
+
+DRAM_ATTR Record records[MAX_TASKS];
+DRAM_ATTR size_t record_count = 0;
+DRAM_ATTR TaskHandle_t running_at_tick[portNUM_PROCESSORS];
+portMUX_TYPE record_lock = portMUX_INITIALIZER_UNLOCKED;
+std::atomic<bool> started{false};
+
+TaskStatus_t task_status[MAX_TASKS];
+uint32_t previous_total_run_time = 0;
+
+TaskSample samples[MAX_TASKS];
+size_t sample_count = 0;
+int64_t sampled_at_us = 0;
+std::atomic<uint32_t> sample_seq{0};
+StaticSemaphore_t sample_mutex_buffer;
+SemaphoreHandle_t sample_mutex = nullptr;
+
+// Call with record_lock held.
+IRAM_ATTR Record* find_record(const TaskHandle_t task) {
+    for (size_t i = 0; i < record_count; ++i)
+        if (records[i].task == task)
+            return &records[i];
+    if (record_count >= MAX_TASKS)
+        return nullptr;
+    Record* record = &records[record_count++];
+    *record = Record{};
+    record->task = task;
+    return record;
+}
+
+IRAM_ATTR void add_wake(Record& record, const int64_t latency_us) {
+    const auto latency = static_cast<uint32_t>(std::clamp<int64_t>(latency_us, 0, UINT32_MAX));
+    ++record.wakes;
+    record.wake_total_us += latency;
+    if (latency > record.wake_max_us)
+        record.wake_max_us = latency;
+}
+
+// Runs in the tick interrupt of each core, also while the flash cache is disabled.
+IRAM_ATTR void on_tick() {
+    const BaseType_t core = xPortGetCoreID();
+    const TaskHandle_t task = xTaskGetCurrentTaskHandleForCore(core);
+    if (task == running_at_tick[core])
+        return;
+    running_at_tick[core] = task;
+    portENTER_CRITICAL_ISR(&record_lock);
+    if (Record* record = find_record(task))
+        ++record->switches;
+    portEXIT_CRITICAL_ISR(&record_lock);
+}
+
+Record* find_record_locked(const TaskHandle_t task) {
+    taskENTER_CRITICAL(&record_lock);
+    Record* record = find_record(task);
+    taskEXIT_CRITICAL(&record_lock);
+    return record;
+}
+
+void forget_finished_tasks() {
+    taskENTER_CRITICAL(&record_lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < record_count; ++i)
+        if (records[i].seen)
+            records[kept++] = records[i];
+    record_count = kept;
+    taskEXIT_CRITICAL(&record_lock);
+}
+
+void take_sample() {
+    uint32_t total_run_time = 0;
+    const UBaseType_t count = uxTaskGetSystemState(task_status, MAX_TASKS, &total_run_time);
+    // The counter runs on every core, so the elapsed time is shared by all of them.
+    const uint32_t elapsed = (total_run_time - previous_total_run_time) * portNUM_PROCESSORS;
+    previous_total_run_time = total_run_time;
+    if (count == 0)
+        ESP_LOGW(TAG, "More than %u tasks, nothing sampled", static_cast<unsigned>(MAX_TASKS));
+
+    taskENTER_CRITICAL(&record_lock);
+    for (size_t i = 0; i < record_count; ++i)
+        records[i].seen = false;
+    taskEXIT_CRITICAL(&record_lock);
+
+    xSemaphoreTake(sample_mutex, portMAX_DELAY);
+    sample_count = 0;
+    for (UBaseType_t i = 0; i < count; ++i) {
+        const TaskStatus_t& ts = task_status[i];
+        Record* record = find_record_locked(ts.xHandle);
+        if (!record)
+            continue;
+        TaskSample& s = samples[sample_count++];
+        std::strncpy(s.name, ts.pcTaskName, sizeof(s.name) - 1);
+        s.name[sizeof(s.name) - 1] = '\0';
+        const BaseType_t core = xTaskGetCoreID(ts.xHandle);
+        s.core = core == tskNO_AFFINITY ? -1 : static_cast<int8_t>(core);
+        s.priority = static_cast<uint8_t>(ts.uxCurrentPriority);
+        s.stack_free = ts.usStackHighWaterMark * sizeof(StackType_t);
+
+        taskENTER_CRITICAL(&record_lock);
+        const uint32_t run_delta = ts.ulRunTimeCounter - record->run_time;
+        s.cpu_permille = static_cast<uint16_t>(
+            elapsed > 0 && record->sampled
+                ? std::min<uint64_t>(static_cast<uint64_t>(run_delta) * 1000 / elapsed, 1000)
+                : 0);
+        s.switches = record->switches - record->switches_sampled;
+        s.wakes = record->wakes;
+        s.wake_max_us = record->wake_max_us;
+        s.wake_avg_us =
+            record->wakes > 0 ? static_cast<uint32_t>(record->wake_total_us / record->wakes) : 0;
+        record->run_time = ts.ulRunTimeCounter;
+        record->switches_sampled = record->switches;
+        record->sampled = true;
+        record->seen = true;
+        taskEXIT_CRITICAL(&record_lock);
+    }
+    sampled_at_us = esp_timer_get_time();
+    ++sample_seq;
+    xSemaphoreGive(sample_mutex);
+    forget_finished_tasks();
+}
+
+[[noreturn]] void sampler_task(void* /*pvParameters*/) {
+    const scheduler::JobId job =
+        scheduler::register_job("profiler", scheduler::Clock::Monotonic,
+                                TASK_PROFILER_PERIOD_MS * 1000LL, scheduler::Policy::Skip);
+    for (;;) {
+        scheduler::wait_next(job);
+        take_sample();
+    }
+}
+
+// Sends the latest sample as one JSON document (and a newline); false if the client is gone.
+bool send_sample(httpd_req_t* req) {
+    static TaskSample staging[MAX_TASKS]; // only the HTTP server task gets here
+    xSemaphoreTake(sample_mutex, portMAX_DELAY);
+    const size_t count = sample_count;
+    std::copy(samples, samples + count, staging);
+    const int64_t at_us = sampled_at_us;
+    const uint32_t seq = sample_seq;
+    xSemaphoreGive(sample_mutex);
+    std::sort(staging, staging + count, [](const TaskSample& a, const TaskSample& b) {
+        return a.cpu_permille > b.cpu_permille;
+    });
+
+    char line[224];
+    int len = std::snprintf(line, sizeof(line),
+                            "{\"up_ms\":%lld,\"period_ms\":%lu,\"seq\":%lu,\"tasks\":[",
+                            at_us / 1000, static_cast<unsigned long>(TASK_PROFILER_PERIOD_MS),
+                            static_cast<unsigned long>(seq));
+    if (httpd_resp_send_chunk(req, line, len) != ESP_OK)
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        const TaskSample& s = staging[i];
+        len = std::snprintf(
+            line, sizeof(line),
+            "%s{\"name\":\"%s\",\"core\":%d,\"prio\":%u,\"cpu\":%u.%u,\"switches\":%lu,"
+            "\"wakes\":%lu,\"wake_max_us\":%lu,\"wake_avg_us\":%lu,\"stack_free\":%lu}",
+            i > 0 ? "," : "", s.name, s.core, s.priority, s.cpu_permille / 10,
+            s.cpu_permille % 10, static_cast<unsigned long>(s.switches),
+            static_cast<unsigned long>(s.wakes), static_cast<unsigned long>(s.wake_max_us),
+            static_cast<unsigned long>(s.wake_avg_us), static_cast<unsigned long>(s.stack_free));
+        if (httpd_resp_send_chunk(req, line, len) != ESP_OK)
+            return false;
+    }
+    return httpd_resp_send_chunk(req, "]}\n", 3) == ESP_OK;
+}
+
+// GET /tasks, or /tasks?stream=N for the next N samples as they are taken.
+esp_err_t tasks_get_handler(httpd_req_t* req) {
+    uint32_t stream = 0;
+    if (char query[32]; httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (char value[8]; httpd_query_key_value(query, "stream", value, sizeof(value)) == ESP_OK)
+            stream = std::min<uint32_t>(std::strtoul(value, nullptr, 10), TASK_PROFILER_STREAM_MAX);
+    }
+    httpd_resp_set_type(req, stream > 0 ? "application/x-ndjson" : "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    bool open = send_sample(req);
+    // The server handles one request at a time, so a stream holds up the other URIs.
+    for (uint32_t sent = 1; open && sent < stream; ++sent) {
+        const uint32_t seq = sample_seq;
+        while (sample_seq == seq)
+            vTaskDelay(pdMS_TO_TICKS(STREAM_POLL_MS));
+        open = send_sample(req);
+    }
+    if (open)
+        httpd_resp_send_chunk(req, nullptr, 0);
+    return ESP_OK;
+}
+
+const httpd_uri_t tasks_uri = {
+    .uri = "/tasks",
+    .method = HTTP_GET,
+    .handler = tasks_get_handler,
+    .user_ctx = nullptr,
+};
+} // namespace
+
+void start() {
+    if (started)
+        return;
+    sample_mutex = xSemaphoreCreateMutexStatic(&sample_mutex_buffer);
+    take_sample(); // serves something right away and sets the counter baselines
+    started = true;
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core)
+        if (esp_register_freertos_tick_hook_for_cpu(on_tick, core) != ESP_OK)
+            ESP_LOGW(TAG, "No tick hook on core %d, switches are not counted", core);
+    if (xTaskCreate(sampler_task, "Profiler", SAMPLER_TASK_STACK_SIZE, nullptr,
+                    SAMPLER_TASK_PRIORITY, nullptr) != pdPASS)
+        ESP_LOGE(TAG, "Failed to create sampler task");
+}
+
+void register_uri(const httpd_handle_t server) {
+    if (!started || !server)
+        return;
+    if (const esp_err_t err = httpd_register_uri_handler(server, &tasks_uri); err != ESP_OK)
+        ESP_LOGE(TAG, "Cannot serve /tasks: %s", esp_err_to_name(err));
+}
+
+IRAM_ATTR void mark_ready(const TaskHandle_t task) {
+    if (!started || !task)
+        return;
+    const int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_SAFE(&record_lock);
+    if (Record* record = find_record(task); record && record->ready_at == 0)
+        record->ready_at = now;
+    portEXIT_CRITICAL_SAFE(&record_lock);
+}
+
+void mark_running() {
+    if (!started)
+        return;
+    const int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&record_lock);
+    if (Record* record = find_record(xTaskGetCurrentTaskHandle()); record && record->ready_at) {
+        add_wake(*record, now - record->ready_at);
+        record->ready_at = 0;
+    }
+    taskEXIT_CRITICAL(&record_lock);
+}
+
+void record_wake(const TaskHandle_t task, const int64_t latency_us) {
+    if (!started || !task)
+        return;
+    taskENTER_CRITICAL(&record_lock);
+    if (Record* record = find_record(task))
+        add_wake(*record, latency_us);
+    taskEXIT_CRITICAL(&record_lock);
+}
+
+} // namespace task_profiler
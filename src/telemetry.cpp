@@ -0,0 +1,308 @@
+#include "telemetry.h"
+
+#include "config.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_publisher.h"
+#include "scheduler.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+namespace telemetry {
+
+namespace {
+constexpr auto TAG = "TELEMETRY";
+constexpr size_t MAX_TASKS = 32; // uxTaskGetSystemState() reports nothing if they do not fit
+constexpr size_t REPORT_PARTS = 3;
+constexpr size_t REPORT_PART_MAX = 512;
+constexpr size_t TASK_ENTRY_MAX = 48;
+constexpr char TASKS_CLOSE[] = "]}";
+constexpr uint32_t TELEMETRY_TASK_STACK_SIZE = 3072;
+
+std::atomic<uint32_t> forecast_ok{0};
+std::atomic<uint32_t> forecast_err{0};
+std::atomic<uint32_t> forecast_latency_ms{0};
+std::atomic<uint32_t> interval_s{TELEMETRY_INTERVAL_S};
+std::atomic<scheduler::JobId> job{scheduler::INVALID_JOB};
+
+// Last reported value of every field, used for delta suppression.
+struct Reported {
+    uint32_t heap;
+    uint32_t heap_min;
+    uint32_t fc_ok;
+    uint32_t fc_err;
+    uint32_t fc_ms;
+};
+
+struct TaskRecord {
+    UBaseType_t number;  // xTaskNumber, stable for the lifetime of a task
+    uint32_t run_time;   // run time counter at the previous sample
+    uint8_t cpu_percent; // as last handed to the publisher, 0xFF before that
+    uint32_t stack_free;
+    uint8_t sampled_cpu; // as sampled for the report being built
+    uint32_t sampled_stack_free;
+    bool seen;
+};
+
+Reported reported{};
+TaskRecord task_records[MAX_TASKS];
+size_t task_record_count = 0;
+uint32_t previous_total_run_time = 0;
+
+TaskStatus_t task_status[MAX_TASKS];
+// Record of every entry in task_status, nullptr for tasks beyond MAX_TASKS records.
+TaskRecord* status_records[MAX_TASKS];
+
+// A report is split into parts of at most REPORT_PART_MAX bytes, each published from its own
+// slot. A part is built by the telemetry task and copied out by the publisher task.
+struct Part {
+    char text[REPORT_PART_MAX];
+    int len = -1;
+    mqtt_publisher::SlotId slot = mqtt_publisher::INVALID_SLOT;
+};
+
+Part parts[REPORT_PARTS];
+portMUX_TYPE report_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Appends formatted text; once the buffer is full the writer stays failed.
+class Writer {
+  public:
+    Writer(char* buf, const size_t size) : buf_(buf), size_(size) {}
+
+    __attribute__((format(printf, 2, 3))) void append(const char* fmt, ...) {
+        if (len_ < 0)
+            return;
+        va_list args;
+        va_start(args, fmt);
+        const int n = std::vsnprintf(buf_ + len_, size_ - len_, fmt, args);
+        va_end(args);
+        len_ = n >= 0 && static_cast<size_t>(n) < size_ - len_ ? len_ + n : -1;
+    }
+
+    // Whether @p len more bytes and the closing of the task list still fit.
+    bool fits(const size_t len) const {
+        return len_ >= 0 && len_ + len + sizeof(TASKS_CLOSE) <= size_;
+    }
+
+    int length() const { return len_; }
+
+  private:
+    char* buf_;
+    size_t size_;
+    int len_ = 0;
+};
+
+bool differs(const uint32_t now, const uint32_t before, const uint32_t threshold) {
+    return (now > before ? now - before : before - now) >= threshold;
+}
+
+TaskRecord* find_task_record(const UBaseType_t number) {
+    for (size_t i = 0; i < task_record_count; ++i)
+        if (task_records[i].number == number)
+            return &task_records[i];
+    return nullptr;
+}
+
+TaskRecord* add_task_record(const UBaseType_t number) {
+    if (task_record_count >= MAX_TASKS)
+        return nullptr;
+    TaskRecord* record = &task_records[task_record_count++];
+    *record = TaskRecord{number, 0, 0xFF, 0, 0, 0, false};
+    return record;
+}
+
+void forget_finished_tasks() {
+    size_t kept = 0;
+    for (size_t i = 0; i < task_record_count; ++i)
+        if (task_records[i].seen)
+            task_records[kept++] = task_records[i];
+    task_record_count = kept;
+}
+
+bool task_due(const TaskRecord& record, const bool full) {
+    return full || record.cpu_percent == 0xFF || record.sampled_stack_free != record.stack_free ||
+           differs(record.sampled_cpu, record.cpu_percent, TELEMETRY_CPU_DELTA_PERCENT);
+}
+
+// Samples the run time counters and stack watermarks of all tasks into task_status and their
+// records; returns the number of tasks.
+UBaseType_t sample_tasks() {
+    uint32_t total_run_time = 0;
+    const UBaseType_t count = uxTaskGetSystemState(task_status, MAX_TASKS, &total_run_time);
+    // The counter runs on every core, so the elapsed time is shared by all of them.
+    const uint32_t elapsed = (total_run_time - previous_total_run_time) * portNUM_PROCESSORS;
+    previous_total_run_time = total_run_time;
+
+    // Records of finished tasks go first, so the pointers taken below stay valid.
+    for (size_t i = 0; i < task_record_count; ++i)
+        task_records[i].seen = false;
+    for (UBaseType_t i = 0; i < count; ++i)
+        if (TaskRecord* record = find_task_record(task_status[i].xTaskNumber))
+            record->seen = true;
+    forget_finished_tasks();
+
+    for (UBaseType_t i = 0; i < count; ++i) {
+        const TaskStatus_t& ts = task_status[i];
+        TaskRecord* record = find_task_record(ts.xTaskNumber);
+        if (!record)
+            record = add_task_record(ts.xTaskNumber);
+        status_records[i] = record;
+        if (!record)
+            continue;
+        const uint32_t run_delta = ts.ulRunTimeCounter - record->run_time;
+        record->sampled_cpu = static_cast<uint8_t>(
+            elapsed > 0 ? static_cast<uint64_t>(run_delta) * 100 / elapsed : 0);
+        record->sampled_stack_free = ts.usStackHighWaterMark * sizeof(StackType_t);
+        record->run_time = ts.ulRunTimeCounter;
+    }
+    return count;
+}
+
+// Copies a built part to the publisher. Only then does it count as reported.
+void hand_over(const size_t part, const char* text, const int len) {
+    taskENTER_CRITICAL(&report_lock);
+    std::memcpy(parts[part].text, text, len + 1);
+    parts[part].len = len;
+    taskEXIT_CRITICAL(&report_lock);
+    mqtt_publisher::mark_dirty(parts[part].slot);
+}
+
+// Builds the report into @p staging part by part, handing every part to the publisher as soon
+// as it is complete, and updates the delta suppression state for what was handed over. Tasks
+// that do not fit into REPORT_PARTS parts stay due for the next report.
+void publish_report(char* staging, const size_t size, const bool full) {
+    const unsigned long up = esp_timer_get_time() / 1000000;
+    Writer w(staging, size);
+    w.append("{\"up\":%lu", up);
+    if (full)
+        w.append(",\"full\":1");
+
+    Reported next = reported;
+    bool changed = full;
+    const uint32_t heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    const uint32_t heap_min = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    if (full || differs(heap, reported.heap, TELEMETRY_HEAP_DELTA_BYTES)) {
+        w.append(",\"heap\":%lu", static_cast<unsigned long>(heap));
+        next.heap = heap;
+        changed = true;
+    }
+    if (full || heap_min != reported.heap_min) {
+        w.append(",\"heap_min\":%lu", static_cast<unsigned long>(heap_min));
+        next.heap_min = heap_min;
+        changed = true;
+    }
+    const uint32_t fc_ok = forecast_ok, fc_err = forecast_err, fc_ms = forecast_latency_ms;
+    if (full || fc_ok != reported.fc_ok || fc_err != reported.fc_err) {
+        w.append(",\"fc_ok\":%lu,\"fc_err\":%lu,\"fc_ms\":%lu", static_cast<unsigned long>(fc_ok),
+                 static_cast<unsigned long>(fc_err), static_cast<unsigned long>(fc_ms));
+        next.fc_ok = fc_ok;
+        next.fc_err = fc_err;
+        next.fc_ms = fc_ms;
+        changed = true;
+    }
+
+    const UBaseType_t count = sample_tasks();
+    size_t part = 0;
+    UBaseType_t part_first = 0; // first task_status entry of the current part
+    bool tasks_open = false;
+    // Completes the current part, tasks [part_first, end), and hands it over.
+    const auto finish_part = [&](const UBaseType_t end) {
+        w.append("%s}", tasks_open ? "]" : "");
+        if (w.length() < 0) {
+            ESP_LOGW(TAG, "Report part %u does not fit into %u bytes",
+                     static_cast<unsigned>(part), static_cast<unsigned>(size));
+            return;
+        }
+        hand_over(part, staging, w.length());
+        if (part == 0)
+            reported = next;
+        for (UBaseType_t i = part_first; i < end; ++i) {
+            if (TaskRecord* record = status_records[i]; record && task_due(*record, full)) {
+                record->cpu_percent = record->sampled_cpu;
+                record->stack_free = record->sampled_stack_free;
+            }
+        }
+    };
+
+    for (UBaseType_t i = 0; i < count; ++i) {
+        const TaskRecord* record = status_records[i];
+        if (!record || !task_due(*record, full))
+            continue;
+        char entry[TASK_ENTRY_MAX];
+        const int n = std::snprintf(entry, sizeof(entry), "[\"%s\",%u,%lu]",
+                                    task_status[i].pcTaskName, record->sampled_cpu,
+                                    static_cast<unsigned long>(record->sampled_stack_free));
+        if (n < 0 || static_cast<size_t>(n) >= sizeof(entry))
+            continue;
+        if (!w.fits(n + 1)) {
+            if (!tasks_open || part + 1 >= REPORT_PARTS)
+                break; // the rest stays due and goes out with the next report
+            finish_part(i);
+            ++part;
+            part_first = i;
+            tasks_open = false;
+            w = Writer(staging, size);
+            w.append("{\"up\":%lu,\"part\":%u%s", up, static_cast<unsigned>(part),
+                     full ? ",\"full\":1" : "");
+        }
+        w.append("%s%s", tasks_open ? "," : ",\"tasks\":[", entry);
+        tasks_open = true;
+        changed = true;
+    }
+    if (changed)
+        finish_part(count);
+}
+
+int render_report(const size_t part, char* topic, const size_t topic_size, char* payload,
+                  const size_t payload_size) {
+    std::snprintf(topic, topic_size, "%s/telemetry", MQTT_TOPIC_BASE);
+    taskENTER_CRITICAL(&report_lock);
+    const int len = parts[part].len;
+    if (len >= 0 && static_cast<size_t>(len) < payload_size)
+        std::memcpy(payload, parts[part].text, len + 1);
+    taskEXIT_CRITICAL(&report_lock);
+    return len >= 0 && static_cast<size_t>(len) < payload_size ? len : -1;
+}
+
+[[noreturn]] void telemetry_task(void* /*pvParameters*/) {
+    static char staging[REPORT_PART_MAX];
+    job = scheduler::register_job("telemetry", scheduler::Clock::Monotonic,
+                                  interval_s * 1000000LL, scheduler::Policy::Skip);
+    uint32_t interval = 0;
+    for (;;) {
+        scheduler::wait_next(job);
+        publish_report(staging, sizeof(staging), interval++ % TELEMETRY_KEYFRAME_EVERY == 0);
+    }
+}
+} // namespace
+
+void start() {
+    for (size_t part = 0; part < REPORT_PARTS; ++part) {
+        parts[part].slot = mqtt_publisher::add_slot(render_report, part, 0, false);
+        if (parts[part].slot == mqtt_publisher::INVALID_SLOT)
+            return;
+    }
+    if (xTaskCreate(telemetry_task, "Telemetry", TELEMETRY_TASK_STACK_SIZE, nullptr,
+                    tskIDLE_PRIORITY + 1, nullptr) != pdPASS)
+        ESP_LOGE(TAG, "Failed to create telemetry task");
+}
+
+void set_interval_s(const uint32_t seconds) {
+    interval_s = seconds;
+    scheduler::set_period(job, seconds * 1000000LL);
+}
+
+void record_forecast_fetch(const bool ok, const uint32_t latency_ms) {
+    if (ok)
+        ++forecast_ok;
+    else
+        ++forecast_err;
+    forecast_latency_ms = latency_ms;
+}
+
+} // namespace telemetry
@@ -0,0 +1,288 @@
+#include "time_sync.h"
+
+#include "clock_discipline.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "task_profiler.h"
+#include <cstdlib>
+#include <ctime>
+#include <sys/time.h>
+
+namespace time_sync {
+
+namespace {
+constexpr auto TAG = "NTP";
+constexpr EventBits_t TIME_VALID_BIT = BIT0;
+constexpr char NVS_NAMESPACE[] = "time";
+constexpr char NVS_KEY_DRIFT[] = "drift_ppb";
+constexpr int32_t DRIFT_SAVE_THRESHOLD_PPB = 100; // avoid a flash write for every tiny update
+constexpr time_t MIN_VALID_EPOCH = 1735689600;     // 2025-01-01, older times were never synced
+constexpr uint32_t SAVE_TASK_STACK_SIZE = 3072;
+constexpr UBaseType_t SAVE_TASK_PRIORITY = 1;
+
+StaticEventGroup_t events_buf;
+EventGroupHandle_t events = xEventGroupCreateStatic(&events_buf);
+StatusCallback status_callback = nullptr;
+
+// Shared by the SNTP callback (tcpip thread) and the correction timer (esp_timer task).
+StaticSemaphore_t lock_buf;
+SemaphoreHandle_t lock = xSemaphoreCreateMutexStatic(&lock_buf);
+ClockDiscipline<DRIFT_ESTIMATOR_SAMPLES> discipline({
+    .step_threshold_us = NTP_STEP_THRESHOLD_MS * 1000LL,
+    .accuracy_bound_us = TIME_ACCURACY_BOUND_MS * 1000LL,
+    .min_interval_ms = NTP_UPDATE_INTERVAL_MS,
+    .max_interval_ms = NTP_MAX_UPDATE_INTERVAL_MS,
+});
+Status last_status = Status::NotSynced;
+int64_t last_offset_us = 0;
+uint32_t sync_count = 0; // server responses applied, to tell a new slew from the one checked
+int32_t saved_drift_ppb = 0; // the estimate last handed to the save task
+esp_timer_handle_t drift_timer = nullptr;
+TaskHandle_t save_task_handle = nullptr;
+
+int64_t to_us(const timeval& tv) {
+    return static_cast<int64_t>(tv.tv_sec) * 1000000LL + tv.tv_usec;
+}
+
+timeval from_us(const int64_t us) {
+    return {static_cast<time_t>(us / 1000000LL), static_cast<suseconds_t>(us % 1000000LL)};
+}
+
+int64_t pending_adjustment_us() {
+    timeval outstanding{};
+    adjtime(nullptr, &outstanding);
+    return to_us(outstanding);
+}
+
+// The system clock, as ClockDiscipline::apply() sees it.
+struct SystemClock {
+    int64_t now_us() const {
+        timeval now{};
+        gettimeofday(&now, nullptr);
+        return to_us(now);
+    }
+    int64_t monotonic_us() const { return esp_timer_get_time(); }
+    int64_t pending_us() const { return pending_adjustment_us(); }
+    bool slew(const int64_t delta_us) const {
+        const timeval delta = from_us(delta_us);
+        return adjtime(&delta, nullptr) == 0;
+    }
+    void step(const int64_t server_us) const {
+        const timeval tv = from_us(server_us);
+        settimeofday(&tv, nullptr);
+    }
+};
+
+int32_t load_drift() {
+    nvs_handle_t handle;
+    int32_t ppb = 0;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_i32(handle, NVS_KEY_DRIFT, &ppb);
+        nvs_close(handle);
+    }
+    return ppb;
+}
+
+void save_drift(const int32_t ppb) {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    if (nvs_set_i32(handle, NVS_KEY_DRIFT, ppb) == ESP_OK && nvs_commit(handle) == ESP_OK)
+        ESP_LOGI(TAG, "Stored drift estimate %ld ppb", static_cast<long>(ppb));
+    nvs_close(handle);
+}
+
+// An NVS commit can wait for a flash page erase; that must not hold up the esp_timer task,
+// which runs every other timer callback of the system.
+[[noreturn]] void save_task(void* /*arg*/) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        task_profiler::mark_running();
+        xSemaphoreTake(lock, portMAX_DELAY);
+        const int32_t ppb = saved_drift_ppb;
+        xSemaphoreGive(lock);
+        save_drift(ppb);
+    }
+}
+
+void report(const Status status, const int64_t offset_us) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    last_status = status;
+    last_offset_us = offset_us;
+    xSemaphoreGive(lock);
+    if (status_callback)
+        status_callback(status, offset_us);
+}
+
+/**
+ * @brief Reports Synced once the slew of the last server response is complete.
+ */
+void check_slew_complete() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const bool slewing = last_status == Status::Slewing;
+    const uint32_t seen = sync_count;
+    xSemaphoreGive(lock);
+    if (!slewing || pending_adjustment_us() != 0)
+        return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // A response applied meanwhile started a new slew.
+    const bool done = last_status == Status::Slewing && sync_count == seen;
+    if (done)
+        last_status = Status::Synced;
+    const int64_t offset_us = last_offset_us;
+    xSemaphoreGive(lock);
+    if (!done)
+        return;
+    sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+    ESP_LOGI(TAG, "Slew of %lld us complete", offset_us);
+    if (status_callback)
+        status_callback(Status::Synced, offset_us);
+}
+
+/**
+ * @brief Periodically slews out the predicted drift, so the clock stays accurate
+ * between syncs. Also reports completed slews and hands a changed estimate to
+ * the save task.
+ */
+void drift_correction_cb(void* /*arg*/) {
+    // Before adding this period's correction, which adjtime() would report as outstanding.
+    check_slew_complete();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const int64_t correction_us = discipline.drift_correction(esp_timer_get_time());
+    const int32_t ppb = discipline.drift_ppb();
+    const bool save =
+        save_task_handle && std::abs(ppb - saved_drift_ppb) >= DRIFT_SAVE_THRESHOLD_PPB;
+    if (save)
+        saved_drift_ppb = ppb;
+    xSemaphoreGive(lock);
+
+    if (correction_us != 0) {
+        // adjtime() replaces the outstanding adjustment, so add to it instead.
+        const timeval delta = from_us(pending_adjustment_us() + correction_us);
+        adjtime(&delta, nullptr);
+    }
+    if (save) {
+        task_profiler::mark_ready(save_task_handle);
+        xTaskNotifyGive(save_task_handle);
+    }
+}
+} // namespace
+
+/**
+ * @brief Applies a server timestamp to the system clock.
+ *
+ * Steps the clock when it has never been set or is too far off, otherwise
+ * slews it with adjtime().
+ */
+void apply_server_time(const timeval& server_tv) {
+    const bool first_sync = !is_time_valid();
+    SystemClock clock;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const ClockSync sync = discipline.apply(clock, to_us(server_tv), first_sync);
+    ++sync_count;
+    const uint32_t interval = discipline.interval_ms();
+    const int32_t ppb = discipline.drift_ppb();
+    const size_t samples = discipline.samples();
+    xSemaphoreGive(lock);
+
+    // Takes effect for the next request, which lwIP schedules after this callback.
+    sntp_set_sync_interval(interval);
+    if (sync.stepped) {
+        sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+        xEventGroupSetBits(events, TIME_VALID_BIT);
+        ESP_LOGI(TAG, "Clock stepped by %lld ms", sync.offset_us / 1000);
+    } else {
+        sntp_set_sync_status(SNTP_SYNC_STATUS_IN_PROGRESS);
+        ESP_LOGI(TAG, "Slewing clock by %lld us", sync.offset_us);
+    }
+    ESP_LOGI(TAG, "Drift %ld ppb (%u samples), next sync in %lu s", static_cast<long>(ppb),
+             static_cast<unsigned>(samples), static_cast<unsigned long>(interval / 1000));
+    report(sync.stepped ? Status::Stepped : Status::Slewing, sync.offset_us);
+}
+
+void start(const StatusCallback callback) {
+    status_callback = callback;
+
+    saved_drift_ppb = load_drift();
+    discipline.restore(saved_drift_ppb, esp_timer_get_time());
+    ESP_LOGI(TAG, "Loaded drift estimate %ld ppb", static_cast<long>(saved_drift_ppb));
+    if (xTaskCreate(save_task, "Drift Save", SAVE_TASK_STACK_SIZE, nullptr, SAVE_TASK_PRIORITY,
+                    &save_task_handle) != pdPASS) {
+        save_task_handle = nullptr;
+        ESP_LOGE(TAG, "Failed to create save task, the drift estimate is not stored");
+    }
+    const esp_timer_create_args_t timer_args = {
+        .callback = drift_correction_cb,
+        .name = "drift_corr",
+    };
+    if (esp_timer_create(&timer_args, &drift_timer) == ESP_OK)
+        esp_timer_start_periodic(drift_timer, DRIFT_CORRECTION_PERIOD_S * 1000000ULL);
+
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, NTP_SERVER);
+    sntp_set_sync_interval(NTP_UPDATE_INTERVAL_MS);
+    esp_sntp_init();
+    ESP_LOGI(TAG, "SNTP started, server %s, interval %d ms", NTP_SERVER, NTP_UPDATE_INTERVAL_MS);
+}
+
+bool adopt_rtc_time(const time_t not_before) {
+    const time_t now = time(nullptr);
+    if (now < MIN_VALID_EPOCH || now < not_before)
+        return false;
+    xEventGroupSetBits(events, TIME_VALID_BIT);
+    ESP_LOGI(TAG, "Clock kept through reset: %lld", static_cast<long long>(now));
+    return true;
+}
+
+void resync() {
+    // Restarting the client sends a request at once; the interval continues from there.
+    if (esp_sntp_enabled())
+        sntp_restart();
+}
+
+Status status() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const Status s = last_status;
+    xSemaphoreGive(lock);
+    return s;
+}
+
+int32_t drift_ppb() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const int32_t ppb = discipline.drift_ppb();
+    xSemaphoreGive(lock);
+    return ppb;
+}
+
+uint32_t sync_interval_ms() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const uint32_t interval = discipline.interval_ms();
+    xSemaphoreGive(lock);
+    return interval;
+}
+
+bool is_time_valid() {
+    return (xEventGroupGetBits(events) & TIME_VALID_BIT) != 0;
+}
+
+bool wait_for_valid_time(const TickType_t timeout) {
+    return (xEventGroupWaitBits(events, TIME_VALID_BIT, pdFALSE, pdTRUE, timeout) &
+            TIME_VALID_BIT) != 0;
+}
+
+} // namespace time_sync
+
+// Replaces the weak default in ESP-IDF's SNTP glue, which always steps on large offsets
+// and slews otherwise at a fixed threshold we cannot configure.
+extern "C" void sntp_sync_time(timeval* tv) {
+    time_sync::apply_server_time(*tv);
+}
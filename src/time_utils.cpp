@@ -1,48 +1,27 @@
 #include <WString.h>
 #include <cstdio>
+#include <cstdlib>
 #include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
 
-
-void wait_until_next_minute() {
-    timeval tv{};
-    gettimeofday(&tv, nullptr);
-
-    // Convert to milliseconds since epoch
-    const int64_t ms_now = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-    // Compute ms in current minute
-    const int64_t ms_into_minute = ms_now % 60000;
-
-    // How many ms to next minute
-    const int64_t ms_to_next_minute = 60000 - ms_into_minute + 1;
-
-    // Convert ms to FreeRTOS ticks (round up to nearest tick)
-    const TickType_t ticks = pdMS_TO_TICKS(ms_to_next_minute);
-
-    vTaskDelay(ticks);
-}
-
-void wait_until_next_second() {
-    timeval tv{};
-    gettimeofday(&tv, nullptr);
-
-    // Convert to milliseconds since epoch
-    const int64_t ms_now = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-    // Compute ms into current second
-    const int64_t ms_into_minute = ms_now % 1000;
-
-    // How many ms to next second
-    const int64_t ms_to_next_minute = 1000 - ms_into_minute + 1;
-
-    // Convert ms to FreeRTOS ticks (round up to nearest tick)
-    const TickType_t ticks = pdMS_TO_TICKS(ms_to_next_minute);
-
-    vTaskDelay(ticks);
+#include "config.h"
+#include "esp_log.h"
+#include "local_clock.h"
+
+namespace {
+LocalClock local_clock;
+portMUX_TYPE local_clock_lock = portMUX_INITIALIZER_UNLOCKED;
+} // namespace
+
+void init_timezone() {
+    // The C library still needs the rule for strftime("%Z") and anything calling localtime_r.
+    setenv("TZ", TIMEZONE, 1);
+    tzset();
+    if (!local_clock.set_timezone(TIMEZONE))
+        ESP_LOGE("TIME", "Cannot parse TIMEZONE '%s', using UTC", TIMEZONE);
 }
 
 unsigned long get_uptime_millis() {
@@ -57,8 +36,9 @@ int64_t get_current_epoch_second() {
 
 tm get_local_time() {
     const time_t now = time(nullptr);
-    tm timeinfo{};
-    localtime_r(&now, &timeinfo);
+    taskENTER_CRITICAL(&local_clock_lock);
+    const tm timeinfo = local_clock.to_local(now);
+    taskEXIT_CRITICAL(&local_clock_lock);
     return timeinfo;
 }
 
@@ -0,0 +1,205 @@
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+namespace trace {
+
+namespace {
+constexpr auto TAG = "TRACE";
+constexpr size_t MAX_TASKS = 32;
+static_assert((TRACE_EVENTS_PER_CORE & (TRACE_EVENTS_PER_CORE - 1)) == 0,
+              "TRACE_EVENTS_PER_CORE must be a power of two");
+
+struct Event {
+    std::atomic<uint32_t> seq; // claim index + 1 once written, 0 while being written
+    int64_t ts_us;
+    const char* name;
+    TaskHandle_t task; // nullptr in an ISR
+    char phase;        // Chrome trace "ph": B, E or i
+};
+
+struct Ring {
+    std::atomic<uint32_t> head; // claims so far
+    Event events[TRACE_EVENTS_PER_CORE];
+};
+
+DRAM_ATTR Ring rings[portNUM_PROCESSORS];
+DRAM_ATTR std::atomic<bool> paused{false};
+
+TaskStatus_t task_status[MAX_TASKS];
+
+IRAM_ATTR void record(const char phase, const char* name) {
+    if (paused.load(std::memory_order_relaxed))
+        return;
+    const int64_t now = esp_timer_get_time();
+    const TaskHandle_t task = xPortInIsrContext() ? nullptr : xTaskGetCurrentTaskHandle();
+    Ring& ring = rings[xPortGetCoreID()];
+    const uint32_t index = ring.head.fetch_add(1, std::memory_order_relaxed);
+    Event& e = ring.events[index & (TRACE_EVENTS_PER_CORE - 1)];
+    e.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.ts_us = now;
+    e.name = name;
+    e.task = task;
+    e.phase = phase;
+    e.seq.store(index + 1, std::memory_order_release);
+}
+
+// Chrome trace thread id: the task, or the core for ISR events.
+uint32_t thread_id(const TaskHandle_t task, const size_t core) {
+    return task ? reinterpret_cast<uintptr_t>(task) : static_cast<uint32_t>(core);
+}
+
+const char* task_name(const TaskHandle_t task, const UBaseType_t task_count) {
+    for (UBaseType_t i = 0; i < task_count; ++i)
+        if (task_status[i].xHandle == task)
+            return task_status[i].pcTaskName;
+    return "finished task";
+}
+
+class Dump {
+  public:
+    explicit Dump(httpd_req_t* req) : req_(req) {}
+
+    bool send(const char* text, const int len) {
+        ok_ = ok_ && httpd_resp_send_chunk(req_, text, len) == ESP_OK;
+        return ok_;
+    }
+
+    bool event(const char* json) {
+        if (!first_ && !send(",", 1))
+            return false;
+        first_ = false;
+        return send(json, static_cast<int>(std::strlen(json)));
+    }
+
+    bool ok() const { return ok_; }
+
+  private:
+    httpd_req_t* req_;
+    bool ok_ = true;
+    bool first_ = true;
+};
+
+// Thread names are sent once per thread; tasks beyond MAX_TASKS are just not named.
+bool name_thread(Dump& dump, const uint32_t tid, const char* name, uint32_t* named,
+                 size_t& named_count) {
+    for (size_t i = 0; i < named_count; ++i)
+        if (named[i] == tid)
+            return true;
+    if (named_count >= MAX_TASKS)
+        return true;
+    named[named_count++] = tid;
+    char line[128];
+    std::snprintf(line, sizeof(line),
+                  "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,"
+                  "\"args\":{\"name\":\"%s\"}}",
+                  static_cast<unsigned long>(tid), name);
+    return dump.event(line);
+}
+
+void send_rings(Dump& dump) {
+    const UBaseType_t task_count = uxTaskGetSystemState(task_status, MAX_TASKS, nullptr);
+    uint32_t named[MAX_TASKS];
+    size_t named_count = 0;
+    char line[160];
+    for (size_t core = 0; core < portNUM_PROCESSORS && dump.ok(); ++core) {
+        Ring& ring = rings[core];
+        char isr_name[12];
+        std::snprintf(isr_name, sizeof(isr_name), "ISR core %u", static_cast<unsigned>(core));
+        const uint32_t head = ring.head.load(std::memory_order_acquire);
+        const uint32_t first = head > TRACE_EVENTS_PER_CORE ? head - TRACE_EVENTS_PER_CORE : 0;
+        for (uint32_t index = first; index != head && dump.ok(); ++index) {
+            const Event& e = ring.events[index & (TRACE_EVENTS_PER_CORE - 1)];
+            // A writer that got past the pause check may still be filling the slot.
+            if (e.seq.load(std::memory_order_acquire) != index + 1)
+                continue;
+            const int64_t ts_us = e.ts_us;
+            const char* name = e.name;
+            const TaskHandle_t task = e.task;
+            const char phase = e.phase;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.seq.load(std::memory_order_relaxed) != index + 1)
+                continue;
+
+            const uint32_t tid = thread_id(task, core);
+            if (!name_thread(dump, tid, task ? task_name(task, task_count) : isr_name, named,
+                             named_count))
+                break;
+            std::snprintf(line, sizeof(line),
+                          "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%lu%s}",
+                          name, phase, ts_us, static_cast<unsigned long>(tid),
+                          phase == 'i' ? ",\"s\":\"t\"" : "");
+            dump.event(line);
+        }
+    }
+}
+
+// GET /trace, /trace?clear=1 to start over afterwards.
+esp_err_t trace_get_handler(httpd_req_t* req) {
+    bool clear = false;
+    if (char query[32]; httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[4];
+        clear = httpd_query_key_value(query, "clear", value, sizeof(value)) == ESP_OK &&
+                value[0] == '1';
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    paused = true;
+    Dump dump(req);
+    constexpr char open[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    dump.send(open, sizeof(open) - 1);
+    send_rings(dump);
+    if (dump.send("]}\n", 3))
+        httpd_resp_send_chunk(req, nullptr, 0);
+    if (clear) {
+        for (Ring& ring : rings) {
+            for (Event& e : ring.events)
+                e.seq.store(0, std::memory_order_relaxed);
+            ring.head.store(0, std::memory_order_relaxed);
+        }
+    }
+    paused = false;
+    return ESP_OK;
+}
+
+const httpd_uri_t trace_uri = {
+    .uri = "/trace",
+    .method = HTTP_GET,
+    .handler = trace_get_handler,
+    .user_ctx = nullptr,
+};
+} // namespace
+
+IRAM_ATTR void begin(const char* name) {
+    record('B', name);
+}
+
+IRAM_ATTR void end(const char* name) {
+    record('E', name);
+}
+
+IRAM_ATTR void instant(const char* name) {
+    record('i', name);
+}
+
+void register_uri(const httpd_handle_t server) {
+    if (!server)
+        return;
+    if (const esp_err_t err = httpd_register_uri_handler(server, &trace_uri); err != ESP_OK)
+        ESP_LOGE(TAG, "Cannot serve /trace: %s", esp_err_to_name(err));
+}
+
+} // namespace trace
+
+#endif // ENABLE_TRACE
@@ -0,0 +1,162 @@
+#include "warm_state.h"
+
+#include "esp_attr.h"
+#include "esp_bit_defs.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include <cstddef>
+#include <type_traits>
+
+namespace warm_state {
+
+namespace {
+constexpr auto TAG = "WARM";
+constexpr uint32_t SNAPSHOT_MAGIC = 0x57524d53; // "WRMS"
+constexpr uint16_t SNAPSHOT_VERSION = 1;
+
+// Parts of the snapshot that hold a value.
+constexpr uint8_t HAS_TIME = BIT0;
+constexpr uint8_t HAS_FORECAST = BIT1;
+constexpr uint8_t HAS_RELAYS = BIT2;
+
+// No default member initializers: RTC_NOINIT data must not be touched by the startup code.
+struct Snapshot {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint8_t parts; // HAS_* bits
+    uint8_t page;  // DisplayPage
+    RelayMask relays;
+    int64_t time_at;
+    int64_t forecast_at;
+    ForecastData16 forecast;
+    uint32_t crc; // over everything above
+};
+static_assert(std::is_trivially_copyable_v<Snapshot>, "the snapshot is copied as raw memory");
+
+RTC_NOINIT_ATTR Snapshot rtc_snapshot;
+Snapshot restored{}; // written once by begin()
+bool warm = false;
+bool started = false; // guarded by snapshot_lock
+portMUX_TYPE snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t crc_of(const Snapshot& s) {
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&s), offsetof(Snapshot, crc));
+}
+
+// Reset causes that leave RTC slow memory intact. A brown-out may not.
+bool keeps_rtc_memory(const esp_reset_reason_t reason) {
+    switch (reason) {
+    case ESP_RST_SW:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_DEEPSLEEP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Applies a change to the snapshot and reseals it.
+template <typename Change> void update(Change&& change) {
+    taskENTER_CRITICAL(&snapshot_lock);
+    if (started) {
+        change(rtc_snapshot);
+        rtc_snapshot.crc = crc_of(rtc_snapshot);
+    }
+    taskEXIT_CRITICAL(&snapshot_lock);
+}
+} // namespace
+
+bool begin() {
+    const esp_reset_reason_t reason = esp_reset_reason();
+    taskENTER_CRITICAL(&snapshot_lock);
+    warm = keeps_rtc_memory(reason) && rtc_snapshot.magic == SNAPSHOT_MAGIC &&
+           rtc_snapshot.version == SNAPSHOT_VERSION && rtc_snapshot.size == sizeof(Snapshot) &&
+           rtc_snapshot.crc == crc_of(rtc_snapshot);
+    if (warm) {
+        restored = rtc_snapshot;
+    } else {
+        rtc_snapshot = Snapshot{};
+        rtc_snapshot.magic = SNAPSHOT_MAGIC;
+        rtc_snapshot.version = SNAPSHOT_VERSION;
+        rtc_snapshot.size = sizeof(Snapshot);
+        rtc_snapshot.crc = crc_of(rtc_snapshot);
+    }
+    started = true;
+    taskEXIT_CRITICAL(&snapshot_lock);
+
+    if (warm)
+        ESP_LOGI(TAG, "Warm boot (reset reason %d): time %s, forecast %s, relays %s",
+                 static_cast<int>(reason), restored.parts & HAS_TIME ? "yes" : "no",
+                 restored.parts & HAS_FORECAST ? "yes" : "no",
+                 restored.parts & HAS_RELAYS ? "yes" : "no");
+    else
+        ESP_LOGI(TAG, "Cold boot (reset reason %d)", static_cast<int>(reason));
+    return warm;
+}
+
+bool is_warm() {
+    return warm;
+}
+
+void save_time(const time_t now) {
+    update([now](Snapshot& s) {
+        s.time_at = now;
+        s.parts |= HAS_TIME;
+    });
+}
+
+void save_forecast(const ForecastData16& forecast, const time_t fetched_at) {
+    update([&](Snapshot& s) {
+        s.forecast = forecast;
+        s.forecast_at = fetched_at;
+        s.parts |= HAS_FORECAST;
+    });
+}
+
+void save_relays(const RelayMask mask) {
+    update([mask](Snapshot& s) {
+        s.relays = mask;
+        s.parts |= HAS_RELAYS;
+    });
+}
+
+void save_page(const DisplayPage page) {
+    update([page](Snapshot& s) { s.page = static_cast<uint8_t>(page); });
+}
+
+bool restored_time(time_t& saved_at) {
+    if (!warm || !(restored.parts & HAS_TIME))
+        return false;
+    saved_at = static_cast<time_t>(restored.time_at);
+    return true;
+}
+
+bool restored_forecast(ForecastData16& forecast, time_t& fetched_at) {
+    if (!warm || !(restored.parts & HAS_FORECAST))
+        return false;
+    forecast = restored.forecast;
+    fetched_at = static_cast<time_t>(restored.forecast_at);
+    return true;
+}
+
+bool restored_relays(RelayMask& mask) {
+    if (!warm || !(restored.parts & HAS_RELAYS))
+        return false;
+    mask = restored.relays;
+    return true;
+}
+
+bool restored_page(DisplayPage& page) {
+    if (!warm)
+        return false;
+    page = static_cast<DisplayPage>(restored.page);
+    return true;
+}
+
+} // namespace warm_state
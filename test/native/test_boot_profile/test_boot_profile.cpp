@@ -0,0 +1,152 @@
+#include <unity.h>
+
+#include "boot_profile.h"
+#include <cstdlib>
+#include <cstring>
+
+using boot::Profile;
+using boot::Stage;
+
+namespace {
+
+constexpr int64_t MS = 1000;
+constexpr int64_t FIRST_FRAME_BOUND_US = 2000 * MS;
+
+// A warm restart in the order setup() runs it: the clock is drawn long before WiFi is up.
+Profile typical_boot() {
+    Profile p;
+    p.record(Stage::AppStart, 0);
+    p.record(Stage::Setup, 312 * MS);
+    p.record(Stage::Display, 355 * MS);
+    p.record(Stage::TimeValid, 356 * MS);
+    p.record(Stage::Forecast, 357 * MS);
+    p.record(Stage::FirstFrame, 371 * MS);
+    p.record(Stage::Relays, 380 * MS);
+    p.record(Stage::Sensors, 420 * MS);
+    p.record(Stage::LinkUp, 2310 * MS);
+    p.record(Stage::Services, 2460 * MS);
+    p.record(Stage::Online, 2460 * MS);
+    return p;
+}
+
+// Reads the JSON of Profile::format() back, as a consumer of the boot topic would.
+Profile parse(const char* json) {
+    Profile p;
+    for (const char* key = std::strchr(json, '"'); key; key = std::strchr(key, '"')) {
+        const char* end = std::strchr(key + 1, '"');
+        const long long ms = std::strtoll(end + 2, nullptr, 10);
+        for (size_t i = 0; i < boot::STAGE_COUNT; ++i) {
+            const char* name = boot::STAGE_NAMES[i];
+            if (std::strlen(name) == static_cast<size_t>(end - key - 1) &&
+                std::strncmp(name, key + 1, end - key - 1) == 0)
+                p.record(static_cast<Stage>(i), ms * MS);
+        }
+        key = end + 1;
+    }
+    return p;
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_typical_boot_is_in_order() {
+    const Profile p = typical_boot();
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Stage::Count),
+                          static_cast<int>(boot::first_out_of_order(p)));
+    TEST_ASSERT_TRUE(boot::first_frame_within(p, FIRST_FRAME_BOUND_US));
+}
+
+void test_only_the_first_record_counts() {
+    Profile p;
+    TEST_ASSERT_TRUE(p.record(Stage::FirstFrame, 400 * MS));
+    TEST_ASSERT_FALSE(p.record(Stage::FirstFrame, 60400 * MS)); // the next minute flip
+    TEST_ASSERT_EQUAL_INT64(400 * MS, p.at_us(Stage::FirstFrame));
+    TEST_ASSERT_EQUAL_INT64(-1, p.at_us(Stage::Online));
+    TEST_ASSERT_EQUAL_INT64(-1, p.at_us(Stage::Count));
+}
+
+void test_format_lists_reached_stages() {
+    Profile p;
+    p.record(Stage::AppStart, 0);
+    p.record(Stage::Setup, 312400);
+    p.record(Stage::Display, 355 * MS);
+    char json[256];
+    const int len = p.format(json, sizeof(json), 3, 297 * MS);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"reset\":3,\"Bootloader\":297,\"AppStart\":0,\"Setup\":312,\"Display\":355}", json);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(std::strlen(json)), len);
+    // Without a known bootloader time the key is left out.
+    p.format(json, sizeof(json), 1, -1);
+    TEST_ASSERT_EQUAL_STRING("{\"reset\":1,\"AppStart\":0,\"Setup\":312,\"Display\":355}", json);
+}
+
+void test_format_refuses_a_short_buffer() {
+    const Profile p = typical_boot();
+    char json[256];
+    const int len = p.format(json, sizeof(json), 3, 297 * MS);
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_EQUAL_INT(-1, p.format(json, static_cast<size_t>(len), 3, 297 * MS));
+    TEST_ASSERT_EQUAL_INT(len, p.format(json, static_cast<size_t>(len) + 1, 3, 297 * MS));
+    TEST_ASSERT_EQUAL_INT(-1, p.format(json, 0, 3, 297 * MS));
+}
+
+void test_published_profile_keeps_order_and_bound() {
+    // What is checked on the retained boot topic: order and first frame from the JSON alone.
+    char json[256];
+    typical_boot().format(json, sizeof(json), 3, 297 * MS);
+    const Profile p = parse(json);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Stage::Count),
+                          static_cast<int>(boot::first_out_of_order(p)));
+    TEST_ASSERT_TRUE(boot::first_frame_within(p, FIRST_FRAME_BOUND_US));
+    TEST_ASSERT_EQUAL_INT64(2460 * MS, p.at_us(Stage::Online));
+}
+
+void test_detects_a_stage_ahead_of_its_dependencies() {
+    // Services started before the link, e.g. after moving mqtt_app_start() into setup().
+    Profile p = typical_boot();
+    Profile early;
+    for (size_t i = 0; i < boot::STAGE_COUNT; ++i) {
+        const auto stage = static_cast<Stage>(i);
+        early.record(stage, stage == Stage::Services ? 400 * MS : p.at_us(stage));
+    }
+    TEST_ASSERT_FALSE(boot::in_order(early, Stage::Services));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Stage::Services),
+                          static_cast<int>(boot::first_out_of_order(early)));
+
+    // Online must not be reached while the forecast is still missing.
+    Profile no_forecast;
+    for (size_t i = 0; i < boot::STAGE_COUNT; ++i)
+        if (static_cast<Stage>(i) != Stage::Forecast)
+            no_forecast.record(static_cast<Stage>(i), p.at_us(static_cast<Stage>(i)));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Stage::Online),
+                          static_cast<int>(boot::first_out_of_order(no_forecast)));
+}
+
+void test_first_frame_bound() {
+    Profile p;
+    p.record(Stage::AppStart, 0);
+    TEST_ASSERT_FALSE(boot::first_frame_within(p, FIRST_FRAME_BOUND_US)); // not drawn yet
+    p.record(Stage::FirstFrame, FIRST_FRAME_BOUND_US);
+    TEST_ASSERT_TRUE(boot::first_frame_within(p, FIRST_FRAME_BOUND_US));
+
+    // A first frame waiting for the network, as with the old blocking setup().
+    Profile slow;
+    slow.record(Stage::AppStart, 0);
+    slow.record(Stage::FirstFrame, FIRST_FRAME_BOUND_US + 1);
+    TEST_ASSERT_FALSE(boot::first_frame_within(slow, FIRST_FRAME_BOUND_US));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_typical_boot_is_in_order);
+    RUN_TEST(test_only_the_first_record_counts);
+    RUN_TEST(test_format_lists_reached_stages);
+    RUN_TEST(test_format_refuses_a_short_buffer);
+    RUN_TEST(test_published_profile_keeps_order_and_bound);
+    RUN_TEST(test_detects_a_stage_ahead_of_its_dependencies);
+    RUN_TEST(test_first_frame_bound);
+    return UNITY_END();
+}
@@ -0,0 +1,147 @@
+#include <unity.h>
+
+#include "brightness_curve.h"
+#include <cmath>
+
+using brightness::Controller;
+using brightness::CurveConfig;
+
+namespace {
+
+// The values of config.h: ALS_DARK_COUNT, ALS_BRIGHT_COUNT, DISPLAY_BRIGHTNESS(_MAX),
+// ALS_HYSTERESIS_LEVELS and ALS_SMOOTHING_SHIFT.
+constexpr CurveConfig CURVE{4, 4000, 0, 15, 0.3f, 2};
+constexpr uint8_t WINDOW_PERCENT = 20; // ALS_THRESHOLD_WINDOW_PERCENT
+
+// Inverse of the curve: the clear count that maps to a fractional level.
+uint16_t count_for_level(const float level) {
+    const float pos = (level - CURVE.min_level) / (CURVE.max_level - CURVE.min_level);
+    const float range = static_cast<float>(CURVE.bright_count) / CURVE.dark_count;
+    return static_cast<uint16_t>(std::lround(CURVE.dark_count * std::pow(range, pos)));
+}
+
+// Feeds the same sample until the filter has settled on it.
+void settle(Controller& controller, const uint16_t count) {
+    for (int i = 0; i < 64; ++i)
+        controller.update(count);
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_curve_ends() {
+    TEST_ASSERT_EQUAL_FLOAT(0.f, brightness::level_for_count(CURVE, 0));
+    TEST_ASSERT_EQUAL_FLOAT(0.f, brightness::level_for_count(CURVE, CURVE.dark_count));
+    TEST_ASSERT_EQUAL_FLOAT(15.f, brightness::level_for_count(CURVE, CURVE.bright_count));
+    TEST_ASSERT_EQUAL_FLOAT(15.f, brightness::level_for_count(CURVE, 0xFFFF));
+    // A configuration without a range stays at the minimum instead of dividing by zero.
+    CurveConfig flat = CURVE;
+    flat.bright_count = flat.dark_count;
+    TEST_ASSERT_EQUAL_FLOAT(0.f, brightness::level_for_count(flat, 1000));
+}
+
+void test_curve_is_logarithmic() {
+    // Every tenfold increase of the light adds the same number of levels.
+    const float per_decade = 15.f / std::log10(4000.f / 4.f);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, per_decade, brightness::level_for_count(CURVE, 40));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 2 * per_decade, brightness::level_for_count(CURVE, 400));
+    // The geometric middle of the range maps to the middle level.
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 7.5f, brightness::level_for_count(CURVE, 126));
+}
+
+void test_curve_is_monotonic_and_bounded() {
+    float previous = brightness::level_for_count(CURVE, 0);
+    for (uint32_t count = 1; count <= 0xFFFF; ++count) {
+        const float level = brightness::level_for_count(CURVE, static_cast<uint16_t>(count));
+        TEST_ASSERT_TRUE(level >= previous);
+        TEST_ASSERT_TRUE(level >= CURVE.min_level && level <= CURVE.max_level);
+        previous = level;
+    }
+}
+
+void test_interrupt_window() {
+    const auto w = brightness::interrupt_window(1000, 20);
+    TEST_ASSERT_EQUAL_UINT16(799, w.low);
+    TEST_ASSERT_EQUAL_UINT16(1201, w.high);
+    // In the dark the window is never empty, at the top it does not wrap around.
+    const auto dark = brightness::interrupt_window(0, 20);
+    TEST_ASSERT_EQUAL_UINT16(0, dark.low);
+    TEST_ASSERT_EQUAL_UINT16(1, dark.high);
+    const auto bright = brightness::interrupt_window(0xFFF0, 20);
+    TEST_ASSERT_EQUAL_UINT16(0xFFFF, bright.high);
+}
+
+void test_first_sample_primes_the_filter() {
+    Controller controller(CURVE);
+    TEST_ASSERT_EQUAL_UINT8(CURVE.min_level, controller.level());
+    TEST_ASSERT_TRUE(controller.update(CURVE.bright_count));
+    TEST_ASSERT_EQUAL_UINT16(CURVE.bright_count, controller.smoothed());
+    TEST_ASSERT_EQUAL_UINT8(CURVE.max_level, controller.level());
+    TEST_ASSERT_FALSE(controller.update(CURVE.bright_count));
+}
+
+void test_ema_follows_a_step() {
+    Controller controller(CURVE);
+    controller.update(100);
+    controller.update(1000);
+    // A new sample weighs 1/4: the error shrinks by 3/4 per sample.
+    TEST_ASSERT_EQUAL_UINT16(325, controller.smoothed());
+    TEST_ASSERT_FALSE(controller.settled(1000, WINDOW_PERCENT));
+    int samples = 1;
+    while (!controller.settled(1000, WINDOW_PERCENT)) {
+        controller.update(1000);
+        ++samples;
+    }
+    // 900 * (3/4)^n must drop below the 201 counts of the window.
+    TEST_ASSERT_EQUAL_INT(6, samples);
+    // The fixed point filter reaches the input instead of stopping short of it.
+    settle(controller, 1000);
+    TEST_ASSERT_EQUAL_UINT16(1000, controller.smoothed());
+}
+
+void test_hysteresis_ignores_small_changes() {
+    Controller controller(CURVE);
+    settle(controller, count_for_level(7.f));
+    TEST_ASSERT_EQUAL_UINT8(7, controller.level());
+    // Light wobbling by up to 0.7 levels either way leaves the display alone.
+    for (int i = 0; i < 100; ++i) {
+        TEST_ASSERT_FALSE(controller.update(count_for_level(7.7f)));
+        TEST_ASSERT_FALSE(controller.update(count_for_level(6.3f)));
+    }
+    TEST_ASSERT_EQUAL_UINT8(7, controller.level());
+    // Without the hysteresis 7.7 alone would already round to 8.
+    settle(controller, count_for_level(7.7f));
+    TEST_ASSERT_EQUAL_UINT8(7, controller.level());
+}
+
+void test_level_changes_beyond_the_hysteresis() {
+    Controller controller(CURVE);
+    settle(controller, count_for_level(7.f));
+    settle(controller, count_for_level(7.9f));
+    TEST_ASSERT_EQUAL_UINT8(8, controller.level());
+    settle(controller, count_for_level(6.1f));
+    TEST_ASSERT_EQUAL_UINT8(6, controller.level());
+    // Without hysteresis the level is simply the rounded curve.
+    CurveConfig plain = CURVE;
+    plain.hysteresis = 0.f;
+    Controller direct(plain);
+    settle(direct, count_for_level(7.f));
+    settle(direct, count_for_level(7.6f));
+    TEST_ASSERT_EQUAL_UINT8(8, direct.level());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_curve_ends);
+    RUN_TEST(test_curve_is_logarithmic);
+    RUN_TEST(test_curve_is_monotonic_and_bounded);
+    RUN_TEST(test_interrupt_window);
+    RUN_TEST(test_first_sample_primes_the_filter);
+    RUN_TEST(test_ema_follows_a_step);
+    RUN_TEST(test_hysteresis_ignores_small_changes);
+    RUN_TEST(test_level_changes_beyond_the_hysteresis);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+#include <unity.h>
+
+#include "forecast_packet.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+constexpr uint32_t START = 1760000400; // 2025-10-09 09:00 UTC
+const double MISSING = NAN;            // null in the JSON of open-meteo
+
+void put_u16(Bytes& out, const uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+void put_u32(Bytes& out, const uint32_t v) {
+    put_u16(out, static_cast<uint16_t>(v));
+    put_u16(out, static_cast<uint16_t>(v >> 16));
+}
+
+// pack_forecast() of tools/publish_forecast.py: the packet ends before the first hour
+// without a temperature or a precipitation probability.
+Bytes pack(const uint32_t start, const std::vector<double>& temps,
+           const std::vector<double>& precip) {
+    size_t hours = std::min({temps.size(), precip.size(), FORECAST_PACKET_MAX_HOURS});
+    for (size_t i = 0; i < hours; ++i) {
+        if (std::isnan(temps[i]) || std::isnan(precip[i])) {
+            hours = i;
+            break;
+        }
+    }
+    Bytes out = {'F', 'C', FORECAST_PACKET_VERSION, static_cast<uint8_t>(hours)};
+    put_u32(out, start);
+    for (size_t i = 0; i < hours; ++i)
+        put_u16(out, static_cast<uint16_t>(static_cast<int16_t>(std::lround(temps[i] * 100))));
+    for (size_t i = 0; i < hours; ++i)
+        out.push_back(static_cast<uint8_t>(std::lround(std::fmin(100, std::fmax(0, precip[i])))));
+    put_u32(out, forecast_packet_detail::crc32(out.data(), out.size()));
+    return out;
+}
+
+// Refreshes the CRC after a test changed the body, so only the intended check fails.
+void reseal(Bytes& packet) {
+    packet.resize(packet.size() - FORECAST_PACKET_CRC_SIZE);
+    put_u32(packet, forecast_packet_detail::crc32(packet.data(), packet.size()));
+}
+
+int error_of(const Bytes& packet) {
+    ForecastPacket out{};
+    return static_cast<int>(decode_forecast_packet(packet.data(), packet.size(), out));
+}
+
+int error(const ForecastPacketError err) { return static_cast<int>(err); }
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_decodes_what_the_script_publishes() {
+    // pack_forecast(1760000400, [12.34, -3.5, None, 20.0], [0, 55, 10, 100]) in Python.
+    const Bytes published = {0x46, 0x43, 0x01, 0x02, 0x90, 0x79, 0xE7, 0x68, 0xD2,
+                             0x04, 0xA2, 0xFE, 0x00, 0x37, 0x69, 0x2F, 0x5A, 0x4D};
+    const Bytes packed = pack(START, {12.34, -3.5, MISSING, 20}, {0, 55, 10, 100});
+    TEST_ASSERT_EQUAL_UINT(published.size(), packed.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(published.data(), packed.data(), published.size());
+
+    ForecastPacket out{};
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::None),
+                          static_cast<int>(decode_forecast_packet(published.data(),
+                                                                  published.size(), out)));
+    TEST_ASSERT_EQUAL_UINT32(START, out.start_epoch);
+    TEST_ASSERT_EQUAL_UINT8(2, out.hours);
+    TEST_ASSERT_EQUAL_INT(1234, out.temps_c100[0]);
+    TEST_ASSERT_EQUAL_INT(-350, out.temps_c100[1]);
+    TEST_ASSERT_EQUAL_UINT8(0, out.precip_percent[0]);
+    TEST_ASSERT_EQUAL_UINT8(55, out.precip_percent[1]);
+}
+
+void test_packet_ends_at_the_first_missing_hour() {
+    // A missing probability ends the packet too, instead of being sent as 0 %.
+    const Bytes packet = pack(START, {21.5, 22.25, 23}, {5, MISSING, 30});
+    ForecastPacket out{};
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::None),
+                          static_cast<int>(decode_forecast_packet(packet.data(), packet.size(),
+                                                                  out)));
+    TEST_ASSERT_EQUAL_UINT8(1, out.hours);
+    TEST_ASSERT_EQUAL_INT(2150, out.temps_c100[0]);
+    // Without a first hour there is nothing to send; the script refuses, the clock too.
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadLength),
+                          error_of(pack(START, {MISSING, 1}, {1, 1})));
+}
+
+void test_full_forecast_is_capped() {
+    const std::vector<double> temps(60, -7.25), precip(60, 40);
+    const Bytes packet = pack(START, temps, precip);
+    ForecastPacket out{};
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::None),
+                          static_cast<int>(decode_forecast_packet(packet.data(), packet.size(),
+                                                                  out)));
+    TEST_ASSERT_EQUAL_UINT8(FORECAST_PACKET_MAX_HOURS, out.hours);
+    TEST_ASSERT_EQUAL_INT(-725, out.temps_c100[FORECAST_PACKET_MAX_HOURS - 1]);
+}
+
+void test_rejects_a_bad_checksum() {
+    Bytes packet = pack(START, {10, 11}, {20, 30});
+    packet[8] ^= 0x01; // one bit of the first temperature
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadChecksum), error_of(packet));
+    packet[8] ^= 0x01;
+    packet.back() ^= 0x80; // the CRC itself
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadChecksum), error_of(packet));
+}
+
+void test_rejects_other_versions_and_magic() {
+    Bytes packet = pack(START, {10}, {20});
+    packet[2] = FORECAST_PACKET_VERSION + 1;
+    reseal(packet);
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadVersion), error_of(packet));
+    packet = pack(START, {10}, {20});
+    packet[1] = 'X';
+    reseal(packet);
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadMagic), error_of(packet));
+}
+
+void test_rejects_truncated_and_padded_packets() {
+    const Bytes packet = pack(START, {10, 11, 12}, {20, 30, 40});
+    for (size_t len = 0; len < packet.size(); ++len) {
+        ForecastPacket out{};
+        const auto err = decode_forecast_packet(packet.data(), len, out);
+        TEST_ASSERT_TRUE(err == ForecastPacketError::TooShort ||
+                         err == ForecastPacketError::BadLength);
+    }
+    Bytes padded = packet;
+    padded.push_back(0);
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadLength), error_of(padded));
+    // An hour count that does not match the length, with a valid CRC.
+    Bytes more_hours = packet;
+    more_hours[3] = 4;
+    reseal(more_hours);
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadLength), error_of(more_hours));
+    ForecastPacket out{};
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::TooShort),
+                          static_cast<int>(decode_forecast_packet(nullptr, 20, out)));
+}
+
+void test_rejects_start_and_values_out_of_range() {
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::BadStart),
+                          error_of(pack(START + 60, {10}, {20})));
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::ValueOutOfRange),
+                          error_of(pack(START, {10, 60.01}, {20, 20})));
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::None),
+                          error_of(pack(START, {-60, 60}, {0, 100})));
+    Bytes packet = pack(START, {10}, {20});
+    packet[10] = 101; // the probability, past what pack() clamps to
+    reseal(packet);
+    TEST_ASSERT_EQUAL_INT(error(ForecastPacketError::ValueOutOfRange), error_of(packet));
+}
+
+void test_rejected_packet_leaves_the_output_alone() {
+    Bytes packet = pack(START, {10}, {20});
+    packet.back() ^= 1;
+    ForecastPacket out{};
+    out.hours = 7;
+    decode_forecast_packet(packet.data(), packet.size(), out);
+    TEST_ASSERT_EQUAL_UINT8(7, out.hours);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_decodes_what_the_script_publishes);
+    RUN_TEST(test_packet_ends_at_the_first_missing_hour);
+    RUN_TEST(test_full_forecast_is_capped);
+    RUN_TEST(test_rejects_a_bad_checksum);
+    RUN_TEST(test_rejects_other_versions_and_magic);
+    RUN_TEST(test_rejects_truncated_and_padded_packets);
+    RUN_TEST(test_rejects_start_and_values_out_of_range);
+    RUN_TEST(test_rejected_packet_leaves_the_output_alone);
+    return UNITY_END();
+}
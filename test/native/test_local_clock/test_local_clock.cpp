@@ -0,0 +1,200 @@
+#include <unity.h>
+
+#include "local_clock.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace {
+
+constexpr char CET_RULE[] = "CET-1CEST,M3.5.0/2,M10.5.0/3";
+constexpr int64_t DAY = 86400;
+constexpr int64_t HOUR = 3600;
+
+// 2025 transitions: 30 March 01:00 UTC (02:00 CET -> 03:00 CEST), 26 October 01:00 UTC.
+const time_t SPRING_TRANSITION = LocalClock::days_from_civil(2025, 3, 30) * DAY + 1 * HOUR;
+const time_t AUTUMN_TRANSITION = LocalClock::days_from_civil(2025, 10, 26) * DAY + 1 * HOUR;
+
+LocalClock local_clock;
+
+// The C library as the reference, with the same rule in TZ.
+tm reference(const time_t utc) {
+    tm t{};
+    localtime_r(&utc, &t);
+    return t;
+}
+
+bool same_time(const tm& a, const tm& b) {
+    return a.tm_year == b.tm_year && a.tm_mon == b.tm_mon && a.tm_mday == b.tm_mday &&
+           a.tm_hour == b.tm_hour && a.tm_min == b.tm_min && a.tm_sec == b.tm_sec &&
+           a.tm_wday == b.tm_wday && a.tm_yday == b.tm_yday && a.tm_isdst == b.tm_isdst;
+}
+
+// Ticks second by second over [from, to) and compares every result with localtime_r().
+void expect_ticks_match_reference(const time_t from, const time_t to) {
+    for (time_t t = from; t < to; ++t) {
+        const tm got = local_clock.to_local(t);
+        const tm want = reference(t);
+        if (!same_time(got, want)) {
+            char message[96];
+            std::snprintf(message, sizeof(message),
+                          "at %lld: %02d:%02d:%02d, expected %02d:%02d:%02d",
+                          static_cast<long long>(t), got.tm_hour, got.tm_min, got.tm_sec,
+                          want.tm_hour, want.tm_min, want.tm_sec);
+            TEST_FAIL_MESSAGE(message);
+        }
+    }
+}
+
+} // namespace
+
+void setUp() {
+    local_clock = LocalClock();
+    TEST_ASSERT_TRUE(local_clock.set_timezone(CET_RULE));
+    setenv("TZ", CET_RULE, 1);
+    tzset();
+}
+
+void tearDown() {}
+
+void test_parses_the_cet_rule() {
+    const TzInfo& tz = local_clock.timezone();
+    TEST_ASSERT_TRUE(tz.has_dst);
+    TEST_ASSERT_EQUAL_INT32(1 * HOUR, tz.std_offset_s);
+    TEST_ASSERT_EQUAL_INT32(2 * HOUR, tz.dst_offset_s);
+    TEST_ASSERT_EQUAL_UINT8(3, tz.dst_start.month);
+    TEST_ASSERT_EQUAL_UINT8(5, tz.dst_start.week);
+    TEST_ASSERT_EQUAL_INT32(2 * HOUR, tz.dst_start.time_s);
+    TEST_ASSERT_EQUAL_UINT8(10, tz.dst_end.month);
+    TEST_ASSERT_EQUAL_INT32(3 * HOUR, tz.dst_end.time_s);
+}
+
+void test_offsets_and_transitions_in_2025() {
+    TEST_ASSERT_EQUAL_INT32(1 * HOUR, local_clock.utc_offset_at(SPRING_TRANSITION - 1));
+    TEST_ASSERT_EQUAL_INT32(2 * HOUR, local_clock.utc_offset_at(SPRING_TRANSITION));
+    TEST_ASSERT_EQUAL_INT32(2 * HOUR, local_clock.utc_offset_at(AUTUMN_TRANSITION - 1));
+    TEST_ASSERT_EQUAL_INT32(1 * HOUR, local_clock.utc_offset_at(AUTUMN_TRANSITION));
+    const time_t winter = SPRING_TRANSITION - DAY;
+    const time_t summer = SPRING_TRANSITION;
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, local_clock.next_transition_after(winter));
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_TRANSITION, local_clock.next_transition_after(summer));
+}
+
+void test_ticks_across_spring_forward() {
+    // 01:59:59 CET is followed by 03:00:00 CEST.
+    expect_ticks_match_reference(SPRING_TRANSITION - 2 * HOUR, SPRING_TRANSITION + 2 * HOUR);
+    const tm before = local_clock.to_local(SPRING_TRANSITION - 1);
+    TEST_ASSERT_EQUAL_INT(1, before.tm_hour);
+    TEST_ASSERT_EQUAL_INT(59, before.tm_min);
+    TEST_ASSERT_EQUAL_INT(0, before.tm_isdst);
+    const tm after = local_clock.to_local(SPRING_TRANSITION);
+    TEST_ASSERT_EQUAL_INT(3, after.tm_hour);
+    TEST_ASSERT_EQUAL_INT(0, after.tm_min);
+    TEST_ASSERT_EQUAL_INT(1, after.tm_isdst);
+}
+
+void test_ticks_across_fall_back() {
+    // 02:59:59 CEST is followed by 02:00:00 CET; the hour is shown twice.
+    expect_ticks_match_reference(AUTUMN_TRANSITION - 2 * HOUR, AUTUMN_TRANSITION + 2 * HOUR);
+    const tm before = local_clock.to_local(AUTUMN_TRANSITION - 1);
+    TEST_ASSERT_EQUAL_INT(2, before.tm_hour);
+    TEST_ASSERT_EQUAL_INT(59, before.tm_min);
+    TEST_ASSERT_EQUAL_INT(1, before.tm_isdst);
+    const tm after = local_clock.to_local(AUTUMN_TRANSITION);
+    TEST_ASSERT_EQUAL_INT(2, after.tm_hour);
+    TEST_ASSERT_EQUAL_INT(0, after.tm_min);
+    TEST_ASSERT_EQUAL_INT(0, after.tm_isdst);
+}
+
+void test_derives_only_at_transitions() {
+    // A tick per second from winter to winter: the first call and the two transitions.
+    const time_t from = SPRING_TRANSITION - DAY;
+    for (time_t t = from; t < AUTUMN_TRANSITION + DAY; t += 1)
+        local_clock.to_local(t);
+    TEST_ASSERT_EQUAL_UINT32(3, local_clock.derivations());
+}
+
+void test_steps_and_jumps_rederive() {
+    const time_t t = SPRING_TRANSITION + 10 * DAY;
+    local_clock.to_local(t);
+    const uint32_t base = local_clock.derivations();
+    // A step backwards, e.g. after an NTP correction.
+    TEST_ASSERT_TRUE(same_time(reference(t - 5), local_clock.to_local(t - 5)));
+    TEST_ASSERT_EQUAL_UINT32(base + 1, local_clock.derivations());
+    // A jump of more than a day, e.g. after a long light sleep.
+    TEST_ASSERT_TRUE(same_time(reference(t + 3 * DAY), local_clock.to_local(t + 3 * DAY)));
+    TEST_ASSERT_EQUAL_UINT32(base + 2, local_clock.derivations());
+    // Minute steps stay incremental, also across midnight and a month end.
+    const time_t month_end = LocalClock::days_from_civil(2025, 5, 1) * DAY - 3 * HOUR;
+    local_clock.to_local(month_end);
+    const uint32_t incremental = local_clock.derivations();
+    expect_ticks_match_reference(month_end, month_end + 2 * HOUR);
+    TEST_ASSERT_EQUAL_UINT32(incremental, local_clock.derivations());
+}
+
+void test_matches_localtime_over_years() {
+    // Hourly samples over several years, including 2024's leap day.
+    const time_t from = LocalClock::days_from_civil(2023, 1, 1) * DAY;
+    const time_t to = LocalClock::days_from_civil(2028, 1, 1) * DAY;
+    for (time_t t = from; t < to; t += HOUR)
+        TEST_ASSERT_TRUE(same_time(reference(t), local_clock.to_local(t)));
+}
+
+void test_southern_hemisphere_rule() {
+    constexpr char rule[] = "AEST-10AEDT,M10.1.0,M4.1.0/3";
+    TEST_ASSERT_TRUE(local_clock.set_timezone(rule));
+    setenv("TZ", rule, 1);
+    tzset();
+    const time_t from = LocalClock::days_from_civil(2025, 1, 1) * DAY;
+    for (time_t t = from; t < from + 366 * DAY; t += 15 * 60)
+        TEST_ASSERT_TRUE(same_time(reference(t), local_clock.to_local(t)));
+}
+
+void test_invalid_rule_falls_back_to_utc() {
+    TEST_ASSERT_FALSE(local_clock.set_timezone("not a rule,"));
+    const tm t = local_clock.to_local(SPRING_TRANSITION);
+    TEST_ASSERT_EQUAL_INT(1, t.tm_hour);
+    TEST_ASSERT_EQUAL_INT(0, t.tm_isdst);
+}
+
+void test_benchmark_against_localtime_r() {
+    // A day of one-second ticks, as loop() asks for the time.
+    constexpr int TICKS = 86400;
+    const time_t from = AUTUMN_TRANSITION - 12 * HOUR;
+    volatile int sink = 0;
+    using Clock = std::chrono::steady_clock;
+
+    const auto libc_start = Clock::now();
+    for (int i = 0; i < TICKS; ++i)
+        sink = sink + reference(from + i).tm_sec;
+    const auto libc_ns = std::chrono::duration<double, std::nano>(Clock::now() - libc_start);
+
+    const auto local_start = Clock::now();
+    for (int i = 0; i < TICKS; ++i)
+        sink = sink + local_clock.to_local(from + i).tm_sec;
+    const auto local_ns = std::chrono::duration<double, std::nano>(Clock::now() - local_start);
+
+    char message[128];
+    std::snprintf(message, sizeof(message),
+                  "per tick: localtime_r %.1f ns, LocalClock %.1f ns (%.0fx), %u derivations",
+                  libc_ns.count() / TICKS, local_ns.count() / TICKS,
+                  libc_ns.count() / local_ns.count(), local_clock.derivations());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(2, local_clock.derivations());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_parses_the_cet_rule);
+    RUN_TEST(test_offsets_and_transitions_in_2025);
+    RUN_TEST(test_ticks_across_spring_forward);
+    RUN_TEST(test_ticks_across_fall_back);
+    RUN_TEST(test_derives_only_at_transitions);
+    RUN_TEST(test_steps_and_jumps_rederive);
+    RUN_TEST(test_matches_localtime_over_years);
+    RUN_TEST(test_southern_hemisphere_rule);
+    RUN_TEST(test_invalid_rule_falls_back_to_utc);
+    RUN_TEST(test_benchmark_against_localtime_r);
+    return UNITY_END();
+}
@@ -0,0 +1,133 @@
+#include <unity.h>
+
+#include "notification_queue.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+// NOTIFY_QUEUE_CAPACITY of config.h and TEXT_MAX of notifications.h.
+using Queue = NotificationQueue<8, 96>;
+
+constexpr int64_t SECOND = 1000000;
+constexpr int64_t NOW = 1000 * SECOND;
+constexpr int64_t LATER = NOW + 300 * SECOND; // NOTIFY_DEFAULT_TTL_S
+
+std::vector<std::string> drain(Queue& queue, const int64_t now_us) {
+    std::vector<std::string> texts;
+    Queue::Entry entry{};
+    while (queue.pop(entry, now_us))
+        texts.emplace_back(entry.view());
+    return texts;
+}
+
+void assert_texts(const std::vector<std::string>& expected,
+                  const std::vector<std::string>& actual) {
+    TEST_ASSERT_EQUAL_UINT(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), actual[i].c_str());
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_highest_priority_first_fifo_within() {
+    Queue queue;
+    queue.push("low", 1, LATER, NOW);
+    queue.push("door 1", 9, LATER, NOW);
+    queue.push("normal", 5, LATER, NOW);
+    queue.push("door 2", 9, LATER, NOW);
+    queue.push("low 2", 1, LATER, NOW);
+    TEST_ASSERT_EQUAL_INT(9, queue.top_priority(NOW));
+    assert_texts({"door 1", "door 2", "normal", "low", "low 2"}, drain(queue, NOW));
+    TEST_ASSERT_EQUAL_INT(-1, queue.top_priority(NOW));
+}
+
+void test_requeued_entry_keeps_its_place() {
+    // A message interrupted by a more important one is put back and shown next.
+    Queue queue;
+    queue.push("first", 5, LATER, NOW);
+    queue.push("second", 5, LATER, NOW);
+    Queue::Entry entry{};
+    TEST_ASSERT_TRUE(queue.pop(entry, NOW));
+    queue.push("alarm", 9, LATER, NOW);
+    TEST_ASSERT_TRUE(queue.requeue(entry, NOW));
+    assert_texts({"alarm", "first", "second"}, drain(queue, NOW));
+    // Nothing is put back once it has expired.
+    queue.push("stale", 5, NOW + SECOND, NOW);
+    queue.pop(entry, NOW);
+    TEST_ASSERT_FALSE(queue.requeue(entry, NOW + SECOND));
+    TEST_ASSERT_EQUAL_UINT(0, queue.size());
+}
+
+void test_full_queue_evicts_the_oldest_of_the_lowest_priority() {
+    Queue queue;
+    queue.push("low a", 2, LATER, NOW);
+    queue.push("low b", 2, LATER, NOW);
+    for (int i = 0; i < 6; ++i)
+        queue.push("mid " + std::to_string(i), 5, LATER, NOW);
+    TEST_ASSERT_EQUAL_UINT(8, queue.size());
+    // The same priority may replace the oldest of its own.
+    TEST_ASSERT_TRUE(queue.push("low c", 2, LATER, NOW));
+    TEST_ASSERT_TRUE(queue.push("high", 9, LATER, NOW));
+    TEST_ASSERT_EQUAL_UINT(8, queue.size());
+    TEST_ASSERT_EQUAL_UINT32(2, queue.evicted());
+    const auto texts = drain(queue, NOW);
+    TEST_ASSERT_EQUAL_STRING("high", texts.front().c_str());
+    TEST_ASSERT_EQUAL_STRING("low c", texts.back().c_str()); // low a and low b are gone
+    TEST_ASSERT_EQUAL_UINT(8, texts.size());
+}
+
+void test_full_queue_rejects_lower_priorities() {
+    Queue queue;
+    for (int i = 0; i < 8; ++i)
+        queue.push("mid " + std::to_string(i), 5, LATER, NOW);
+    TEST_ASSERT_FALSE(queue.push("low", 4, LATER, NOW));
+    TEST_ASSERT_EQUAL_UINT32(0, queue.evicted());
+    // A flood of one priority keeps the newest messages.
+    for (int i = 8; i < 20; ++i)
+        TEST_ASSERT_TRUE(queue.push("mid " + std::to_string(i), 5, LATER, NOW));
+    const auto texts = drain(queue, NOW);
+    TEST_ASSERT_EQUAL_UINT(8, texts.size());
+    TEST_ASSERT_EQUAL_STRING("mid 12", texts.front().c_str());
+    TEST_ASSERT_EQUAL_STRING("mid 19", texts.back().c_str());
+}
+
+void test_expired_entries_are_dropped() {
+    Queue queue;
+    queue.push("short", 9, NOW + 10 * SECOND, NOW);
+    queue.push("long", 1, LATER, NOW);
+    TEST_ASSERT_EQUAL_INT(9, queue.top_priority(NOW + 10 * SECOND - 1));
+    TEST_ASSERT_EQUAL_INT(1, queue.top_priority(NOW + 10 * SECOND));
+    TEST_ASSERT_EQUAL_UINT(1, queue.size());
+    assert_texts({}, drain(queue, LATER));
+    // Expired entries make room before anything is evicted.
+    for (int i = 0; i < 8; ++i)
+        queue.push("old", 9, NOW + SECOND, NOW);
+    TEST_ASSERT_TRUE(queue.push("new", 1, LATER, NOW + SECOND));
+    TEST_ASSERT_EQUAL_UINT32(0, queue.evicted());
+    assert_texts({"new"}, drain(queue, NOW + SECOND));
+}
+
+void test_long_text_is_truncated() {
+    Queue queue;
+    queue.push(std::string(200, 'x'), 5, LATER, NOW);
+    Queue::Entry entry{};
+    TEST_ASSERT_TRUE(queue.pop(entry, NOW));
+    TEST_ASSERT_EQUAL_UINT8(95, entry.len);
+    TEST_ASSERT_EQUAL_UINT(95, std::string(entry.text).size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_highest_priority_first_fifo_within);
+    RUN_TEST(test_requeued_entry_keeps_its_place);
+    RUN_TEST(test_full_queue_evicts_the_oldest_of_the_lowest_priority);
+    RUN_TEST(test_full_queue_rejects_lower_priorities);
+    RUN_TEST(test_expired_entries_are_dropped);
+    RUN_TEST(test_long_text_is_truncated);
+    return UNITY_END();
+}
@@ -0,0 +1,349 @@
+#include <unity.h>
+
+#include "ota_package.h"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+constexpr uint8_t COPY = 0, ADD = 1, INSERT = 2;
+
+struct Op {
+    uint8_t op;
+    uint32_t offset;
+    uint32_t len;
+    Bytes data; // added or inserted bytes
+};
+
+void put_u32(Bytes& out, const uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+// The patch encoding of encode_patch() in tools/ota_pack.py.
+Bytes encode(const std::vector<Op>& ops) {
+    Bytes out;
+    for (const Op& op : ops) {
+        out.push_back(op.op);
+        if (op.op != INSERT)
+            put_u32(out, op.offset);
+        put_u32(out, op.len);
+        out.insert(out.end(), op.data.begin(), op.data.end());
+    }
+    return out;
+}
+
+// The reference, as apply_patch() in tools/ota_pack.py.
+Bytes apply(const Bytes& base, const std::vector<Op>& ops) {
+    Bytes out;
+    for (const Op& op : ops) {
+        for (uint32_t i = 0; i < op.len; ++i) {
+            if (op.op == COPY)
+                out.push_back(base[op.offset + i]);
+            else if (op.op == ADD)
+                out.push_back(static_cast<uint8_t>(base[op.offset + i] + op.data[i]));
+            else
+                out.push_back(op.data[i]);
+        }
+    }
+    return out;
+}
+
+Bytes random_bytes(std::mt19937& rng, const size_t len) {
+    Bytes out(len);
+    for (auto& b : out)
+        b = static_cast<uint8_t>(rng());
+    return out;
+}
+
+std::vector<Op> random_ops(std::mt19937& rng, const size_t base_size, const int count) {
+    std::vector<Op> ops;
+    for (int i = 0; i < count; ++i) {
+        Op op{static_cast<uint8_t>(rng() % 3), 0, static_cast<uint32_t>(rng() % 40), {}};
+        if (op.op != INSERT)
+            op.offset = static_cast<uint32_t>(rng() % (base_size - op.len + 1));
+        if (op.op != COPY)
+            op.data = random_bytes(rng, op.len);
+        ops.push_back(op);
+    }
+    return ops;
+}
+
+// Decodes a patch split into the given pieces and collects the output.
+struct Run {
+    OtaPackageError error = OtaPackageError::None;
+    bool stopped = false;
+    bool at_boundary = false;
+    Bytes out;
+    size_t largest_write = 0;
+};
+
+Run decode(const Bytes& base, const Bytes& patch, const std::vector<size_t>& pieces,
+           const size_t scratch_size, const size_t stop_after = SIZE_MAX) {
+    Bytes scratch(scratch_size);
+    OtaDeltaDecoder decoder(base.data(), base.size(), scratch.data(), scratch.size());
+    Run run;
+    const auto sink = [&](const uint8_t* data, const size_t len) {
+        if (run.out.size() + len > stop_after)
+            return false;
+        run.out.insert(run.out.end(), data, data + len);
+        run.largest_write = len > run.largest_write ? len : run.largest_write;
+        return true;
+    };
+    size_t at = 0;
+    for (const size_t n : pieces) {
+        run.error = decoder.feed(patch.data() + at, n, sink, run.stopped);
+        at += n;
+        if (run.error != OtaPackageError::None || run.stopped)
+            break;
+    }
+    run.at_boundary = decoder.at_op_boundary();
+    return run;
+}
+
+std::vector<size_t> whole(const Bytes& patch) { return {patch.size()}; }
+
+// A header as build_package() in tools/ota_pack.py writes it, signed with a dummy signature.
+Bytes package_header() {
+    Bytes h = {'C', 'L', 'K', 'P', OTA_PACKAGE_VERSION, 1, 12, 0};
+    put_u32(h, 1234567);
+    put_u32(h, 654321);
+    for (uint8_t i = 0; i < 32; ++i)
+        h.push_back(i);
+    h.push_back(71);
+    for (uint8_t i = 0; i < OTA_PACKAGE_MAX_SIGNATURE; ++i)
+        h.push_back(i < 71 ? static_cast<uint8_t>(0x80 + i) : 0);
+    h.resize(OTA_PACKAGE_HEADER_SIZE, 0);
+    return h;
+}
+
+int header_error(const Bytes& h, const size_t len) {
+    OtaPackageHeader out{};
+    return static_cast<int>(decode_ota_package_header(h.data(), len, out));
+}
+
+int header_error(const Bytes& h) { return header_error(h, h.size()); }
+
+const Bytes BASE = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100};
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_applies_each_op() {
+    const std::vector<Op> ops = {
+        {COPY, 2, 3, {}},
+        {ADD, 0, 2, {1, 0xFF}},
+        {INSERT, 0, 3, {7, 8, 9}},
+        {INSERT, 0, 0, {}},
+        {COPY, 9, 1, {}},
+    };
+    const Bytes patch = encode(ops);
+    const Run run = decode(BASE, patch, whole(patch), 16);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None), static_cast<int>(run.error));
+    TEST_ASSERT_FALSE(run.stopped);
+    TEST_ASSERT_TRUE(run.at_boundary);
+    const Bytes expected = {30, 40, 50, 11, 19, 7, 8, 9, 100};
+    TEST_ASSERT_EQUAL_UINT(expected.size(), run.out.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), run.out.data(), expected.size());
+}
+
+void test_every_split_point() {
+    // Splits the patch in two at every byte, so each op, argument and data boundary
+    // falls between two feed() calls once.
+    const std::vector<Op> ops = {
+        {COPY, 1, 4, {}}, {ADD, 3, 3, {5, 6, 7}}, {INSERT, 0, 2, {1, 2}}, {COPY, 0, 10, {}}};
+    const Bytes patch = encode(ops);
+    const Bytes expected = apply(BASE, ops);
+    for (size_t split = 0; split <= patch.size(); ++split) {
+        const Run run = decode(BASE, patch, {split, patch.size() - split}, 4);
+        TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None),
+                              static_cast<int>(run.error));
+        TEST_ASSERT_TRUE(run.at_boundary);
+        TEST_ASSERT_EQUAL_UINT(expected.size(), run.out.size());
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), run.out.data(), expected.size());
+    }
+    // And byte by byte.
+    const Run run = decode(BASE, patch, std::vector<size_t>(patch.size(), 1), 4);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), run.out.data(), expected.size());
+}
+
+void test_random_patches_in_random_chunks() {
+    std::mt19937 rng(48);
+    const Bytes base = random_bytes(rng, 300);
+    for (int round = 0; round < 500; ++round) {
+        const std::vector<Op> ops = random_ops(rng, base.size(), 1 + rng() % 12);
+        const Bytes patch = encode(ops);
+        const Bytes expected = apply(base, ops);
+        std::vector<size_t> pieces;
+        for (size_t left = patch.size(); left > 0;) {
+            const size_t n = 1 + rng() % (left < 24 ? left : 24);
+            pieces.push_back(n);
+            left -= n;
+        }
+        const size_t scratch_size = 1 + rng() % 16;
+        const Run run = decode(base, patch, pieces, scratch_size);
+        TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None),
+                              static_cast<int>(run.error));
+        TEST_ASSERT_TRUE(run.at_boundary);
+        TEST_ASSERT_EQUAL_UINT(expected.size(), run.out.size());
+        if (!expected.empty())
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), run.out.data(), expected.size());
+    }
+}
+
+void test_runs_larger_than_the_scratch_buffer() {
+    std::mt19937 rng(1);
+    const Bytes base = random_bytes(rng, 100);
+    const std::vector<Op> ops = {{ADD, 0, 100, random_bytes(rng, 100)}, {COPY, 0, 100, {}}};
+    const Bytes patch = encode(ops);
+    const Run run = decode(base, patch, whole(patch), 8);
+    const Bytes expected = apply(base, ops);
+    TEST_ASSERT_EQUAL_UINT(expected.size(), run.out.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), run.out.data(), expected.size());
+    TEST_ASSERT_EQUAL_UINT(8, run.largest_write);
+}
+
+void test_rejects_ranges_outside_the_base() {
+    const auto error_of = [](const std::vector<Op>& ops) {
+        const Bytes patch = encode(ops);
+        return static_cast<int>(decode(BASE, patch, whole(patch), 4).error);
+    };
+    const int bad = static_cast<int>(OtaPackageError::BadDelta);
+    const int none = static_cast<int>(OtaPackageError::None);
+    TEST_ASSERT_EQUAL_INT(none, error_of({{COPY, 0, 10, {}}})); // up to the last byte
+    TEST_ASSERT_EQUAL_INT(bad, error_of({{COPY, 0, 11, {}}}));
+    TEST_ASSERT_EQUAL_INT(bad, error_of({{COPY, 10, 1, {}}}));
+    TEST_ASSERT_EQUAL_INT(bad, error_of({{ADD, 8, 3, {1, 2, 3}}}));
+    // An offset and length that wrap around in 32 bits.
+    TEST_ASSERT_EQUAL_INT(bad, error_of({{COPY, 0xFFFFFFFFu, 2, {}}}));
+    TEST_ASSERT_EQUAL_INT(bad, error_of({{ADD, 2, 0xFFFFFFFFu, {}}}));
+    // An unknown op.
+    const Bytes unknown = {3, 0, 0, 0, 0};
+    TEST_ASSERT_EQUAL_INT(bad, static_cast<int>(decode(BASE, unknown, whole(unknown), 4).error));
+}
+
+void test_sink_stopping_partway() {
+    const std::vector<Op> ops = {{INSERT, 0, 6, {1, 2, 3, 4, 5, 6}},
+                                 {COPY, 0, 10, {}},
+                                 {ADD, 0, 10, Bytes(10, 1)}};
+    const Bytes patch = encode(ops);
+    const Bytes expected = apply(BASE, ops);
+    // Stopping inside each op: insert, copy and add.
+    for (const size_t stop_after : {3u, 10u, 20u}) {
+        const Run run = decode(BASE, patch, whole(patch), 4, stop_after);
+        TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None),
+                              static_cast<int>(run.error));
+        TEST_ASSERT_TRUE(run.stopped);
+        TEST_ASSERT_FALSE(run.at_boundary);
+        TEST_ASSERT_TRUE(run.out.size() <= stop_after);
+        if (!run.out.empty())
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), run.out.data(), run.out.size());
+    }
+}
+
+void test_truncated_patch_is_not_at_an_op_boundary() {
+    const std::vector<Op> ops = {{COPY, 0, 4, {}}, {INSERT, 0, 4, {1, 2, 3, 4}}};
+    const Bytes patch = encode(ops);
+    // The copy ends after 9 bytes, the insert after 9 + 5 + 4.
+    for (size_t cut = 0; cut <= patch.size(); ++cut) {
+        const Run run = decode(BASE, patch, {cut}, 4);
+        const bool complete = cut == 0 || cut == 9 || cut == patch.size();
+        TEST_ASSERT_EQUAL(complete, run.at_boundary);
+    }
+}
+
+void test_decodes_a_package_header() {
+    const Bytes h = package_header();
+    OtaPackageHeader out{};
+    TEST_ASSERT_TRUE(is_ota_package(h.data(), h.size()));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None),
+                          static_cast<int>(decode_ota_package_header(h.data(), h.size(), out)));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageKind::Delta), static_cast<int>(out.kind));
+    TEST_ASSERT_EQUAL_UINT8(12, out.window_bits);
+    TEST_ASSERT_EQUAL_UINT32(1234567, out.image_size);
+    TEST_ASSERT_EQUAL_UINT32(654321, out.payload_size);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(h.data() + 16, out.image_sha256, 32);
+    TEST_ASSERT_EQUAL_UINT8(71, out.signature_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(h.data() + 49, out.signature, OTA_PACKAGE_MAX_SIGNATURE);
+}
+
+void test_header_error_paths() {
+    const Bytes good = package_header();
+    const auto with = [&](const size_t at, const uint8_t value) {
+        Bytes h = good;
+        h[at] = value;
+        return header_error(h);
+    };
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::TooShort),
+                          header_error(good, OTA_PACKAGE_HEADER_SIZE - 1));
+    OtaPackageHeader out{};
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::TooShort),
+                          static_cast<int>(decode_ota_package_header(nullptr, 128, out)));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadMagic), with(3, 'Q'));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadVersion), with(4, 0));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadVersion), with(4, 2));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None), with(5, 0)); // full
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadKind), with(5, 2));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadWindow), with(6, 8));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None), with(6, 9));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None), with(6, 15));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadWindow), with(6, 16));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None), with(48, 0)); // unsigned
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None), with(48, 72));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::BadSignatureLength), with(48, 73));
+}
+
+void test_rejected_header_leaves_the_output_alone() {
+    Bytes h = package_header();
+    h[4] = 2;
+    OtaPackageHeader out{};
+    out.image_size = 42;
+    decode_ota_package_header(h.data(), h.size(), out);
+    TEST_ASSERT_EQUAL_UINT32(42, out.image_size);
+}
+
+void test_plain_images_are_not_packages() {
+    // An ESP32 app image starts with 0xE9.
+    const uint8_t image[] = {0xE9, 0x05, 0x02, 0x20, 0x00};
+    TEST_ASSERT_FALSE(is_ota_package(image, sizeof(image)));
+    const uint8_t magic[] = {'C', 'L', 'K', 'P'};
+    TEST_ASSERT_FALSE(is_ota_package(magic, 3));
+    TEST_ASSERT_FALSE(is_ota_package(nullptr, 4));
+}
+
+void test_decodes_the_delta_base() {
+    Bytes d;
+    put_u32(d, 0x00123456);
+    for (uint8_t i = 0; i < 32; ++i)
+        d.push_back(static_cast<uint8_t>(0xA0 + i));
+    OtaDeltaBase base{};
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::TooShort),
+                          static_cast<int>(decode_ota_delta_base(d.data(), d.size() - 1, base)));
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(OtaPackageError::None),
+                          static_cast<int>(decode_ota_delta_base(d.data(), d.size(), base)));
+    TEST_ASSERT_EQUAL_UINT32(0x00123456, base.size);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(d.data() + 4, base.sha256, 32);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_applies_each_op);
+    RUN_TEST(test_every_split_point);
+    RUN_TEST(test_random_patches_in_random_chunks);
+    RUN_TEST(test_runs_larger_than_the_scratch_buffer);
+    RUN_TEST(test_rejects_ranges_outside_the_base);
+    RUN_TEST(test_sink_stopping_partway);
+    RUN_TEST(test_truncated_patch_is_not_at_an_op_boundary);
+    RUN_TEST(test_decodes_a_package_header);
+    RUN_TEST(test_header_error_paths);
+    RUN_TEST(test_rejected_header_leaves_the_output_alone);
+    RUN_TEST(test_plain_images_are_not_packages);
+    RUN_TEST(test_decodes_the_delta_base);
+    return UNITY_END();
+}
@@ -0,0 +1,266 @@
+#include <unity.h>
+
+#include "ota_resume.h"
+#include <cstdint>
+#include <vector>
+
+using ota_resume::Action;
+using ota_resume::Record;
+using ota_resume::Result;
+
+namespace {
+
+// The values of config.h: OTA_SAVE_EVERY_BYTES, OTA_MAX_RESUME_BOOTS, OTA_MAX_ATTEMPTS and
+// OTA_RETRY_DELAY_MS.
+constexpr ota_resume::Config CONFIG{64 * 1024, 3, 5, 5000};
+constexpr uint32_t CHUNK = 2048; // OTA_HTTP_BUFFER_SIZE
+constexpr uint32_t NEVER = UINT32_MAX;
+
+// The image server, with the bad links tools/ota_server.py simulates.
+struct Server {
+    uint32_t image_size = 1000000;
+    uint32_t drop_every = 0;      // --drop-every: bytes sent across connections per drop
+    bool invalid = false;         // an image that does not validate once complete
+    uint32_t reset_after = NEVER; // the chip resets after this many bytes in one boot
+    uint8_t refused = 0;          // connections that fail before sending anything
+    uint32_t sent_since_drop = 0;
+};
+
+// The device side of ota.cpp with the NVS record and the download loop reduced to what the
+// policy sees: bytes arriving in chunks, a connection that drops and a chip that resets.
+struct Device {
+    explicit Device(Server& s) : server(s) {}
+
+    Server& server;
+    bool pending = false; // the record exists in NVS
+    Record nvs{0, 0};
+    uint32_t received_this_boot = 0;
+    uint32_t downloaded = 0; // all bytes transferred, to catch downloads starting over
+    bool reset = false;
+    bool installed = false;
+    std::vector<uint32_t> delays_ms;
+
+    void save(const uint32_t written) {
+        nvs = ota_resume::saved(pending ? nvs : Record{0, 0}, written);
+        pending = true;
+    }
+
+    void clear() {
+        pending = false;
+        nvs = {0, 0};
+    }
+
+    // download() in ota.cpp: continues at written, saves periodically and on failure.
+    Result download(uint32_t& written) {
+        uint32_t saved = written;
+        if (server.refused > 0) {
+            --server.refused;
+            save(written);
+            return Result::Failed;
+        }
+        while (written < server.image_size) {
+            if (server.drop_every && server.sent_since_drop >= server.drop_every) {
+                server.sent_since_drop = 0;
+                save(written);
+                return Result::Failed;
+            }
+            if (received_this_boot >= server.reset_after) {
+                reset = true; // nothing more runs in this boot
+                return Result::Failed;
+            }
+            const uint32_t n = server.image_size - written < CHUNK ? server.image_size - written
+                                                                   : CHUNK;
+            written += n;
+            downloaded += n;
+            received_this_boot += n;
+            server.sent_since_drop += n;
+            if (ota_resume::save_due(CONFIG, saved, written)) {
+                save(written);
+                saved = written;
+            }
+        }
+        return server.invalid ? Result::Invalid : Result::Done;
+    }
+
+    // otaUpdateTask() for one URL.
+    Action trigger() {
+        uint32_t written = pending ? nvs.written : 0;
+        for (uint8_t attempt = 1;; ++attempt) {
+            const Result result = download(written);
+            if (reset)
+                return Action::Keep;
+            const ota_resume::Next next = ota_resume::after_attempt(CONFIG, result, attempt);
+            if (next.action != Action::Retry) {
+                if (next.action == Action::Install) {
+                    installed = true;
+                    clear();
+                } else if (next.action == Action::Drop) {
+                    clear();
+                }
+                return next.action;
+            }
+            delays_ms.push_back(next.delay_ms);
+        }
+    }
+
+    // ota_app_start() after a restart; returns false if the pending download was dropped.
+    bool boot() {
+        reset = false;
+        received_this_boot = 0;
+        if (!pending)
+            return true;
+        if (!ota_resume::count_boot(CONFIG, nvs)) {
+            clear();
+            return false;
+        }
+        trigger();
+        return true;
+    }
+};
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_saving_resets_the_boot_count_only_on_progress() {
+    // The case of e658d7d: a failure saved at the same offset kept the chip retrying forever.
+    const Record record{131072, 2};
+    TEST_ASSERT_EQUAL_UINT8(2, ota_resume::saved(record, 131072).boots);
+    TEST_ASSERT_EQUAL_UINT8(0, ota_resume::saved(record, 131073).boots);
+    TEST_ASSERT_EQUAL_UINT32(131073, ota_resume::saved(record, 131073).written);
+    TEST_ASSERT_FALSE(ota_resume::save_due(CONFIG, 0, 65535));
+    TEST_ASSERT_TRUE(ota_resume::save_due(CONFIG, 0, 65536));
+}
+
+void test_boot_count_caps_and_saturates() {
+    Record record{4096, 0};
+    for (uint8_t boot = 1; boot <= CONFIG.max_resume_boots; ++boot)
+        TEST_ASSERT_TRUE(ota_resume::count_boot(CONFIG, record));
+    TEST_ASSERT_FALSE(ota_resume::count_boot(CONFIG, record));
+    record.boots = UINT8_MAX;
+    TEST_ASSERT_FALSE(ota_resume::count_boot(CONFIG, record));
+    TEST_ASSERT_EQUAL_UINT8(UINT8_MAX, record.boots);
+}
+
+void test_retries_with_growing_delays_then_keeps_the_offset() {
+    for (uint8_t attempt = 1; attempt < CONFIG.max_attempts; ++attempt) {
+        const auto next = ota_resume::after_attempt(CONFIG, Result::Failed, attempt);
+        TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Retry), static_cast<int>(next.action));
+        TEST_ASSERT_EQUAL_UINT32(5000u * attempt, next.delay_ms);
+    }
+    const auto last = ota_resume::after_attempt(CONFIG, Result::Failed, CONFIG.max_attempts);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Keep), static_cast<int>(last.action));
+    const auto done = ota_resume::after_attempt(CONFIG, Result::Done, 1);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Install), static_cast<int>(done.action));
+    // A complete image that does not validate will not get better by retrying.
+    const auto invalid = ota_resume::after_attempt(CONFIG, Result::Invalid, 1);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Drop), static_cast<int>(invalid.action));
+}
+
+void test_dropped_connections_continue_where_they_stopped() {
+    // ota_server.py --drop-every 300000
+    Server server;
+    server.drop_every = 300000;
+    Device device(server);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Install), static_cast<int>(device.trigger()));
+    TEST_ASSERT_TRUE(device.installed);
+    TEST_ASSERT_FALSE(device.pending);
+    TEST_ASSERT_EQUAL_UINT32(server.image_size, device.downloaded); // nothing fetched twice
+    const std::vector<uint32_t> expected = {5000, 10000, 15000};
+    TEST_ASSERT_EQUAL_UINT(expected.size(), device.delays_ms.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        TEST_ASSERT_EQUAL_UINT32(expected[i], device.delays_ms[i]);
+}
+
+void test_a_bad_link_is_continued_by_the_next_trigger() {
+    // Five attempts only get through half the image; the offset is kept for later.
+    Server server;
+    server.drop_every = 100000;
+    Device device(server);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Keep), static_cast<int>(device.trigger()));
+    TEST_ASSERT_TRUE(device.pending);
+    TEST_ASSERT_EQUAL_UINT32(5 * 49 * CHUNK, device.nvs.written); // a drop ends the chunk
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Install), static_cast<int>(device.trigger()));
+    TEST_ASSERT_EQUAL_UINT32(server.image_size, device.downloaded);
+}
+
+void test_an_invalid_image_is_dropped_at_once() {
+    Server server;
+    server.invalid = true;
+    Device device(server);
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(Action::Drop), static_cast<int>(device.trigger()));
+    TEST_ASSERT_FALSE(device.installed);
+    TEST_ASSERT_FALSE(device.pending);
+    TEST_ASSERT_TRUE(device.delays_ms.empty());
+}
+
+void test_resets_without_progress_are_dropped_after_the_cap() {
+    // Something in the download resets the chip 200 kB in, before the next save is due.
+    Server server;
+    server.reset_after = 200000;
+    Device device(server);
+    device.trigger();
+    TEST_ASSERT_TRUE(device.reset);
+    TEST_ASSERT_EQUAL_UINT32(3 * 65536, device.nvs.written);
+    // Each restart gets a little further than the saved offset but never to the next save.
+    server.reset_after = 10000;
+    for (uint8_t boot = 1; boot <= CONFIG.max_resume_boots; ++boot) {
+        TEST_ASSERT_TRUE(device.boot());
+        TEST_ASSERT_TRUE(device.reset);
+        TEST_ASSERT_EQUAL_UINT8(boot, device.nvs.boots);
+    }
+    TEST_ASSERT_FALSE(device.boot());
+    TEST_ASSERT_FALSE(device.pending);
+    TEST_ASSERT_FALSE(device.installed);
+}
+
+void test_resets_with_progress_are_continued_to_the_end() {
+    // A reset every 100 kB still saves at least once per boot, so the update gets through.
+    Server server;
+    server.reset_after = 100000;
+    Device device(server);
+    device.trigger();
+    int boots = 0;
+    while (!device.installed) {
+        TEST_ASSERT_TRUE(device.boot());
+        TEST_ASSERT_TRUE(++boots < 100);
+    }
+    TEST_ASSERT_TRUE(boots > CONFIG.max_resume_boots);
+    TEST_ASSERT_FALSE(device.pending);
+}
+
+void test_drops_at_the_same_offset_keep_the_boot_count() {
+    // The link drops right where the last boot stopped, and the chip resets again. Saving the
+    // unchanged offset on each drop must not count as progress.
+    Server server;
+    server.reset_after = 70000;
+    Device device(server);
+    device.trigger();
+    TEST_ASSERT_EQUAL_UINT32(65536, device.nvs.written);
+    server.reset_after = 4000;
+    for (uint8_t boot = 1; boot <= CONFIG.max_resume_boots; ++boot) {
+        server.refused = 1; // the first attempt fails at once and saves 65536 again
+        TEST_ASSERT_TRUE(device.boot());
+        TEST_ASSERT_EQUAL_UINT(1, device.delays_ms.size());
+        device.delays_ms.clear();
+        TEST_ASSERT_EQUAL_UINT32(65536, device.nvs.written);
+        TEST_ASSERT_EQUAL_UINT8(boot, device.nvs.boots);
+    }
+    TEST_ASSERT_FALSE(device.boot());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_saving_resets_the_boot_count_only_on_progress);
+    RUN_TEST(test_boot_count_caps_and_saturates);
+    RUN_TEST(test_retries_with_growing_delays_then_keeps_the_offset);
+    RUN_TEST(test_dropped_connections_continue_where_they_stopped);
+    RUN_TEST(test_a_bad_link_is_continued_by_the_next_trigger);
+    RUN_TEST(test_an_invalid_image_is_dropped_at_once);
+    RUN_TEST(test_resets_without_progress_are_dropped_after_the_cap);
+    RUN_TEST(test_resets_with_progress_are_continued_to_the_end);
+    RUN_TEST(test_drops_at_the_same_offset_keep_the_boot_count);
+    return UNITY_END();
+}
@@ -0,0 +1,143 @@
+#include <unity.h>
+
+#include "publish_journal.h"
+#include <vector>
+
+namespace {
+
+constexpr size_t SLOTS = 24; // mqtt_publisher::MAX_SLOTS
+
+using Journal = PublishJournal<SLOTS>;
+
+std::vector<uint8_t> drain(Journal& journal) {
+    std::vector<uint8_t> ids;
+    uint8_t id;
+    while (journal.pop(id))
+        ids.push_back(id);
+    return ids;
+}
+
+void assert_order(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual) {
+    TEST_ASSERT_EQUAL_UINT(expected.size(), actual.size());
+    if (!expected.empty())
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), actual.data(), expected.size());
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_pops_in_order_of_the_first_change() {
+    Journal journal;
+    TEST_ASSERT_TRUE(journal.empty());
+    TEST_ASSERT_TRUE(journal.push(5));
+    TEST_ASSERT_TRUE(journal.push(2));
+    TEST_ASSERT_TRUE(journal.push(9));
+    TEST_ASSERT_EQUAL_UINT(3, journal.size());
+    assert_order({5, 2, 9}, drain(journal));
+    TEST_ASSERT_TRUE(journal.empty());
+    uint8_t id = 77;
+    TEST_ASSERT_FALSE(journal.pop(id));
+    TEST_ASSERT_EQUAL_UINT8(77, id);
+}
+
+void test_repeated_changes_keep_their_place() {
+    Journal journal;
+    journal.push(3);
+    journal.push(1);
+    // A burst of updates to slot 3 is one message, still sent before slot 1.
+    for (int i = 0; i < 100; ++i)
+        TEST_ASSERT_FALSE(journal.push(3));
+    TEST_ASSERT_TRUE(journal.pending(3));
+    TEST_ASSERT_EQUAL_UINT(2, journal.size());
+    assert_order({3, 1}, drain(journal));
+    // Once sent, the next change queues the slot again, now at the back.
+    journal.push(1);
+    TEST_ASSERT_TRUE(journal.push(3));
+    assert_order({1, 3}, drain(journal));
+}
+
+void test_rejects_unknown_slots() {
+    Journal journal;
+    TEST_ASSERT_FALSE(journal.push(SLOTS));
+    TEST_ASSERT_FALSE(journal.push_front(255));
+    TEST_ASSERT_FALSE(journal.pending(SLOTS));
+    TEST_ASSERT_TRUE(journal.empty());
+}
+
+void test_full_ring_keeps_the_order_across_the_wrap() {
+    Journal journal;
+    // Move the head off zero so the ring wraps while filling up.
+    for (uint8_t id = 0; id < 10; ++id)
+        journal.push(id);
+    drain(journal);
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < SLOTS; ++i) {
+        const auto id = static_cast<uint8_t>((i * 7) % SLOTS); // every slot once
+        TEST_ASSERT_TRUE(journal.push(id));
+        expected.push_back(id);
+    }
+    TEST_ASSERT_EQUAL_UINT(SLOTS, journal.size());
+    // Every slot is pending: changing any of them again cannot overflow the ring.
+    for (uint8_t id = 0; id < SLOTS; ++id) {
+        TEST_ASSERT_FALSE(journal.push(id));
+        TEST_ASSERT_FALSE(journal.push_front(id));
+    }
+    TEST_ASSERT_EQUAL_UINT(SLOTS, journal.size());
+    assert_order(expected, drain(journal));
+}
+
+void test_failed_send_is_retried_first() {
+    Journal journal;
+    journal.push(4);
+    journal.push(6);
+    journal.push(8);
+    uint8_t id;
+    journal.pop(id);
+    TEST_ASSERT_EQUAL_UINT8(4, id);
+    TEST_ASSERT_FALSE(journal.pending(4));
+    // requeue_front() in mqtt_publisher.cpp after the enqueue failed.
+    TEST_ASSERT_TRUE(journal.push_front(4));
+    assert_order({4, 6, 8}, drain(journal));
+    // If the slot changed again while it was being sent, it is already queued at the back.
+    journal.push(4);
+    journal.push(6);
+    journal.pop(id);
+    journal.push(id);
+    TEST_ASSERT_FALSE(journal.push_front(id));
+    assert_order({6, 4}, drain(journal));
+}
+
+void test_replay_after_reconnect() {
+    // The broker is gone while the clock keeps changing: relays, time, sensors.
+    Journal journal;
+    const std::vector<uint8_t> changes = {2, 0, 2, 7, 0, 11, 2, 7, 3, 11, 0};
+    for (const uint8_t id : changes)
+        journal.push(id);
+    TEST_ASSERT_EQUAL_UINT(5, journal.size());
+    // After the reconnect the first enqueue fails and the second drain picks up from there.
+    uint8_t id;
+    journal.pop(id);
+    journal.push_front(id);
+    std::vector<uint8_t> sent;
+    journal.pop(id);
+    sent.push_back(id);
+    journal.push(0); // still pending, merged into the queued message
+    journal.push(2); // the slot just sent changed again
+    for (const uint8_t rest : drain(journal))
+        sent.push_back(rest);
+    assert_order({2, 0, 7, 11, 3, 2}, sent);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pops_in_order_of_the_first_change);
+    RUN_TEST(test_repeated_changes_keep_their_place);
+    RUN_TEST(test_rejects_unknown_slots);
+    RUN_TEST(test_full_ring_keeps_the_order_across_the_wrap);
+    RUN_TEST(test_failed_send_is_retried_first);
+    RUN_TEST(test_replay_after_reconnect);
+    return UNITY_END();
+}
@@ -0,0 +1,177 @@
+#include <unity.h>
+
+#include "relay_schedule.h"
+
+using relay_schedule::Anchor;
+using relay_schedule::Event;
+using relay_schedule::Table;
+
+namespace {
+
+constexpr int64_t DAY = 86400;
+constexpr int64_t HOUR = 3600;
+constexpr relay_schedule::Location SZCZECIN{53.428543, 14.552812};
+
+LocalClock tz_clock;
+
+// 2025 transitions of "CET-1CEST,M3.5.0/2,M10.5.0/3": 30 March 01:00 UTC, 26 October 01:00 UTC.
+const int64_t SPRING_DAY = LocalClock::days_from_civil(2025, 3, 30);
+const int64_t AUTUMN_DAY = LocalClock::days_from_civil(2025, 10, 26);
+const time_t SPRING_TRANSITION = SPRING_DAY * DAY + 1 * HOUR;
+const time_t AUTUMN_TRANSITION = AUTUMN_DAY * DAY + 1 * HOUR;
+
+int64_t local_seconds(const int64_t day, const int hour, const int minute) {
+    return day * DAY + hour * HOUR + minute * 60;
+}
+
+time_t wall_to_utc(const int64_t day, const int hour, const int minute) {
+    return relay_schedule::local_to_utc(local_seconds(day, hour, minute), tz_clock);
+}
+
+Event daily_at(const int hour, const int minute, const uint8_t relay = 0) {
+    return Event{relay_schedule::ALL_DAYS, static_cast<uint8_t>(Anchor::Clock),
+                 static_cast<int16_t>(hour * 60 + minute), relay, 1};
+}
+
+} // namespace
+
+void setUp() { tz_clock.set_timezone("CET-1CEST,M3.5.0/2,M10.5.0/3"); }
+
+void tearDown() {}
+
+void test_ordinary_days_use_the_offset_of_the_day() {
+    // Winter time the day before spring forward, summer time the day after.
+    TEST_ASSERT_EQUAL_INT64(local_seconds(SPRING_DAY - 1, 6, 30) - 1 * HOUR,
+                            wall_to_utc(SPRING_DAY - 1, 6, 30));
+    TEST_ASSERT_EQUAL_INT64(local_seconds(SPRING_DAY + 1, 6, 30) - 2 * HOUR,
+                            wall_to_utc(SPRING_DAY + 1, 6, 30));
+    TEST_ASSERT_EQUAL_INT64(local_seconds(AUTUMN_DAY + 1, 6, 30) - 1 * HOUR,
+                            wall_to_utc(AUTUMN_DAY + 1, 6, 30));
+}
+
+void test_spring_gap_fires_at_the_transition() {
+    // 02:00..02:59 never happens on the last Sunday of March.
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, wall_to_utc(SPRING_DAY, 2, 0));
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, wall_to_utc(SPRING_DAY, 2, 30));
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, wall_to_utc(SPRING_DAY, 2, 59));
+    // Around the gap the wall time is unambiguous.
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION - 60, wall_to_utc(SPRING_DAY, 1, 59));
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, wall_to_utc(SPRING_DAY, 3, 0));
+}
+
+void test_autumn_repeated_hour_fires_at_first_occurrence() {
+    // 02:00..02:59 happens twice on the last Sunday of October, first in summer time.
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_TRANSITION - 1 * HOUR, wall_to_utc(AUTUMN_DAY, 2, 0));
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_TRANSITION - 30 * 60, wall_to_utc(AUTUMN_DAY, 2, 30));
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_TRANSITION + 1 * HOUR, wall_to_utc(AUTUMN_DAY, 3, 0));
+}
+
+void test_daily_event_fires_once_per_day_across_spring_forward() {
+    Table table;
+    TEST_ASSERT_TRUE(table.add(daily_at(2, 30)));
+    table.sort();
+
+    time_t t = local_seconds(SPRING_DAY - 1, 12, 0) - 1 * HOUR;
+    TEST_ASSERT_TRUE(relay_schedule::next_fire_time(table, t, tz_clock, SZCZECIN, t));
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, t);
+    TEST_ASSERT_TRUE(relay_schedule::next_fire_time(table, t, tz_clock, SZCZECIN, t));
+    TEST_ASSERT_EQUAL_INT64(local_seconds(SPRING_DAY + 1, 2, 30) - 2 * HOUR, t);
+}
+
+void test_daily_event_fires_once_per_day_across_fall_back() {
+    Table table;
+    TEST_ASSERT_TRUE(table.add(daily_at(2, 30)));
+    table.sort();
+
+    time_t t = local_seconds(AUTUMN_DAY - 1, 12, 0) - 2 * HOUR;
+    TEST_ASSERT_TRUE(relay_schedule::next_fire_time(table, t, tz_clock, SZCZECIN, t));
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_TRANSITION - 30 * 60, t);
+    // Not again when 02:30 comes round the second time, an hour later.
+    TEST_ASSERT_TRUE(relay_schedule::next_fire_time(table, t, tz_clock, SZCZECIN, t));
+    TEST_ASSERT_EQUAL_INT64(local_seconds(AUTUMN_DAY + 1, 2, 30) - 1 * HOUR, t);
+}
+
+void test_events_keep_their_order_inside_the_gap() {
+    // 01:59 and 03:00 bracket the gap; 02:15 collapses onto the transition with 03:00.
+    Table table;
+    TEST_ASSERT_TRUE(table.add(daily_at(1, 59, 0)));
+    TEST_ASSERT_TRUE(table.add(daily_at(2, 15, 1)));
+    TEST_ASSERT_TRUE(table.add(daily_at(3, 0, 2)));
+    table.sort();
+
+    time_t t = local_seconds(SPRING_DAY, 0, 0) - 1 * HOUR;
+    TEST_ASSERT_TRUE(relay_schedule::next_fire_time(table, t, tz_clock, SZCZECIN, t));
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION - 60, t);
+    TEST_ASSERT_TRUE(relay_schedule::next_fire_time(table, t, tz_clock, SZCZECIN, t));
+    TEST_ASSERT_EQUAL_INT64(SPRING_TRANSITION, t);
+    for (const Event& e : table) {
+        time_t at;
+        TEST_ASSERT_TRUE(relay_schedule::event_time_on(e, SPRING_DAY, tz_clock, SZCZECIN, at));
+        TEST_ASSERT_GREATER_OR_EQUAL(SPRING_TRANSITION - 60, at);
+        TEST_ASSERT_LESS_OR_EQUAL(SPRING_TRANSITION, at);
+    }
+}
+
+void test_local_day_follows_the_offset() {
+    // 23:30 UTC the day before is already the transition day in CET, and in CEST.
+    using relay_schedule::local_day;
+    TEST_ASSERT_EQUAL_INT64(SPRING_DAY, local_day(SPRING_DAY * DAY - 30 * 60, tz_clock));
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_DAY, local_day(AUTUMN_DAY * DAY - 30 * 60, tz_clock));
+    // Midnight of the next day is 23:00 UTC again once back on winter time.
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_DAY, local_day(AUTUMN_DAY * DAY + 23 * HOUR - 1, tz_clock));
+    TEST_ASSERT_EQUAL_INT64(AUTUMN_DAY + 1, local_day(AUTUMN_DAY * DAY + 23 * HOUR, tz_clock));
+}
+
+void test_sun_events_do_not_jump_with_dst() {
+    // Sunrise is computed in UTC and moves by minutes, not by the hour the wall clock does.
+    for (const int64_t day : {SPRING_DAY, AUTUMN_DAY}) {
+        const Event sunrise{relay_schedule::ALL_DAYS, static_cast<uint8_t>(Anchor::Sunrise), 0, 0,
+                            1};
+        time_t before, on, after;
+        using relay_schedule::event_time_on;
+        TEST_ASSERT_TRUE(event_time_on(sunrise, day - 1, tz_clock, SZCZECIN, before));
+        TEST_ASSERT_TRUE(event_time_on(sunrise, day, tz_clock, SZCZECIN, on));
+        TEST_ASSERT_TRUE(event_time_on(sunrise, day + 1, tz_clock, SZCZECIN, after));
+        TEST_ASSERT_INT_WITHIN(5 * 60, DAY, on - before);
+        TEST_ASSERT_INT_WITHIN(5 * 60, DAY, after - on);
+    }
+}
+
+void test_spring_sunrise_in_szczecin() {
+    // Sunrise on 30 March 2025 in Szczecin: 06:41 CEST (04:41 UTC), within two minutes.
+    const Event sunrise{relay_schedule::ALL_DAYS, static_cast<uint8_t>(Anchor::Sunrise), 0, 0, 1};
+    time_t at;
+    TEST_ASSERT_TRUE(relay_schedule::event_time_on(sunrise, SPRING_DAY, tz_clock, SZCZECIN, at));
+    TEST_ASSERT_INT_WITHIN(2 * 60, SPRING_DAY * DAY + 4 * HOUR + 41 * 60, at);
+}
+
+void test_full_table_fits_text_max() {
+    // The longest entry the parser accepts, "MTWTF..,sunrise-720,255,off", MAX_EVENTS times.
+    Table table;
+    for (size_t i = 0; i < relay_schedule::MAX_EVENTS; ++i)
+        TEST_ASSERT_TRUE(
+            table.add(Event{0x3E, static_cast<uint8_t>(Anchor::Sunrise), -720, 254, 0}));
+    table.sort();
+    char text[relay_schedule::TEXT_MAX];
+    const int len = table.format(text, sizeof(text));
+    TEST_ASSERT_EQUAL_INT(relay_schedule::MAX_EVENTS * relay_schedule::EVENT_TEXT_MAX - 1, len);
+
+    Table parsed;
+    TEST_ASSERT_TRUE(parsed.parse(text, 255));
+    TEST_ASSERT_EQUAL_UINT(relay_schedule::MAX_EVENTS, parsed.size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ordinary_days_use_the_offset_of_the_day);
+    RUN_TEST(test_spring_gap_fires_at_the_transition);
+    RUN_TEST(test_autumn_repeated_hour_fires_at_first_occurrence);
+    RUN_TEST(test_daily_event_fires_once_per_day_across_spring_forward);
+    RUN_TEST(test_daily_event_fires_once_per_day_across_fall_back);
+    RUN_TEST(test_events_keep_their_order_inside_the_gap);
+    RUN_TEST(test_local_day_follows_the_offset);
+    RUN_TEST(test_sun_events_do_not_jump_with_dst);
+    RUN_TEST(test_spring_sunrise_in_szczecin);
+    RUN_TEST(test_full_table_fits_text_max);
+    return UNITY_END();
+}
@@ -0,0 +1,306 @@
+#include <unity.h>
+
+#include "clock_discipline.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+// Drives ClockDiscipline the way time_sync.cpp does, against an NTP stand-in on a local UDP
+// port. Time is simulated: the server answers from a shared true time, so days of drift run in
+// milliseconds.
+
+namespace {
+
+constexpr int64_t SECOND = 1000000;
+constexpr int64_t MINUTE = 60 * SECOND;
+constexpr int64_t HOUR = 60 * MINUTE;
+constexpr int64_t DAY = 24 * HOUR;
+constexpr uint32_t NTP_EPOCH_OFFSET_S = 2208988800u; // 1900-01-01 to 1970-01-01
+constexpr int64_t DRIFT_PERIOD = MINUTE;             // DRIFT_CORRECTION_PERIOD_S
+constexpr int64_t SLEW_DIVISOR = 64; // ESP-IDF adjtime() slews 1/64 of the elapsed time at most
+
+const ClockDisciplineConfig CONFIG{
+    .step_threshold_us = 2 * SECOND,
+    .accuracy_bound_us = 100000,
+    .min_interval_ms = 60 * 60 * 1000,
+    .max_interval_ms = 24 * 60 * 60 * 1000,
+};
+
+std::atomic<int64_t> true_time_us{1760000000 * SECOND};
+
+// Answers mode 3 requests with the true time plus an injected offset (a server error).
+class NtpStandIn {
+  public:
+    NtpStandIn() {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr_);
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&addr_), &len);
+        timeval timeout{0, 100000};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        thread_ = std::thread([this] { serve(); });
+    }
+
+    ~NtpStandIn() {
+        running_ = false;
+        thread_.join();
+        close(fd_);
+    }
+
+    const sockaddr_in& address() const { return addr_; }
+    void inject_offset(const int64_t us) { offset_us_ = us; }
+    uint32_t requests() const { return requests_; }
+
+  private:
+    void serve() {
+        uint8_t packet[48];
+        while (running_) {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            const ssize_t n = recvfrom(fd_, packet, sizeof(packet), 0,
+                                       reinterpret_cast<sockaddr*>(&from), &from_len);
+            if (n != sizeof(packet) || (packet[0] & 0x07) != 3)
+                continue;
+            ++requests_;
+            const int64_t now_us = true_time_us + offset_us_;
+            const uint32_t seconds = static_cast<uint32_t>(now_us / SECOND) + NTP_EPOCH_OFFSET_S;
+            const auto fraction = static_cast<uint32_t>((now_us % SECOND) * 4294967296LL / SECOND);
+            uint8_t reply[48]{};
+            reply[0] = 0x24; // LI 0, version 4, mode 4 (server)
+            reply[1] = 1;    // stratum
+            std::memcpy(reply + 24, packet + 40, 8); // originate = client's transmit
+            for (const size_t at : {32, 40}) {       // receive and transmit timestamps
+                const uint32_t be[2] = {htonl(seconds), htonl(fraction)};
+                std::memcpy(reply + at, be, sizeof(be));
+            }
+            sendto(fd_, reply, sizeof(reply), 0, reinterpret_cast<sockaddr*>(&from), from_len);
+        }
+    }
+
+    int fd_ = -1;
+    sockaddr_in addr_{};
+    std::thread thread_;
+    std::atomic<bool> running_{true};
+    std::atomic<int64_t> offset_us_{0};
+    std::atomic<uint32_t> requests_{0};
+};
+
+// Asks the stand-in for the time; returns it in microseconds since 1970.
+int64_t query(const NtpStandIn& server) {
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t packet[48]{};
+    packet[0] = 0x23; // version 4, mode 3 (client)
+    sendto(fd, packet, sizeof(packet), 0, reinterpret_cast<const sockaddr*>(&server.address()),
+           sizeof(server.address()));
+    const ssize_t n = recv(fd, packet, sizeof(packet), 0);
+    close(fd);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(48, n, "no answer from the NTP stand-in");
+    TEST_ASSERT_EQUAL_INT(4, packet[0] & 0x07);
+    uint32_t be[2];
+    std::memcpy(be, packet + 40, sizeof(be));
+    const int64_t seconds = static_cast<int64_t>(ntohl(be[0])) - NTP_EPOCH_OFFSET_S;
+    return seconds * SECOND + static_cast<int64_t>(ntohl(be[1])) * SECOND / 4294967296LL;
+}
+
+// The device's system clock: an oscillator off by drift_ppb, and adjtime() slewing.
+class SimClock {
+  public:
+    explicit SimClock(const int64_t drift_ppb) : drift_ppb_(drift_ppb) {}
+
+    // The clock interface of ClockDiscipline::apply().
+    int64_t now_us() const { return local_us_; }
+    int64_t monotonic_us() const { return monotonic_us_; }
+    int64_t pending_us() const { return pending_us_; }
+    void step(const int64_t us) { local_us_ = us; }
+    bool slew(const int64_t delta_us) {
+        if (refuse_slew)
+            return false;
+        pending_us_ = delta_us;
+        return true;
+    }
+
+    bool refuse_slew = false; // adjtime() failing, e.g. for an offset beyond its range
+
+    // Lets @p us of true time pass; returns the largest jump of the clock in one second.
+    int64_t run(int64_t us) {
+        int64_t worst = 0;
+        for (; us > 0; us -= SECOND) {
+            const int64_t dt = us < SECOND ? us : SECOND;
+            true_time_us += dt;
+            drift_residue_ += drift_ppb_ * dt;
+            const int64_t drift = drift_residue_ / 1000000000;
+            drift_residue_ -= drift * 1000000000;
+            const int64_t limit = dt / SLEW_DIVISOR;
+            const int64_t slew = pending_us_ > limit ? limit : pending_us_ < -limit ? -limit
+                                                                                   : pending_us_;
+            pending_us_ -= slew;
+            local_us_ += dt + drift + slew;
+            monotonic_us_ += dt + drift;
+            const int64_t jump = std::llabs(drift + slew);
+            worst = jump > worst ? jump : worst;
+        }
+        return worst;
+    }
+
+    int64_t error() const { return local_us_ - true_time_us; }
+
+  private:
+    int64_t drift_ppb_;
+    int64_t drift_residue_ = 0;
+    int64_t local_us_ = 0; // 1970 until the first sync
+    int64_t monotonic_us_ = 0;
+    int64_t pending_us_ = 0;
+};
+
+struct Device {
+    explicit Device(const int64_t drift_ppb) : clock(drift_ppb), discipline(CONFIG) {
+        discipline.restore(0, clock.monotonic_us());
+    }
+
+    // apply_server_time() of time_sync.cpp; returns whether the clock was stepped.
+    bool sync(const NtpStandIn& server) {
+        const ClockSync result = discipline.apply(clock, query(server), !valid);
+        valid = true;
+        return result.stepped;
+    }
+
+    // Runs until the next sync is due, with drift_correction_cb() every DRIFT_PERIOD.
+    int64_t run_interval() {
+        int64_t worst = 0;
+        for (int64_t left = discipline.interval_ms() * 1000LL; left > 0; left -= DRIFT_PERIOD) {
+            const int64_t jump = clock.run(left < DRIFT_PERIOD ? left : DRIFT_PERIOD);
+            worst = jump > worst ? jump : worst;
+            if (const int64_t correction = discipline.drift_correction(clock.monotonic_us()))
+                clock.slew(clock.pending_us() + correction);
+        }
+        return worst;
+    }
+
+    SimClock clock;
+    ClockDiscipline<8> discipline;
+    bool valid = false;
+};
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_first_sync_steps_to_server_time() {
+    NtpStandIn server;
+    Device device(0);
+    TEST_ASSERT_TRUE(device.sync(server));
+    TEST_ASSERT_EQUAL_UINT32(1, server.requests());
+    TEST_ASSERT_INT64_WITHIN(1, 0, device.clock.error());
+}
+
+void test_small_offset_is_slewed_without_jumps() {
+    NtpStandIn server;
+    Device device(0);
+    device.sync(server);
+
+    // The server is now 300 ms ahead; the clock follows it gradually.
+    server.inject_offset(300000);
+    TEST_ASSERT_FALSE(device.sync(server));
+    TEST_ASSERT_INT64_WITHIN(1, 0, device.clock.error());
+    // 300 ms at 1/64 take 19.2 s; the clock never moves more than 1/64 s extra per second.
+    const int64_t worst = device.clock.run(20 * SECOND);
+    TEST_ASSERT_LESS_OR_EQUAL(SECOND / SLEW_DIVISOR, worst);
+    TEST_ASSERT_INT64_WITHIN(1, 300000, device.clock.error());
+    TEST_ASSERT_EQUAL_INT64(0, device.clock.pending_us());
+}
+
+void test_large_offset_is_stepped() {
+    NtpStandIn server;
+    Device device(0);
+    device.sync(server);
+
+    server.inject_offset(5 * SECOND);
+    TEST_ASSERT_TRUE(device.sync(server));
+    TEST_ASSERT_INT64_WITHIN(1, 5 * SECOND, device.clock.error());
+}
+
+void test_offset_is_stepped_when_it_cannot_be_slewed() {
+    NtpStandIn server;
+    Device device(0);
+    device.sync(server);
+
+    server.inject_offset(300000);
+    device.clock.refuse_slew = true;
+    TEST_ASSERT_TRUE(device.sync(server));
+    TEST_ASSERT_INT64_WITHIN(1, 300000, device.clock.error());
+    TEST_ASSERT_EQUAL_INT64(0, device.clock.pending_us());
+}
+
+void test_drift_is_learned_and_interval_widens() {
+    NtpStandIn server;
+    Device device(40000); // 40 ppm fast, 3.5 s a day
+    device.sync(server);
+
+    int64_t worst_jump = 0;
+    int64_t worst_offset = 0;
+    for (int i = 0; i < 20; ++i) {
+        worst_jump = std::max<int64_t>(worst_jump, device.run_interval());
+        const int64_t before = device.clock.error();
+        TEST_ASSERT_FALSE_MESSAGE(device.sync(server), "a drifting clock must not be stepped");
+        if (i >= 4) // once the estimate settled
+            worst_offset = std::max<int64_t>(worst_offset, std::llabs(before));
+    }
+    TEST_ASSERT_INT_WITHIN(2000, 40000, device.discipline.drift_ppb());
+    TEST_ASSERT_EQUAL_UINT32(CONFIG.max_interval_ms, device.discipline.interval_ms());
+    TEST_ASSERT_LESS_THAN(CONFIG.accuracy_bound_us, worst_offset);
+    TEST_ASSERT_LESS_OR_EQUAL(SECOND / SLEW_DIVISOR, worst_jump);
+}
+
+void test_interval_shrinks_when_the_offset_grows() {
+    NtpStandIn server;
+    Device device(20000);
+    device.sync(server);
+    for (int i = 0; i < 12; ++i) {
+        device.run_interval();
+        device.sync(server);
+    }
+    TEST_ASSERT_EQUAL_UINT32(CONFIG.max_interval_ms, device.discipline.interval_ms());
+
+    // The server jumps by 500 ms (e.g. it was corrected itself): slewed, and synced more often.
+    server.inject_offset(500000);
+    device.run_interval();
+    TEST_ASSERT_FALSE(device.sync(server));
+    TEST_ASSERT_EQUAL_UINT32(CONFIG.max_interval_ms / 2, device.discipline.interval_ms());
+    device.clock.run(40 * SECOND);
+    TEST_ASSERT_INT64_WITHIN(5000, 500000, device.clock.error());
+}
+
+void test_drift_correction_sums_to_the_drift() {
+    ClockDiscipline<8> discipline(CONFIG);
+    discipline.restore(-12345, 0);
+    int64_t total = 0;
+    for (int64_t t = DRIFT_PERIOD; t <= DAY; t += DRIFT_PERIOD)
+        total += discipline.drift_correction(t);
+    // A slow clock (negative ppb) is advanced by 12345 ns per second.
+    TEST_ASSERT_INT64_WITHIN(1, 12345LL * 86400 / 1000, total);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sync_steps_to_server_time);
+    RUN_TEST(test_small_offset_is_slewed_without_jumps);
+    RUN_TEST(test_large_offset_is_stepped);
+    RUN_TEST(test_offset_is_stepped_when_it_cannot_be_slewed);
+    RUN_TEST(test_drift_is_learned_and_interval_widens);
+    RUN_TEST(test_interval_shrinks_when_the_offset_grows);
+    RUN_TEST(test_drift_correction_sums_to_the_drift);
+    return UNITY_END();
+}
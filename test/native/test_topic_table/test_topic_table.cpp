@@ -0,0 +1,156 @@
+#include <unity.h>
+
+#include "topic_table.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+
+constexpr size_t TOPIC_MAX = 64;
+constexpr char BASE[] = "clock";
+constexpr char OTA_TOPIC[] = "device/ota/url";
+constexpr uint8_t OTA = 0, RELAY = 1, OTHER = 2;
+constexpr size_t OTHER_TOPICS = 4; // group, forecast, notify, schedule
+
+void relay_topic(char* buf, const size_t size, const size_t idx) {
+    std::snprintf(buf, size, "%s/light%u/command", BASE, static_cast<unsigned>(idx + 1));
+}
+
+// The table as mqtt.cpp builds it on connect, for any number of relays.
+template <size_t RELAYS> void build(TopicTable<RELAYS + 1 + OTHER_TOPICS, TOPIC_MAX>& table) {
+    table.clear();
+    table.add(OTA_TOPIC, OTA);
+    for (size_t i = 0; i < RELAYS; ++i) {
+        char topic[TOPIC_MAX];
+        relay_topic(topic, sizeof(topic), i);
+        table.add(topic, RELAY, static_cast<uint8_t>(i));
+    }
+    for (const char* suffix : {"group/command", "forecast", "notify", "schedule/set"}) {
+        char topic[TOPIC_MAX];
+        std::snprintf(topic, sizeof(topic), "%s/%s", BASE, suffix);
+        table.add(topic, OTHER);
+    }
+    table.build();
+}
+
+// The dispatch the table replaced: copy the topic, then format and compare every relay topic.
+int linear_dispatch(const char* data, const size_t len, const size_t relays) {
+    const std::string topic(data, len);
+    if (topic == OTA_TOPIC)
+        return -2;
+    for (size_t i = 0; i < relays; ++i) {
+        char expected[TOPIC_MAX];
+        relay_topic(expected, sizeof(expected), i);
+        if (topic == expected)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+template <typename Table> int table_dispatch(const Table& table, const char* data, size_t len) {
+    const auto* entry = table.find({data, len});
+    if (!entry)
+        return -1;
+    return entry->kind == RELAY ? entry->arg : -2;
+}
+
+using Clock = std::chrono::steady_clock;
+
+// Nanoseconds per dispatch of the messages the device receives: every relay command once.
+template <size_t RELAYS> void benchmark() {
+    static TopicTable<RELAYS + 1 + OTHER_TOPICS, TOPIC_MAX> table;
+    build<RELAYS>(table);
+    char topics[RELAYS][TOPIC_MAX];
+    for (size_t i = 0; i < RELAYS; ++i)
+        relay_topic(topics[i], TOPIC_MAX, i);
+
+    constexpr int ROUNDS = 200000 / static_cast<int>(RELAYS) + 1;
+    volatile int sink = 0;
+
+    const auto linear_start = Clock::now();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < RELAYS; ++i)
+            sink = sink + linear_dispatch(topics[i], std::strlen(topics[i]), RELAYS);
+    const auto linear_ns = std::chrono::duration<double, std::nano>(Clock::now() - linear_start);
+
+    const auto table_start = Clock::now();
+    for (int r = 0; r < ROUNDS; ++r)
+        for (size_t i = 0; i < RELAYS; ++i)
+            sink = sink + table_dispatch(table, topics[i], std::strlen(topics[i]));
+    const auto table_ns = std::chrono::duration<double, std::nano>(Clock::now() - table_start);
+
+    const double calls = static_cast<double>(ROUNDS) * RELAYS;
+    char message[128];
+    std::snprintf(message, sizeof(message),
+                  "%3zu relays, %3zu topics: formatted compare %7.1f ns, table %5.1f ns",
+                  RELAYS, table.size(), linear_ns.count() / calls, table_ns.count() / calls);
+    TEST_MESSAGE(message);
+
+    // Both must agree, whatever their speed.
+    for (size_t i = 0; i < RELAYS; ++i)
+        TEST_ASSERT_EQUAL_INT(linear_dispatch(topics[i], std::strlen(topics[i]), RELAYS),
+                              table_dispatch(table, topics[i], std::strlen(topics[i])));
+}
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_finds_every_topic() {
+    TopicTable<3 + 1 + OTHER_TOPICS, TOPIC_MAX> table;
+    build<3>(table);
+    TEST_ASSERT_EQUAL_UINT(3 + 1 + OTHER_TOPICS, table.size());
+    for (size_t i = 0; i < 3; ++i) {
+        char topic[TOPIC_MAX];
+        relay_topic(topic, sizeof(topic), i);
+        const auto* entry = table.find(topic);
+        TEST_ASSERT_NOT_NULL(entry);
+        TEST_ASSERT_EQUAL_UINT8(RELAY, entry->kind);
+        TEST_ASSERT_EQUAL_UINT8(i, entry->arg);
+        TEST_ASSERT_EQUAL_STRING(topic, entry->topic);
+    }
+    TEST_ASSERT_EQUAL_UINT8(OTA, table.find(OTA_TOPIC)->kind);
+    TEST_ASSERT_EQUAL_UINT8(OTHER, table.find("clock/forecast")->kind);
+}
+
+void test_rejects_unknown_topics() {
+    TopicTable<3 + 1 + OTHER_TOPICS, TOPIC_MAX> table;
+    build<3>(table);
+    TEST_ASSERT_NULL(table.find("clock/light4/command"));
+    TEST_ASSERT_NULL(table.find("clock/light1/state"));    // our own publishes
+    TEST_ASSERT_NULL(table.find("clock/light1/comman"));   // a prefix
+    TEST_ASSERT_NULL(table.find("clock/light1/commands")); // an extension
+    TEST_ASSERT_NULL(table.find(""));
+    TEST_ASSERT_NULL(table.find(std::string(200, 'x')));
+}
+
+void test_add_refuses_what_does_not_fit() {
+    TopicTable<2, 8> table;
+    TEST_ASSERT_FALSE(table.add("12345678", RELAY)); // no room for the terminator
+    TEST_ASSERT_TRUE(table.add("1234567", RELAY));
+    TEST_ASSERT_TRUE(table.add("b", RELAY));
+    TEST_ASSERT_FALSE(table.add("a", RELAY));
+    table.build();
+    TEST_ASSERT_NOT_NULL(table.find("b"));
+    TEST_ASSERT_NULL(table.find("a"));
+}
+
+void test_benchmark_dispatch_as_relays_grow() {
+    benchmark<3>();
+    benchmark<8>();
+    benchmark<32>();
+    benchmark<120>();
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_finds_every_topic);
+    RUN_TEST(test_rejects_unknown_topics);
+    RUN_TEST(test_add_refuses_what_does_not_fit);
+    RUN_TEST(test_benchmark_dispatch_as_relays_grow);
+    return UNITY_END();
+}
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Flood a clock with relay commands through an MQTT broker and check it keeps up.
+
+Every relay command topic gets --count alternating ON/OFF commands as fast as mosquitto_pub
+sends them, all relays at once. The clock must apply them without stalling its MQTT client and
+end in the state of the last command of every relay; the coalescing publish queue should answer
+with far fewer state messages than it received commands. A single command sent after the flood
+measures how quickly the clock responds again.
+
+    tools/mqtt_burst_test.py --host 192.168.1.10 -u user -P pass
+    tools/mqtt_burst_test.py --host localhost --count 5000 --relays 3
+
+Start a local broker for it with e.g. `mosquitto -v`, with the clock's MQTT_BROKER_IP pointing
+at it. Exits with status 1 if a final state is wrong or the clock stops answering.
+"""
+
+import argparse
+import subprocess
+import sys
+import threading
+import time
+
+
+class StateWatcher:
+    """Collects the relay state messages the clock publishes, with their arrival times."""
+
+    def __init__(self, args, relays):
+        command = ["mosquitto_sub", "-h", args.host, "-p", str(args.port), "-v"]
+        command += auth(args)
+        for i in range(relays):
+            command += ["-t", state_topic(args.base, i)]
+        self.process = subprocess.Popen(command, stdout=subprocess.PIPE, text=True)
+        self.lock = threading.Lock()
+        self.changed = threading.Condition(self.lock)
+        self.messages = []  # (time, relay, payload)
+        self.topics = {state_topic(args.base, i): i for i in range(relays)}
+        threading.Thread(target=self.read, daemon=True).start()
+
+    def read(self):
+        for line in self.process.stdout:
+            topic, _, payload = line.rstrip("\n").partition(" ")
+            if topic in self.topics:
+                with self.changed:
+                    self.messages.append((time.monotonic(), self.topics[topic], payload))
+                    self.changed.notify_all()
+
+    def count(self):
+        with self.lock:
+            return len(self.messages)
+
+    def last_state(self, relay):
+        with self.lock:
+            for _, i, payload in reversed(self.messages):
+                if i == relay:
+                    return payload
+        return None
+
+    def wait_for(self, relay, payload, since, timeout):
+        """Time of the first state message of relay with payload after since, or None."""
+        deadline = time.monotonic() + timeout
+        with self.changed:
+            while True:
+                for at, i, p in self.messages:
+                    if at >= since and i == relay and p == payload:
+                        return at
+                remaining = deadline - time.monotonic()
+                if remaining <= 0:
+                    return None
+                self.changed.wait(remaining)
+
+    def wait_quiet(self, quiet, timeout):
+        """Waits until no state message arrived for quiet seconds; returns the last arrival."""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            with self.lock:
+                last = self.messages[-1][0] if self.messages else 0
+            if time.monotonic() - last >= quiet:
+                break
+            time.sleep(0.1)
+        return last
+
+    def stop(self):
+        self.process.terminate()
+
+
+def auth(args):
+    credentials = ["-u", args.user] if args.user else []
+    return credentials + (["-P", args.password] if args.password else [])
+
+
+def command_topic(base, relay):
+    return f"{base}/light{relay + 1}/command"
+
+
+def state_topic(base, relay):
+    return f"{base}/light{relay + 1}/state"
+
+
+def flood(args, relay, count, final):
+    """Sends count alternating commands to one relay, the last one being final."""
+    other = "OFF" if final == "ON" else "ON"
+    lines = "".join(f"{final if (count - 1 - n) % 2 == 0 else other}\n" for n in range(count))
+    command = ["mosquitto_pub", "-h", args.host, "-p", str(args.port), "-q", str(args.qos),
+               "-t", command_topic(args.base, relay), "-l"] + auth(args)
+    subprocess.run(command, input=lines, text=True, check=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("-u", "--user")
+    parser.add_argument("-P", "--password")
+    parser.add_argument("--base", default="clock", help="MQTT_TOPIC_BASE of the clock")
+    parser.add_argument("--relays", type=int, default=3, help="RELAY_COUNT of the clock")
+    parser.add_argument("--count", type=int, default=1000, help="commands per relay")
+    parser.add_argument("--qos", type=int, choices=(0, 1, 2), default=0)
+    parser.add_argument("--timeout", type=float, default=30, help="seconds to wait for the clock")
+    args = parser.parse_args()
+
+    watcher = StateWatcher(args, args.relays)
+    time.sleep(1)  # let the subscription settle and the retained states arrive
+    retained = watcher.count()
+
+    # Relays end alternately on and off, so a clock that stops early is caught either way.
+    finals = ["ON" if i % 2 == 0 else "OFF" for i in range(args.relays)]
+    start = time.monotonic()
+    senders = [threading.Thread(target=flood, args=(args, i, args.count, finals[i]))
+               for i in range(args.relays)]
+    for sender in senders:
+        sender.start()
+    for sender in senders:
+        sender.join()
+    sent = time.monotonic() - start
+    commands = args.count * args.relays
+    print(f"sent {commands} commands in {sent:.2f} s ({commands / sent:.0f}/s)")
+
+    last = watcher.wait_quiet(quiet=2, timeout=args.timeout)
+    states = watcher.count() - retained
+    print(f"received {states} state messages, {commands / max(states, 1):.0f} commands per "
+          f"message, last one {max(last - start, 0):.2f} s after the flood started")
+
+    failed = False
+    for i in range(args.relays):
+        state = watcher.last_state(i)
+        if state != finals[i]:
+            print(f"light{i + 1}: state {state}, expected {finals[i]}")
+            failed = True
+
+    # The clock must still answer promptly once the flood is over.
+    flip = "OFF" if finals[0] == "ON" else "ON"
+    sent_at = time.monotonic()
+    flood(args, 0, 1, flip)
+    answered = watcher.wait_for(0, flip, sent_at, args.timeout)
+    if answered is None:
+        print(f"light1: no answer to a command within {args.timeout:.0f} s")
+        failed = True
+    else:
+        print(f"round trip after the flood: {(answered - sent_at) * 1000:.0f} ms")
+    watcher.stop()
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
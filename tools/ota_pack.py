@@ -0,0 +1,274 @@
+#!/usr/bin/env python3
+"""Pack a firmware image into a compressed, optionally signed OTA package.
+
+The clock inflates a package while it downloads, straight into the update partition, so only
+the compressed bytes cross the network. The format is described in include/ota_package.h.
+
+    tools/ota_pack.py .pio/build/esp32dev/firmware.bin -o firmware.clkp
+    tools/ota_pack.py firmware.bin -o firmware.clkp --key signing_key.pem
+    tools/ota_pack.py firmware.bin --bench
+
+With --base the package is a delta: a patch against the image the clock runs now, which it
+rebuilds the new image from. Keep the firmware.bin of every release for this. A clock running
+anything else refuses the patch, so keep the full package at hand as well.
+
+    tools/ota_pack.py new/firmware.bin --base old/firmware.bin -o update.clkp --bench
+
+Serve the package with tools/ota_server.py and trigger the update with its URL as usual; a
+plain image is still accepted unless the firmware is built with ENABLE_OTA_SIGNATURE.
+
+Signing uses an ECDSA P-256 key and the openssl command line tool:
+
+    openssl ecparam -name prime256v1 -genkey -noout -out signing_key.pem
+    tools/ota_pack.py --pubkey signing_key.pem   # paste into OTA_SIGNING_PUBLIC_KEY_PEM
+
+--bench compares the package with the plain image (and, for a delta, with the full package):
+bytes on the wire, inflate speed on this machine and two estimates: the download time at a few
+link speeds, from the byte counts alone, and the RAM the device needs for inflating, from the
+buffer sizes. The real numbers come from the device, which logs after each update:
+
+    OTA: Rebuilt ... in <ms> ms (<KiB/s>), heap peak <bytes> (<buffers>, inflater state <bytes>)
+"""
+
+import argparse
+import hashlib
+import struct
+import subprocess
+import sys
+import time
+import zlib
+
+MAGIC = b"CLKP"
+VERSION = 1
+KIND_FULL = 0
+KIND_DELTA = 1
+HEADER_SIZE = 128
+SIGNED_SIZE = 48
+MAX_SIGNATURE = 72
+MIN_WINDOW_BITS = 9
+MAX_WINDOW_BITS = 15
+
+# Device side buffers besides the window: tinfl_decompressor and one OTA_HTTP_BUFFER_SIZE chunk.
+# sizeof(tinfl_decompressor) of the ROM miniz, roughly; the device logs the exact value.
+TINFL_STATE_BYTES_ESTIMATE = 11000
+INPUT_BUFFER_BYTES = 2048
+LINK_SPEEDS_KIB = (50, 200, 1000)
+
+OP_COPY, OP_ADD, OP_INSERT = 0, 1, 2
+BLOCK = 16  # bytes hashed to find a match in the base
+INDEX_STEP = 4  # base positions indexed; matches are extended backwards to cover the gap
+MIN_MATCH = 24  # shorter matches cost more as ops than as inserted bytes
+
+
+def deflate(image, window_bits, level=9):
+    """Raw deflate stream (no zlib header), as inflated by the ROM tinfl on the device."""
+    compressor = zlib.compressobj(level, zlib.DEFLATED, -window_bits, memLevel=9)
+    return compressor.compress(image) + compressor.flush()
+
+
+def inflate(payload, window_bits):
+    return zlib.decompress(payload, -window_bits)
+
+
+def sign(key_path, data):
+    """DER encoded ECDSA signature over SHA-256 of data."""
+    result = subprocess.run(["openssl", "dgst", "-sha256", "-sign", key_path], input=data,
+                            capture_output=True, check=True)
+    if len(result.stdout) > MAX_SIGNATURE:
+        sys.exit(f"signature of {len(result.stdout)} bytes does not fit, use a P-256 key")
+    return result.stdout
+
+
+def public_key_pem(key_path):
+    return subprocess.run(["openssl", "pkey", "-in", key_path, "-pubout"], capture_output=True,
+                          check=True, text=True).stdout
+
+
+def match_forward(a, ai, b, bi, limit):
+    n = 0
+    while n < limit:
+        s = min(64, limit - n)
+        if a[ai + n : ai + n + s] == b[bi + n : bi + n + s]:
+            n += s
+            continue
+        while n < limit and a[ai + n] == b[bi + n]:
+            n += 1
+        break
+    return n
+
+
+def diff(base, image):
+    """Patch ops rebuilding image from base, as (op, offset, length, data)."""
+    index = {}
+    for i in range(0, len(base) - BLOCK + 1, INDEX_STEP):
+        index.setdefault(base[i : i + BLOCK], i)
+
+    ops = []
+    shift = None  # image position minus base position of the last copy
+
+    def literal(start, end):
+        if end <= start:
+            return
+        at = start - shift if shift is not None else -1
+        if 0 <= at and at + end - start <= len(base):
+            old = base[at : at + end - start]
+            new = image[start:end]
+            if sum(x == y for x, y in zip(old, new)) * 2 >= len(new):
+                ops.append((OP_ADD, at, end - start, bytes((x - y) & 0xFF for x, y in zip(new, old))))
+                return
+        ops.append((OP_INSERT, 0, end - start, image[start:end]))
+
+    pending = pos = 0
+    while pos + BLOCK <= len(image):
+        best_len = best_at = 0
+        for at in (pos - shift if shift is not None else None, index.get(image[pos : pos + BLOCK])):
+            if at is None or not 0 <= at < len(base):
+                continue
+            n = match_forward(base, at, image, pos, min(len(base) - at, len(image) - pos))
+            if n > best_len:
+                best_len, best_at = n, at
+        if best_len < MIN_MATCH:
+            pos += 1
+            continue
+        back = 0
+        while pos - back > pending and best_at - back > 0 and image[pos - back - 1] == base[best_at - back - 1]:
+            back += 1
+        literal(pending, pos - back)
+        ops.append((OP_COPY, best_at - back, best_len + back, b""))
+        pos += best_len
+        pending = pos
+        shift = pos - (best_at + best_len)
+    literal(pending, len(image))
+    return ops
+
+
+def encode_patch(ops):
+    out = bytearray()
+    for op, offset, length, data in ops:
+        if op == OP_INSERT:
+            out += struct.pack("<BI", op, length) + data
+        else:
+            out += struct.pack("<BII", op, offset, length) + data
+    return bytes(out)
+
+
+def apply_patch(base, patch):
+    """Reference implementation of the decoder on the device."""
+    out = bytearray()
+    pos = 0
+    while pos < len(patch):
+        op = patch[pos]
+        if op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", patch, pos + 1)
+            pos += 5
+            out += patch[pos : pos + length]
+        else:
+            offset, length = struct.unpack_from("<II", patch, pos + 1)
+            pos += 9
+            if op == OP_COPY:
+                out += base[offset : offset + length]
+                continue
+            out += bytes((x + y) & 0xFF for x, y in zip(base[offset : offset + length], patch[pos : pos + length]))
+        pos += length
+    return bytes(out)
+
+
+def build_package(image, payload, window_bits, key_path=None, kind=KIND_FULL, base=None):
+    signed = MAGIC + struct.pack("<BBBBII", VERSION, kind, window_bits, 0, len(image), len(payload))
+    signed += hashlib.sha256(image).digest()
+    assert len(signed) == SIGNED_SIZE
+    signature = sign(key_path, signed) if key_path else b""
+    header = signed + bytes([len(signature)]) + signature.ljust(MAX_SIGNATURE, b"\0")
+    if kind == KIND_DELTA:
+        header = header.ljust(HEADER_SIZE, b"\0") + struct.pack("<I", len(base)) + hashlib.sha256(base).digest()
+    return header.ljust(HEADER_SIZE, b"\0") + payload
+
+
+def c_string(pem):
+    """The PEM as a C string literal for include/config.h."""
+    lines = pem.strip().splitlines()
+    return "\n".join(f'"{line}\\n"' for line in lines)
+
+
+def bench(image, payload, package, window_bits, full=None, ops=None):
+    began = time.perf_counter()
+    runs = 0
+    while time.perf_counter() - began < 0.5:
+        inflate(payload, window_bits)
+        runs += 1
+    inflate_s = (time.perf_counter() - began) / runs
+
+    print(f"image      {len(image):>10} bytes")
+    if full is not None:
+        print(f"full       {len(full):>10} bytes, {100 * len(full) / len(image):.1f} %")
+    print(f"package    {len(package):>10} bytes, {100 * len(package) / len(image):.1f} % "
+          f"({len(image) - len(package)} bytes saved)")
+    if ops is not None:
+        copied = sum(length for op, _, length, _ in ops if op == OP_COPY)
+        added = sum(length for op, _, length, _ in ops if op == OP_ADD)
+        print(f"patch      {len(ops):>10} ops: {copied} bytes copied, {added} added, "
+              f"{len(image) - copied - added} inserted")
+    print(f"window     {1 << window_bits:>10} bytes")
+    print("estimated download time, link speed only (no TLS, latency or flash writes):")
+    for kib in LINK_SPEEDS_KIB:
+        plain = len(image) / 1024 / kib
+        packed = len(package) / 1024 / kib
+        print(f"at {kib:>4} KiB/s  {plain:6.1f} s -> {packed:6.1f} s")
+    inflated = len(image) if ops is None else len(inflate(payload, window_bits))
+    print(f"inflate on this host  {inflated / 1024 / 1024 / inflate_s:.0f} MiB/s")
+    scratch = 0 if ops is None else INPUT_BUFFER_BYTES
+    ram = TINFL_STATE_BYTES_ESTIMATE + (1 << window_bits) + INPUT_BUFFER_BYTES + scratch
+    print(f"estimated device RAM for inflating  ~{ram} bytes "
+          f"(state ~{TINFL_STATE_BYTES_ESTIMATE}, window {1 << window_bits}, "
+          f"input {INPUT_BUFFER_BYTES}{f', patch scratch {scratch}' if scratch else ''}); "
+          f"the HTTP client comes on top, see the heap peak in the device log")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", nargs="?", help="firmware image to pack")
+    parser.add_argument("-o", "--output", help="package to write")
+    parser.add_argument("--window-bits", type=int, default=12, choices=range(MIN_WINDOW_BITS, MAX_WINDOW_BITS + 1),
+                        metavar=f"{MIN_WINDOW_BITS}..{MAX_WINDOW_BITS}",
+                        help="deflate window of 2^N bytes, also the inflate buffer on the device (default: 12)")
+    parser.add_argument("--key", help="ECDSA P-256 private key (PEM) to sign the package with")
+    parser.add_argument("--base", help="image running on the clock now; makes a delta package")
+    parser.add_argument("--bench", action="store_true", help="compare package and image, see above")
+    parser.add_argument("--pubkey", metavar="KEY", help="print the public key of KEY for include/config.h and exit")
+    args = parser.parse_args()
+
+    if args.pubkey:
+        print(c_string(public_key_pem(args.pubkey)))
+        return
+    if not args.image or not (args.output or args.bench):
+        parser.error("an image and --output or --bench are required")
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    payload = deflate(image, args.window_bits)
+    if inflate(payload, args.window_bits) != image:
+        sys.exit("deflate roundtrip failed")
+    package = build_package(image, payload, args.window_bits, args.key)
+    full, ops = None, None
+    if args.base:
+        with open(args.base, "rb") as f:
+            base = f.read()
+        ops = diff(base, image)
+        patch = encode_patch(ops)
+        if apply_patch(base, patch) != image:
+            sys.exit("patch roundtrip failed")
+        full = package
+        payload = deflate(patch, args.window_bits)
+        package = build_package(image, payload, args.window_bits, args.key, KIND_DELTA, base)
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(package)
+        print(f"{args.output}: {len(image)} -> {len(package)} bytes"
+              f"{', delta' if args.base else ''}{', signed' if args.key else ''}")
+    if args.bench:
+        bench(image, payload, package, args.window_bits, full, ops)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Serve a firmware image for OTA testing, with Range requests and simulated bad links.
+
+Stands in for the real firmware server when testing the update path of the clock: ranged
+requests, resuming after a dropped connection and progress reporting.
+
+    tools/ota_server.py .pio/build/esp32dev/firmware.bin
+    tools/ota_server.py firmware.bin --rate 50 --drop-every 300000
+
+Then trigger the update with the URL printed at start, e.g.
+
+    mosquitto_pub -h <broker> -t device/ota/url -m http://192.168.1.20:8070/firmware.bin
+    curl -d http://192.168.1.20:8070/firmware.bin http://<clock>/ota_trigger
+
+--drop-every closes the connection after that many bytes in total were sent since the last
+drop, so the clock has to continue with a Range request. --rate limits the throughput, which
+makes the progress on the display and on <base>/ota easy to follow.
+"""
+
+import argparse
+import os
+import re
+import socket
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+RANGE_RE = re.compile(r"bytes=(\d*)-(\d*)$")
+CHUNK = 1024
+
+
+class Link:
+    """Bytes sent across all connections, for --drop-every."""
+
+    def __init__(self, drop_every):
+        self.drop_every = drop_every
+        self.sent = 0
+        self.lock = threading.Lock()
+
+    def send(self, n):
+        """Counts n bytes; returns False if the connection should be dropped instead."""
+        with self.lock:
+            if self.drop_every and self.sent + n > self.drop_every:
+                self.sent = 0
+                return False
+            self.sent += n
+            return True
+
+
+def make_handler(image, name, rate, link):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_HEAD(self):
+            self.respond(send_body=False)
+
+        def do_GET(self):
+            self.respond(send_body=True)
+
+        def respond(self, send_body):
+            if self.path.lstrip("/") != name:
+                self.send_error(404)
+                return
+            start, end = 0, len(image) - 1
+            ranged = "Range" in self.headers
+            if ranged:
+                m = RANGE_RE.match(self.headers["Range"].strip())
+                if not m or (not m.group(1) and not m.group(2)):
+                    self.send_error(416)
+                    return
+                if m.group(1):
+                    start = int(m.group(1))
+                    if m.group(2):
+                        end = min(int(m.group(2)), end)
+                else:  # suffix range
+                    start = max(0, len(image) - int(m.group(2)))
+                if start > end:
+                    self.send_response(416)
+                    self.send_header("Content-Range", f"bytes */{len(image)}")
+                    self.send_header("Content-Length", "0")
+                    self.end_headers()
+                    return
+            self.send_response(206 if ranged else 200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Accept-Ranges", "bytes")
+            self.send_header("Content-Length", str(end - start + 1))
+            if ranged:
+                self.send_header("Content-Range", f"bytes {start}-{end}/{len(image)}")
+            self.end_headers()
+            if send_body:
+                self.send_body(start, end + 1)
+
+        def send_body(self, start, stop):
+            began = time.monotonic()
+            pos = start
+            while pos < stop:
+                n = min(CHUNK, stop - pos)
+                if not link.send(n):
+                    self.log_message("dropping the connection at byte %d", pos)
+                    self.connection.shutdown(socket.SHUT_RDWR)
+                    self.close_connection = True
+                    return
+                self.wfile.write(image[pos : pos + n])
+                pos += n
+                if rate:
+                    ahead = (pos - start) / (rate * 1024) - (time.monotonic() - began)
+                    if ahead > 0:
+                        time.sleep(ahead)
+
+    return Handler
+
+
+def local_address():
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+        try:
+            s.connect(("192.0.2.1", 9))  # no packet is sent
+            return s.getsockname()[0]
+        except OSError:
+            return "127.0.0.1"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="firmware image to serve")
+    parser.add_argument("--port", type=int, default=8070)
+    parser.add_argument("--rate", type=float, default=0, help="throughput limit in KiB/s (default: none)")
+    parser.add_argument("--drop-every", type=int, default=0, metavar="BYTES",
+                        help="drop the connection after this many bytes (default: never)")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    name = os.path.basename(args.image)
+    server = ThreadingHTTPServer(("", args.port), make_handler(image, name, args.rate, Link(args.drop_every)))
+    print(f"Serving {len(image)} bytes at http://{local_address()}:{args.port}/{name}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
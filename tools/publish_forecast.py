@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Publish a weather forecast to the clocks in the binary format of include/forecast_packet.h.
+
+Fetches the hourly forecast from open-meteo (the same data the clock fetches itself), packs it
+and publishes it retained to <base>/forecast with mosquitto_pub, so every clock on the broker
+gets it without doing its own HTTPS request.
+
+    tools/publish_forecast.py --host 192.168.1.10 -u user -P pass
+    tools/publish_forecast.py --dump forecast.bin    # write the packet instead of publishing
+
+Run it hourly, e.g. from cron.
+"""
+
+import argparse
+import json
+import pathlib
+import re
+import struct
+import subprocess
+import sys
+import time
+import urllib.request
+import zlib
+
+PACKET_VERSION = 1
+MAX_HOURS = 48
+CONFIG_H = pathlib.Path(__file__).resolve().parent.parent / "include" / "config.h"
+URL_TEMPLATE = (
+    "https://api.open-meteo.com/v1/forecast?"
+    "latitude={latitude}&longitude={longitude}"
+    "&hourly=temperature_2m,precipitation_probability&forecast_days=2&timeformat=unixtime"
+)
+
+
+def default_url():
+    """The forecast URL for the location of the clock, CLOCK_LATITUDE/CLOCK_LONGITUDE in config.h."""
+    config = CONFIG_H.read_text()
+    location = {}
+    for key in ("latitude", "longitude"):
+        match = re.search(rf"^#define CLOCK_{key.upper()} (\S+)", config, re.MULTILINE)
+        if not match:
+            sys.exit(f"CLOCK_{key.upper()} not found in {CONFIG_H}, pass --url")
+        location[key] = match.group(1)
+    return URL_TEMPLATE.format(**location)
+
+
+def fetch_forecast(url):
+    with urllib.request.urlopen(url, timeout=30) as response:
+        hourly = json.load(response)["hourly"]
+    return hourly["time"], hourly["temperature_2m"], hourly["precipitation_probability"]
+
+
+def pack_forecast(start_epoch, temps, precip):
+    """Packs hourly temperatures [degC] and precipitation probabilities [%] starting at start_epoch."""
+    if start_epoch % 3600:
+        raise ValueError("start must be on a full hour")
+    hours = min(len(temps), len(precip), MAX_HOURS)
+    # The hours of a packet are consecutive, so it ends before the first hour open-meteo has
+    # no value for (null in its JSON).
+    hours = next((i for i in range(hours) if temps[i] is None or precip[i] is None), hours)
+    if hours == 0:
+        raise ValueError("no forecast values for the first hour")
+    body = struct.pack("<2sBBI", b"FC", PACKET_VERSION, hours, start_epoch)
+    body += struct.pack(f"<{hours}h", *(round(t * 100) for t in temps[:hours]))
+    body += struct.pack(f"<{hours}B", *(max(0, min(100, round(p))) for p in precip[:hours]))
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", help="open-meteo URL returning unixtime hourly data "
+                        "(default: the location in include/config.h)")
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("-u", "--username")
+    parser.add_argument("-P", "--password")
+    parser.add_argument("--topic", default="clock/forecast", help="MQTT_TOPIC_BASE + /forecast")
+    parser.add_argument("--dump", metavar="FILE", help="write the packet to FILE instead of publishing")
+    args = parser.parse_args()
+
+    times, temps, precip = fetch_forecast(args.url or default_url())
+    # Drop the hours that are already over; the clock drops any that pass after publishing.
+    now_hour = int(time.time()) // 3600 * 3600
+    first = next((i for i, t in enumerate(times) if t >= now_hour), None)
+    if first is None:
+        sys.exit("forecast does not cover the current hour")
+    try:
+        packet = pack_forecast(times[first], temps[first:], precip[first:])
+    except ValueError as e:
+        sys.exit(f"cannot publish the forecast: {e}")
+    available = min(len(times) - first, MAX_HOURS)
+    if packet[3] < available:
+        print(f"warning: no values for {times[first + packet[3]]}, "
+              f"publishing {packet[3]} of {available} hours", file=sys.stderr)
+
+    if args.dump:
+        with open(args.dump, "wb") as f:
+            f.write(packet)
+        return
+
+    cmd = ["mosquitto_pub", "-h", args.host, "-p", str(args.port), "-t", args.topic, "-r", "-s"]
+    if args.username:
+        cmd += ["-u", args.username]
+    if args.password:
+        cmd += ["-P", args.password]
+    subprocess.run(cmd, input=packet, check=True)
+    print(f"published {len(packet)} bytes, {packet[3]} hours from {times[first]}")
+
+
+if __name__ == "__main__":
+    main()